@@ -823,6 +823,40 @@ static intptr_t QDECL CL_DllSyscall( intptr_t arg, ... ) {
 }
 
 
+/*
+====================
+CL_PrefetchGameFiles
+
+Queue files that cgame is going to register from the gamestate
+so that i/o workers can read them while the vm initializes
+====================
+*/
+static void CL_PrefetchGameFiles( qboolean qvm ) {
+	const char *names[ MAX_SOUNDS + MAX_MODELS + 1 ];
+	const char *s;
+	int i, count;
+
+	count = 0;
+
+	if ( qvm )
+		names[ count++ ] = "vm/cgame.qvm";
+
+	for ( i = 1; i < MAX_MODELS; i++ ) {
+		s = cl.gameState.stringData + cl.gameState.stringOffsets[ CS_MODELS + i ];
+		if ( *s != '\0' && *s != '*' ) // skip inline models
+			names[ count++ ] = s;
+	}
+
+	for ( i = 1; i < MAX_SOUNDS; i++ ) {
+		s = cl.gameState.stringData + cl.gameState.stringOffsets[ CS_SOUNDS + i ];
+		if ( *s != '\0' && *s != '*' ) // skip player-specific sounds
+			names[ count++ ] = s;
+	}
+
+	FS_PrefetchFiles( names, count );
+}
+
+
 /*
 ====================
 CL_InitCGame
@@ -860,6 +894,8 @@ void CL_InitCGame( void ) {
 			interpret = VMI_COMPILED;
 	}
 
+	CL_PrefetchGameFiles( interpret != VMI_NATIVE );
+
 	cgvm = VM_Create( VM_CGAME, CL_CgameSystemCalls, CL_DllSyscall, interpret );
 	if ( !cgvm ) {
 		Com_Error( ERR_DROP, "VM_Create on cgame failed" );
@@ -887,6 +923,9 @@ void CL_InitCGame( void ) {
 	// on the card even if the driver does deferred loading
 	re.EndRegistration();
 
+	// release whatever cgame did not ask for
+	FS_FlushPrefetch();
+
 	// make sure everything is paged in
 	if (!Sys_LowPhysicalMemory()) {
 		Com_TouchMemory();
@@ -35,6 +35,7 @@ static const char *svc_strings[] = {
 	"svc_EOF",
 	"svc_voipSpeex", // ioq3 extension
 	"svc_voipOpus",  // ioq3 extension
+	"svc_relay",
 };
 
 static void SHOWNET( msg_t *msg, const char *s ) {
@@ -97,6 +97,12 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 #error overflow: (CS_MAX) > MAX_CONFIGSTRINGS
 #endif
 
+// client slots from MAX_CLIENTS on don't fit before CS_LOCATIONS, modules
+// which negotiated them (see "MAX_SERVER_CLIENTS_Q3E" value) put player
+// info there instead
+#define CS_PLAYERS_EXT			CS_MAX
+#define CS_PLAYER_INFO(n)		((n) < MAX_CLIENTS ? CS_PLAYERS+(n) : CS_PLAYERS_EXT+(n)-MAX_CLIENTS)
+
 typedef enum {
 	GT_FFA,				// free for all
 	GT_TOURNAMENT,		// one on one tournament
@@ -97,6 +97,21 @@ typedef struct {
 } sharedEntity_t;
 
 
+// single request for G_TRACE_BATCH, sizes are stored inline
+// so the whole batch is one contiguous block of module memory
+typedef struct {
+	vec3_t		start;
+	vec3_t		mins;
+	vec3_t		maxs;
+	vec3_t		end;
+	int			passEntityNum;
+	int			contentmask;
+	int			capsule;			// use capsule instead of bounding box
+} traceRequest_t;
+
+#define	MAX_TRACE_BATCH		4096
+
+
 
 //===============================================================
 
@@ -398,6 +413,7 @@ typedef enum {
 
 	// engine extensions
 	G_CVAR_SETDESCRIPTION,
+	G_TRACE_BATCH,	// ( trace_t *results, const traceRequest_t *requests, int count );
 	G_TRAP_GETVALUE = COM_TRAP_GETVALUE
 
 } gameImport_t;
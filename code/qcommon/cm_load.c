@@ -606,6 +606,9 @@ void CM_LoadMap( const char *name, qboolean clientload, int *checksum ) {
 	int				i;
 	dheader_t		header;
 	int				length;
+#ifndef BSPC
+	int				handle;
+#endif
 
 	if ( !name || !name[0] ) {
 		Com_Error( ERR_DROP, "%s: NULL name", __func__ );
@@ -624,9 +627,18 @@ void CM_LoadMap( const char *name, qboolean clientload, int *checksum ) {
 
 	if ( !strcmp( cm.name, name ) && clientload ) {
 		*checksum = cm.checksum;
+#ifndef BSPC
+		// renderer loads the same file next
+		FS_PrefetchFiles( &name, 1 );
+#endif
 		return;
 	}
 
+#ifndef BSPC
+	// start reading as early as possible
+	handle = FS_ReadFileAsync( name );
+#endif
+
 	// free old stuff
 	CM_ClearMap();
 
@@ -645,7 +657,10 @@ void CM_LoadMap( const char *name, qboolean clientload, int *checksum ) {
 	// load the file
 	//
 #ifndef BSPC
-	length = FS_ReadFile( name, &buf );
+	length = FS_WaitFile( handle, &buf );
+	if ( clientload ) {
+		FS_PrefetchFiles( &name, 1 );
+	}
 #else
 	length = LoadQuakeFile( (quakefile_t *) name, &buf );
 #endif
@@ -210,6 +210,7 @@ typedef struct {
 	qboolean	isPoint;	// optimized case
 	trace_t		trace;		// returned from trace call
 	sphere_t	sphere;		// sphere for oriendted capsule collision
+	qboolean	concurrent;	// may run on several threads, don't touch shared state
 } traceWork_t;
 
 typedef struct leafList_s {
@@ -1343,10 +1343,10 @@ static void CM_TracePointThroughPatchCollide( traceWork_t *tw, const struct patc
 		if ( j == facet->numBorders ) {
 			// we hit this facet
 #ifndef BSPC
-			if (!cv) {
+			if ( !cv && !tw->concurrent ) {
 				cv = Cvar_Get( "r_debugSurfaceUpdate", "1", 0 );
 			}
-			if (cv->integer) {
+			if ( cv && cv->integer && !tw->concurrent ) {
 				debugPatchCollide = pc;
 				debugFacet = facet;
 			}
@@ -1534,10 +1534,10 @@ void CM_TraceThroughPatchCollide( traceWork_t *tw, const struct patchCollide_s *
 				//	enterFrac = 0;
 				//}
 #ifndef BSPC
-				if (!cv) {
+				if ( !cv && !tw->concurrent ) {
 					cv = Cvar_Get( "r_debugSurfaceUpdate", "1", 0 );
 				}
-				if (cv && cv->integer) {
+				if ( cv && cv->integer && !tw->concurrent ) {
 					debugPatchCollide = pc;
 					debugFacet = facet;
 				}
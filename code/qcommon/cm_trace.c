@@ -241,10 +241,12 @@ static void CM_TestInLeaf( traceWork_t *tw, const cLeaf_t *leaf ) {
 	for (k=0 ; k<leaf->numLeafBrushes ; k++) {
 		brushnum = cm.leafbrushes[leaf->firstLeafBrush+k];
 		b = &cm.brushes[brushnum];
-		if (b->checkcount == cm.checkcount) {
-			continue;	// already checked this brush in another leaf
+		if ( !tw->concurrent ) {
+			if (b->checkcount == cm.checkcount) {
+				continue;	// already checked this brush in another leaf
+			}
+			b->checkcount = cm.checkcount;
 		}
-		b->checkcount = cm.checkcount;
 
 		if ( !(b->contents & tw->contents)) {
 			continue;
@@ -267,10 +269,12 @@ static void CM_TestInLeaf( traceWork_t *tw, const cLeaf_t *leaf ) {
 			if ( !patch ) {
 				continue;
 			}
-			if ( patch->checkcount == cm.checkcount ) {
-				continue;	// already checked this brush in another leaf
+			if ( !tw->concurrent ) {
+				if ( patch->checkcount == cm.checkcount ) {
+					continue;	// already checked this brush in another leaf
+				}
+				patch->checkcount = cm.checkcount;
 			}
-			patch->checkcount = cm.checkcount;
 
 			if ( !(patch->contents & tw->contents)) {
 				continue;
@@ -423,12 +427,15 @@ static void CM_PositionTest( traceWork_t *tw ) {
 	ll.lastLeaf = 0;
 	ll.overflowed = qfalse;
 
-	cm.checkcount++;
+	if ( !tw->concurrent ) {
+		cm.checkcount++;
+	}
 
 	CM_BoxLeafnums_r( &ll, 0 );
 
-
-	cm.checkcount++;
+	if ( !tw->concurrent ) {
+		cm.checkcount++;
+	}
 
 	// test the contents of the leafs
 	for (i=0 ; i < ll.count ; i++) {
@@ -456,7 +463,9 @@ CM_TraceThroughPatch
 static void CM_TraceThroughPatch( traceWork_t *tw, const cPatch_t *patch ) {
 	float		oldFrac;
 
-	c_patch_traces++;
+	if ( !tw->concurrent ) {
+		c_patch_traces++;
+	}
 
 	oldFrac = tw->trace.fraction;
 
@@ -495,7 +504,9 @@ static void CM_TraceThroughBrush( traceWork_t *tw, const cbrush_t *brush ) {
 		return;
 	}
 
-	c_brush_traces++;
+	if ( !tw->concurrent ) {
+		c_brush_traces++;
+	}
 
 	getout = qfalse;
 	startout = qfalse;
@@ -673,10 +684,12 @@ static void CM_TraceThroughLeaf( traceWork_t *tw, const cLeaf_t *leaf ) {
 		brushnum = cm.leafbrushes[leaf->firstLeafBrush+k];
 
 		b = &cm.brushes[brushnum];
-		if ( b->checkcount == cm.checkcount ) {
-			continue;	// already checked this brush in another leaf
+		if ( !tw->concurrent ) {
+			if ( b->checkcount == cm.checkcount ) {
+				continue;	// already checked this brush in another leaf
+			}
+			b->checkcount = cm.checkcount;
 		}
-		b->checkcount = cm.checkcount;
 
 		if ( !(b->contents & tw->contents) ) {
 			continue;
@@ -704,10 +717,12 @@ static void CM_TraceThroughLeaf( traceWork_t *tw, const cLeaf_t *leaf ) {
 			if ( !patch ) {
 				continue;
 			}
-			if ( patch->checkcount == cm.checkcount ) {
-				continue;	// already checked this patch in another leaf
+			if ( !tw->concurrent ) {
+				if ( patch->checkcount == cm.checkcount ) {
+					continue;	// already checked this patch in another leaf
+				}
+				patch->checkcount = cm.checkcount;
 			}
-			patch->checkcount = cm.checkcount;
 
 			if ( !(patch->contents & tw->contents) ) {
 				continue;
@@ -1142,7 +1157,7 @@ CM_Trace
 ==================
 */
 static void CM_Trace( trace_t *results, const vec3_t start, const vec3_t end, const vec3_t mins, const vec3_t maxs,
-						clipHandle_t model, const vec3_t origin, int brushmask, qboolean capsule, const sphere_t *sphere ) {
+						clipHandle_t model, const vec3_t origin, int brushmask, qboolean capsule, const sphere_t *sphere, qboolean concurrent ) {
 	int			i;
 	traceWork_t	tw;
 	vec3_t		offset;
@@ -1150,13 +1165,15 @@ static void CM_Trace( trace_t *results, const vec3_t start, const vec3_t end, co
 
 	cmod = CM_ClipHandleToModel( model );
 
-	cm.checkcount++;		// for multi-check avoidance
-
-	c_traces++;				// for statistics, may be zeroed
+	if ( !concurrent ) {
+		cm.checkcount++;	// for multi-check avoidance
+		c_traces++;			// for statistics, may be zeroed
+	}
 
 	// fill in a default trace
 	Com_Memset( &tw, 0, sizeof(tw) );
 	tw.trace.fraction = 1;	// assume it goes the entire distance until shown otherwise
+	tw.concurrent = concurrent;
 	VectorCopy(origin, tw.modelOrigin);
 
 	if (!cm.numNodes) {
@@ -1363,7 +1380,23 @@ CM_BoxTrace
 void CM_BoxTrace( trace_t *results, const vec3_t start, const vec3_t end,
 						const vec3_t mins, const vec3_t maxs,
 						clipHandle_t model, int brushmask, qboolean capsule ) {
-	CM_Trace( results, start, end, mins, maxs, model, vec3_origin, brushmask, capsule, NULL );
+	CM_Trace( results, start, end, mins, maxs, model, vec3_origin, brushmask, capsule, NULL, qfalse );
+}
+
+
+/*
+==================
+CM_BoxTraceConcurrent
+
+Same as CM_BoxTrace but can be called from several threads at once
+for inline models, at the cost of testing brushes shared by several
+leafs more than once. Must not overlap with CM_TempBoxModel() calls
+==================
+*/
+void CM_BoxTraceConcurrent( trace_t *results, const vec3_t start, const vec3_t end,
+						const vec3_t mins, const vec3_t maxs,
+						clipHandle_t model, int brushmask, qboolean capsule ) {
+	CM_Trace( results, start, end, mins, maxs, model, vec3_origin, brushmask, capsule, NULL, qtrue );
 }
 
 
@@ -1449,7 +1482,7 @@ void CM_TransformedBoxTrace( trace_t *results, const vec3_t start, const vec3_t
 	}
 
 	// sweep the box through the model
-	CM_Trace( &trace, start_l, end_l, symetricSize[0], symetricSize[1], model, origin, brushmask, capsule, &sphere );
+	CM_Trace( &trace, start_l, end_l, symetricSize[0], symetricSize[1], model, origin, brushmask, capsule, &sphere, qfalse );
 
 	// if the bmodel was rotated and there was a collision
 	if ( rotated && trace.fraction != 1.0 ) {
@@ -113,6 +113,18 @@ static int	lastTime;
 int			com_frameTime;
 static int	com_frameNumber;
 
+// dedicated server frame start lateness, see "framestats" command
+typedef struct {
+	unsigned int	frames;
+	unsigned int	late;		// started more than 1ms behind schedule
+	int64_t			sum;
+	double			sumSq;
+	int				min;
+	int				max;
+} frameStats_t;
+
+static frameStats_t	com_frameStats;
+
 qboolean	com_errorEntered = qfalse;
 qboolean	com_fullyInitialized = qfalse;
 
@@ -126,6 +138,7 @@ static char com_errorMessage[ MAXPRINTMSG ];
 
 static void Com_Shutdown( void );
 static void Com_WriteConfig_f( void );
+static void Com_FrameStats_f( void );
 void CIN_CloseAllVideos( void );
 
 //============================================================================
@@ -342,6 +355,9 @@ void NORETURN FORMAT_PRINTF(2, 3) QDECL Com_Error( errorParm_t code, const char
 
 	Cbuf_Init();
 
+	// release files still being read for aborted loads
+	FS_CancelAsyncReads();
+
 	if ( code == ERR_DISCONNECT || code == ERR_SERVERDISCONNECT ) {
 		VM_Forced_Unload_Start();
 		SV_Shutdown( "Server disconnected" );
@@ -1304,40 +1320,13 @@ static void MergeBlock( memblock_t *curr_free, const memblock_t *next )
 
 /*
 ========================
-Z_Free
+Z_ZoneFree
 ========================
 */
-void Z_Free( void *ptr ) {
-	memblock_t	*block, *other;
+static void Z_ZoneFree( memblock_t *block ) {
+	memblock_t	*other;
 	memzone_t *zone;
 
-	if (!ptr) {
-		Com_Error( ERR_DROP, "Z_Free: NULL pointer" );
-	}
-
-	block = (memblock_t *) ( (byte *)ptr - sizeof(memblock_t));
-	if (block->id != ZONEID) {
-		Com_Error( ERR_FATAL, "Z_Free: freed a pointer without ZONEID" );
-	}
-
-	if (block->tag == TAG_FREE) {
-		Com_Error( ERR_FATAL, "Z_Free: freed a freed pointer" );
-	}
-
-	// if static memory
-#ifdef USE_STATIC_TAGS
-	if (block->tag == TAG_STATIC) {
-		return;
-	}
-#endif
-
-	// check the memory trash tester
-#ifdef USE_TRASH_TEST
-	if ( *(int *)((byte *)block + block->size - 4 ) != ZONEID ) {
-		Com_Error( ERR_FATAL, "Z_Free: memory block wrote past end" );
-	}
-#endif
-
 	if ( block->tag == TAG_SMALL ) {
 		zone = smallzone;
 	} else {
@@ -1348,7 +1337,7 @@ void Z_Free( void *ptr ) {
 
 	// set the block to something that should cause problems
 	// if it is referenced...
-	Com_Memset( ptr, 0xaa, block->size - sizeof( *block ) );
+	Com_Memset( block + 1, 0xaa, block->size - sizeof( *block ) );
 
 	block->tag = TAG_FREE; // mark as free
 	block->id = ZONEID;
@@ -1389,54 +1378,14 @@ void Z_Free( void *ptr ) {
 
 /*
 ================
-Z_FreeTags
-================
-*/
-int Z_FreeTags( memtag_t tag ) {
-	int			count;
-	memzone_t	*zone;
-	memblock_t	*block, *freed;
-
-	if ( tag == TAG_STATIC ) {
-		Com_Error( ERR_FATAL, "Z_FreeTags( TAG_STATIC )" );
-		return 0;
-	} else if ( tag == TAG_SMALL ) {
-		zone = smallzone;
-	} else {
-		zone = mainzone;
-	}
-
-	count = 0;
-	for ( block = zone->blocklist.next ; ; ) {
-		if ( block->tag == tag && block->id == ZONEID ) {
-			if ( block->prev->tag == TAG_FREE )
-				freed = block->prev;  // current block will be merged with previous
-			else
-				freed = block; // will leave in place
-			Z_Free( (void*)( block + 1 ) );
-			block = freed;
-			count++;
-		}
-		if ( block->next == &zone->blocklist ) {
-			break;	// all blocks have been hit
-		}
-		block = block->next;
-	}
-
-	return count;
-}
-
-
-/*
-================
-Z_TagMalloc
+Z_ZoneAlloc
 ================
 */
 #ifdef ZONE_DEBUG
-void *Z_TagMallocDebug( int size, memtag_t tag, char *label, char *file, int line ) {
+static void *Z_ZoneAlloc( int size, memtag_t tag, char *label, char *file, int line ) {
 	int		allocSize;
 #else
-void *Z_TagMalloc( int size, memtag_t tag ) {
+static void *Z_ZoneAlloc( int size, memtag_t tag ) {
 #endif
 	int		extra;
 #ifndef USE_MULTI_SEGMENT
@@ -1445,10 +1394,6 @@ void *Z_TagMalloc( int size, memtag_t tag ) {
 	memblock_t *base;
 	memzone_t *zone;
 
-	if ( tag == TAG_FREE ) {
-		Com_Error( ERR_FATAL, "Z_TagMalloc: tried to use with TAG_FREE" );
-	}
-
 	if ( tag == TAG_SMALL ) {
 		zone = smallzone;
 	} else {
@@ -1551,6 +1496,411 @@ void *Z_TagMalloc( int size, memtag_t tag ) {
 }
 
 
+/*
+==============================================================================
+
+Slab caches for small allocations
+
+Requests up to ZSLAB_MAX_SIZE bytes are served from per-tag, per-size-class
+caches of ZSLAB_PAGE_SIZE pages, which are ordinary zone blocks with the same tag
+so zone statistics and Z_FreeTags() keep working. Slots carry the usual block
+header with SLABID instead of ZONEID so Z_Free() can tell them apart,
+header->next points to the owning slab, header->prev links free slots.
+
+==============================================================================
+*/
+
+#define SLABID			0x1d4a12
+#define ZSLAB_PAGE_SIZE	4096
+#define ZSLAB_MAX_SIZE	512
+#define ZSLAB_CLASSES	10
+
+static const int zslabClassSize[ ZSLAB_CLASSES ] = { 16, 32, 48, 64, 96, 128, 192, 256, 384, 512 };
+
+struct zslabCache_s;
+
+typedef struct zslab_s {
+	struct zslab_s	*next, *prev;
+	struct zslabCache_s *cache;
+	memblock_t		*freeSlots;
+	int				used;		// slots in use
+	int				carved;		// slots handed out at least once
+} zslab_t;
+
+typedef struct zslabCache_s {
+	zslab_t			*partial;	// slabs with free slots
+	zslab_t			*full;
+	memtag_t		tag;
+	int				slotSize;
+	int				numSlots;	// per slab
+	int				numSlabs;
+	int				numEmpty;
+	int				used;		// slots in use
+} zslabCache_t;
+
+static zslabCache_t zslabCaches[ TAG_COUNT ][ ZSLAB_CLASSES ];
+static byte zslabClass[ ZSLAB_MAX_SIZE / 16 + 1 ];	// (size + 15) / 16 -> size class
+static qboolean zslabBypass;	// for zonebench
+
+
+static void Z_InitSlabs( void ) {
+	zslabCache_t *cache;
+	int tag, i, n;
+
+	for ( i = 0, n = 0; i < ARRAY_LEN( zslabClass ); i++ ) {
+		while ( zslabClassSize[ n ] < i * 16 )
+			n++;
+		zslabClass[ i ] = n;
+	}
+
+	for ( tag = 0; tag < TAG_COUNT; tag++ ) {
+		for ( i = 0; i < ZSLAB_CLASSES; i++ ) {
+			cache = &zslabCaches[ tag ][ i ];
+			Com_Memset( cache, 0, sizeof( *cache ) );
+			cache->tag = tag;
+#ifdef USE_TRASH_TEST
+			cache->slotSize = PAD( sizeof( memblock_t ) + zslabClassSize[ i ] + 4, sizeof( intptr_t ) );
+#else
+			cache->slotSize = PAD( sizeof( memblock_t ) + zslabClassSize[ i ], sizeof( intptr_t ) );
+#endif
+			cache->numSlots = ( ZSLAB_PAGE_SIZE - PAD( sizeof( zslab_t ), sizeof( intptr_t ) ) ) / cache->slotSize;
+		}
+	}
+}
+
+
+static void Z_SlabLink( zslab_t **list, zslab_t *slab ) {
+	slab->prev = NULL;
+	slab->next = *list;
+	if ( *list ) {
+		(*list)->prev = slab;
+	}
+	*list = slab;
+}
+
+
+static void Z_SlabUnlink( zslab_t **list, zslab_t *slab ) {
+	if ( slab->prev ) {
+		slab->prev->next = slab->next;
+	} else {
+		*list = slab->next;
+	}
+	if ( slab->next ) {
+		slab->next->prev = slab->prev;
+	}
+}
+
+
+static memblock_t *Z_SlabAlloc( int size, memtag_t tag ) {
+	zslabCache_t *cache;
+	zslab_t *slab;
+	memblock_t *block;
+
+	cache = &zslabCaches[ tag ][ zslabClass[ ( size + 15 ) >> 4 ] ];
+
+	slab = cache->partial;
+	if ( slab == NULL ) {
+#ifdef ZONE_DEBUG
+		slab = Z_ZoneAlloc( ZSLAB_PAGE_SIZE, tag, "slab", __FILE__, __LINE__ );
+#else
+		slab = Z_ZoneAlloc( ZSLAB_PAGE_SIZE, tag );
+#endif
+		slab->cache = cache;
+		slab->freeSlots = NULL;
+		slab->used = 0;
+		slab->carved = 0;
+		Z_SlabLink( &cache->partial, slab );
+		cache->numSlabs++;
+		cache->numEmpty++;
+	}
+
+	if ( slab->freeSlots ) {
+		block = slab->freeSlots;
+		slab->freeSlots = block->prev;
+	} else {
+		block = (memblock_t *)( (byte *)slab + PAD( sizeof( zslab_t ), sizeof( intptr_t ) ) + slab->carved * cache->slotSize );
+		block->next = (memblock_t *)slab;
+		block->size = cache->slotSize;
+		slab->carved++;
+	}
+
+	if ( slab->used++ == 0 ) {
+		cache->numEmpty--;
+	}
+	if ( slab->used == cache->numSlots ) {
+		Z_SlabUnlink( &cache->partial, slab );
+		Z_SlabLink( &cache->full, slab );
+	}
+	cache->used++;
+
+	block->prev = NULL;
+	block->tag = tag;
+	block->id = SLABID;
+
+#ifdef USE_TRASH_TEST
+	*(int *)((byte *)block + block->size - 4) = ZONEID;
+#endif
+
+	return block;
+}
+
+
+static void Z_SlabFree( memblock_t *block ) {
+	zslab_t *slab = (zslab_t *)block->next;
+	zslabCache_t *cache = slab->cache;
+
+	Com_Memset( block + 1, 0xaa, block->size - sizeof( *block ) );
+
+	block->tag = TAG_FREE;
+	block->prev = slab->freeSlots;
+	slab->freeSlots = block;
+	cache->used--;
+
+	if ( slab->used-- == cache->numSlots ) {
+		Z_SlabUnlink( &cache->full, slab );
+		Z_SlabLink( &cache->partial, slab );
+	}
+
+	if ( slab->used == 0 ) {
+		// keep one empty slab per cache to avoid thrashing
+		if ( cache->numEmpty == 0 ) {
+			cache->numEmpty++;
+		} else {
+			Z_SlabUnlink( &cache->partial, slab );
+			cache->numSlabs--;
+			Z_ZoneFree( (memblock_t *)slab - 1 );
+		}
+	}
+}
+
+
+/*
+================
+Z_SlabFreeTags
+
+Releases all slabs of the tag, returns number of freed allocations
+================
+*/
+static int Z_SlabFreeTags( memtag_t tag ) {
+	zslabCache_t *cache;
+	zslab_t *slab;
+	int i, count;
+
+	count = 0;
+	for ( i = 0; i < ZSLAB_CLASSES; i++ ) {
+		cache = &zslabCaches[ tag ][ i ];
+		count += cache->used;
+		while ( ( slab = cache->partial ) != NULL ) {
+			cache->partial = slab->next;
+			Z_ZoneFree( (memblock_t *)slab - 1 );
+		}
+		while ( ( slab = cache->full ) != NULL ) {
+			cache->full = slab->next;
+			Z_ZoneFree( (memblock_t *)slab - 1 );
+		}
+		cache->numSlabs = cache->numEmpty = cache->used = 0;
+	}
+
+	return count;
+}
+
+
+static void Z_SlabStats( qboolean small, int *slabs, int *objects, int *bytes ) {
+	const zslabCache_t *cache;
+	int tag, i;
+
+	*slabs = *objects = *bytes = 0;
+	for ( tag = 0; tag < TAG_COUNT; tag++ ) {
+		if ( ( tag == TAG_SMALL ) != small )
+			continue;
+		for ( i = 0; i < ZSLAB_CLASSES; i++ ) {
+			cache = &zslabCaches[ tag ][ i ];
+			*slabs += cache->numSlabs;
+			*objects += cache->used;
+			*bytes += cache->used * cache->slotSize;
+		}
+	}
+}
+
+
+/*
+==============================================================================
+
+Allocation trace, see Com_ZoneBench_f
+
+==============================================================================
+*/
+
+typedef enum {
+	ZT_ALLOC,
+	ZT_FREE,
+	ZT_FREETAGS
+} zoneTraceOpType_t;
+
+typedef struct {
+	const void	*ptr;		// recorded pointer, becomes allocation index after Z_ResolveTrace
+	int			size;
+	byte		op;
+	byte		tag;
+} zoneTraceOp_t;
+
+static zoneTraceOp_t *zoneTrace;
+static int zoneTraceOps;
+static int zoneTraceMaxOps;
+static qboolean zoneTraceRecording;
+
+
+static void Z_TraceOp( zoneTraceOpType_t op, const void *ptr, int size, memtag_t tag ) {
+	zoneTraceOp_t *t;
+
+	if ( zoneTraceOps >= zoneTraceMaxOps ) {
+		zoneTraceRecording = qfalse;
+		Com_Printf( "zonebench: trace buffer is full, %i operations captured\n", zoneTraceOps );
+		return;
+	}
+
+	t = &zoneTrace[ zoneTraceOps++ ];
+	t->ptr = ptr;
+	t->size = size;
+	t->op = op;
+	t->tag = tag;
+}
+
+
+/*
+========================
+Z_Free
+========================
+*/
+void Z_Free( void *ptr ) {
+	memblock_t	*block;
+
+	if (!ptr) {
+		Com_Error( ERR_DROP, "Z_Free: NULL pointer" );
+	}
+
+	block = (memblock_t *) ( (byte *)ptr - sizeof(memblock_t));
+	if ( block->id != ZONEID && block->id != SLABID ) {
+		Com_Error( ERR_FATAL, "Z_Free: freed a pointer without ZONEID" );
+	}
+
+	if (block->tag == TAG_FREE) {
+		Com_Error( ERR_FATAL, "Z_Free: freed a freed pointer" );
+	}
+
+	// if static memory
+#ifdef USE_STATIC_TAGS
+	if (block->tag == TAG_STATIC) {
+		return;
+	}
+#endif
+
+	// check the memory trash tester
+#ifdef USE_TRASH_TEST
+	if ( *(int *)((byte *)block + block->size - 4 ) != ZONEID ) {
+		Com_Error( ERR_FATAL, "Z_Free: memory block wrote past end" );
+	}
+#endif
+
+	if ( zoneTraceRecording ) {
+		Z_TraceOp( ZT_FREE, ptr, 0, block->tag );
+	}
+
+	if ( block->id == SLABID ) {
+		Z_SlabFree( block );
+	} else {
+		Z_ZoneFree( block );
+	}
+}
+
+
+/*
+================
+Z_FreeTags
+================
+*/
+int Z_FreeTags( memtag_t tag ) {
+	int			count;
+	memzone_t	*zone;
+	memblock_t	*block, *freed;
+
+	if ( tag == TAG_STATIC ) {
+		Com_Error( ERR_FATAL, "Z_FreeTags( TAG_STATIC )" );
+		return 0;
+	} else if ( tag == TAG_SMALL ) {
+		zone = smallzone;
+	} else {
+		zone = mainzone;
+	}
+
+	if ( zoneTraceRecording ) {
+		Z_TraceOp( ZT_FREETAGS, NULL, 0, tag );
+	}
+
+	count = Z_SlabFreeTags( tag );
+
+	for ( block = zone->blocklist.next ; ; ) {
+		if ( block->tag == tag && block->id == ZONEID ) {
+			if ( block->prev->tag == TAG_FREE )
+				freed = block->prev;  // current block will be merged with previous
+			else
+				freed = block; // will leave in place
+			Z_ZoneFree( block );
+			block = freed;
+			count++;
+		}
+		if ( block->next == &zone->blocklist ) {
+			break;	// all blocks have been hit
+		}
+		block = block->next;
+	}
+
+	return count;
+}
+
+
+/*
+================
+Z_TagMalloc
+================
+*/
+#ifdef ZONE_DEBUG
+void *Z_TagMallocDebug( int size, memtag_t tag, char *label, char *file, int line ) {
+#else
+void *Z_TagMalloc( int size, memtag_t tag ) {
+#endif
+	memblock_t *block;
+	void *ptr;
+
+	if ( tag == TAG_FREE ) {
+		Com_Error( ERR_FATAL, "Z_TagMalloc: tried to use with TAG_FREE" );
+	}
+
+	if ( (unsigned)size <= ZSLAB_MAX_SIZE && !zslabBypass ) {
+		block = Z_SlabAlloc( size, tag );
+#ifdef ZONE_DEBUG
+		block->d.label = label;
+		block->d.file = file;
+		block->d.line = line;
+		block->d.allocSize = size;
+#endif
+		ptr = block + 1;
+	} else {
+#ifdef ZONE_DEBUG
+		ptr = Z_ZoneAlloc( size, tag, label, file, line );
+#else
+		ptr = Z_ZoneAlloc( size, tag );
+#endif
+	}
+
+	if ( zoneTraceRecording ) {
+		Z_TraceOp( ZT_ALLOC, ptr, size, tag );
+	}
+
+	return ptr;
+}
+
+
 /*
 ========================
 Z_Malloc
@@ -1923,6 +2273,7 @@ Com_Meminfo_f
 static void Com_Meminfo_f( void ) {
 	zone_stats_t st;
 	int		unused;
+	int		slabs, objects, bytes;
 
 	Com_Printf( "%8i bytes total hunk\n", s_hunkTotal );
 	Com_Printf( "\n" );
@@ -1958,6 +2309,8 @@ static void Com_Meminfo_f( void ) {
 	Com_Printf( "        %8i bytes in botlib\n", st.botlibBytes );
 	Com_Printf( "        %8i bytes in renderer\n", st.rendererBytes );
 	Com_Printf( "        %8i bytes in other\n", st.zoneBytes - ( st.botlibBytes + st.rendererBytes ) );
+	Z_SlabStats( qfalse, &slabs, &objects, &bytes );
+	Com_Printf( "        %8i bytes in %i slab objects (%i slabs)\n", bytes, objects, slabs );
 	Com_Printf( "        %8i bytes in %i free blocks\n", st.freeBytes, st.freeBlocks );
 	if ( st.freeBlocks > 1 ) {
 		Com_Printf( "        (largest: %i bytes, smallest: %i bytes)\n\n", st.freeLargest, st.freeSmallest );
@@ -1967,6 +2320,8 @@ static void Com_Meminfo_f( void ) {
 	Com_Printf( "%8i bytes total small zone\n\n", smallzone->size );
 	Com_Printf( "%8i bytes in %i small zone blocks%s\n", st.zoneBytes, st.zoneBlocks,
 		st.zoneSegments > 1 ? va( " and %i segments", st.zoneSegments ) : "" );
+	Z_SlabStats( qtrue, &slabs, &objects, &bytes );
+	Com_Printf( "        %8i bytes in %i slab objects (%i slabs)\n", bytes, objects, slabs );
 	Com_Printf( "        %8i bytes in %i free blocks\n", st.freeBytes, st.freeBlocks );
 	if ( st.freeBlocks > 1 ) {
 		Com_Printf( "        (largest: %i bytes, smallest: %i bytes)\n\n", st.freeLargest, st.freeSmallest );
@@ -1974,6 +2329,225 @@ static void Com_Meminfo_f( void ) {
 }
 
 
+typedef struct {
+	int		op;
+	int		size;
+	int		tag;
+	int		index;		// allocation index
+} zoneReplayOp_t;
+
+
+/*
+=================
+Z_ResolveTrace
+
+Turns recorded pointers into allocation indexes, expands Z_FreeTags() into
+frees of traced allocations, frees of untraced pointers are dropped
+=================
+*/
+static int Z_ResolveTrace( zoneReplayOp_t *out, int *numAllocs ) {
+	const zoneTraceOp_t *t;
+	const void **hashPtr;
+	int *hashIndex, *allocTag;
+	byte *allocLive;
+	int hashSize, i, j, h, n, k;
+
+	for ( i = 0, k = 0; i < zoneTraceOps; i++ ) {
+		if ( zoneTrace[i].op == ZT_ALLOC ) {
+			k++;
+		}
+	}
+
+	for ( hashSize = 1024; hashSize < k * 2; hashSize <<= 1 )
+		;
+
+	hashPtr = calloc( hashSize, sizeof( *hashPtr ) );
+	hashIndex = calloc( hashSize, sizeof( *hashIndex ) );
+	allocTag = calloc( k + 1, sizeof( *allocTag ) );
+	allocLive = calloc( k + 1, sizeof( *allocLive ) );
+
+	n = k = 0;
+	for ( i = 0, t = zoneTrace; i < zoneTraceOps; i++, t++ ) {
+		if ( t->op == ZT_ALLOC ) {
+			h = ( (uintptr_t)t->ptr >> 3 ) & ( hashSize - 1 );
+			while ( hashPtr[h] && hashPtr[h] != (void *)1 ) {
+				h = ( h + 1 ) & ( hashSize - 1 );
+			}
+			hashPtr[h] = t->ptr;
+			hashIndex[h] = k;
+			allocTag[k] = t->tag;
+			allocLive[k] = 1;
+			out[n].op = ZT_ALLOC;
+			out[n].size = t->size;
+			out[n].tag = t->tag;
+			out[n].index = k++;
+			n++;
+		} else if ( t->op == ZT_FREE ) {
+			h = ( (uintptr_t)t->ptr >> 3 ) & ( hashSize - 1 );
+			while ( hashPtr[h] && hashPtr[h] != t->ptr ) {
+				h = ( h + 1 ) & ( hashSize - 1 );
+			}
+			if ( hashPtr[h] ) {
+				hashPtr[h] = (void *)1; // deleted
+				allocLive[ hashIndex[h] ] = 0;
+				out[n].op = ZT_FREE;
+				out[n].index = hashIndex[h];
+				n++;
+			}
+		} else {
+			for ( j = 0; j < k; j++ ) {
+				if ( allocLive[j] && allocTag[j] == t->tag ) {
+					allocLive[j] = 0;
+					out[n].op = ZT_FREE;
+					out[n].index = j;
+					n++;
+				}
+			}
+			// forget pointers of this tag
+			for ( h = 0; h < hashSize; h++ ) {
+				if ( hashPtr[h] && hashPtr[h] != (void *)1 && allocTag[ hashIndex[h] ] == t->tag ) {
+					hashPtr[h] = (void *)1;
+				}
+			}
+		}
+	}
+
+	free( allocLive );
+	free( allocTag );
+	free( hashIndex );
+	free( (void *)hashPtr );
+
+	*numAllocs = k;
+	return n;
+}
+
+
+/*
+=================
+Z_ReplayTrace
+=================
+*/
+static int64_t Z_ReplayTrace( const zoneReplayOp_t *ops, int numOps, void **live, int numAllocs, int *freeBlocks ) {
+	zone_stats_t st;
+	int64_t start, end;
+	int i;
+
+	start = Sys_Microseconds();
+	for ( i = 0; i < numOps; i++, ops++ ) {
+		if ( ops->op == ZT_ALLOC ) {
+			live[ ops->index ] = Z_TagMalloc( ops->size, ops->tag );
+		} else {
+			Z_Free( live[ ops->index ] );
+			live[ ops->index ] = NULL;
+		}
+	}
+	end = Sys_Microseconds();
+
+	Zone_Stats( "main", mainzone, qfalse, &st );
+	*freeBlocks = st.freeBlocks;
+	Zone_Stats( "small", smallzone, qfalse, &st );
+	*freeBlocks += st.freeBlocks;
+
+	for ( i = 0; i < numAllocs; i++ ) {
+		if ( live[i] ) {
+			Z_Free( live[i] );
+			live[i] = NULL;
+		}
+	}
+
+	return end - start;
+}
+
+
+/*
+=================
+Com_ZoneBench_f
+
+zonebench record [maxops] | stop | [iterations]
+Replays allocation trace captured e.g. during map load with and without slab caches
+=================
+*/
+static void Com_ZoneBench_f( void ) {
+	static const char *names[2] = { "slab", "zone" };
+	zoneReplayOp_t *ops;
+	void **live;
+	int64_t elapsed[2];
+	int freeBlocks[2];
+	int iterations, numOps, numAllocs, mode, i, n;
+	const char *cmd;
+
+	cmd = Cmd_Argv( 1 );
+
+	if ( !Q_stricmp( cmd, "record" ) ) {
+		n = Cmd_Argc() > 2 ? atoi( Cmd_Argv( 2 ) ) : 1048576;
+		if ( n < 1024 ) {
+			n = 1024;
+		}
+		zoneTraceRecording = qfalse;
+		free( zoneTrace );
+		zoneTrace = calloc( n, sizeof( *zoneTrace ) );
+		zoneTraceOps = 0;
+		if ( !zoneTrace ) {
+			zoneTraceMaxOps = 0;
+			Com_Printf( "zonebench: failed to allocate trace buffer\n" );
+			return;
+		}
+		zoneTraceMaxOps = n;
+		zoneTraceRecording = qtrue;
+		Com_Printf( "zonebench: recording up to %i operations\n", n );
+		return;
+	}
+
+	if ( !Q_stricmp( cmd, "stop" ) ) {
+		zoneTraceRecording = qfalse;
+		Com_Printf( "zonebench: %i operations captured\n", zoneTraceOps );
+		return;
+	}
+
+	if ( !zoneTraceOps ) {
+		Com_Printf( "usage: zonebench record [maxops] | stop | [iterations]\n" );
+		return;
+	}
+
+	iterations = *cmd ? atoi( cmd ) : 10;
+	if ( iterations < 1 ) {
+		iterations = 1;
+	}
+
+	zoneTraceRecording = qfalse;
+
+	ops = calloc( zoneTraceOps * 2, sizeof( *ops ) );
+	live = calloc( zoneTraceOps + 1, sizeof( *live ) );
+	if ( !ops || !live ) {
+		free( ops );
+		free( live );
+		Com_Printf( "zonebench: out of memory\n" );
+		return;
+	}
+
+	numOps = Z_ResolveTrace( ops, &numAllocs );
+
+	for ( mode = 0; mode < 2; mode++ ) {
+		zslabBypass = ( mode == 1 );
+		elapsed[ mode ] = 0;
+		for ( i = 0; i < iterations; i++ ) {
+			elapsed[ mode ] += Z_ReplayTrace( ops, numOps, live, numAllocs, &freeBlocks[ mode ] );
+		}
+	}
+	zslabBypass = qfalse;
+
+	free( live );
+	free( ops );
+
+	Com_Printf( "%i operations, %i allocations, %i iterations:\n", numOps, numAllocs, iterations );
+	for ( mode = 0; mode < 2; mode++ ) {
+		Com_Printf( " %s: %.2fms per replay, %i free blocks at the end\n", names[ mode ],
+			(double)elapsed[ mode ] / ( iterations * 1000 ), freeBlocks[ mode ] );
+	}
+}
+
+
+
 /*
 ===============
 Com_TouchMemory
@@ -2039,6 +2613,8 @@ static void Com_InitSmallZoneMemory( void ) {
 	Com_Memset( s_buf, 0, smallZoneSize );
 	smallzone = (memzone_t *)s_buf;
 	Z_ClearZone( smallzone, smallzone, smallZoneSize, 1 );
+
+	Z_InitSlabs();
 }
 
 
@@ -2192,6 +2768,7 @@ static void Com_InitHunkMemory( void ) {
 	Hunk_Clear();
 
 	Cmd_AddCommand( "meminfo", Com_Meminfo_f );
+	Cmd_AddCommand( "zonebench", Com_ZoneBench_f );
 #ifdef ZONE_DEBUG
 	Cmd_AddCommand( "zonelog", Z_LogHeap );
 #endif
@@ -2806,6 +3383,7 @@ Com_RunAndTimeServerPacket
 */
 void Com_RunAndTimeServerPacket( const netadr_t *evFrom, msg_t *buf ) {
 	int		t1, t2, msec;
+	int64_t	start;
 
 	t1 = 0;
 
@@ -2813,8 +3391,12 @@ void Com_RunAndTimeServerPacket( const netadr_t *evFrom, msg_t *buf ) {
 		t1 = Sys_Milliseconds ();
 	}
 
+	start = Com_ProfileStart();
+
 	SV_PacketEvent( evFrom, buf );
 
+	Com_ProfileCount( "packets", start );
+
 	if ( com_speeds->integer ) {
 		t2 = Sys_Milliseconds ();
 		msec = t2 - t1;
@@ -2879,6 +3461,7 @@ int Com_EventLoop( void ) {
 			break;
 #endif // !DEDICATED
 		case SE_CONSOLE:
+			SV_JournalCommand( (char *)ev.evPtr );
 			Cbuf_AddText( (char *)ev.evPtr );
 			Cbuf_AddText( "\n" );
 			break;
@@ -2920,6 +3503,37 @@ int Com_Milliseconds( void ) {
 	return ev.evTime;
 }
 
+
+/*
+================
+Com_MillisecondsToUsec
+
+Returns Sys_Microseconds() time when given Sys_Milliseconds() value begins
+================
+*/
+int64_t Com_MillisecondsToUsec( int msec )
+{
+	int64_t now;
+	int curr;
+
+#ifdef _WIN32
+	// performance counter is not aligned with Sys_Milliseconds()
+	now = Sys_Microseconds();
+	curr = Sys_Milliseconds();
+#else
+	// both use gettimeofday() and Sys_Milliseconds() counts from a whole
+	// second, retry if millisecond has changed between the calls
+	do {
+		now = Sys_Microseconds();
+		curr = Sys_Milliseconds();
+	} while ( ( now / 1000 - curr ) % 1000 != 0 );
+
+	now -= now % 1000;
+#endif
+
+	return now + (int64_t)( msec - curr ) * 1000;
+}
+
 //============================================================================
 
 /*
@@ -3765,6 +4379,8 @@ void Com_Init( char *commandLine ) {
 	Com_InitSmallZoneMemory();
 	Cvar_Init();
 
+	MSG_InitTables();
+
 #if defined(_WIN32) && defined(_DEBUG)
 	com_noErrorInterrupt = Cvar_Get( "com_noErrorInterrupt", "0", 0 );
 #endif
@@ -3945,8 +4561,10 @@ void Com_Init( char *commandLine ) {
 
 	Cmd_AddCommand( "quit", Com_Quit_f );
 	Cmd_AddCommand( "changeVectors", MSG_ReportChangeVectors_f );
+	Cmd_AddCommand( "msgbench", MSG_Bench_f );
 	Cmd_AddCommand( "writeconfig", Com_WriteConfig_f );
 	Cmd_SetCommandCompletionFunc( "writeconfig", Cmd_CompleteWriteCfgName );
+	Cmd_AddCommand( "framestats", Com_FrameStats_f );
 	Cmd_AddCommand( "game_restart", Com_GameRestart_f );
 
 	s = va( "%s %s %s", Q3_VERSION, PLATFORM_STRING, __DATE__ );
@@ -4034,6 +4652,7 @@ void Com_Init( char *commandLine ) {
 	Com_Printf( "--- Common Initialization Complete ---\n" );
 
 	NET_Init();
+	LoadGen_Init();
 
 	Com_Printf( "Working directory: %s\n", Sys_Pwd() );
 }
@@ -4198,6 +4817,85 @@ static int Com_TimeVal( int minMsec )
 	return timeVal;
 }
 
+
+/*
+=================
+Com_TimeValUsec
+
+Converts remaining milliseconds into microseconds left
+until corresponding millisecond boundary
+=================
+*/
+static int Com_TimeValUsec( int timeVal, int64_t now )
+{
+	if ( timeVal <= 0 )
+		return 0;
+#ifdef _WIN32
+	// performance counter is not aligned with Sys_Milliseconds()
+	return timeVal * 1000;
+#else
+	return timeVal * 1000 - (int)( now % 1000 );
+#endif
+}
+
+
+/*
+=================
+Com_FrameStats
+=================
+*/
+static void Com_FrameStats( int64_t deadline )
+{
+	frameStats_t *fs = &com_frameStats;
+	int lateness;
+
+	lateness = (int)( Sys_Microseconds() - deadline );
+
+	if ( fs->frames == 0 || lateness < fs->min )
+		fs->min = lateness;
+	if ( fs->frames == 0 || lateness > fs->max )
+		fs->max = lateness;
+	if ( lateness > 1000 )
+		fs->late++;
+
+	fs->frames++;
+	fs->sum += lateness;
+	fs->sumSq += (double)lateness * lateness;
+}
+
+
+/*
+=================
+Com_FrameStats_f
+=================
+*/
+static void Com_FrameStats_f( void )
+{
+	const frameStats_t *fs = &com_frameStats;
+	double mean, dev;
+
+	if ( !Q_stricmp( Cmd_Argv( 1 ), "reset" ) ) {
+		Com_Memset( &com_frameStats, 0, sizeof( com_frameStats ) );
+		return;
+	}
+
+	if ( fs->frames == 0 ) {
+		Com_Printf( "No server frames recorded.\n" );
+		return;
+	}
+
+	mean = (double)fs->sum / fs->frames;
+	dev = fs->sumSq / fs->frames - mean * mean;
+	dev = dev > 0.0 ? sqrt( dev ) : 0.0;
+
+	Com_Printf( "frame start lateness over %u frames (%s):\n", fs->frames,
+		NET_EpollActive() ? "epoll" : "select" );
+	Com_Printf( " mean %.1fus, stddev %.1fus\n", mean, dev );
+	Com_Printf( " min %ius, max %ius\n", fs->min, fs->max );
+	Com_Printf( " %u frames late by more than 1ms\n", fs->late );
+}
+
+
 /*
 =================
 Com_FrameInit
@@ -4220,8 +4918,12 @@ void Com_Frame( qboolean noDelay ) {
 #endif
 	int	msec, realMsec, minMsec;
 	int	sleepMsec;
+	int	sleepUsec;
 	int	timeVal;
 	int	timeValSV;
+	int64_t	deadline;
+	int64_t	wakeup, now;
+	qboolean usecWait;
 
 	int	timeBeforeFirstEvents;
 	int	timeBeforeServer;
@@ -4263,6 +4965,13 @@ void Com_Frame( qboolean noDelay ) {
 	}
 #endif
 
+	// server journal playback runs recorded frames without waiting
+	if ( SV_JournalPlaying() ) {
+		SV_JournalPlayback();
+		com_frameNumber++;
+		return;
+	}
+
 	//
 	// main event loop
 	//
@@ -4272,7 +4981,7 @@ void Com_Frame( qboolean noDelay ) {
 
 	// we may want to spin here if things are going too fast
 	if ( com_dedicated->integer ) {
-		minMsec = SV_FrameMsec();
+		minMsec = LoadGen_FrameMsec( SV_FrameMsec() );
 #ifndef DEDICATED
 		bias = 0;
 #endif
@@ -4303,10 +5012,37 @@ void Com_Frame( qboolean noDelay ) {
 #endif
 	}
 
+	deadline = 0;
+	usecWait = qfalse;
+	if ( com_dedicated->integer && com_sv_running->integer && noDelay == qfalse ) {
+		deadline = SV_FrameDeadline();
+		if ( deadline && NET_EpollActive() && !LoadGen_Active() ) {
+			usecWait = qtrue;
+		} else {
+			deadline = Sys_Microseconds();
+			deadline += Com_TimeValUsec( Com_TimeVal( minMsec ), deadline );
+		}
+	}
+
+	if ( usecWait ) {
+		// sleep until absolute deadline of the next server frame
+		do {
+			wakeup = deadline;
+			timeValSV = SV_SendQueuedPackets();
+			now = Sys_Microseconds();
+			if ( now + timeValSV * 1000LL < wakeup )
+				wakeup = now + timeValSV * 1000LL;
+			NET_SleepUntil( wakeup );
+		} while ( Sys_Microseconds() < deadline );
+	} else
 	// waiting for incoming packets
 	if ( noDelay == qfalse )
 	do {
 		if ( com_sv_running->integer ) {
+			if ( com_dedicated->integer ) {
+				// hibernating server wakes up on first connection
+				minMsec = LoadGen_FrameMsec( SV_FrameMsec() );
+			}
 			timeValSV = SV_SendQueuedPackets();
 			timeVal = Com_TimeVal( minMsec );
 			if ( timeValSV < timeVal )
@@ -4321,15 +5057,38 @@ void Com_Frame( qboolean noDelay ) {
 		if ( timeVal > sleepMsec )
 			Com_EventLoop();
 #endif
-		NET_Sleep( sleepMsec * 1000 - 500 );
+		if ( com_dedicated->integer && NET_EpollActive() ) {
+			// timer will fire exactly on next millisecond boundary
+			sleepUsec = Com_TimeValUsec( sleepMsec, Sys_Microseconds() );
+		} else {
+			sleepUsec = sleepMsec * 1000 - 500;
+		}
+		NET_Sleep( sleepUsec );
 	} while( Com_TimeVal( minMsec ) );
 
+	if ( deadline ) {
+		Com_FrameStats( deadline );
+	}
+
+	// packets, commands and snapshots sent while processing them
+	// are accounted to the server frame which follows
+	if ( com_sv_running->integer ) {
+		Com_ProfileFrame();
+	}
+
 	lastTime = com_frameTime;
 	com_frameTime = Com_EventLoop();
 	realMsec = com_frameTime - lastTime;
 
+	SV_JournalExecute();
 	Cbuf_Execute();
 
+	// journal playback started from command buffer runs from next frame
+	if ( SV_JournalPlaying() ) {
+		com_frameNumber++;
+		return;
+	}
+
 	// mess with msec if needed
 	msec = Com_ModifyMsec( realMsec );
 
@@ -4342,6 +5101,8 @@ void Com_Frame( qboolean noDelay ) {
 
 	SV_Frame( msec );
 
+	LoadGen_Frame();
+
 	// if "dedicated" has been modified, start up
 	// or shut down the client system.
 	// Do this after the server may have started,
@@ -4456,6 +5217,11 @@ Com_Shutdown
 =================
 */
 static void Com_Shutdown( void ) {
+
+	LoadGen_Shutdown();
+
+	Com_ShutdownJobs();
+
 	if ( logfile != FS_INVALID_HANDLE ) {
 		FS_FCloseFile( logfile );
 		logfile = FS_INVALID_HANDLE;
@@ -231,6 +231,23 @@ void Cvar_CommandCompletion( void (*callback)(const char *s) )
 }
 
 
+/*
+============
+Cvar_ForEach
+============
+*/
+void Cvar_ForEach( void (*callback)(const cvar_t *var) )
+{
+	const cvar_t *cvar;
+
+	for ( cvar = cvar_vars; cvar; cvar = cvar->next ) {
+		if ( cvar->name ) {
+			callback( cvar );
+		}
+	}
+}
+
+
 static qboolean Cvar_IsIntegral( const char *s ) {
 
 	if ( *s == '-' && *(s+1) != '\0' )
@@ -235,6 +235,12 @@ typedef struct fileInPack_s {
 	struct	fileInPack_s*	next;		// next file in the hash
 } fileInPack_t;
 
+typedef struct {
+	byte			*base;
+	size_t			size;
+	int				refs;						// pak and handed out buffers
+} fileMap_t;
+
 typedef struct pack_s {
 	char			*pakFilename;				// c:\quake3\baseq3\pak0.pk3
 	char			*pakBasename;				// pak0
@@ -252,6 +258,8 @@ typedef struct pack_s {
 
 	int				handleUsed;
 
+	fileMap_t		*map;						// read-only view of the whole pk3, if mapped
+
 #ifdef USE_HANDLE_CACHE
 	struct pack_s	*next_h;						// double-linked list of unreferenced paks with open file handles
 	struct pack_s	*prev_h;
@@ -313,6 +321,7 @@ static	cvar_t		*fs_gamedirvar;
 static	cvar_t		*fs_locked;
 #endif
 static	cvar_t		*fs_excludeReference;
+static	cvar_t		*fs_mapFiles;
 
 static	searchpath_t	*fs_searchpaths;
 static	int			fs_readCount;			// total bytes read
@@ -343,6 +352,9 @@ typedef struct {
 	qboolean	zipFile;
 	int			zipFilePos;
 	int			zipFileLen;
+	qboolean	memFile;		// file.v is a malloc'ed buffer filled by i/o workers
+	int			memFilePos;
+	int			memFileLen;
 	char		name[MAX_ZPATH];
 	handleOwner_t	owner;
 	int			pakIndex;
@@ -379,6 +391,7 @@ void Com_ReadCDKey( const char *filename );
 
 static int FS_GetModList( char *listbuf, int bufsize );
 static void FS_CheckIdPaks( void );
+static void FS_AsyncCancel( qboolean prefetchOnly );
 void FS_Reload( void );
 
 
@@ -462,6 +475,9 @@ static FILE	*FS_FileForHandle( fileHandle_t f ) {
 	if ( fsh[f].zipFile ) {
 		Com_Error( ERR_DROP, "FS_FileForHandle: can't get FILE on zip file" );
 	}
+	if ( fsh[f].memFile ) {
+		Com_Error( ERR_DROP, "FS_FileForHandle: can't get FILE on memory file" );
+	}
 	if ( ! fsh[f].handleFiles.file.o ) {
 		Com_Error( ERR_DROP, "FS_FileForHandle: NULL" );
 	}
@@ -1006,6 +1022,43 @@ int FS_SV_FOpenFileRead( const char *filename, fileHandle_t *fp ) {
 }
 
 
+/*
+===========
+FS_SV_OSPath
+
+Returns full path of the file FS_SV_FOpenFileRead() would open
+or NULL if there is no such file
+===========
+*/
+const char *FS_SV_OSPath( const char *filename ) {
+	const char *bases[ 3 ];
+	const char *ospath;
+	fileOffset_t size;
+	fileTime_t mtime, ctime;
+	int i;
+
+	if ( !fs_searchpaths ) {
+		Com_Error( ERR_FATAL, "Filesystem call made without initialization" );
+	}
+
+	bases[ 0 ] = fs_homepath->string;
+	bases[ 1 ] = fs_basepath->string;
+	bases[ 2 ] = fs_steampath->string;
+
+	for ( i = 0; i < ARRAY_LEN( bases ); i++ ) {
+		if ( !bases[ i ][ 0 ] || ( i == 1 && !Q_stricmp( bases[ 0 ], bases[ 1 ] ) ) ) {
+			continue;
+		}
+		ospath = FS_BuildOSPath( bases[ i ], filename, NULL );
+		if ( Sys_GetFileStats( ospath, &size, &mtime, &ctime ) ) {
+			return ospath;
+		}
+	}
+
+	return NULL;
+}
+
+
 /*
 ===========
 FS_SV_Rename
@@ -1192,6 +1245,9 @@ void FS_FCloseFile( fileHandle_t f ) {
 			}
 		}
 #endif
+	} else if ( fd->memFile ) {
+		free( fd->handleFiles.file.v );
+		fd->handleFiles.file.v = NULL;
 	} else {
 		if ( fd->handleFiles.file.o ) {
 			fclose( fd->handleFiles.file.o );
@@ -1372,181 +1428,1182 @@ static qboolean FS_IsExt( const char *filename, const char *ext, size_t namelen
 	if ( extlen > namelen )
 		return qfalse;
 
-	filename += namelen - extlen;
+	filename += namelen - extlen;
+
+	return !Q_stricmp( filename, ext );
+}
+
+
+/*
+===========
+FS_StripExt
+===========
+*/
+qboolean FS_StripExt( char *filename, const char *ext )
+{
+	int extlen, namelen;
+
+	extlen = strlen( ext );
+	namelen = strlen( filename );
+
+	if ( extlen > namelen )
+		return qfalse;
+
+	filename += namelen - extlen;
+
+	if ( !Q_stricmp( filename, ext ) ) 
+	{
+		filename[0] = '\0';
+		return qtrue;
+	}
+
+	return qfalse;
+}
+
+
+static const char *FS_HasExt( const char *fileName, const char **extList, int extCount ) 
+{
+	const char *e;
+	int i;
+
+	e = strrchr( fileName, '.' );
+
+	if ( !e ) 
+		return NULL;
+
+	for ( i = 0, e++; i < extCount; i++ ) 
+	{
+		if ( !Q_stricmp( e, extList[i] ) )
+			return e;
+	}
+
+	return NULL;
+}
+
+
+static qboolean FS_GeneralRef( const char *filename ) 
+{
+	// allowed non-ref extensions
+	static const char *extList[] = { "config", "shader", "shaderx", "mtr", "arena", "menu", "bot", "cfg", "txt" };
+
+	if ( FS_HasExt( filename, extList, ARRAY_LEN( extList ) ) )
+		return qfalse;
+	
+	if ( !Q_stricmp( filename, "vm/qagame.qvm" ) )
+		return qfalse;
+
+	if ( strstr( filename, "levelshots" ) )
+		return qfalse;
+
+	return qtrue;
+}
+
+
+/*
+===========
+FS_BypassPure
+===========
+*/
+static int numServerPaks;
+void FS_BypassPure( void )
+{
+	// workers read the pure list
+	if ( fs_numServerPaks ) {
+		FS_AsyncCancel( qfalse );
+	}
+	numServerPaks = fs_numServerPaks;
+	fs_numServerPaks = 0;
+}
+
+
+/*
+===========
+FS_RestorePure
+===========
+*/
+void FS_RestorePure( void )
+{
+	if ( numServerPaks ) {
+		FS_AsyncCancel( qfalse );
+	}
+	fs_numServerPaks = numServerPaks;
+}
+
+
+/*
+=================
+FS_ReferencePakFile
+=================
+*/
+static void FS_ReferencePakFile( pack_t *pak, const char *name ) {
+
+	// mark the pak as having been referenced and mark specifics on cgame and ui
+	// these are loaded from all pk3s
+	// from every pk3 file.
+
+	if ( !( pak->referenced & FS_GENERAL_REF ) && FS_GeneralRef( name ) ) {
+		pak->referenced |= FS_GENERAL_REF;
+	}
+	if ( !( pak->referenced & FS_CGAME_REF ) && !strcmp( name, "vm/cgame.qvm" ) ) {
+		pak->referenced |= FS_CGAME_REF;
+	}
+	if ( !( pak->referenced & FS_UI_REF ) && !strcmp( name, "vm/ui.qvm" ) ) {
+		pak->referenced |= FS_UI_REF;
+	}
+}
+
+
+static int FS_OpenFileInPak( fileHandle_t *file, pack_t *pak, fileInPack_t *pakFile, qboolean uniqueFILE ) {
+	fileHandleData_t *f;
+	unz_s *zfi;
+	FILE *temp;
+
+	FS_ReferencePakFile( pak, pakFile->name );
+
+	if ( !pak->handle ) {
+		pak->handle = unzOpen( pak->pakFilename );
+		if ( !pak->handle ) {
+			Com_Printf( S_COLOR_RED "Error opening %s@%s\n", pak->pakBasename, pakFile->name );
+			*file = FS_INVALID_HANDLE;
+			return -1;
+		}
+	}
+
+	if ( uniqueFILE ) {
+		// open a new file on the pakfile
+		temp = unzReOpen( pak->pakFilename, pak->handle );
+		if ( temp == NULL ) {
+			Com_Printf( S_COLOR_RED "Couldn't reopen %s", pak->pakFilename );
+			*file = FS_INVALID_HANDLE;
+			return -1;
+		}
+	} else {
+		temp = pak->handle;
+	}
+
+	*file = FS_HandleForFile();
+	f = &fsh[ *file ];
+	FS_InitHandle( f );
+
+	f->zipFile = qtrue;
+	f->handleFiles.file.z = temp;
+	f->handleFiles.unique = uniqueFILE;
+
+	Q_strncpyz( f->name, pakFile->name, sizeof( f->name ) );
+	zfi = (unz_s *)f->handleFiles.file.z;
+	// in case the file was new
+	temp = zfi->file;
+	// set the file position in the zip file (also sets the current file info)
+	unzSetCurrentFileInfoPosition( pak->handle, pakFile->pos );
+	// copy the file info into the unzip structure
+	Com_Memcpy( zfi, pak->handle, sizeof( *zfi ) );
+	// we copy this back into the structure
+	zfi->file = temp;
+	// open the file in the zip
+	unzOpenCurrentFile( f->handleFiles.file.z );
+	f->zipFilePos = pakFile->pos;
+	f->zipFileLen = pakFile->size;
+	f->pakIndex = pak->index;
+	fs_lastPakIndex = pak->index;
+	f->pak = pak;
+
+#ifdef USE_HANDLE_CACHE
+	if ( pak->next_h ) {
+		FS_RemoveFromHandleList( pak );
+	}
+#endif
+
+	pak->handleUsed++;
+
+	if ( fs_debug->integer ) {
+		Com_Printf( "FS_FOpenFileRead: %s (found in '%s')\n",
+			pakFile->name, pak->pakFilename );
+	}
+
+	return zfi->cur_file_info.uncompressed_size;
+}
+
+
+/*
+==========================================================================
+
+MEMORY MAPPED FILES
+
+Pk3 files are mapped read-only when loaded and FS_ReadFile() returns pointers
+straight into the mapping for entries stored without compression, large loose
+files are mapped the same way. This is done only for binary formats whose
+loaders never write into the buffer nor rely on its trailing zero, anything
+else still gets a copy. Mappings are reference counted so handed out buffers
+stay valid until FS_FreeFile() even if the pak itself is released.
+
+==========================================================================
+*/
+
+#define MAX_MAPPED_BUFFERS	64
+#define MIN_MAPPED_FILESIZE	(64*1024)	// reading smaller loose files is cheaper
+
+typedef struct {
+	const byte	*data;
+	fileMap_t	*map;
+} mappedBuffer_t;
+
+static mappedBuffer_t	fs_mappedBuffers[ MAX_MAPPED_BUFFERS ];
+static int				fs_numMappedBuffers;
+
+
+/*
+=================
+FS_MapAlignment
+
+Returns required data alignment if file can be used from mapping, 0 otherwise
+=================
+*/
+static int FS_MapAlignment( const char *name )
+{
+	static const char *images[] = { "jpg", "jpeg", "png", "tga", "bmp", "pcx" };
+	const char *ext;
+	int i;
+
+	ext = COM_GetExtension( name );
+
+	// lumps are accessed through int and float pointers
+	if ( !Q_stricmp( ext, "bsp" ) ) {
+		return sizeof( int32_t );
+	}
+
+	for ( i = 0; i < ARRAY_LEN( images ); i++ ) {
+		if ( !Q_stricmp( ext, images[ i ] ) ) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+
+static unsigned int FS_ZipShort( const byte *p )
+{
+	return p[0] | ( p[1] << 8 );
+}
+
+
+static unsigned long FS_ZipLong( const byte *p )
+{
+	return p[0] | ( p[1] << 8 ) | ( p[2] << 16 ) | ( (unsigned long)p[3] << 24 );
+}
+
+
+/*
+=================
+FS_MappedPakFile
+
+Locates data of file stored without compression in the pk3 mapping,
+pos is the file info position in zip, may be called from any thread
+=================
+*/
+static const byte *FS_MappedPakFile( const fileMap_t *map, const char *name, unsigned long pos, unsigned long size )
+{
+	const byte *header, *data;
+	unsigned long offset;
+	int align;
+
+	align = FS_MapAlignment( name );
+	if ( !map || !align || pos > map->size || map->size - pos < 46 ) {
+		return NULL;
+	}
+
+	// central directory record
+	header = map->base + pos;
+	if ( FS_ZipLong( header ) != 0x02014b50 || FS_ZipShort( header + 10 ) != 0 /* stored */
+		|| FS_ZipLong( header + 20 ) != size || FS_ZipLong( header + 24 ) != size ) {
+		return NULL;
+	}
+
+	// local file header
+	offset = FS_ZipLong( header + 42 );
+	if ( offset > map->size || map->size - offset < 30 ) {
+		return NULL;
+	}
+	header = map->base + offset;
+	if ( FS_ZipLong( header ) != 0x04034b50 ) {
+		return NULL;
+	}
+
+	offset += 30 + FS_ZipShort( header + 26 ) + FS_ZipShort( header + 28 );
+	if ( offset > map->size || map->size - offset < size ) {
+		return NULL;
+	}
+
+	data = map->base + offset;
+	if ( (intptr_t)data & ( align - 1 ) ) {
+		return NULL;
+	}
+
+	return data;
+}
+
+
+/*
+=================
+FS_MapLooseFile
+
+Checks if file from directory should be mapped, may be called from any thread
+=================
+*/
+static qboolean FS_MapLooseFile( const char *name, int length )
+{
+	return length >= MIN_MAPPED_FILESIZE && fs_mapFiles->integer && FS_MapAlignment( name );
+}
+
+
+/*
+=================
+FS_MapPak
+=================
+*/
+static void FS_MapPak( pack_t *pak )
+{
+	fileMap_t *map;
+	void *base;
+	FILE *f;
+	int length;
+
+	if ( pak->map || !fs_mapFiles || !fs_mapFiles->integer ) {
+		return;
+	}
+
+	f = Sys_FOpen( pak->pakFilename, "rb" );
+	if ( f == NULL ) {
+		return;
+	}
+
+	length = FS_FileLength( f );
+	base = length > 0 ? Sys_MapFile( f, length ) : NULL;
+	fclose( f );
+
+	if ( base == NULL ) {
+		Com_DPrintf( "Couldn't map %s\n", pak->pakFilename );
+		return;
+	}
+
+	map = Z_Malloc( sizeof( *map ) );
+	map->base = base;
+	map->size = length;
+	map->refs = 1;
+
+	pak->map = map;
+}
+
+
+/*
+=================
+FS_ReleaseMap
+=================
+*/
+static void FS_ReleaseMap( fileMap_t *map )
+{
+	if ( --map->refs == 0 ) {
+		Sys_UnmapFile( map->base, map->size );
+		Z_Free( map );
+	}
+}
+
+
+/*
+=================
+FS_ReadMappedFile
+
+Hands out file opened by FS_FOpenFileRead() from mapping, if possible
+=================
+*/
+static qboolean FS_ReadMappedFile( fileHandle_t h, int len, void **buffer )
+{
+	const fileHandleData_t *f;
+	const byte *data;
+	fileMap_t *map;
+	void *base;
+
+	f = &fsh[ h ];
+
+	if ( f->memFile || fs_numMappedBuffers == MAX_MAPPED_BUFFERS ) {
+		return qfalse;
+	}
+
+	if ( f->zipFile ) {
+		map = f->pak->map;
+		data = FS_MappedPakFile( map, f->name, f->zipFilePos, len );
+		if ( data == NULL ) {
+			return qfalse;
+		}
+		map->refs++;
+	} else {
+		if ( !FS_MapLooseFile( f->name, len ) ) {
+			return qfalse;
+		}
+		base = Sys_MapFile( f->handleFiles.file.o, len );
+		if ( base == NULL ) {
+			return qfalse;
+		}
+		map = Z_Malloc( sizeof( *map ) );
+		map->base = base;
+		map->size = len;
+		map->refs = 1;
+		data = base;
+	}
+
+	fs_mappedBuffers[ fs_numMappedBuffers ].data = data;
+	fs_mappedBuffers[ fs_numMappedBuffers ].map = map;
+	fs_numMappedBuffers++;
+
+	if ( fs_debug->integer ) {
+		Com_Printf( "FS_ReadFile: %s (mapped)\n", f->name );
+	}
+
+	*buffer = (void *)data;
+
+	return qtrue;
+}
+
+
+/*
+=================
+FS_FreeMappedFile
+=================
+*/
+static qboolean FS_FreeMappedFile( const void *buffer )
+{
+	int i;
+
+	for ( i = 0; i < fs_numMappedBuffers; i++ ) {
+		if ( fs_mappedBuffers[ i ].data == buffer ) {
+			FS_ReleaseMap( fs_mappedBuffers[ i ].map );
+			fs_mappedBuffers[ i ] = fs_mappedBuffers[ --fs_numMappedBuffers ];
+			return qtrue;
+		}
+	}
+
+	return qfalse;
+}
+
+
+extern qboolean		com_fullyInitialized;
+
+/*
+==========================================================================
+
+ASYNCHRONOUS FILE READING
+
+I/O worker threads do the search path lookup, reading and decompression
+of files queued by FS_ReadFileAsync() and FS_PrefetchFiles(). Results are
+picked up by FS_WaitFile(), prefetched ones also by any FS_FOpenFileRead()
+or FS_ReadFile() call on the same path, so existing loaders benefit without
+changes once their file lists are queued up front.
+
+Workers only read search paths, pak hash tables and pure lists - all queued
+files are cancelled before any of these change. Workers must not call
+Com_Printf(), Com_Error() or allocate zone/hunk memory.
+
+==========================================================================
+*/
+
+#define MAX_IO_THREADS		8
+#define MAX_ASYNC_FILES		1024
+#define ASYNC_HASH_SIZE		256
+#define ASYNC_MAX_BYTES		(64*1024*1024)	// loaded but not yet picked up
+
+typedef enum {
+	AF_FREE,
+	AF_QUEUED,
+	AF_LOADING,
+	AF_DONE
+} asyncState_t;
+
+typedef struct asyncFile_s {
+	char				name[MAX_ZPATH];
+	asyncState_t		state;
+	qboolean			prefetch;	// not owned by FS_ReadFileAsync() caller
+	byte				*data;		// malloc'ed, NULL if not found or not loaded
+	int					length;
+	pack_t				*pak;		// NULL if found in directory
+	const searchpath_t	*search;
+	struct asyncFile_s	*hashNext;
+	struct asyncFile_s	*queueNext;
+} asyncFile_t;
+
+typedef struct {
+	sysMutex_t		*lock;
+	sysCond_t		*wake;		// workers are waiting for queued files
+	sysCond_t		*done;		// main thread is waiting for a file being loaded
+
+	sysThread_t		*threads[ MAX_IO_THREADS ];
+	int				numThreads;
+	qboolean		shutdown;
+
+	asyncFile_t		*queueHead;
+	asyncFile_t		**queueTail;
+	int				loadedBytes;
+
+	// accessed only by main thread
+	asyncFile_t		files[ MAX_ASYNC_FILES ];
+	asyncFile_t		*hashTable[ ASYNC_HASH_SIZE ];
+	int				numFiles;
+	int				nextFile;
+} asyncIO_t;
+
+static asyncIO_t	fs_io;
+static cvar_t		*fs_ioThreads;
+
+// loadbench recording
+static char			*fs_benchNames;
+static int			fs_benchCount;
+static int			fs_benchMax;
+
+
+/*
+=================
+FS_AsyncReserve
+
+Accounts memory for loaded files, prefetch fails when too much is not picked up yet
+=================
+*/
+static qboolean FS_AsyncReserve( int length, qboolean limit )
+{
+	qboolean ok;
+
+	Sys_LockMutex( fs_io.lock );
+	ok = ( !limit || fs_io.loadedBytes + length <= ASYNC_MAX_BYTES );
+	if ( ok ) {
+		fs_io.loadedBytes += length;
+	}
+	Sys_UnlockMutex( fs_io.lock );
+
+	return ok;
+}
+
+
+/*
+=================
+FS_AsyncLoad
+
+Finds and reads file, may be called from any thread
+=================
+*/
+static void FS_AsyncLoad( asyncFile_t *af )
+{
+	char			ospath[MAX_OSPATH*2+MAX_ZPATH+4];
+	const searchpath_t *search;
+	const fileInPack_t *pakFile;
+	const directory_t *dir;
+	unsigned long	fullHash, hash;
+	FILE			*fp;
+	byte			*data;
+	int				length;
+
+	af->data = NULL;
+	af->length = -1;
+	af->pak = NULL;
+	af->search = NULL;
+
+	fullHash = FS_HashFileName( af->name, 0U );
+
+	for ( search = fs_searchpaths; search; search = search->next ) {
+		if ( search->pack && search->pack->hashTable[ (hash = fullHash & (search->pack->hashSize-1)) ] ) {
+			if ( !FS_PakIsPure( search->pack ) ) {
+				continue;
+			}
+			for ( pakFile = search->pack->hashTable[ hash ]; pakFile; pakFile = pakFile->next ) {
+				if ( !FS_FilenameCompare( pakFile->name, af->name ) ) {
+					break;
+				}
+			}
+			if ( !pakFile ) {
+				continue;
+			}
+			af->search = search;
+			af->pak = search->pack;
+			// FS_ReadFile() will use it from mapping
+			if ( FS_MappedPakFile( search->pack->map, af->name, pakFile->pos, pakFile->size ) ) {
+				return;
+			}
+			length = pakFile->size;
+			if ( !FS_AsyncReserve( length, af->prefetch ) ) {
+				return;
+			}
+			fp = Sys_FOpen( search->pack->pakFilename, "rb" );
+			data = fp ? malloc( length + 1 ) : NULL;
+			if ( data && unzReadFileAtPosition( fp, pakFile->pos, data, length ) == UNZ_OK ) {
+				data[ length ] = '\0';
+				af->data = data;
+				af->length = length;
+			} else {
+				free( data );
+				FS_AsyncReserve( -length, qfalse );
+			}
+			if ( fp ) {
+				fclose( fp );
+			}
+			return;
+		} else if ( search->dir && search->policy != DIR_DENY ) {
+			dir = search->dir;
+			// FS_BuildOSPath() is not reentrant
+			Com_sprintf( ospath, sizeof( ospath ), "%s%c%s%c%s", dir->path, PATH_SEP, dir->gamedir, PATH_SEP, af->name );
+			FS_ReplaceSeparators( ospath );
+			fp = Sys_FOpen( ospath, "rb" );
+			if ( !fp ) {
+				continue;
+			}
+			af->search = search;
+			length = FS_FileLength( fp );
+			// FS_ReadFile() will map it
+			if ( length >= 0 && !FS_MapLooseFile( af->name, length ) && FS_AsyncReserve( length, af->prefetch ) ) {
+				data = malloc( length + 1 );
+				if ( data && fread( data, 1, length, fp ) == (size_t)length ) {
+					data[ length ] = '\0';
+					af->data = data;
+					af->length = length;
+				} else {
+					free( data );
+					FS_AsyncReserve( -length, qfalse );
+				}
+			}
+			fclose( fp );
+			return;
+		}
+	}
+}
+
+
+/*
+=================
+FS_AsyncWorker
+=================
+*/
+static void FS_AsyncWorker( void *unused )
+{
+	asyncFile_t *af;
+
+	Sys_LockMutex( fs_io.lock );
+
+	for ( ;; ) {
+		while ( !fs_io.queueHead && !fs_io.shutdown ) {
+			Sys_CondWait( fs_io.wake, fs_io.lock );
+		}
+		if ( fs_io.shutdown ) {
+			break;
+		}
+		af = fs_io.queueHead;
+		fs_io.queueHead = af->queueNext;
+		if ( !fs_io.queueHead ) {
+			fs_io.queueTail = &fs_io.queueHead;
+		}
+		af->state = AF_LOADING;
+		Sys_UnlockMutex( fs_io.lock );
+
+		FS_AsyncLoad( af );
+
+		Sys_LockMutex( fs_io.lock );
+		af->state = AF_DONE;
+		Sys_CondBroadcast( fs_io.done );
+	}
+
+	Sys_UnlockMutex( fs_io.lock );
+}
+
+
+/*
+=================
+FS_AsyncShutdown
+=================
+*/
+static void FS_AsyncShutdown( void )
+{
+	int i;
+
+	if ( !fs_io.lock ) {
+		return;
+	}
+
+	Sys_LockMutex( fs_io.lock );
+	fs_io.shutdown = qtrue;
+	Sys_CondBroadcast( fs_io.wake );
+	Sys_UnlockMutex( fs_io.lock );
+
+	for ( i = 0; i < fs_io.numThreads; i++ ) {
+		Sys_JoinThread( fs_io.threads[ i ] );
+	}
+
+	Sys_DestroyCond( fs_io.done );
+	Sys_DestroyCond( fs_io.wake );
+	Sys_DestroyMutex( fs_io.lock );
+
+	Com_Memset( &fs_io, 0, sizeof( fs_io ) );
+}
+
+
+/*
+=================
+FS_AsyncStartup
+
+(Re)starts i/o workers if fs_ioThreads has been changed,
+must be called with no files queued
+=================
+*/
+static void FS_AsyncStartup( void )
+{
+	sysThread_t *thread;
+	int count;
+
+	if ( fs_io.lock && !fs_ioThreads->modified ) {
+		return;
+	}
+
+	fs_ioThreads->modified = qfalse;
+
+	FS_AsyncShutdown();
+
+	fs_io.queueTail = &fs_io.queueHead;
+
+	fs_io.lock = Sys_CreateMutex();
+	fs_io.wake = Sys_CreateCond();
+	fs_io.done = Sys_CreateCond();
+
+	if ( !fs_io.lock || !fs_io.wake || !fs_io.done ) {
+		Com_Error( ERR_FATAL, "FS_AsyncStartup: failed to create synchronization objects" );
+	}
+
+	count = fs_ioThreads->integer;
+	while ( fs_io.numThreads < count ) {
+		thread = Sys_CreateThread( FS_AsyncWorker, NULL );
+		if ( !thread ) {
+			Com_Printf( S_COLOR_YELLOW "WARNING: failed to start i/o worker thread\n" );
+			break;
+		}
+		fs_io.threads[ fs_io.numThreads++ ] = thread;
+	}
+
+	Com_DPrintf( "%i i/o worker threads started\n", fs_io.numThreads );
+}
+
+
+/*
+=================
+FS_AsyncFind
+=================
+*/
+static asyncFile_t *FS_AsyncFind( const char *qpath )
+{
+	asyncFile_t *af;
+
+	for ( af = fs_io.hashTable[ FS_HashFileName( qpath, ASYNC_HASH_SIZE ) ]; af; af = af->hashNext ) {
+		if ( !FS_FilenameCompare( af->name, qpath ) ) {
+			return af;
+		}
+	}
+
+	return NULL;
+}
+
+
+/*
+=================
+FS_AsyncWait
+
+Waits for file completion, takes the job over if no worker picked it up yet
+=================
+*/
+static void FS_AsyncWait( asyncFile_t *af )
+{
+	asyncFile_t **prev;
+
+	Sys_LockMutex( fs_io.lock );
+
+	if ( af->state == AF_QUEUED ) {
+		for ( prev = &fs_io.queueHead; *prev != af; prev = &(*prev)->queueNext )
+			;
+		if ( ( *prev = af->queueNext ) == NULL ) {
+			fs_io.queueTail = prev;
+		}
+		af->state = AF_LOADING;
+		Sys_UnlockMutex( fs_io.lock );
+
+		FS_AsyncLoad( af );
+
+		Sys_LockMutex( fs_io.lock );
+		af->state = AF_DONE;
+	}
+
+	while ( af->state != AF_DONE ) {
+		Sys_CondWait( fs_io.done, fs_io.lock );
+	}
+
+	Sys_UnlockMutex( fs_io.lock );
+}
+
+
+/*
+=================
+FS_AsyncRelease
+
+Releases completed file slot, data is freed unless it was taken
+=================
+*/
+static void FS_AsyncRelease( asyncFile_t *af )
+{
+	asyncFile_t **prev;
+
+	for ( prev = &fs_io.hashTable[ FS_HashFileName( af->name, ASYNC_HASH_SIZE ) ]; *prev != af; prev = &(*prev)->hashNext )
+		;
+	*prev = af->hashNext;
+
+	if ( af->data ) {
+		free( af->data );
+		FS_AsyncReserve( -af->length, qfalse );
+	}
+
+	Com_Memset( af, 0, sizeof( *af ) );
+	fs_io.numFiles--;
+}
+
+
+/*
+=================
+FS_AsyncCancel
+
+Drops queued and completed files, waits for the ones being loaded.
+Unless prefetchOnly is set, files of FS_ReadFileAsync() callers are
+released as well, their handles become invalid
+=================
+*/
+static void FS_AsyncCancel( qboolean prefetchOnly )
+{
+	asyncFile_t *af, **prev;
+	int i;
+
+	if ( !fs_io.numFiles ) {
+		return;
+	}
+
+	// remove from queue
+	Sys_LockMutex( fs_io.lock );
+	for ( prev = &fs_io.queueHead; ( af = *prev ) != NULL; ) {
+		if ( prefetchOnly && !af->prefetch ) {
+			prev = &af->queueNext;
+			continue;
+		}
+		*prev = af->queueNext;
+		af->state = AF_DONE;
+	}
+	fs_io.queueTail = prev;
+	Sys_UnlockMutex( fs_io.lock );
+
+	for ( i = 0, af = fs_io.files; i < MAX_ASYNC_FILES && fs_io.numFiles; i++, af++ ) {
+		if ( af->state == AF_FREE || ( prefetchOnly && !af->prefetch ) ) {
+			continue;
+		}
+		FS_AsyncWait( af );
+		FS_AsyncRelease( af );
+	}
+}
+
+
+/*
+=================
+FS_AsyncQueue
+=================
+*/
+static asyncFile_t *FS_AsyncQueue( const char *qpath, qboolean prefetch )
+{
+	asyncFile_t *af;
+	unsigned long hash;
+	int i;
+
+	if ( !fs_searchpaths ) {
+		Com_Error( ERR_FATAL, "Filesystem call made without initialization" );
+	}
+
+	if ( !qpath || !qpath[0] ) {
+		Com_Error( ERR_FATAL, "FS_ReadFileAsync with empty name" );
+	}
+
+	if ( qpath[0] == '/' || qpath[0] == '\\' ) {
+		qpath++;
+	}
+
+	if ( strlen( qpath ) >= MAX_ZPATH ) {
+		if ( prefetch ) {
+			return NULL;
+		}
+		Com_Error( ERR_DROP, "FS_ReadFileAsync: too long name %s", qpath );
+	}
+
+	af = FS_AsyncFind( qpath );
+	if ( af ) {
+		if ( prefetch ) {
+			return NULL;
+		}
+		if ( af->prefetch ) {
+			af->prefetch = qfalse; // take over
+			return af;
+		}
+	}
+
+	if ( fs_io.numFiles == 0 ) {
+		FS_AsyncStartup();
+	}
+
+	if ( prefetch && fs_io.numThreads == 0 ) {
+		return NULL;
+	}
+
+	if ( fs_io.numFiles == MAX_ASYNC_FILES ) {
+		if ( prefetch ) {
+			return NULL;
+		}
+		FS_AsyncCancel( qtrue );
+		if ( fs_io.numFiles == MAX_ASYNC_FILES ) {
+			Com_Error( ERR_DROP, "FS_ReadFileAsync: too many pending files" );
+		}
+	}
+
+	for ( i = 0; i < MAX_ASYNC_FILES; i++ ) {
+		af = &fs_io.files[ ( fs_io.nextFile + i ) % MAX_ASYNC_FILES ];
+		if ( af->state == AF_FREE ) {
+			break;
+		}
+	}
+	fs_io.nextFile = ( af - fs_io.files + 1 ) % MAX_ASYNC_FILES;
+	fs_io.numFiles++;
+
+	Q_strncpyz( af->name, qpath, sizeof( af->name ) );
+	af->prefetch = prefetch;
+	af->length = -1;
+
+	hash = FS_HashFileName( af->name, ASYNC_HASH_SIZE );
+	af->hashNext = fs_io.hashTable[ hash ];
+	fs_io.hashTable[ hash ] = af;
+
+	// these are handled by FS_ReadFile() or refused by FS_FOpenFileRead()
+	if ( FS_CheckDirTraversal( qpath ) || ( com_fullyInitialized && strstr( qpath, "q3key" ) )
+		|| ( com_journalDataFile != FS_INVALID_HANDLE && strstr( qpath, ".cfg" ) ) ) {
+		af->state = AF_DONE;
+		return af;
+	}
+
+	Sys_LockMutex( fs_io.lock );
+	af->state = AF_QUEUED;
+	af->queueNext = NULL;
+	*fs_io.queueTail = af;
+	fs_io.queueTail = &af->queueNext;
+	Sys_CondSignal( fs_io.wake );
+	Sys_UnlockMutex( fs_io.lock );
+
+	return af;
+}
+
+
+/*
+=================
+FS_AsyncUsable
+
+Search rules may have been relaxed for a while when the file was loaded
+=================
+*/
+static qboolean FS_AsyncUsable( const asyncFile_t *af )
+{
+	if ( !af->data ) {
+		return qfalse;
+	}
+
+	if ( af->pak ) {
+		return FS_PakIsPure( af->pak );
+	}
 
-	return !Q_stricmp( filename, ext );
+	return af->search->policy != DIR_DENY;
 }
 
 
 /*
-===========
-FS_StripExt
-===========
+=================
+FS_AsyncTake
+
+Marks references as regular open would do and takes file data
+=================
 */
-qboolean FS_StripExt( char *filename, const char *ext )
+static byte *FS_AsyncTake( asyncFile_t *af )
 {
-	int extlen, namelen;
+	byte *data;
 
-	extlen = strlen( ext );
-	namelen = strlen( filename );
+	if ( af->pak ) {
+		FS_ReferencePakFile( af->pak, af->name );
+		fs_lastPakIndex = af->pak->index;
+	}
 
-	if ( extlen > namelen )
-		return qfalse;
+	if ( fs_debug->integer ) {
+		if ( af->pak ) {
+			Com_Printf( "FS_FOpenFileRead: %s (found in '%s', async)\n", af->name, af->pak->pakFilename );
+		} else {
+			Com_Printf( "FS_FOpenFileRead: %s (found in '%s/%s', async)\n", af->name,
+				af->search->dir->path, af->search->dir->gamedir );
+		}
+	}
 
-	filename += namelen - extlen;
+	FS_AsyncReserve( -af->length, qfalse );
 
-	if ( !Q_stricmp( filename, ext ) ) 
-	{
-		filename[0] = '\0';
-		return qtrue;
-	}
+	data = af->data;
+	af->data = NULL;
 
-	return qfalse;
+	return data;
 }
 
 
-static const char *FS_HasExt( const char *fileName, const char **extList, int extCount ) 
+/*
+=================
+FS_OpenAsyncFile
+
+Opens prefetched file as a memory file
+=================
+*/
+static qboolean FS_OpenAsyncFile( const char *filename, fileHandle_t *file, int *length )
 {
-	const char *e;
-	int i;
+	fileHandleData_t *f;
+	asyncFile_t *af;
 
-	e = strrchr( fileName, '.' );
+	af = FS_AsyncFind( filename );
+	if ( !af || !af->prefetch ) {
+		return qfalse;
+	}
 
-	if ( !e ) 
-		return NULL;
+	FS_AsyncWait( af );
 
-	for ( i = 0, e++; i < extCount; i++ ) 
-	{
-		if ( !Q_stricmp( e, extList[i] ) )
-			return e;
+	if ( !FS_AsyncUsable( af ) ) {
+		FS_AsyncRelease( af );
+		return qfalse;
 	}
 
-	return NULL;
-}
-
+	*file = FS_HandleForFile();
+	f = &fsh[ *file ];
+	FS_InitHandle( f );
 
-static qboolean FS_GeneralRef( const char *filename ) 
-{
-	// allowed non-ref extensions
-	static const char *extList[] = { "config", "shader", "shaderx", "mtr", "arena", "menu", "bot", "cfg", "txt" };
+	*length = af->length;
 
-	if ( FS_HasExt( filename, extList, ARRAY_LEN( extList ) ) )
-		return qfalse;
-	
-	if ( !Q_stricmp( filename, "vm/qagame.qvm" ) )
-		return qfalse;
+	f->handleFiles.file.v = FS_AsyncTake( af );
+	f->memFile = qtrue;
+	f->memFilePos = 0;
+	f->memFileLen = *length;
+	if ( af->pak ) {
+		f->pakIndex = af->pak->index;
+		fs_lastPakIndex = af->pak->index;
+	}
+	Q_strncpyz( f->name, filename, sizeof( f->name ) );
 
-	if ( strstr( filename, "levelshots" ) )
-		return qfalse;
+	FS_AsyncRelease( af );
 
 	return qtrue;
 }
 
 
 /*
-===========
-FS_BypassPure
-===========
+=================
+FS_ReadFileAsync
+
+Starts loading file in background, result must be picked up with FS_WaitFile()
+=================
 */
-static int numServerPaks;
-void FS_BypassPure( void )
+int FS_ReadFileAsync( const char *qpath )
 {
-	numServerPaks = fs_numServerPaks;
-	fs_numServerPaks = 0;
+	return FS_AsyncQueue( qpath, qfalse ) - fs_io.files + 1;
 }
 
 
 /*
-===========
-FS_RestorePure
-===========
+=================
+FS_WaitFile
+
+Waits for FS_ReadFileAsync() completion, returns the same as FS_ReadFile()
+=================
 */
-void FS_RestorePure( void )
+int FS_WaitFile( int handle, void **buffer )
 {
-	fs_numServerPaks = numServerPaks;
-}
+	char qpath[MAX_ZPATH];
+	asyncFile_t *af;
+	byte *buf;
+	int len;
 
+	if ( handle <= 0 || handle > MAX_ASYNC_FILES || fs_io.files[ handle - 1 ].state == AF_FREE
+		|| fs_io.files[ handle - 1 ].prefetch ) {
+		Com_Error( ERR_DROP, "FS_WaitFile: invalid handle %i", handle );
+	}
 
-static int FS_OpenFileInPak( fileHandle_t *file, pack_t *pak, fileInPack_t *pakFile, qboolean uniqueFILE ) {
-	fileHandleData_t *f;
-	unz_s *zfi;
-	FILE *temp;
+	af = &fs_io.files[ handle - 1 ];
 
-	// mark the pak as having been referenced and mark specifics on cgame and ui
-	// these are loaded from all pk3s
-	// from every pk3 file.
+	FS_AsyncWait( af );
 
-	if ( !( pak->referenced & FS_GENERAL_REF ) && FS_GeneralRef( pakFile->name ) ) {
-		pak->referenced |= FS_GENERAL_REF;
-	}
-	if ( !( pak->referenced & FS_CGAME_REF ) && !strcmp( pakFile->name, "vm/cgame.qvm" ) ) {
-		pak->referenced |= FS_CGAME_REF;
-	}
-	if ( !( pak->referenced & FS_UI_REF ) && !strcmp( pakFile->name, "vm/ui.qvm" ) ) {
-		pak->referenced |= FS_UI_REF;
+	if ( !buffer || !FS_AsyncUsable( af ) ) {
+		// let it go through the regular path, with journaling and error messages
+		Q_strncpyz( qpath, af->name, sizeof( qpath ) );
+		FS_AsyncRelease( af );
+		return FS_ReadFile( qpath, buffer );
 	}
 
-	if ( !pak->handle ) {
-		pak->handle = unzOpen( pak->pakFilename );
-		if ( !pak->handle ) {
-			Com_Printf( S_COLOR_RED "Error opening %s@%s\n", pak->pakBasename, pakFile->name );
-			*file = FS_INVALID_HANDLE;
-			return -1;
-		}
-	}
+	len = af->length;
 
-	if ( uniqueFILE ) {
-		// open a new file on the pakfile
-		temp = unzReOpen( pak->pakFilename, pak->handle );
-		if ( temp == NULL ) {
-			Com_Printf( S_COLOR_RED "Couldn't reopen %s", pak->pakFilename );
-			*file = FS_INVALID_HANDLE;
-			return -1;
-		}
-	} else {
-		temp = pak->handle;
-	}
+	buf = Hunk_AllocateTempMemory( len + 1 );
+	Com_Memcpy( buf, af->data, len + 1 );
+	*buffer = buf;
 
-	*file = FS_HandleForFile();
-	f = &fsh[ *file ];
-	FS_InitHandle( f );
+	free( FS_AsyncTake( af ) );
+	FS_AsyncRelease( af );
 
-	f->zipFile = qtrue;
-	f->handleFiles.file.z = temp;
-	f->handleFiles.unique = uniqueFILE;
+	fs_loadCount++;
+	fs_loadStack++;
 
-	Q_strncpyz( f->name, pakFile->name, sizeof( f->name ) );
-	zfi = (unz_s *)f->handleFiles.file.z;
-	// in case the file was new
-	temp = zfi->file;
-	// set the file position in the zip file (also sets the current file info)
-	unzSetCurrentFileInfoPosition( pak->handle, pakFile->pos );
-	// copy the file info into the unzip structure
-	Com_Memcpy( zfi, pak->handle, sizeof( *zfi ) );
-	// we copy this back into the structure
-	zfi->file = temp;
-	// open the file in the zip
-	unzOpenCurrentFile( f->handleFiles.file.z );
-	f->zipFilePos = pakFile->pos;
-	f->zipFileLen = pakFile->size;
-	f->pakIndex = pak->index;
-	fs_lastPakIndex = pak->index;
-	f->pak = pak;
+	return len;
+}
 
-#ifdef USE_HANDLE_CACHE
-	if ( pak->next_h ) {
-		FS_RemoveFromHandleList( pak );
-	}
-#endif
 
-	pak->handleUsed++;
+/*
+=================
+FS_PrefetchFiles
 
-	if ( fs_debug->integer ) {
-		Com_Printf( "FS_FOpenFileRead: %s (found in '%s')\n",
-			pakFile->name, pak->pakFilename );
+Queues files which are about to be loaded, they are picked up by the
+regular FS_FOpenFileRead()/FS_ReadFile() calls or FS_FlushPrefetch()
+=================
+*/
+void FS_PrefetchFiles( const char **qpaths, int count )
+{
+	int i;
+
+	for ( i = 0; i < count; i++ ) {
+		if ( !FS_AsyncQueue( qpaths[ i ], qtrue ) && fs_io.numThreads == 0 ) {
+			break;
+		}
 	}
+}
 
-	return zfi->cur_file_info.uncompressed_size;
+
+/*
+=================
+FS_FlushPrefetch
+
+Drops prefetched files which were not picked up
+=================
+*/
+void FS_FlushPrefetch( void )
+{
+	FS_AsyncCancel( qtrue );
+}
+
+
+/*
+=================
+FS_CancelAsyncReads
+
+Called on errors, interrupted loaders never pick up their files
+=================
+*/
+void FS_CancelAsyncReads( void )
+{
+	FS_AsyncCancel( qfalse );
 }
 
 
@@ -1560,8 +2617,6 @@ Used for streaming data out of either a
 separate file or a ZIP file.
 ===========
 */
-extern qboolean		com_fullyInitialized;
-
 int FS_FOpenFileRead( const char *filename, fileHandle_t *file, qboolean uniqueFILE ) {
 	const searchpath_t	*search;
 	char			*netpath;
@@ -1639,6 +2694,15 @@ int FS_FOpenFileRead( const char *filename, fileHandle_t *file, qboolean uniqueF
 		return -1;
 	}
 
+	if ( fs_benchCount < fs_benchMax ) {
+		Q_strncpyz( fs_benchNames + fs_benchCount++ * MAX_ZPATH, filename, MAX_ZPATH );
+	}
+
+	// pick up prefetched file
+	if ( fs_io.numFiles && FS_OpenAsyncFile( filename, file, &length ) ) {
+		return length;
+	}
+
 	//
 	// search through the path, one element at a time
 	//
@@ -1816,7 +2880,15 @@ int FS_Read( void *buffer, int len, fileHandle_t f ) {
 	buf = (byte *)buffer;
 	fs_readCount += len;
 
-	if ( !fsh[f].zipFile ) {
+	if ( fsh[f].memFile ) {
+		remaining = fsh[f].memFileLen - fsh[f].memFilePos;
+		if ( len > remaining ) {
+			len = remaining;
+		}
+		Com_Memcpy( buf, (byte *)fsh[f].handleFiles.file.v + fsh[f].memFilePos, len );
+		fsh[f].memFilePos += len;
+		return len;
+	} else if ( !fsh[f].zipFile ) {
 		remaining = len;
 		tries = 0;
 		while (remaining) {
@@ -1926,6 +2998,27 @@ int FS_Seek( fileHandle_t f, long offset, fsOrigin_t origin ) {
 		return -1;
 	}
 
+	if ( fsh[f].memFile ) {
+		switch( origin ) {
+		case FS_SEEK_CUR:
+			offset += fsh[f].memFilePos;
+			break;
+		case FS_SEEK_END:
+			offset += fsh[f].memFileLen;
+			break;
+		case FS_SEEK_SET:
+			break;
+		default:
+			Com_Error( ERR_FATAL, "Bad origin in FS_Seek" );
+			return -1;
+		}
+		if ( offset < 0 || offset > fsh[f].memFileLen ) {
+			return -1;
+		}
+		fsh[f].memFilePos = offset;
+		return 0;
+	}
+
 	if ( fsh[f].zipFile == qtrue ) {
 		//FIXME: this is really, really crappy
 		//(but better than what was here before)
@@ -2177,6 +3270,13 @@ int FS_ReadFile( const char *qpath, void **buffer ) {
 		return len;
 	}
 
+	if ( FS_ReadMappedFile( h, len, buffer ) ) {
+		fs_loadCount++;
+		fs_loadStack++;
+		FS_FCloseFile( h );
+		return len;
+	}
+
 	buf = Hunk_AllocateTempMemory( len + 1 );
 	*buffer = buf;
 
@@ -2214,7 +3314,9 @@ void FS_FreeFile( void *buffer ) {
 	}
 	fs_loadStack--;
 
-	Hunk_FreeTempMemory( buffer );
+	if ( !fs_numMappedBuffers || !FS_FreeMappedFile( buffer ) ) {
+		Hunk_FreeTempMemory( buffer );
+	}
 
 	// if all of our temp files are free, clear all of our space
 	if ( fs_loadStack == 0 ) {
@@ -2979,6 +4081,7 @@ static pack_t *FS_LoadZipFile( const char *zipfile )
 		}
 
 		pack->touched = qtrue;
+		FS_MapPak( pack );
 		return pack; // loaded from cache
 	}
 #endif
@@ -3135,6 +4238,8 @@ static pack_t *FS_LoadZipFile( const char *zipfile )
 #endif
 #endif
 
+	FS_MapPak( pack );
+
 	return pack;
 }
 
@@ -3158,6 +4263,12 @@ static void FS_FreePak( pack_t *pak )
 		pak->handle = NULL;
 	}
 
+	if ( pak->map )
+	{
+		FS_ReleaseMap( pak->map );
+		pak->map = NULL;
+	}
+
 	Z_Free( pak );
 }
 
@@ -4452,6 +5563,12 @@ void FS_Shutdown( qboolean closemfp )
 	searchpath_t	*p, *next;
 	int i;
 
+	// workers must not see search paths going away
+	FS_AsyncCancel( qfalse );
+	if ( closemfp ) {
+		FS_AsyncShutdown();
+	}
+
 	// close opened files
 	if ( closemfp ) 
 	{
@@ -4511,6 +5628,7 @@ void FS_Shutdown( qboolean closemfp )
 	Cmd_RemoveCommand( "which" );
 	Cmd_RemoveCommand( "lsof" );
 	Cmd_RemoveCommand( "fs_restart" );
+	Cmd_RemoveCommand( "loadbench" );
 }
 
 
@@ -4575,6 +5693,8 @@ static void FS_ReorderPurePaks( void )
 	// only relevant when connected to pure server
 	if ( !fs_numServerPaks )
 		return;
+
+	FS_AsyncCancel( qfalse );
 	
 	p_insert_index = &fs_searchpaths; // we insert in order at the beginning of the list 
 	for ( i = 0 ; i < fs_numServerPaks ; i++ ) {
@@ -4628,6 +5748,92 @@ static void FS_ListOpenFiles_f( void ) {
 }
 
 
+/*
+================
+FS_LoadBench_f
+
+loadbench record [maxfiles] | stop | [iterations]
+Replays files opened during recording (e.g. a map load) with and without prefetch
+================
+*/
+static void FS_LoadBench_f( void ) {
+	const char **list;
+	const char *cmd, *name;
+	int64_t start, elapsed[2];
+	int iterations, mode, i, n;
+	void *buf;
+
+	cmd = Cmd_Argv( 1 );
+
+	if ( !Q_stricmp( cmd, "record" ) ) {
+		n = Cmd_Argc() > 2 ? atoi( Cmd_Argv( 2 ) ) : 8192;
+		if ( n < 64 ) {
+			n = 64;
+		}
+		free( fs_benchNames );
+		fs_benchNames = calloc( n, MAX_ZPATH );
+		fs_benchCount = 0;
+		fs_benchMax = fs_benchNames ? n : 0;
+		Com_Printf( "loadbench: recording up to %i files\n", fs_benchMax );
+		return;
+	}
+
+	if ( !Q_stricmp( cmd, "stop" ) ) {
+		fs_benchMax = 0;
+		Com_Printf( "loadbench: %i files captured\n", fs_benchCount );
+		return;
+	}
+
+	if ( !fs_benchCount ) {
+		Com_Printf( "usage: loadbench record [maxfiles] | stop | [iterations]\n" );
+		return;
+	}
+
+	iterations = *cmd ? atoi( cmd ) : 3;
+	if ( iterations < 1 ) {
+		iterations = 1;
+	}
+
+	fs_benchMax = 0;
+
+	list = malloc( fs_benchCount * sizeof( *list ) );
+	if ( !list ) {
+		Com_Printf( "loadbench: out of memory\n" );
+		return;
+	}
+	for ( i = 0; i < fs_benchCount; i++ ) {
+		list[ i ] = fs_benchNames + i * MAX_ZPATH;
+	}
+
+	// warm up OS file cache so both modes run in the same conditions
+	elapsed[0] = elapsed[1] = 0;
+	for ( i = -1; i < iterations; i++ ) {
+		for ( mode = 0; mode < 2; mode++ ) {
+			start = Sys_Microseconds();
+			if ( mode == 1 ) {
+				FS_PrefetchFiles( list, fs_benchCount );
+			}
+			for ( n = 0; n < fs_benchCount; n++ ) {
+				name = list[ n ];
+				if ( FS_ReadFile( name, &buf ) >= 0 && buf ) {
+					FS_FreeFile( buf );
+				}
+			}
+			FS_FlushPrefetch();
+			if ( i >= 0 ) {
+				elapsed[ mode ] += Sys_Microseconds() - start;
+			}
+		}
+	}
+
+	free( (void *)list );
+
+	Com_Printf( "%i files, %i iterations:\n", fs_benchCount, iterations );
+	Com_Printf( " %-8s %.2fms per load\n", "sync", (double)elapsed[0] / ( iterations * 1000 ) );
+	Com_Printf( " %-8s %.2fms per load (%i i/o threads)\n", "prefetch", (double)elapsed[1] / ( iterations * 1000 ), fs_io.numThreads );
+}
+
+
 /*
 =====================
 FS_LoadedPakPureChecksums
@@ -4695,6 +5901,12 @@ static void FS_Startup( void ) {
 	fs_basegame = Cvar_Get( "fs_basegame", BASEGAME, CVAR_INIT | CVAR_PROTECTED );
 	Cvar_SetDescription( fs_basegame, "Write-protected CVAR specifying the path to the base game(s) folder(s), separated by '/'." );
 	fs_steampath = Cvar_Get( "fs_steampath", Sys_SteamPath(), CVAR_INIT | CVAR_PROTECTED | CVAR_PRIVATE );
+	fs_ioThreads = Cvar_Get( "fs_ioThreads", "0", CVAR_ARCHIVE_ND );
+	Cvar_CheckRange( fs_ioThreads, "0", XSTRING( MAX_IO_THREADS ), CV_INTEGER );
+	Cvar_SetDescription( fs_ioThreads, "Number of background threads reading files which loaders queue ahead of use, 0 reads them on demand." );
+	fs_mapFiles = Cvar_Get( "fs_mapFiles", sizeof( void * ) > 4 ? "1" : "0", CVAR_ARCHIVE_ND );
+	Cvar_CheckRange( fs_mapFiles, "0", "1", CV_INTEGER );
+	Cvar_SetDescription( fs_mapFiles, "Map pk3 and large files into memory so that maps and images stored without compression are loaded without copying. Applies to pk3 files loaded after change." );
 
 	/* parse fs_basegame cvar */
 	if ( basegame_cnt == 0 || Q_stricmp( basegame, fs_basegame->string ) ) {
@@ -4824,6 +6036,7 @@ static void FS_Startup( void ) {
  	Cmd_AddCommand( "which", FS_Which_f );
 	Cmd_SetCommandCompletionFunc( "which", FS_CompleteFileName );
 	Cmd_AddCommand( "fs_restart", FS_Reload );
+	Cmd_AddCommand( "loadbench", FS_LoadBench_f );
 
 	// print the current search paths
 	//FS_Path_f();
@@ -5277,6 +6490,8 @@ exception of .cfg and .dat files.
 void FS_PureServerSetLoadedPaks( const char *pakSums, const char *pakNames ) {
 	int		i, c, d;
 
+	FS_AsyncCancel( qfalse );
+
 	Cmd_TokenizeString( pakSums );
 
 	c = Cmd_Argc();
@@ -5571,7 +6786,9 @@ int	FS_FOpenFileByMode( const char *qpath, fileHandle_t *f, fsMode_t mode ) {
 
 int FS_FTell( fileHandle_t f ) {
 	int pos;
-	if ( fsh[f].zipFile ) {
+	if ( fsh[f].memFile ) {
+		pos = fsh[f].memFilePos;
+	} else if ( fsh[f].zipFile ) {
 		pos = unztell( fsh[f].handleFiles.file.z );
 	} else {
 		pos = ftell( fsh[f].handleFiles.file.o );
@@ -209,3 +209,112 @@ int HuffmanGetSymbol( unsigned int* symbol, const byte* buffer, int bitIndex )
 
 	return (int)(entry >> 8);
 }
+
+
+// multi-symbol decoder, indexed with next 12 bits of the stream:
+// bits 0..7 - first symbol, 8..15 - second symbol,
+// 16..19 - length of the first symbol, 20..23 - total length,
+// 24..25 - number of symbols that are fully contained in these 12 bits
+static uint32_t HuffmanPairTable[ 4096 ];
+
+
+void HuffmanInit( void )
+{
+	uint32_t i, entry, len0, len1;
+
+	for ( i = 0; i < ARRAY_LEN( HuffmanPairTable ); i++ )
+	{
+		entry = HuffmanDecoderTable[ i & 0x7FF ];
+		len0 = entry >> 8;
+		HuffmanPairTable[ i ] = ( entry & 0xFF ) | ( len0 << 16 ) | ( len0 << 20 ) | ( 1 << 24 );
+
+		// prefix property: the second symbol is valid if its code is within known bits
+		entry = HuffmanDecoderTable[ ( i >> len0 ) & 0x7FF ];
+		len1 = entry >> 8;
+		if ( len0 + len1 <= 12 )
+		{
+			HuffmanPairTable[ i ] = ( HuffmanPairTable[ i ] & 0xFFFFF ) | ( ( entry & 0xFF ) << 8 ) | ( ( len0 + len1 ) << 20 ) | ( 2 << 24 );
+		}
+	}
+}
+
+
+/*
+Word-at-a-time versions of HuffmanPutBit/HuffmanPutSymbol/HuffmanGetSymbol.
+
+(bits & 7) raw bits followed by (bits >> 3) huffman symbols take at most 7+4*11 bits
+so a whole MSG_WriteBits/MSG_ReadBits field fits into a single 64-bit word,
+caller must ensure that 8 bytes at (bitIndex >> 3) are accessible.
+Little-endian only.
+*/
+int HuffmanPutBits( byte* fout, int32_t bitIndex, uint32_t value, int bits )
+{
+	byte *out = fout + ( bitIndex >> 3 );
+	const int shift = bitIndex & 7;
+	const int nbits = bits & 7;
+	uint64_t acc;
+	uint16_t entry;
+	int count;
+
+	acc = value & ( ( 1 << nbits ) - 1 );
+	count = nbits;
+	value >>= nbits;
+
+	for ( bits >>= 3; bits > 0; bits-- )
+	{
+		entry = HuffmanEncoderTable[ value & 0xFF ];
+		acc |= (uint64_t)( ( entry >> 4 ) & 0x7FF ) << count;
+		count += entry & 15;
+		value >>= 8;
+	}
+
+	// merge with partially filled current byte, following ones start fresh
+	if ( shift )
+	{
+		acc = ( acc << shift ) | out[ 0 ];
+	}
+	memcpy( out, &acc, sizeof( acc ) );
+
+	return count;
+}
+
+
+int HuffmanGetBits( uint32_t* value, const byte* buffer, int32_t bitIndex, int bits )
+{
+	const int nbits = bits & 7;
+	uint64_t word;
+	uint32_t v, entry;
+	int count, out, len;
+
+	memcpy( &word, buffer + ( bitIndex >> 3 ), sizeof( word ) );
+	word >>= bitIndex & 7; // at least 56 valid bits
+
+	v = (uint32_t)word & ( ( 1 << nbits ) - 1 );
+	word >>= nbits;
+	count = out = nbits;
+
+	for ( bits >>= 3; bits > 0; )
+	{
+		entry = HuffmanPairTable[ word & 0xFFF ];
+		if ( bits >= 2 && ( entry >> 24 ) == 2 )
+		{
+			v |= ( entry & 0xFFFF ) << out;
+			len = ( entry >> 20 ) & 15;
+			out += 16;
+			bits -= 2;
+		}
+		else
+		{
+			v |= ( entry & 0xFF ) << out;
+			len = ( entry >> 16 ) & 15;
+			out += 8;
+			bits--;
+		}
+		word >>= len;
+		count += len;
+	}
+
+	*value = v;
+
+	return count;
+}
@@ -0,0 +1,244 @@
+// simple worker pool for data-parallel loops
+
+#include "q_shared.h"
+#include "qcommon.h"
+
+/*
+=============================================================================
+
+Com_RunJobs() executes func( arg, index ) for every index in [0..count)
+and returns only when all of them are completed. The calling thread takes
+part in processing so with zero workers this is just a plain loop.
+
+Job functions must not call Com_Error(), Com_Printf() or allocate
+zone/hunk memory - collect such results and handle them after return.
+
+=============================================================================
+*/
+
+#define MAX_JOB_WORKERS 16
+
+typedef struct {
+	sysMutex_t		*lock;
+	sysCond_t		*wake;		// workers are waiting for a new batch
+	sysCond_t		*done;		// caller is waiting for batch completion
+
+	sysThread_t		*threads[ MAX_JOB_WORKERS ];
+	int				numThreads;
+
+	jobFunc_t		func;
+	void			*arg;
+	int				count;
+	int				next;		// next index to pick up
+	int				pending;	// indexes not completed yet
+	int				batch;		// incremented for each new batch
+	qboolean		shutdown;
+} jobPool_t;
+
+static jobPool_t pool;
+
+
+/*
+=================
+Com_ProcessJobs
+
+Picks up and executes indexes from current batch until none left,
+must be called with pool lock held
+=================
+*/
+static void Com_ProcessJobs( void )
+{
+	jobFunc_t func;
+	void *arg;
+	int index;
+	int completed;
+
+	func = pool.func;
+	arg = pool.arg;
+	completed = 0;
+
+	while ( pool.next < pool.count ) {
+		index = pool.next++;
+		Sys_UnlockMutex( pool.lock );
+		func( arg, index );
+		completed++;
+		Sys_LockMutex( pool.lock );
+	}
+
+	pool.pending -= completed;
+
+	if ( pool.pending == 0 && completed ) {
+		Sys_CondSignal( pool.done );
+	}
+}
+
+
+/*
+=================
+Com_JobWorker
+=================
+*/
+static void Com_JobWorker( void *unused )
+{
+	int batch;
+
+	Sys_LockMutex( pool.lock );
+
+	batch = pool.batch;
+
+	for ( ;; ) {
+		while ( pool.batch == batch && !pool.shutdown ) {
+			Sys_CondWait( pool.wake, pool.lock );
+		}
+		if ( pool.shutdown ) {
+			break;
+		}
+		batch = pool.batch;
+		Com_ProcessJobs();
+	}
+
+	Sys_UnlockMutex( pool.lock );
+}
+
+
+/*
+=================
+Com_ShutdownJobs
+=================
+*/
+void Com_ShutdownJobs( void )
+{
+	int i;
+
+	if ( !pool.lock ) {
+		return;
+	}
+
+	Sys_LockMutex( pool.lock );
+	pool.shutdown = qtrue;
+	Sys_CondBroadcast( pool.wake );
+	Sys_UnlockMutex( pool.lock );
+
+	for ( i = 0; i < pool.numThreads; i++ ) {
+		Sys_JoinThread( pool.threads[ i ] );
+	}
+
+	Sys_DestroyCond( pool.done );
+	Sys_DestroyCond( pool.wake );
+	Sys_DestroyMutex( pool.lock );
+
+	Com_Memset( &pool, 0, sizeof( pool ) );
+}
+
+
+/*
+=================
+Com_SetJobWorkers
+
+(Re)starts worker pool with specified number of threads,
+returns actual number of started threads
+=================
+*/
+int Com_SetJobWorkers( int count )
+{
+	sysThread_t *thread;
+
+	if ( count < 0 ) {
+		count = 0;
+	} else if ( count > MAX_JOB_WORKERS ) {
+		count = MAX_JOB_WORKERS;
+	}
+
+	if ( count == pool.numThreads ) {
+		return pool.numThreads;
+	}
+
+	Com_ShutdownJobs();
+
+	if ( count == 0 ) {
+		return 0;
+	}
+
+	pool.lock = Sys_CreateMutex();
+	pool.wake = Sys_CreateCond();
+	pool.done = Sys_CreateCond();
+
+	if ( !pool.lock || !pool.wake || !pool.done ) {
+		Com_Printf( S_COLOR_YELLOW "WARNING: failed to create job synchronization objects\n" );
+		if ( pool.done ) Sys_DestroyCond( pool.done );
+		if ( pool.wake ) Sys_DestroyCond( pool.wake );
+		if ( pool.lock ) Sys_DestroyMutex( pool.lock );
+		Com_Memset( &pool, 0, sizeof( pool ) );
+		return 0;
+	}
+
+	while ( pool.numThreads < count ) {
+		thread = Sys_CreateThread( Com_JobWorker, NULL );
+		if ( !thread ) {
+			Com_Printf( S_COLOR_YELLOW "WARNING: failed to start job worker thread\n" );
+			break;
+		}
+		pool.threads[ pool.numThreads++ ] = thread;
+	}
+
+	Com_DPrintf( "%i job worker threads started\n", pool.numThreads );
+
+	return pool.numThreads;
+}
+
+
+/*
+=================
+Com_JobWorkers
+=================
+*/
+int Com_JobWorkers( void )
+{
+	return pool.numThreads;
+}
+
+
+/*
+=================
+Com_RunJobs
+=================
+*/
+void Com_RunJobs( jobFunc_t func, void *arg, int count )
+{
+	int i;
+
+	if ( count <= 0 ) {
+		return;
+	}
+
+	if ( pool.numThreads == 0 || count == 1 ) {
+		for ( i = 0; i < count; i++ ) {
+			func( arg, i );
+		}
+		return;
+	}
+
+	Sys_LockMutex( pool.lock );
+
+	pool.func = func;
+	pool.arg = arg;
+	pool.count = count;
+	pool.next = 0;
+	pool.pending = count;
+	pool.batch++;
+
+	Sys_CondBroadcast( pool.wake );
+
+	Com_ProcessJobs();
+
+	while ( pool.pending > 0 ) {
+		Sys_CondWait( pool.done, pool.lock );
+	}
+
+	pool.func = NULL;
+	pool.arg = NULL;
+	pool.count = 0;
+	pool.next = 0;
+
+	Sys_UnlockMutex( pool.lock );
+}
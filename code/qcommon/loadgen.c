@@ -0,0 +1,1075 @@
+// headless load generator for server scaling benchmarks
+
+#include "q_shared.h"
+#include "qcommon.h"
+
+/*
+=============================================================================
+
+Simulates many protocol 71 clients connecting to a remote server. Every
+simulated client owns a socket (so the server sees distinct ip:port pairs),
+runs a netchan, streams usercmds at loadgen_packetRate and fully decodes
+gamestates and snapshots with the regular delta decoders, so the server
+does exactly the same work as for real players.
+
+Each connection has its own server message parser, see msg_parse.c,
+entity baselines are shared by all clients since they connect to the
+same server.
+
+The server should run with sv_pure 0 (pure checksums are never sent)
+and sv_maxclientsPerIP raised or loadgen_bindCount used with multiple
+local addresses (any 127.x.x.x works for loopback targets on Linux).
+
+=============================================================================
+*/
+
+#define LOADGEN_MAX_CLIENTS		1024
+#define LOADGEN_PARSE_ENTITIES	( MAX_SNAPSHOT_ENTITIES * 2 )	// must be power of two
+#define LOADGEN_RETRY_MSEC		1000
+#define LOADGEN_TIMEOUT_MSEC	30000
+
+typedef enum {
+	LGS_DROPPED,
+	LGS_CHALLENGING,	// waiting for challengeResponse
+	LGS_CONNECTING,		// waiting for connectResponse
+	LGS_CONNECTED,		// netchan is up, waiting for gamestate
+	LGS_PRIMED,			// got gamestate, waiting for first snapshot
+	LGS_ACTIVE
+} lgState_t;
+
+static const char *lgStateNames[] = {
+	"dropped",
+	"challenging",
+	"connecting",
+	"connected",
+	"primed",
+	"active"
+};
+
+typedef struct {
+	int				realtime;
+	int				serverTime;
+} lgOutPacket_t;
+
+// counters are reset after each report
+typedef struct {
+	int				packetsIn;
+	int				bytesIn;
+	int				packetsOut;
+	int				bytesOut;
+	int				dropped;
+	int				snapshots;
+	int				entities;
+	int				deltaErrors;
+	int				maxGap;
+	int				pingSum;
+	int				pingCount;
+} lgStats_t;
+
+typedef struct {
+	int				index;
+	int				socket;
+	lgState_t		state;
+	char			message[ 64 ];	// last print or drop reason
+
+	int				qport;
+	int				clientChallenge;
+	int				challenge;
+	int				lastSendTime;
+	int				lastRecvTime;
+	netchan_t		netchan;
+
+	int				serverId;
+	msgParser_t		parser;
+
+	int				cmdNumber;
+	int				scriptPos;
+	usercmd_t		lastCmd;
+	lgOutPacket_t	outPackets[ PACKET_BACKUP ];
+
+	int				snapTime;		// realtime of latest snapshot
+	int				realtime;		// of packet being parsed
+	entityState_t	parseEntities[ LOADGEN_PARSE_ENTITIES ];
+
+	lgStats_t		stats;
+} lgClient_t;
+
+// single step of usercmd script
+typedef struct {
+	signed char		forwardmove;
+	signed char		rightmove;
+	signed char		upmove;
+	int				buttons;
+	float			yawSpeed;		// degrees per second
+	float			pitch;
+} lgCmd_t;
+
+typedef struct {
+	qboolean		active;
+	netadr_t		server;
+	lgClient_t		*clients[ LOADGEN_MAX_CLIENTS ];
+	int				numClients;
+	int				controlSocket;	// rcon queries
+
+	lgCmd_t			*script;
+	int				scriptLength;
+
+	entityState_t	*baselines;
+
+	int				startTime;
+	int				reportTime;
+	int				tokenTime;
+	float			tokens;			// handshake packets allowed to send
+	qboolean		pureWarned;
+} loadGen_t;
+
+static loadGen_t lg;
+
+static cvar_t *loadgen_packetRate;
+static cvar_t *loadgen_rate;
+static cvar_t *loadgen_connectRate;
+static cvar_t *loadgen_bindAddress;
+static cvar_t *loadgen_bindCount;
+static cvar_t *loadgen_reportInterval;
+static cvar_t *loadgen_rconPassword;
+
+
+/*
+=================
+LoadGen_Drop
+=================
+*/
+static void LoadGen_Drop( lgClient_t *cl, const char *reason )
+{
+	if ( cl->state == LGS_DROPPED ) {
+		return;
+	}
+
+	cl->state = LGS_DROPPED;
+	Q_strncpyz( cl->message, reason, sizeof( cl->message ) );
+
+	Com_Printf( "loadgen client %i dropped: %s\n", cl->index, reason );
+}
+
+
+/*
+=================
+LoadGen_SystemInfo
+=================
+*/
+static void LoadGen_SystemInfo( lgClient_t *cl, const char *info )
+{
+	cl->serverId = atoi( Info_ValueForKey( info, "sv_serverid" ) );
+
+	if ( atoi( Info_ValueForKey( info, "sv_pure" ) ) && !lg.pureWarned ) {
+		Com_Printf( S_COLOR_YELLOW "WARNING: loadgen clients can't pass pure checks, set sv_pure 0 on server\n" );
+		lg.pureWarned = qtrue;
+	}
+}
+
+
+/*
+=================
+LoadGen_ParserDrop
+=================
+*/
+static void LoadGen_ParserDrop( msgParser_t *p, const char *reason )
+{
+	LoadGen_Drop( p->owner, reason );
+}
+
+
+/*
+=================
+LoadGen_Configstring
+=================
+*/
+static void LoadGen_Configstring( msgParser_t *p, int index, const char *s )
+{
+	if ( index == CS_SYSTEMINFO ) {
+		LoadGen_SystemInfo( p->owner, s );
+	}
+}
+
+
+/*
+=================
+LoadGen_Gamestate
+=================
+*/
+static void LoadGen_Gamestate( msgParser_t *p )
+{
+	lgClient_t *cl = p->owner;
+
+	cl->cmdNumber = 0;
+	cl->lastCmd.serverTime = 0;
+
+	cl->state = LGS_PRIMED;
+}
+
+
+/*
+=================
+LoadGen_Snapshot
+=================
+*/
+static void LoadGen_Snapshot( msgParser_t *p, const parseSnapshot_t *snap )
+{
+	lgClient_t *cl = p->owner;
+	int i, packetNum;
+
+	// ask for a non-compressed one if the delta source is invalid
+	if ( !snap->valid ) {
+		cl->stats.deltaErrors++;
+		return;
+	}
+
+	// ping is time since the usercmd which server has just run
+	for ( i = 0; i < PACKET_BACKUP; i++ ) {
+		packetNum = ( cl->netchan.outgoingSequence - 1 - i ) & PACKET_MASK;
+		if ( snap->ps.commandTime - cl->outPackets[ packetNum ].serverTime >= 0 ) {
+			cl->stats.pingSum += cl->realtime - cl->outPackets[ packetNum ].realtime;
+			cl->stats.pingCount++;
+			break;
+		}
+	}
+
+	if ( cl->state == LGS_ACTIVE && cl->realtime - cl->snapTime > cl->stats.maxGap ) {
+		cl->stats.maxGap = cl->realtime - cl->snapTime;
+	}
+
+	cl->snapTime = cl->realtime;
+
+	cl->stats.snapshots++;
+	cl->stats.entities += snap->numEntities;
+
+	cl->state = LGS_ACTIVE;
+}
+
+
+/*
+=================
+LoadGen_ConnectionlessPacket
+=================
+*/
+static void LoadGen_ConnectionlessPacket( lgClient_t *cl, msg_t *msg )
+{
+	const char *s, *c;
+
+	MSG_BeginReadingOOB( msg );
+	MSG_ReadLong( msg ); // skip the -1
+
+	s = MSG_ReadStringLine( msg );
+	Cmd_TokenizeString( s );
+	c = Cmd_Argv( 0 );
+
+	if ( !Q_stricmp( c, "challengeResponse" ) ) {
+		if ( cl->state != LGS_CHALLENGING || atoi( Cmd_Argv( 2 ) ) != cl->clientChallenge ) {
+			return;
+		}
+		if ( Cmd_Argc() < 4 || atoi( Cmd_Argv( 3 ) ) != NEW_PROTOCOL_VERSION ) {
+			LoadGen_Drop( cl, va( "server protocol %s is not supported", Cmd_Argv( 3 ) ) );
+			return;
+		}
+		cl->challenge = atoi( Cmd_Argv( 1 ) );
+		cl->state = LGS_CONNECTING;
+		cl->lastSendTime = 0;
+	} else if ( !Q_stricmp( c, "connectResponse" ) ) {
+		if ( cl->state != LGS_CONNECTING || atoi( Cmd_Argv( 1 ) ) != cl->challenge ) {
+			return;
+		}
+		Netchan_Setup( NS_CLIENT, &cl->netchan, &lg.server, cl->qport, cl->challenge, qfalse );
+		MSG_ParserConnect( &cl->parser );
+		cl->state = LGS_CONNECTED;
+		cl->lastSendTime = 0;
+	} else if ( !Q_stricmp( c, "print" ) ) {
+		s = MSG_ReadString( msg );
+		Q_strncpyz( cl->message, s, sizeof( cl->message ) );
+		Com_DPrintf( "loadgen client %i: %s", cl->index, s );
+	} else if ( !Q_stricmp( c, "disconnect" ) ) {
+		if ( cl->state >= LGS_CONNECTED ) {
+			LoadGen_Drop( cl, "server disconnected" );
+		}
+	}
+}
+
+
+/*
+=================
+LoadGen_ReadPackets
+=================
+*/
+static void LoadGen_ReadPackets( lgClient_t *cl, int realtime )
+{
+	static byte buf[ MAX_MSGLEN_BUF ];
+	netadr_t from;
+	msg_t msg;
+
+	MSG_Init( &msg, buf, MAX_MSGLEN );
+
+	while ( NET_GetAuxPacket( cl->socket, &from, &msg ) ) {
+		if ( !NET_CompareAdr( &from, &lg.server ) || msg.cursize < 4 ) {
+			continue;
+		}
+
+		cl->lastRecvTime = realtime;
+
+		if ( *(int32_t *)msg.data == -1 ) {
+			LoadGen_ConnectionlessPacket( cl, &msg );
+			continue;
+		}
+
+		if ( cl->state < LGS_CONNECTED ) {
+			continue;
+		}
+
+		cl->stats.packetsIn++;
+		cl->stats.bytesIn += msg.cursize;
+
+		if ( !Netchan_Process( &cl->netchan, &msg ) ) {
+			continue; // out of order, duplicated, fragment, etc.
+		}
+
+		cl->stats.dropped += cl->netchan.dropped;
+		cl->parser.serverMessageSequence = cl->netchan.incomingSequence;
+		cl->realtime = realtime;
+
+		MSG_ParseServerMessage( &cl->parser, &msg );
+	}
+}
+
+
+/*
+=================
+LoadGen_Transmit
+
+Non-fragmenting part of Netchan_Transmit() for own socket
+=================
+*/
+static void LoadGen_Transmit( lgClient_t *cl, const msg_t *buf )
+{
+	byte data[ MAX_PACKETLEN + 8 ];
+	msg_t send;
+
+	MSG_InitOOB( &send, data, sizeof( data ) - 8 );
+
+	MSG_WriteLong( &send, cl->netchan.outgoingSequence );
+	MSG_WriteShort( &send, cl->qport );
+	MSG_WriteLong( &send, NETCHAN_GENCHECKSUM( cl->challenge, cl->netchan.outgoingSequence ) );
+	MSG_WriteData( &send, buf->data, buf->cursize );
+
+	cl->netchan.outgoingSequence++;
+
+	NET_SendAuxPacket( cl->socket, send.cursize, send.data, &lg.server );
+
+	cl->stats.packetsOut++;
+	cl->stats.bytesOut += send.cursize;
+}
+
+
+/*
+=================
+LoadGen_BuildCmd
+=================
+*/
+static void LoadGen_BuildCmd( lgClient_t *cl, usercmd_t *cmd, int realtime )
+{
+	static const playerState_t nullps;
+	const parseSnapshot_t *snap;
+	const playerState_t *ps;
+	const lgCmd_t *step;
+	lgCmd_t synth;
+	float yaw;
+	int t;
+
+	Com_Memset( cmd, 0, sizeof( *cmd ) );
+
+	snap = cl->parser.snap;
+	ps = snap ? &snap->ps : &nullps;
+
+	// extrapolate server time from the last snapshot
+	if ( snap ) {
+		cmd->serverTime = snap->serverTime + ( realtime - cl->snapTime );
+	} else {
+		cmd->serverTime = cl->lastCmd.serverTime + 1000 / loadgen_packetRate->integer;
+	}
+	if ( cmd->serverTime <= cl->lastCmd.serverTime ) {
+		cmd->serverTime = cl->lastCmd.serverTime + 1;
+	}
+
+	if ( lg.scriptLength ) {
+		step = &lg.script[ cl->scriptPos++ % lg.scriptLength ];
+	} else {
+		// run around in circles, strafe, jump and shoot in a per-client rhythm
+		t = realtime - lg.startTime + cl->index * 337;
+		synth.forwardmove = 127;
+		synth.rightmove = ( ( t / 1500 ) & 1 ) ? 127 : -127;
+		synth.upmove = ( t % 3000 ) < 100 ? 127 : 0;
+		synth.buttons = ( t % 2000 ) < 500 ? BUTTON_ATTACK : 0;
+		synth.yawSpeed = 90.0f;
+		synth.pitch = 0.0f;
+		step = &synth;
+	}
+
+	yaw = step->yawSpeed * ( realtime - lg.startTime ) * 0.001f + cl->index * 47.0f;
+
+	cmd->angles[ PITCH ] = ANGLE2SHORT( step->pitch ) - ps->delta_angles[ PITCH ];
+	cmd->angles[ YAW ] = ANGLE2SHORT( yaw ) - ps->delta_angles[ YAW ];
+	cmd->forwardmove = step->forwardmove;
+	cmd->rightmove = step->rightmove;
+	cmd->upmove = step->upmove;
+	cmd->buttons = step->buttons;
+	cmd->weapon = ps->weapon;
+}
+
+
+/*
+=================
+LoadGen_SendCmd
+=================
+*/
+static void LoadGen_SendCmd( lgClient_t *cl, int realtime, const char *command )
+{
+	static const usercmd_t nullcmd = { 0 };
+	byte data[ MAX_MSGLEN_BUF ];
+	usercmd_t cmd;
+	msg_t buf;
+	int key;
+
+	MSG_Init( &buf, data, MAX_MSGLEN );
+	MSG_Bitstream( &buf );
+
+	MSG_WriteLong( &buf, cl->serverId );
+	MSG_WriteLong( &buf, cl->parser.serverMessageSequence );
+	MSG_WriteLong( &buf, cl->parser.serverCommandSequence );
+
+	if ( command ) {
+		MSG_WriteByte( &buf, clc_clientCommand );
+		MSG_WriteLong( &buf, cl->parser.reliableSequence );
+		MSG_WriteString( &buf, command );
+	} else if ( cl->state >= LGS_PRIMED ) {
+		LoadGen_BuildCmd( cl, &cmd, realtime );
+
+		if ( !cl->parser.snap || cl->parser.serverMessageSequence != cl->parser.snap->messageNum ) {
+			MSG_WriteByte( &buf, clc_moveNoDelta );
+		} else {
+			MSG_WriteByte( &buf, clc_move );
+		}
+
+		key = MSG_ParserCommandKey( &cl->parser );
+
+		// duplicate previous command like cl_packetdup 1
+		if ( cl->cmdNumber ) {
+			MSG_WriteByte( &buf, 2 );
+			MSG_WriteDeltaUsercmdKey( &buf, key, &nullcmd, &cl->lastCmd );
+			MSG_WriteDeltaUsercmdKey( &buf, key, &cl->lastCmd, &cmd );
+		} else {
+			MSG_WriteByte( &buf, 1 );
+			MSG_WriteDeltaUsercmdKey( &buf, key, &nullcmd, &cmd );
+		}
+
+		cl->outPackets[ cl->netchan.outgoingSequence & PACKET_MASK ].realtime = realtime;
+		cl->outPackets[ cl->netchan.outgoingSequence & PACKET_MASK ].serverTime = cmd.serverTime;
+
+		cl->lastCmd = cmd;
+		cl->cmdNumber++;
+	}
+
+	MSG_WriteByte( &buf, clc_EOF );
+
+	LoadGen_Transmit( cl, &buf );
+
+	cl->lastSendTime = realtime;
+}
+
+
+/*
+=================
+LoadGen_SendConnect
+=================
+*/
+static void LoadGen_SendConnect( lgClient_t *cl )
+{
+	char info[ MAX_INFO_STRING ];
+	byte data[ MAX_INFO_STRING * 2 ];
+	msg_t msg;
+	int len;
+
+	info[0] = '\0';
+	Info_SetValueForKey( info, "name", va( "loadgen%i", cl->index ) );
+	Info_SetValueForKey( info, "rate", loadgen_rate->string );
+	Info_SetValueForKey( info, "snaps", "1000" );
+	Info_SetValueForKey( info, "protocol", XSTRING( NEW_PROTOCOL_VERSION ) );
+	Info_SetValueForKey( info, "qport", va( "%i", cl->qport ) );
+	Info_SetValueForKey( info, "challenge", va( "%i", cl->challenge ) );
+	Info_SetValueForKey( info, "client", Q3_VERSION );
+	Info_SetValueForKey( info, "clientLimit", XSTRING( MAX_SERVER_CLIENTS ) );
+
+	data[0] = data[1] = data[2] = data[3] = 0xff;
+	len = Com_sprintf( (char *)data + 4, sizeof( data ) - 4, "connect \"%s\"", info );
+
+	// same as NET_OutOfBandCompress()
+	msg.data = data;
+	msg.cursize = len + 4;
+	Huff_Compress( &msg, 12 );
+
+	NET_SendAuxPacket( cl->socket, msg.cursize, msg.data, &lg.server );
+}
+
+
+
+
+/*
+=================
+LoadGen_OutOfBandPrint
+=================
+*/
+static void QDECL LoadGen_OutOfBandPrint( int handle, const char *format, ... ) __attribute__ ((format (printf, 2, 3)));
+
+static void QDECL LoadGen_OutOfBandPrint( int handle, const char *format, ... )
+{
+	char string[ MAX_PACKETLEN ];
+	va_list argptr;
+	int len;
+
+	string[0] = string[1] = string[2] = string[3] = -1;
+
+	va_start( argptr, format );
+	len = Q_vsnprintf( string + 4, sizeof( string ) - 4, format, argptr ) + 4;
+	va_end( argptr );
+
+	NET_SendAuxPacket( handle, len, string, &lg.server );
+}
+
+
+/*
+=================
+LoadGen_ClientFrame
+=================
+*/
+static void LoadGen_ClientFrame( lgClient_t *cl, int realtime )
+{
+	switch ( cl->state ) {
+	case LGS_DROPPED:
+		break;
+
+	case LGS_CHALLENGING:
+	case LGS_CONNECTING:
+		// handshake packets are rate limited by server per address
+		if ( realtime - cl->lastSendTime < LOADGEN_RETRY_MSEC || lg.tokens < 1.0f ) {
+			break;
+		}
+		lg.tokens -= 1.0f;
+		if ( cl->state == LGS_CHALLENGING ) {
+			LoadGen_OutOfBandPrint( cl->socket, "getchallenge %d %s", cl->clientChallenge, GAMENAME_FOR_MASTER );
+		} else {
+			LoadGen_SendConnect( cl );
+		}
+		cl->lastSendTime = realtime;
+		break;
+
+	default:
+		if ( realtime - cl->lastRecvTime > LOADGEN_TIMEOUT_MSEC ) {
+			LoadGen_Drop( cl, "server connection timed out" );
+			break;
+		}
+		if ( realtime - cl->lastSendTime >= 1000 / loadgen_packetRate->integer ) {
+			LoadGen_SendCmd( cl, realtime, NULL );
+		}
+		break;
+	}
+}
+
+
+/*
+=================
+LoadGen_ReadControl
+
+Prints rcon replies
+=================
+*/
+static void LoadGen_ReadControl( void )
+{
+	static byte buf[ MAX_MSGLEN_BUF ];
+	netadr_t from;
+	msg_t msg;
+
+	MSG_Init( &msg, buf, MAX_MSGLEN );
+
+	while ( NET_GetAuxPacket( lg.controlSocket, &from, &msg ) ) {
+		if ( !NET_CompareAdr( &from, &lg.server ) || msg.cursize < 4 || *(int32_t *)msg.data != -1 ) {
+			continue;
+		}
+		MSG_BeginReadingOOB( &msg );
+		MSG_ReadLong( &msg );
+		if ( !Q_stricmp( MSG_ReadStringLine( &msg ), "print" ) ) {
+			Com_Printf( "%s", MSG_ReadString( &msg ) );
+		}
+	}
+}
+
+
+/*
+=================
+LoadGen_Report
+
+Prints summary of all clients since the last report, optionally
+with per-client lines, and asks server for its frame timings
+=================
+*/
+static void LoadGen_Report( qboolean verbose, int realtime )
+{
+	const lgClient_t *cl;
+	const lgStats_t *st;
+	int counts[ ARRAY_LEN( lgStateNames ) ];
+	int64_t bytesIn, bytesOut, snapshots, entities, pingSum, pingCount;
+	int deltaErrors, dropped, maxGap;
+	float seconds, rate, minRate, maxRate;
+	int i, active;
+
+	seconds = ( realtime - lg.reportTime ) * 0.001f;
+	if ( seconds <= 0.0f ) {
+		seconds = 0.001f;
+	}
+
+	Com_Memset( counts, 0, sizeof( counts ) );
+	bytesIn = bytesOut = snapshots = entities = pingSum = pingCount = 0;
+	deltaErrors = dropped = maxGap = 0;
+	minRate = maxRate = 0.0f;
+	active = 0;
+
+	if ( verbose ) {
+		Com_Printf( "  # state       snaps/s  KB/s in  ents  ping  gap  drop  message\n" );
+		Com_Printf( "---- ----------- ------- ------- ----- ----- ---- ----- -------\n" );
+	}
+
+	for ( i = 0; i < lg.numClients; i++ ) {
+		cl = lg.clients[ i ];
+		st = &cl->stats;
+
+		counts[ cl->state ]++;
+
+		rate = st->snapshots / seconds;
+		if ( cl->state == LGS_ACTIVE ) {
+			if ( active == 0 || rate < minRate )
+				minRate = rate;
+			if ( active == 0 || rate > maxRate )
+				maxRate = rate;
+			active++;
+		}
+
+		bytesIn += st->bytesIn;
+		bytesOut += st->bytesOut;
+		snapshots += st->snapshots;
+		entities += st->entities;
+		pingSum += st->pingSum;
+		pingCount += st->pingCount;
+		deltaErrors += st->deltaErrors;
+		dropped += st->dropped;
+		if ( st->maxGap > maxGap )
+			maxGap = st->maxGap;
+
+		if ( verbose ) {
+			Com_Printf( "%4i %-11s %7.1f %7.1f %5i %5i %4i %5i  %s\n", i, lgStateNames[ cl->state ],
+				rate, st->bytesIn / seconds / 1024.0f, st->snapshots ? st->entities / st->snapshots : 0,
+				st->pingCount ? st->pingSum / st->pingCount : 0, st->maxGap, st->dropped, cl->message );
+		}
+	}
+
+	Com_Printf( "loadgen: %.1fs, %i active, %i loading, %i connecting, %i dropped\n", seconds,
+		counts[ LGS_ACTIVE ], counts[ LGS_PRIMED ] + counts[ LGS_CONNECTED ],
+		counts[ LGS_CHALLENGING ] + counts[ LGS_CONNECTING ], counts[ LGS_DROPPED ] );
+
+	if ( active ) {
+		Com_Printf( " snapshots/s per client: avg %.1f, min %.1f, max %.1f, max gap %ims\n",
+			snapshots / seconds / active, minRate, maxRate, maxGap );
+	}
+
+	Com_Printf( " in %.1f KB/s (%.1f per client), out %.1f KB/s, %i entities/snapshot, ping %i\n",
+		bytesIn / seconds / 1024.0f, lg.numClients ? bytesIn / seconds / 1024.0f / lg.numClients : 0.0f,
+		bytesOut / seconds / 1024.0f, snapshots ? (int)( entities / snapshots ) : 0,
+		pingCount ? (int)( pingSum / pingCount ) : 0 );
+
+	if ( dropped || deltaErrors ) {
+		Com_Printf( " %i packets lost, %i snapshots with lost delta source\n", dropped, deltaErrors );
+	}
+
+	for ( i = 0; i < lg.numClients; i++ ) {
+		Com_Memset( &lg.clients[ i ]->stats, 0, sizeof( lgStats_t ) );
+	}
+
+	lg.reportTime = realtime;
+
+	// server frame timings, see "framestats" and "sv_profile" commands
+	if ( loadgen_rconPassword->string[0] ) {
+		LoadGen_OutOfBandPrint( lg.controlSocket, "rcon \"%s\" framestats", loadgen_rconPassword->string );
+		LoadGen_OutOfBandPrint( lg.controlSocket, "rcon \"%s\" sv_profile", loadgen_rconPassword->string );
+	}
+}
+
+
+/*
+=================
+LoadGen_LoadScript
+
+Each line is a single usercmd:
+forwardmove rightmove upmove buttons yawspeed pitch
+=================
+*/
+static qboolean LoadGen_LoadScript( const char *filename )
+{
+	union {
+		char	*c;
+		void	*v;
+	} buffer;
+	const char *text, *token;
+	lgCmd_t *step;
+	int len, lines, n;
+
+	len = FS_ReadFile( filename, &buffer.v );
+	if ( !buffer.c ) {
+		Com_Printf( "Couldn't load %s.\n", filename );
+		return qfalse;
+	}
+
+	lines = 1;
+	for ( text = buffer.c; *text; text++ ) {
+		if ( *text == '\n' ) {
+			lines++;
+		}
+	}
+
+	lg.script = Z_Malloc( lines * sizeof( lgCmd_t ) );
+	lg.scriptLength = 0;
+
+	text = buffer.c;
+	COM_BeginParseSession( filename );
+
+	while ( lg.scriptLength < lines ) {
+		token = COM_ParseExt( &text, qtrue );
+		if ( !token[0] ) {
+			break;
+		}
+		step = &lg.script[ lg.scriptLength++ ];
+		step->forwardmove = atoi( token );
+		step->rightmove = atoi( COM_ParseExt( &text, qfalse ) );
+		step->upmove = atoi( COM_ParseExt( &text, qfalse ) );
+		step->buttons = atoi( COM_ParseExt( &text, qfalse ) );
+		step->yawSpeed = atof( COM_ParseExt( &text, qfalse ) );
+		step->pitch = atof( COM_ParseExt( &text, qfalse ) );
+		SkipRestOfLine( &text );
+	}
+
+	FS_FreeFile( buffer.v );
+
+	n = lg.scriptLength;
+	if ( !n ) {
+		Com_Printf( "%s has no commands.\n", filename );
+		Z_Free( lg.script );
+		lg.script = NULL;
+		return qfalse;
+	}
+
+	Com_Printf( "Loaded %i usercmds from %s (%i bytes).\n", n, filename, len );
+
+	return qtrue;
+}
+
+
+/*
+=================
+LoadGen_Stop
+=================
+*/
+static void LoadGen_Stop( void )
+{
+	lgClient_t *cl;
+	int i, n;
+
+	if ( !lg.active ) {
+		return;
+	}
+
+	for ( i = 0; i < lg.numClients; i++ ) {
+		cl = lg.clients[ i ];
+		if ( cl->state >= LGS_CONNECTED ) {
+			// like CL_Disconnect(), repeat in case of packet loss
+			cl->parser.reliableSequence++;
+			for ( n = 0; n < 3; n++ ) {
+				LoadGen_SendCmd( cl, Sys_Milliseconds(), "disconnect" );
+			}
+		}
+		NET_CloseAuxSocket( cl->socket );
+		Z_Free( cl );
+	}
+
+	NET_CloseAuxSocket( lg.controlSocket );
+
+	if ( lg.script ) {
+		Z_Free( lg.script );
+	}
+	if ( lg.baselines ) {
+		Z_Free( lg.baselines );
+	}
+
+	Com_Memset( &lg, 0, sizeof( lg ) );
+}
+
+
+/*
+=================
+LoadGen_BindAddress
+
+Returns local address for specified client or NULL for any
+=================
+*/
+static const netadr_t *LoadGen_BindAddress( int index, netadr_t *adr )
+{
+	uint32_t ip;
+
+	if ( !loadgen_bindAddress->string[0] ) {
+		return NULL;
+	}
+
+	if ( !NET_StringToAdr( loadgen_bindAddress->string, adr, NA_UNSPEC ) || adr->type == NA_LOOPBACK ) {
+		return NULL;
+	}
+	adr->port = 0;
+
+	if ( adr->type == NA_IP ) {
+		// consecutive addresses
+		ip = ( adr->ipv._4[0] << 24 ) | ( adr->ipv._4[1] << 16 ) | ( adr->ipv._4[2] << 8 ) | adr->ipv._4[3];
+		ip += index % loadgen_bindCount->integer;
+		adr->ipv._4[0] = ip >> 24;
+		adr->ipv._4[1] = ip >> 16;
+		adr->ipv._4[2] = ip >> 8;
+		adr->ipv._4[3] = ip;
+	}
+
+	return adr;
+}
+
+
+/*
+=================
+LoadGen_f
+
+loadgen <server[:port]> <clients> [cmdfile]
+=================
+*/
+static void LoadGen_f( void )
+{
+	lgClient_t *cl;
+	netadr_t adr;
+	int i, count, realtime;
+
+	if ( Cmd_Argc() < 3 ) {
+		Com_Printf( "usage: loadgen <server[:port]> <clients> [cmdfile]\n" );
+		return;
+	}
+
+	LoadGen_Stop();
+
+	if ( !NET_StringToAdr( Cmd_Argv( 1 ), &lg.server, NA_UNSPEC ) || lg.server.type == NA_LOOPBACK ) {
+		Com_Printf( "Bad server address %s.\n", Cmd_Argv( 1 ) );
+		return;
+	}
+
+	count = atoi( Cmd_Argv( 2 ) );
+	if ( count < 1 || count > LOADGEN_MAX_CLIENTS ) {
+		Com_Printf( "Clients count must be in range 1..%i.\n", LOADGEN_MAX_CLIENTS );
+		return;
+	}
+
+	if ( Cmd_Argc() > 3 && !LoadGen_LoadScript( Cmd_Argv( 3 ) ) ) {
+		return;
+	}
+
+	lg.controlSocket = NET_OpenAuxSocket( NULL );
+	if ( lg.controlSocket < 0 ) {
+		return;
+	}
+
+	lg.active = qtrue;
+	lg.baselines = Z_Malloc( MAX_GENTITIES * sizeof( entityState_t ) );
+
+	realtime = Sys_Milliseconds();
+
+	for ( i = 0; i < count; i++ ) {
+		cl = Z_Malloc( sizeof( *cl ) );
+		cl->socket = NET_OpenAuxSocket( LoadGen_BindAddress( i, &adr ) );
+		if ( cl->socket < 0 ) {
+			Z_Free( cl );
+			break;
+		}
+		cl->index = i;
+		cl->parser.owner = cl;
+		cl->parser.baselines = lg.baselines;
+		cl->parser.parseEntities = cl->parseEntities;
+		cl->parser.parseEntitiesMask = LOADGEN_PARSE_ENTITIES - 1;
+		cl->parser.drop = LoadGen_ParserDrop;
+		cl->parser.configstring = LoadGen_Configstring;
+		cl->parser.gamestate = LoadGen_Gamestate;
+		cl->parser.snapshot = LoadGen_Snapshot;
+		cl->state = LGS_CHALLENGING;
+		cl->qport = ( rand() ^ i ) & 0xffff;
+		cl->clientChallenge = ( ( rand() << 16 ) ^ rand() ^ realtime ) & 0x7fffffff;
+		cl->lastSendTime = realtime - LOADGEN_RETRY_MSEC;
+		cl->lastRecvTime = realtime;
+		lg.clients[ lg.numClients++ ] = cl;
+	}
+
+	if ( !lg.numClients ) {
+		LoadGen_Stop();
+		return;
+	}
+
+	lg.startTime = realtime;
+	lg.reportTime = realtime;
+	lg.tokenTime = realtime;
+	lg.tokens = loadgen_connectRate->integer;
+
+	Com_Printf( "loadgen: connecting %i clients to %s\n", lg.numClients, NET_AdrToStringwPort( &lg.server ) );
+}
+
+
+/*
+=================
+LoadGen_Stop_f
+=================
+*/
+static void LoadGen_Stop_f( void )
+{
+	if ( !lg.active ) {
+		Com_Printf( "Load generator is not running.\n" );
+		return;
+	}
+
+	LoadGen_Report( qfalse, Sys_Milliseconds() );
+	LoadGen_Stop();
+}
+
+
+/*
+=================
+LoadGen_Stats_f
+=================
+*/
+static void LoadGen_Stats_f( void )
+{
+	if ( !lg.active ) {
+		Com_Printf( "Load generator is not running.\n" );
+		return;
+	}
+
+	LoadGen_Report( qtrue, Sys_Milliseconds() );
+}
+
+
+/*
+=================
+LoadGen_Frame
+=================
+*/
+void LoadGen_Frame( void )
+{
+	int realtime, i;
+
+	if ( !lg.active ) {
+		return;
+	}
+
+	realtime = Sys_Milliseconds();
+
+	for ( i = 0; i < lg.numClients; i++ ) {
+		LoadGen_ReadPackets( lg.clients[ i ], realtime );
+	}
+
+	LoadGen_ReadControl();
+
+	lg.tokens += ( realtime - lg.tokenTime ) * loadgen_connectRate->integer * 0.001f;
+	if ( lg.tokens > loadgen_connectRate->integer ) {
+		lg.tokens = loadgen_connectRate->integer;
+	}
+	lg.tokenTime = realtime;
+
+	for ( i = 0; i < lg.numClients; i++ ) {
+		LoadGen_ClientFrame( lg.clients[ i ], realtime );
+	}
+
+	if ( loadgen_reportInterval->integer && realtime - lg.reportTime >= loadgen_reportInterval->integer * 1000 ) {
+		LoadGen_Report( qfalse, realtime );
+	}
+}
+
+
+/*
+=================
+LoadGen_Active
+=================
+*/
+qboolean LoadGen_Active( void )
+{
+	return lg.active;
+}
+
+
+/*
+=================
+LoadGen_FrameMsec
+
+Caps main loop sleep time so packets are sent and read in time
+=================
+*/
+int LoadGen_FrameMsec( int msec )
+{
+	if ( lg.active && msec > 1 ) {
+		return 1;
+	}
+
+	return msec;
+}
+
+
+/*
+=================
+LoadGen_Init
+=================
+*/
+void LoadGen_Init( void )
+{
+	loadgen_packetRate = Cvar_Get( "loadgen_packetRate", "30", 0 );
+	Cvar_CheckRange( loadgen_packetRate, "1", "125", CV_INTEGER );
+	Cvar_SetDescription( loadgen_packetRate, "Number of packets with usercmds sent per second by each load generator client." );
+	loadgen_rate = Cvar_Get( "loadgen_rate", "25000", 0 );
+	Cvar_CheckRange( loadgen_rate, "1000", "1000000", CV_INTEGER );
+	Cvar_SetDescription( loadgen_rate, "Rate userinfo value of load generator clients." );
+	loadgen_connectRate = Cvar_Get( "loadgen_connectRate", "10", 0 );
+	Cvar_CheckRange( loadgen_connectRate, "1", "1000", CV_INTEGER );
+	Cvar_SetDescription( loadgen_connectRate, "Maximum number of handshake packets per second sent by load generator." );
+	loadgen_bindAddress = Cvar_Get( "loadgen_bindAddress", "", 0 );
+	Cvar_SetDescription( loadgen_bindAddress, "Local address for load generator clients, any if empty." );
+	loadgen_bindCount = Cvar_Get( "loadgen_bindCount", "1", 0 );
+	Cvar_CheckRange( loadgen_bindCount, "1", "256", CV_INTEGER );
+	Cvar_SetDescription( loadgen_bindCount, "Number of consecutive IPv4 addresses starting from loadgen_bindAddress to spread load generator clients over." );
+	loadgen_reportInterval = Cvar_Get( "loadgen_reportInterval", "10", 0 );
+	Cvar_CheckRange( loadgen_reportInterval, "0", "3600", CV_INTEGER );
+	Cvar_SetDescription( loadgen_reportInterval, "Seconds between load generator summaries, 0 - only on loadgen_stats command." );
+	loadgen_rconPassword = Cvar_Get( "loadgen_rconPassword", "", CVAR_TEMP );
+	Cvar_SetDescription( loadgen_rconPassword, "If set, load generator reports will also query server frame timings over rcon." );
+
+	Cmd_AddCommand( "loadgen", LoadGen_f );
+	Cmd_AddCommand( "loadgen_stop", LoadGen_Stop_f );
+	Cmd_AddCommand( "loadgen_stats", LoadGen_Stats_f );
+}
+
+
+/*
+=================
+LoadGen_Shutdown
+=================
+*/
+void LoadGen_Shutdown( void )
+{
+	LoadGen_Stop();
+}
@@ -22,6 +22,15 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 #include "q_shared.h"
 #include "qcommon.h"
 
+#if idx64
+#include <emmintrin.h>
+#elif arm64
+#include <arm_neon.h>
+#endif
+#if defined( _MSC_VER ) && ( idx64 || arm64 )
+#include <intrin.h>
+#endif
+
 static int pcount[256];
 
 /*
@@ -93,12 +102,95 @@ bit functions
 =============================================================================
 */
 
+#ifdef Q3_LITTLE_ENDIAN
+// HuffmanPutBits() and HuffmanGetBits() access 8 bytes at the current position
+#define MSG_WORD_ACCESS( msg ) ( ( ( (msg)->bit >> 3 ) + 8 ) <= (msg)->maxsize )
+#else
+#define MSG_WORD_ACCESS( msg ) qfalse
+#endif
+
+
+/*
+=================
+MSG_PutBitsRef
+
+Bit-at-a-time huffman encoding, used at the end of buffer
+and as a reference implementation for MSG_Bench_f
+=================
+*/
+static int MSG_PutBitsRef( byte *data, int bitIndex, int value, int bits ) {
+	int	i, nbits;
+
+	nbits = bits & 7;
+	for ( i = 0; i < nbits; i++ ) {
+		HuffmanPutBit( data, bitIndex, (value & 1) );
+		bitIndex++;
+		value = (value>>1);
+	}
+	for ( i = nbits; i < bits; i += 8 ) {
+		bitIndex += HuffmanPutSymbol( data, bitIndex, (value & 0xFF) );
+		value = (value>>8);
+	}
+
+	return bitIndex;
+}
+
+
+/*
+=================
+MSG_GetBitsRef
+
+Reading counterpart of MSG_PutBitsRef
+=================
+*/
+static int MSG_GetBitsRef( const byte *buffer, int *bitIndex, int bits ) {
+	unsigned int sym;
+	int	i, nbits;
+	int value;
+
+	value = 0;
+	nbits = bits & 7;
+	for ( i = 0; i < nbits; i++ ) {
+		value |= HuffmanGetBit( buffer, *bitIndex ) << i;
+		(*bitIndex)++;
+	}
+	for ( i = nbits; i < bits; i += 8 ) {
+		*bitIndex += HuffmanGetSymbol( &sym, buffer, *bitIndex );
+		value |= ( sym << i );
+	}
+
+	return value;
+}
+
+
+/*
+=================
+MSG_WriteError
+
+Messages encoded on worker threads can't longjmp out,
+so the first error is stored and the message is marked
+as overflowed to stop further writes, caller must raise
+it on main thread
+=================
+*/
+static void MSG_WriteError( msg_t *msg, const char *fmt, int value ) {
+	if ( !msg->deferError ) {
+		Com_Error( ERR_DROP, fmt, value );
+	}
+	if ( !msg->error ) {
+		msg->error = fmt;
+		msg->errorValue = value;
+	}
+	msg->overflowed = qtrue;
+}
+
+
 // negative bit values include signs
 void MSG_WriteBits( msg_t *msg, int value, int bits ) {
-	int	i;
 
 	if ( bits == 0 || bits < -31 || bits > 32 ) {
-		Com_Error( ERR_DROP, "MSG_WriteBits: bad bits %i", bits );
+		MSG_WriteError( msg, "MSG_WriteBits: bad bits %i", bits );
+		return;
 	}
 
 	if ( msg->overflowed != qfalse )
@@ -123,25 +215,15 @@ void MSG_WriteBits( msg_t *msg, int value, int bits ) {
 			msg->cursize += 4;
 			msg->bit += 32;
 		} else {
-			Com_Error(ERR_DROP, "can't write %d bits", bits);
+			MSG_WriteError( msg, "can't write %d bits", bits );
+			return;
 		}
 	} else {
 		value &= (0xffffffff>>(32-bits));
-		if ( bits & 7 ) {
-			int nbits;
-			nbits = bits&7;
-			for ( i = 0; i < nbits ; i++ ) {
-				HuffmanPutBit( msg->data, msg->bit, (value & 1) );
-				msg->bit++;
-				value = (value>>1);
-			}
-			bits = bits - nbits;
-		}
-		if ( bits ) {
-			for( i = 0 ; i < bits ; i += 8 ) {
-				msg->bit += HuffmanPutSymbol( msg->data, msg->bit, (value & 0xFF) );
-				value = (value>>8);
-			}
+		if ( MSG_WORD_ACCESS( msg ) ) {
+			msg->bit += HuffmanPutBits( msg->data, msg->bit, value, bits );
+		} else {
+			msg->bit = MSG_PutBitsRef( msg->data, msg->bit, value, bits );
 		}
 		msg->cursize = (msg->bit>>3)+1;
 	}
@@ -152,11 +234,60 @@ void MSG_WriteBits( msg_t *msg, int value, int bits ) {
 }
 
 
+/*
+=================
+MSG_WriteBitString
+
+Appends bits that were written into another bitstream message starting
+from bit zero, the result is identical to repeating the original writes.
+Unused bits of the last source byte must be zero, which is always true
+for data produced by MSG_WriteBits()
+=================
+*/
+void MSG_WriteBitString( msg_t *msg, const byte *data, int bits ) {
+	byte	*out;
+	int		i, n;
+	int		shift;
+
+	if ( msg->oob ) {
+		Com_Error( ERR_DROP, "MSG_WriteBitString: can't write to OOB message" );
+	}
+
+	if ( msg->overflowed != qfalse || bits <= 0 )
+		return;
+
+	if ( msg->bit + bits > msg->maxbits ) {
+		msg->overflowed = qtrue;
+		return;
+	}
+
+	out = msg->data + ( msg->bit >> 3 );
+	shift = msg->bit & 7;
+
+	if ( shift == 0 ) {
+		Com_Memcpy( out, data, ( bits + 7 ) >> 3 );
+	} else {
+		// current byte is partially filled, next ones start fresh
+		n = ( bits + 7 ) >> 3;
+		out[ 0 ] |= data[ 0 ] << shift;
+		for ( i = 1; i < n; i++ ) {
+			out[ i ] = ( data[ i - 1 ] >> ( 8 - shift ) ) | ( data[ i ] << shift );
+		}
+		// tail of the last source byte may spill into one more byte
+		if ( ( ( msg->bit + bits - 1 ) >> 3 ) - ( msg->bit >> 3 ) == n ) {
+			out[ n ] = data[ n - 1 ] >> ( 8 - shift );
+		}
+	}
+
+	msg->bit += bits;
+	msg->cursize = ( msg->bit >> 3 ) + 1;
+}
+
+
 static int MSG_ReadBits( msg_t *msg, int bits ) {
 	int		value;
 	qboolean	sgn;
-	int		i;
-	unsigned int	sym;
+	uint32_t	v;
 	const byte *buffer = msg->data; // dereference optimization
 
 	if ( msg->bit >= msg->maxbits )
@@ -195,26 +326,13 @@ static int MSG_ReadBits( msg_t *msg, int bits ) {
 		else
 			Com_Error( ERR_DROP, "can't read %d bits", bits );
 	} else {
-		const int nbits = bits & 7;
-		int bitIndex = msg->bit; // dereference optimization
-		if ( nbits )
-		{		
-			for ( i = 0; i < nbits; i++ ) {
-				value |= HuffmanGetBit( buffer, bitIndex ) << i;
-				bitIndex++;
-			}
-			bits -= nbits;
-		}
-		if ( bits )
-		{
-			for ( i = 0; i < bits; i += 8 )
-			{
-				bitIndex += HuffmanGetSymbol( &sym, buffer, bitIndex );
-				value |= ( sym << (i+nbits) );
-			}
+		if ( MSG_WORD_ACCESS( msg ) ) {
+			msg->bit += HuffmanGetBits( &v, buffer, msg->bit, bits );
+			value = v;
+		} else {
+			value = MSG_GetBitsRef( buffer, &msg->bit, bits );
 		}
-		msg->bit = bitIndex;
-		msg->readcount = (bitIndex >> 3) + 1;
+		msg->readcount = (msg->bit >> 3) + 1;
 	}
 
 	if ( sgn && bits < 32 ) {
@@ -733,6 +851,73 @@ static const netField_t entityStateFields[] =
 };
 
 
+// struct word index -> netField index, used to turn changed words into changed fields
+static byte entityWordField[ sizeof( entityState_t ) / 4 ];
+static uint64_t entityFieldWords;
+static byte playerWordField[ sizeof( playerState_t ) / 4 ];
+static uint64_t playerFieldWords[ 2 ];
+
+typedef char msgWordMaskCheck[ ( sizeof( entityState_t ) <= 64*4 && sizeof( playerState_t ) <= 128*4 ) ? 1 : -1 ];
+
+
+static ID_INLINE int MSG_LowestBit( uint64_t v ) {
+#if defined( _MSC_VER ) && ( idx64 || arm64 )
+	unsigned long i;
+	_BitScanForward64( &i, v );
+	return (int)i;
+#elif defined( __GNUC__ )
+	return __builtin_ctzll( v );
+#else
+	int i;
+	for ( i = 0; !( v & 1 ); i++ )
+		v >>= 1;
+	return i;
+#endif
+}
+
+
+/*
+=================
+MSG_ChangedWords
+
+Sets bit N in mask when N-th 32-bit word differs, mask must be cleared by caller
+=================
+*/
+static void MSG_ChangedWords( const int *a, const int *b, int words, uint64_t *mask ) {
+	int i = 0;
+#if idx64
+	__m128i eq;
+	for ( ; i + 4 <= words; i += 4 ) {
+		eq = _mm_cmpeq_epi32( _mm_loadu_si128( (const __m128i *)( a + i ) ), _mm_loadu_si128( (const __m128i *)( b + i ) ) );
+		mask[ i >> 6 ] |= (uint64_t)( _mm_movemask_ps( _mm_castsi128_ps( eq ) ) ^ 15 ) << ( i & 63 );
+	}
+#elif arm64
+	static const uint32_t lanes[4] = { 1, 2, 4, 8 };
+	const uint32x4_t lane = vld1q_u32( lanes );
+	uint32x4_t ne;
+	for ( ; i + 4 <= words; i += 4 ) {
+		ne = vmvnq_u32( vceqq_u32( vld1q_u32( (const uint32_t *)a + i ), vld1q_u32( (const uint32_t *)b + i ) ) );
+		mask[ i >> 6 ] |= (uint64_t)vaddvq_u32( vandq_u32( ne, lane ) ) << ( i & 63 );
+	}
+#endif
+	for ( ; i < words; i++ ) {
+		if ( a[i] != b[i] ) {
+			mask[ i >> 6 ] |= 1ULL << ( i & 63 );
+		}
+	}
+}
+
+
+// extracts up to 32 bits of word mask starting from first
+static ID_INLINE int MSG_MaskBits( const uint64_t *mask, int first, int count ) {
+	uint64_t v = mask[ first >> 6 ] >> ( first & 63 );
+	if ( ( first & 63 ) + count > 64 ) {
+		v |= mask[ ( first >> 6 ) + 1 ] << ( 64 - ( first & 63 ) );
+	}
+	return (int)( v & ( ( 1ULL << count ) - 1 ) );
+}
+
+
 // if (int)f == f and (int)f + ( 1<<(FLOAT_INT_BITS-1) ) < ( 1 << FLOAT_INT_BITS )
 // the float will be sent with FLOAT_INT_BITS, otherwise all 32 bits will be sent
 #define	FLOAT_INT_BITS	13
@@ -751,19 +936,17 @@ identical, under the assumption that the in-order delta code will catch it.
 */
 void MSG_WriteDeltaEntity( msg_t *msg, const entityState_t *from, const entityState_t *to, qboolean force ) {
 	int			i, lc;
-	int			numFields;
 	const netField_t *field;
 	int			trunc;
 	float		fullFloat;
-	const int	*fromF, *toF;
-
-	numFields = ARRAY_LEN( entityStateFields );
+	const int	*toF;
+	uint64_t	changed, changedFields;
 
 	// all fields should be 32 bits to avoid any compiler packing issues
 	// the "number" field is not part of the field list
 	// if this assert fails, someone added a field to the entityState_t
 	// struct without updating the message fields
-	assert( numFields + 1 == sizeof( *from )/4 );
+	assert( ARRAY_LEN( entityStateFields ) + 1 == sizeof( *from )/4 );
 
 	// a NULL to is a delta remove message
 	if ( to == NULL ) {
@@ -776,15 +959,22 @@ void MSG_WriteDeltaEntity( msg_t *msg, const entityState_t *from, const entitySt
 	}
 
 	if ( to->number < 0 || to->number >= MAX_GENTITIES ) {
-		Com_Error( ERR_DROP, "MSG_WriteDeltaEntity: Bad entity number: %i", to->number );
+		MSG_WriteError( msg, "MSG_WriteDeltaEntity: Bad entity number: %i", to->number );
+		return;
 	}
 
+	// compare whole structs, then map changed words to fields
+	changed = 0;
+	MSG_ChangedWords( (const int *)from, (const int *)to, ARRAY_LEN( entityWordField ), &changed );
+	changed &= entityFieldWords;
+
 	lc = 0;
-	// build the change vector as bytes so it is endian independent
-	for ( i = 0, field = entityStateFields ; i < numFields ; i++, field++ ) {
-		fromF = (int *)( (byte *)from + field->offset );
-		toF = (int *)( (byte *)to + field->offset );
-		if ( *fromF != *toF ) {
+	changedFields = 0;
+	while ( changed ) {
+		i = entityWordField[ MSG_LowestBit( changed ) ];
+		changed &= changed - 1;
+		changedFields |= 1ULL << i;
+		if ( i >= lc ) {
 			lc = i+1;
 		}
 	}
@@ -808,14 +998,13 @@ void MSG_WriteDeltaEntity( msg_t *msg, const entityState_t *from, const entitySt
 	MSG_WriteByte( msg, lc );	// # of changes
 
 	for ( i = 0, field = entityStateFields ; i < lc ; i++, field++ ) {
-		fromF = (int *)( (byte *)from + field->offset );
-		toF = (int *)( (byte *)to + field->offset );
-
-		if ( *fromF == *toF ) {
+		if ( !( changedFields & ( 1ULL << i ) ) ) {
 			MSG_WriteBits( msg, 0, 1 );	// no change
 			continue;
 		}
 
+		toF = (int *)( (byte *)to + field->offset );
+
 		MSG_WriteBits( msg, 1, 1 );	// changed
 
 		if ( field->bits == 0 ) {
@@ -1048,6 +1237,31 @@ static const netField_t playerStateFields[] =
 { PSF(loopSound), 16 }
 };
 
+/*
+=================
+MSG_InitTables
+=================
+*/
+void MSG_InitTables( void ) {
+	const netField_t *field;
+	int i, w;
+
+	HuffmanInit();
+
+	for ( i = 0, field = entityStateFields; i < ARRAY_LEN( entityStateFields ); i++, field++ ) {
+		w = field->offset / 4;
+		entityWordField[ w ] = i;
+		entityFieldWords |= 1ULL << w;
+	}
+
+	for ( i = 0, field = playerStateFields; i < ARRAY_LEN( playerStateFields ); i++, field++ ) {
+		w = field->offset / 4;
+		playerWordField[ w ] = i;
+		playerFieldWords[ w >> 6 ] |= 1ULL << ( w & 63 );
+	}
+}
+
+
 /*
 =============
 MSG_WriteDeltaPlayerstate
@@ -1061,38 +1275,44 @@ void MSG_WriteDeltaPlayerstate( msg_t *msg, const playerState_t *from, const pla
 	int				persistantbits;
 	int				ammobits;
 	int				powerupbits;
-	int				numFields;
 	const netField_t *field;
-	const int		*fromF, *toF;
+	const int		*toF;
 	float			fullFloat;
-	int				trunc, lc;
+	int				trunc, lc, n;
+	uint64_t		changed[2], m, changedFields;
 
 	if ( !from ) {
 		from = &dummy;
 	}
 
-	numFields = ARRAY_LEN( playerStateFields );
+	// compare whole structs, then map changed words to fields
+	changed[0] = changed[1] = 0;
+	MSG_ChangedWords( (const int *)from, (const int *)to, ARRAY_LEN( playerWordField ), changed );
 
 	lc = 0;
-	for ( i = 0, field = playerStateFields ; i < numFields ; i++, field++ ) {
-		fromF = (const int *)( (byte *)from + field->offset );
-		toF = (const int *)( (byte *)to + field->offset );
-		if ( *fromF != *toF ) {
-			lc = i+1;
+	changedFields = 0;
+	for ( n = 0; n < 2; n++ ) {
+		m = changed[n] & playerFieldWords[n];
+		while ( m ) {
+			i = playerWordField[ n * 64 + MSG_LowestBit( m ) ];
+			m &= m - 1;
+			changedFields |= 1ULL << i;
+			if ( i >= lc ) {
+				lc = i+1;
+			}
 		}
 	}
 
 	MSG_WriteByte( msg, lc );	// # of changes
 
 	for ( i = 0, field = playerStateFields ; i < lc ; i++, field++ ) {
-		fromF = (const int *)( (byte *)from + field->offset );
-		toF = (const int *)( (byte *)to + field->offset );
-
-		if ( *fromF == *toF ) {
+		if ( !( changedFields & ( 1ULL << i ) ) ) {
 			MSG_WriteBits( msg, 0, 1 );	// no change
 			continue;
 		}
 
+		toF = (const int *)( (byte *)to + field->offset );
+
 		MSG_WriteBits( msg, 1, 1 );	// changed
 //		pcount[i]++;
 
@@ -1121,30 +1341,10 @@ void MSG_WriteDeltaPlayerstate( msg_t *msg, const playerState_t *from, const pla
 	//
 	// send the arrays
 	//
-	statsbits = 0;
-	for (i=0 ; i<MAX_STATS ; i++) {
-		if (to->stats[i] != from->stats[i]) {
-			statsbits |= 1<<i;
-		}
-	}
-	persistantbits = 0;
-	for (i=0 ; i<MAX_PERSISTANT ; i++) {
-		if (to->persistant[i] != from->persistant[i]) {
-			persistantbits |= 1<<i;
-		}
-	}
-	ammobits = 0;
-	for (i=0 ; i<MAX_WEAPONS ; i++) {
-		if (to->ammo[i] != from->ammo[i]) {
-			ammobits |= 1<<i;
-		}
-	}
-	powerupbits = 0;
-	for (i=0 ; i<MAX_POWERUPS ; i++) {
-		if (to->powerups[i] != from->powerups[i]) {
-			powerupbits |= 1<<i;
-		}
-	}
+	statsbits = MSG_MaskBits( changed, offsetof( playerState_t, stats ) / 4, MAX_STATS );
+	persistantbits = MSG_MaskBits( changed, offsetof( playerState_t, persistant ) / 4, MAX_PERSISTANT );
+	ammobits = MSG_MaskBits( changed, offsetof( playerState_t, ammo ) / 4, MAX_WEAPONS );
+	powerupbits = MSG_MaskBits( changed, offsetof( playerState_t, powerups ) / 4, MAX_POWERUPS );
 
 	if (!statsbits && !persistantbits && !ammobits && !powerupbits) {
 		MSG_WriteBits( msg, 0, 1 );	// no change
@@ -1347,3 +1547,334 @@ void MSG_ReadDeltaPlayerstate( msg_t *msg, const playerState_t *from, playerStat
 }
 
 //===========================================================================
+
+
+/*
+=============================================================================
+
+huffman codec benchmark
+
+=============================================================================
+*/
+
+#define MSGBENCH_MAX_MSGS	1024
+#define MSGBENCH_MAX_DATA	(4*1024*1024)
+#define MSGBENCH_MAX_OPS	(512*1024)
+
+typedef struct {
+	int		value;
+	int		bits;
+} msgBenchOp_t;
+
+typedef struct {
+	int		offset;		// in data
+	int		length;		// in bytes
+	int		firstOp;
+	int		numOps;
+} msgBenchMsg_t;
+
+typedef struct {
+	msgBenchMsg_t	msgs[ MSGBENCH_MAX_MSGS ];
+	int				numMsgs;
+	byte			*data;
+	int				dataSize;
+	msgBenchOp_t	*ops;
+	int				numOps;
+	int				seed;
+} msgBench_t;
+
+
+static void MSG_WriteBitsRef( msg_t *msg, int value, int bits ) {
+	if ( bits < 0 ) {
+		bits = -bits;
+	}
+	value &= (0xffffffff>>(32-bits));
+	msg->bit = MSG_PutBitsRef( msg->data, msg->bit, value, bits );
+	msg->cursize = (msg->bit>>3)+1;
+}
+
+
+static int MSG_ReadBitsRef( msg_t *msg, int bits ) {
+	int value;
+
+	if ( bits < 0 ) {
+		value = MSG_GetBitsRef( msg->data, &msg->bit, -bits );
+		if ( bits > -32 && ( value & ( 1 << ( -bits - 1 ) ) ) ) {
+			value |= -1 ^ ( ( 1 << -bits ) - 1 );
+		}
+	} else {
+		value = MSG_GetBitsRef( msg->data, &msg->bit, bits );
+	}
+	msg->readcount = (msg->bit>>3)+1;
+
+	return value;
+}
+
+
+// field widths as used by netfield tables and MSG_Write* functions
+static int MSG_BenchRandomBits( int *seed ) {
+	static const int widths[] = { 1, 1, 1, 8, 8, 8, -8, 16, -16, 32, 32, GENTITYNUM_BITS, FLOAT_INT_BITS, 19, 24, MAX_POWERUPS };
+	int bits = widths[ Q_rand( seed ) % ARRAY_LEN( widths ) ];
+	// and some arbitrary ones
+	if ( ( Q_rand( seed ) & 7 ) == 0 ) {
+		bits = 1 + Q_rand( seed ) % 32;
+		if ( bits < 32 && bits >= 8 && ( bits & 7 ) == 0 && ( Q_rand( seed ) & 1 ) ) {
+			bits = -bits;
+		}
+	}
+	return bits;
+}
+
+
+/*
+=================
+MSG_BenchLoadDemo
+
+Loads raw server messages from demo file, field widths are random
+since only the symbol stream matters for the codec
+=================
+*/
+static void MSG_BenchLoadDemo( msgBench_t *mb, const char *name ) {
+	fileHandle_t	f;
+	msgBenchMsg_t	*m;
+	msg_t			msg;
+	int				header[2], len;
+
+	if ( FS_FOpenFileRead( name, &f, qtrue ) < 0 || f == FS_INVALID_HANDLE ) {
+		Com_Printf( "msgbench: couldn't open %s\n", name );
+		return;
+	}
+
+	while ( mb->numMsgs < MSGBENCH_MAX_MSGS ) {
+		if ( FS_Read( header, sizeof( header ), f ) != sizeof( header ) )
+			break;
+		len = LittleLong( header[1] );
+		if ( len <= 0 || len > MAX_MSGLEN || mb->dataSize + len > MSGBENCH_MAX_DATA - 16 )
+			break;
+		m = &mb->msgs[ mb->numMsgs ];
+		m->offset = mb->dataSize;
+		m->length = len;
+		if ( FS_Read( mb->data + m->offset, len, f ) != len )
+			break;
+
+		// split into fields
+		MSG_Init( &msg, mb->data + m->offset, len );
+		msg.cursize = len;
+		m->firstOp = mb->numOps;
+		while ( msg.bit < len * 8 - 32 && mb->numOps < MSGBENCH_MAX_OPS ) {
+			mb->ops[ mb->numOps ].bits = MSG_BenchRandomBits( &mb->seed );
+			mb->ops[ mb->numOps ].value = MSG_ReadBitsRef( &msg, mb->ops[ mb->numOps ].bits );
+			mb->numOps++;
+		}
+		m->numOps = mb->numOps - m->firstOp;
+		mb->dataSize += len;
+		mb->numMsgs++;
+	}
+
+	FS_FCloseFile( f );
+}
+
+
+/*
+=================
+MSG_BenchSynthesize
+
+Generates snapshot-like messages: mostly small values and changed-field bits
+=================
+*/
+static void MSG_BenchSynthesize( msgBench_t *mb ) {
+	msgBenchMsg_t	*m;
+	msgBenchOp_t	*op;
+	msg_t			msg;
+	int				bits, r;
+
+	while ( mb->numMsgs < 256 ) {
+		m = &mb->msgs[ mb->numMsgs ];
+		m->offset = mb->dataSize;
+		m->firstOp = mb->numOps;
+		MSG_Init( &msg, mb->data + m->offset, 1400 );
+		while ( msg.bit < 1400 * 8 - 64 && mb->numOps < MSGBENCH_MAX_OPS ) {
+			op = &mb->ops[ mb->numOps++ ];
+			bits = MSG_BenchRandomBits( &mb->seed );
+			r = Q_rand( &mb->seed );
+			switch ( r & 3 ) {
+				case 0: op->value = 0; break;
+				case 1: op->value = ( r >> 2 ) & 15; break;
+				case 2: op->value = ( r >> 2 ) & 1023; break;
+				default: op->value = Q_rand( &mb->seed ) ^ ( r << 16 ); break;
+			}
+			op->bits = bits;
+			MSG_WriteBitsRef( &msg, op->value, bits );
+		}
+		m->numOps = mb->numOps - m->firstOp;
+		m->length = msg.cursize;
+		mb->dataSize += msg.cursize;
+		mb->numMsgs++;
+	}
+}
+
+
+/*
+=================
+MSG_BenchVerify
+
+Compares output of both codecs at random starting bit offsets,
+returns number of mismatches
+=================
+*/
+static int MSG_BenchVerify( msgBench_t *mb ) {
+	static byte		buf[2][ MAX_MSGLEN_BUF * 2 ];
+	const msgBenchMsg_t	*m;
+	const msgBenchOp_t	*op;
+	msg_t			msg[2];
+	int				i, n, prefix, v[2], errors;
+
+	errors = 0;
+
+	for ( i = 0, m = mb->msgs; i < mb->numMsgs; i++, m++ ) {
+		// fill with garbage to catch stray writes
+		Com_Memset( buf[0], i, sizeof( buf[0] ) );
+		Com_Memset( buf[1], i, sizeof( buf[1] ) );
+
+		// leave little room sometimes so bytewise tail path is covered
+		n = ( i & 3 ) ? MAX_MSGLEN : ( m->length + 8 + 4 );
+		MSG_Init( &msg[0], buf[0], n );
+		MSG_Init( &msg[1], buf[1], n );
+
+		prefix = Q_rand( &mb->seed ) % 64;
+		for ( n = 0; n < prefix; n++ ) {
+			MSG_WriteBits( &msg[0], n & 1, 1 );
+			MSG_WriteBitsRef( &msg[1], n & 1, 1 );
+		}
+
+		for ( n = 0, op = mb->ops + m->firstOp; n < m->numOps; n++, op++ ) {
+			MSG_WriteBits( &msg[0], op->value, op->bits );
+			MSG_WriteBitsRef( &msg[1], op->value, op->bits );
+		}
+
+		// byte after the last one with written bits is included in cursize but not defined
+		if ( msg[0].bit != msg[1].bit || msg[0].cursize != msg[1].cursize || memcmp( buf[0], buf[1], ( msg[0].bit + 7 ) >> 3 ) ) {
+			Com_Printf( S_COLOR_YELLOW "msgbench: message %i encoded differently\n", i );
+			errors++;
+			continue;
+		}
+
+		// read back
+		msg[0].readcount = msg[0].bit = 0;
+		msg[1].readcount = msg[1].bit = 0;
+		msg[1].maxbits = msg[0].maxbits = msg[0].cursize * 8;
+		for ( n = 0; n < prefix; n++ ) {
+			MSG_ReadBits( &msg[0], 1 );
+			MSG_ReadBitsRef( &msg[1], 1 );
+		}
+		for ( n = 0, op = mb->ops + m->firstOp; n < m->numOps; n++, op++ ) {
+			v[0] = MSG_ReadBits( &msg[0], op->bits );
+			v[1] = MSG_ReadBitsRef( &msg[1], op->bits );
+			if ( v[0] != v[1] || msg[0].bit != msg[1].bit ) {
+				break;
+			}
+		}
+		if ( n != m->numOps ) {
+			Com_Printf( S_COLOR_YELLOW "msgbench: message %i field %i decoded differently\n", i, n );
+			errors++;
+		}
+	}
+
+	return errors;
+}
+
+
+/*
+=================
+MSG_Bench_f
+
+msgbench [demo file] [iterations]
+Verifies and times word-at-a-time huffman codec against bit-at-a-time one
+on messages from a demo or on synthetic snapshot-like ones
+=================
+*/
+void MSG_Bench_f( void ) {
+	static byte		buf[ MAX_MSGLEN_BUF ];
+	msgBench_t		*mb;
+	const msgBenchMsg_t	*m;
+	const msgBenchOp_t	*op;
+	msg_t			msg;
+	int64_t			t[2][2];
+	int				codec, iterations, errors, i, n, k;
+	const char		*arg;
+
+	mb = Z_Malloc( sizeof( *mb ) );
+	mb->data = Z_Malloc( MSGBENCH_MAX_DATA );
+	mb->ops = Z_Malloc( MSGBENCH_MAX_OPS * sizeof( mb->ops[0] ) );
+	mb->seed = 0x1234;
+
+	iterations = 20;
+	arg = Cmd_Argv( 1 );
+	if ( *arg && !Q_isanumber( arg ) ) {
+		MSG_BenchLoadDemo( mb, arg );
+		arg = Cmd_Argv( 2 );
+	} else {
+		MSG_BenchSynthesize( mb );
+	}
+	if ( *arg ) {
+		iterations = atoi( arg );
+		if ( iterations < 1 ) {
+			iterations = 1;
+		}
+	}
+
+	if ( !mb->numMsgs ) {
+		Com_Printf( "usage: msgbench [demo] [iterations]\n" );
+		goto done;
+	}
+
+	errors = 0;
+	for ( i = 0; i < 4; i++ ) {
+		errors += MSG_BenchVerify( mb );
+	}
+
+	for ( codec = 0; codec < 2; codec++ ) {
+		t[codec][0] = t[codec][1] = 0;
+		for ( k = 0; k < iterations; k++ ) {
+			for ( i = 0, m = mb->msgs; i < mb->numMsgs; i++, m++ ) {
+				MSG_Init( &msg, buf, MAX_MSGLEN );
+				op = mb->ops + m->firstOp;
+				t[codec][0] -= Sys_Microseconds();
+				if ( codec == 0 ) {
+					for ( n = 0; n < m->numOps; n++, op++ )
+						MSG_WriteBits( &msg, op->value, op->bits );
+				} else {
+					for ( n = 0; n < m->numOps; n++, op++ )
+						MSG_WriteBitsRef( &msg, op->value, op->bits );
+				}
+				t[codec][0] += Sys_Microseconds();
+
+				MSG_Init( &msg, mb->data + m->offset, MAX_MSGLEN );
+				op = mb->ops + m->firstOp;
+				t[codec][1] -= Sys_Microseconds();
+				if ( codec == 0 ) {
+					for ( n = 0; n < m->numOps; n++, op++ )
+						MSG_ReadBits( &msg, op->bits );
+				} else {
+					for ( n = 0; n < m->numOps; n++, op++ )
+						MSG_ReadBitsRef( &msg, op->bits );
+				}
+				t[codec][1] += Sys_Microseconds();
+			}
+		}
+	}
+
+	Com_Printf( "%i messages, %i fields, %i bytes, %i iterations:\n", mb->numMsgs, mb->numOps, mb->dataSize, iterations );
+	Com_Printf( " word: write %.2fms read %.2fms\n", (double)t[0][0] / ( iterations * 1000 ), (double)t[0][1] / ( iterations * 1000 ) );
+	Com_Printf( " bit:  write %.2fms read %.2fms\n", (double)t[1][0] / ( iterations * 1000 ), (double)t[1][1] / ( iterations * 1000 ) );
+	if ( errors ) {
+		Com_Printf( S_COLOR_YELLOW "WARNING: %i mismatches between codecs\n", errors );
+	} else {
+		Com_Printf( "output is identical\n" );
+	}
+
+done:
+	Z_Free( mb->ops );
+	Z_Free( mb->data );
+	Z_Free( mb );
+}
@@ -0,0 +1,511 @@
+// server message parser for headless clients
+
+#include "q_shared.h"
+#include "qcommon.h"
+#include "../game/g_public.h"
+
+/*
+=============================================================================
+
+Decodes server messages the same way as client/cl_parse.c, but keeps all
+state in msgParser_t, so the load generator can run many connections and
+the relay can keep its own delta sources and entity flags. Owner handles
+the netchan and passes decoded data to its game state through the sinks.
+
+=============================================================================
+*/
+
+static playerState_t skippedPlayerState;	// svc_relay player states nobody keeps
+
+
+/*
+=================
+MSG_ParserDrop
+=================
+*/
+static qboolean MSG_ParserDrop( msgParser_t *p, const char *reason )
+{
+	p->drop( p, reason );
+
+	return qfalse;
+}
+
+
+/*
+=================
+MSG_ParserConnect
+
+Resets sequences for new netchan
+=================
+*/
+void MSG_ParserConnect( msgParser_t *p )
+{
+	p->serverMessageSequence = 0;
+	p->serverCommandSequence = 0;
+	p->reliableSequence = 0;
+	p->reliableAcknowledge = 0;
+}
+
+
+/*
+=================
+MSG_ParserCommandKey
+
+Key for MSG_WriteDeltaUsercmdKey() of next client message
+=================
+*/
+int MSG_ParserCommandKey( const msgParser_t *p )
+{
+	int key;
+
+	key = p->checksumFeed;
+	key ^= p->serverMessageSequence;
+	key ^= p->commandKeys[ p->serverCommandSequence & ( MAX_RELIABLE_COMMANDS - 1 ) ];
+
+	return key;
+}
+
+
+/*
+=================
+MSG_ParseCommandString
+=================
+*/
+static qboolean MSG_ParseCommandString( msgParser_t *p, msg_t *msg )
+{
+	const char *s, *cmd;
+	int seq, index;
+
+	seq = MSG_ReadLong( msg );
+	s = MSG_ReadString( msg );
+
+	// see if we have already received it
+	if ( p->serverCommandSequence - seq >= 0 ) {
+		return qtrue;
+	}
+	p->serverCommandSequence = seq;
+
+	// only hash is needed to encode usercmds
+	p->commandKeys[ seq & ( MAX_RELIABLE_COMMANDS - 1 ) ] = MSG_HashKey( s, 32 );
+
+	Cmd_TokenizeString( s );
+	cmd = Cmd_Argv( 0 );
+
+	if ( !strcmp( cmd, "disconnect" ) ) {
+		return MSG_ParserDrop( p, Cmd_Argc() > 1 ? va( "server disconnected - %s", Cmd_Argv( 1 ) ) : "server disconnected" );
+	}
+
+	if ( !strcmp( cmd, "cs" ) ) {
+		// headless clients declare long strings support so "bcs" is never sent
+		index = atoi( Cmd_Argv( 1 ) );
+		if ( (unsigned) index < MAX_CONFIGSTRINGS && p->configstring ) {
+			p->configstring( p, index, Cmd_ArgsFrom( 2 ) );
+		}
+	} else if ( p->command ) {
+		p->command( p, s );
+	}
+
+	return qtrue;
+}
+
+
+/*
+=================
+MSG_ParseGamestate
+=================
+*/
+static qboolean MSG_ParseGamestate( msgParser_t *p, msg_t *msg )
+{
+	entityState_t nullstate;
+	const char *s;
+	int cmd, i, next;
+
+	Com_Memset( &nullstate, 0, sizeof( nullstate ) );
+
+	// a gamestate always marks a server command sequence
+	p->serverCommandSequence = MSG_ReadLong( msg );
+
+	// server sends configstrings in ascending order
+	next = 0;
+
+	while ( 1 ) {
+		cmd = MSG_ReadByte( msg );
+
+		if ( cmd == svc_EOF ) {
+			break;
+		}
+
+		if ( cmd == svc_configstring ) {
+			i = MSG_ReadShort( msg );
+			if ( i < 0 || i >= MAX_CONFIGSTRINGS ) {
+				return MSG_ParserDrop( p, "configstring > MAX_CONFIGSTRINGS" );
+			}
+			s = MSG_ReadBigString( msg );
+			if ( p->configstring ) {
+				for ( ; next < i; next++ ) {
+					p->configstring( p, next, "" );
+				}
+				p->configstring( p, i, s );
+			}
+			if ( next <= i ) {
+				next = i + 1;
+			}
+		} else if ( cmd == svc_baseline ) {
+			i = MSG_ReadEntitynum( msg );
+			if ( i < 0 || i >= MAX_GENTITIES ) {
+				return MSG_ParserDrop( p, "baseline number out of range" );
+			}
+			MSG_ReadDeltaEntity( msg, &nullstate, &p->baselines[ i ], i );
+		} else {
+			return MSG_ParserDrop( p, "bad gamestate command byte" );
+		}
+	}
+
+	if ( p->configstring ) {
+		for ( ; next < MAX_CONFIGSTRINGS; next++ ) {
+			p->configstring( p, next, "" );
+		}
+	}
+
+	p->clientNum = MSG_ReadLong( msg );
+	p->checksumFeed = MSG_ReadLong( msg );
+
+	if ( (unsigned) p->clientNum >= MAX_SERVER_CLIENTS ) {
+		return MSG_ParserDrop( p, "bad client number" );
+	}
+
+	// wipe all delta sources
+	for ( i = 0; i < PACKET_BACKUP; i++ ) {
+		p->snapshots[ i ].valid = qfalse;
+	}
+	p->snap = NULL;
+	p->parseEntitiesNum = 0;
+
+	if ( p->gamestate ) {
+		p->gamestate( p );
+	}
+
+	return qtrue;
+}
+
+
+/*
+=================
+MSG_ParseDeltaEntity
+=================
+*/
+static void MSG_ParseDeltaEntity( msgParser_t *p, msg_t *msg, parseSnapshot_t *frame, int newnum, const entityState_t *old, qboolean unchanged )
+{
+	entityState_t *state;
+	int index;
+
+	index = p->parseEntitiesNum & p->parseEntitiesMask;
+	state = &p->parseEntities[ index ];
+
+	if ( unchanged ) {
+		*state = *old;
+	} else {
+		MSG_ReadDeltaEntity( msg, old, state, newnum );
+	}
+
+	if ( state->number == ( MAX_GENTITIES - 1 ) ) {
+		return; // entity was delta removed
+	}
+
+	// may be set by svc_relay
+	if ( p->entity ) {
+		p->entity( p, index, 0, 0 );
+	}
+
+	p->parseEntitiesNum++;
+	frame->numEntities++;
+}
+
+
+/*
+=================
+MSG_ParseOldEntity
+=================
+*/
+static const entityState_t *MSG_ParseOldEntity( const msgParser_t *p, const parseSnapshot_t *oldframe, int oldindex, int *oldnum )
+{
+	const entityState_t *oldstate;
+
+	if ( !oldframe || oldindex >= oldframe->numEntities ) {
+		*oldnum = MAX_GENTITIES + 1;
+		return NULL;
+	}
+
+	oldstate = &p->parseEntities[ ( oldframe->parseEntitiesNum + oldindex ) & p->parseEntitiesMask ];
+	*oldnum = oldstate->number;
+
+	return oldstate;
+}
+
+
+/*
+=================
+MSG_ParsePacketEntities
+=================
+*/
+static qboolean MSG_ParsePacketEntities( msgParser_t *p, msg_t *msg, const parseSnapshot_t *oldframe, parseSnapshot_t *newframe )
+{
+	const entityState_t *oldstate;
+	int newnum, oldnum, oldindex;
+
+	newframe->parseEntitiesNum = p->parseEntitiesNum;
+	newframe->numEntities = 0;
+
+	oldindex = 0;
+	oldstate = MSG_ParseOldEntity( p, oldframe, oldindex, &oldnum );
+
+	while ( 1 ) {
+		newnum = MSG_ReadEntitynum( msg );
+
+		if ( newnum < 0 ) {
+			return MSG_ParserDrop( p, "end of message in packet entities" );
+		}
+
+		if ( newnum == ( MAX_GENTITIES - 1 ) ) {
+			break;
+		}
+
+		// one or more entities from the old packet are unchanged
+		while ( oldnum < newnum ) {
+			MSG_ParseDeltaEntity( p, msg, newframe, oldnum, oldstate, qtrue );
+			oldstate = MSG_ParseOldEntity( p, oldframe, ++oldindex, &oldnum );
+		}
+
+		if ( oldnum == newnum ) {
+			// delta from previous state
+			MSG_ParseDeltaEntity( p, msg, newframe, newnum, oldstate, qfalse );
+			oldstate = MSG_ParseOldEntity( p, oldframe, ++oldindex, &oldnum );
+		} else {
+			// delta from baseline
+			MSG_ParseDeltaEntity( p, msg, newframe, newnum, &p->baselines[ newnum ], qfalse );
+		}
+	}
+
+	// any remaining entities in the old frame are copied over
+	while ( oldnum != MAX_GENTITIES + 1 ) {
+		MSG_ParseDeltaEntity( p, msg, newframe, oldnum, oldstate, qtrue );
+		oldstate = MSG_ParseOldEntity( p, oldframe, ++oldindex, &oldnum );
+	}
+
+	return qtrue;
+}
+
+
+/*
+=================
+MSG_ParseSnapshot
+=================
+*/
+static qboolean MSG_ParseSnapshot( msgParser_t *p, msg_t *msg )
+{
+	const parseSnapshot_t *old;
+	parseSnapshot_t *snap;
+	byte areamask[ MAX_MAP_AREA_BYTES ];
+	int deltaNum, areabytes, serverTime, messageNum;
+	int i, n, oldMessageNum;
+
+	serverTime = MSG_ReadLong( msg );
+	messageNum = p->serverMessageSequence;
+
+	deltaNum = MSG_ReadByte( msg );
+	MSG_ReadByte( msg ); // snapFlags
+
+	// the delta source may be lost, read the frame anyway
+	// but keep it out of the snapshot ring
+	snap = &p->snapshots[ messageNum & PACKET_MASK ];
+	if ( !deltaNum ) {
+		old = NULL;
+	} else {
+		deltaNum = messageNum - deltaNum;
+		old = &p->snapshots[ deltaNum & PACKET_MASK ];
+		if ( !old->valid || old->messageNum != deltaNum || p->parseEntitiesNum - old->parseEntitiesNum > p->parseEntitiesMask + 1 - MAX_SNAPSHOT_ENTITIES ) {
+			snap = &p->scratch;
+		}
+	}
+
+	if ( snap == p->snap ) {
+		p->snap = NULL;
+	}
+
+	snap->valid = qfalse;
+	snap->serverTime = serverTime;
+	snap->messageNum = messageNum;
+
+	areabytes = MSG_ReadByte( msg );
+	if ( areabytes > sizeof( areamask ) ) {
+		return MSG_ParserDrop( p, "invalid areamask size" );
+	}
+	MSG_ReadData( msg, areamask, areabytes );
+
+	MSG_ReadDeltaPlayerstate( msg, old ? &old->ps : NULL, &snap->ps );
+
+	if ( !MSG_ParsePacketEntities( p, msg, old, snap ) ) {
+		return qfalse;
+	}
+
+	// svc_relay follows in the same message
+	p->parsed = snap;
+	p->parsedFrom = old;
+
+	if ( snap != &p->scratch ) {
+		// invalidate frames skipped since the last one
+		oldMessageNum = p->snap ? p->snap->messageNum + 1 : messageNum;
+		if ( messageNum - oldMessageNum >= PACKET_BACKUP ) {
+			oldMessageNum = messageNum - ( PACKET_BACKUP - 1 );
+		}
+		for ( i = 0, n = messageNum - oldMessageNum; i < n; i++ ) {
+			p->snapshots[ ( oldMessageNum + i ) & PACKET_MASK ].valid = qfalse;
+		}
+
+		snap->valid = qtrue;
+		p->snap = snap;
+	}
+
+	if ( p->snapshot ) {
+		p->snapshot( p, snap );
+	}
+
+	return qtrue;
+}
+
+
+/*
+=================
+MSG_ParseRelayInfo
+
+See SV_WriteRelayInfo()
+=================
+*/
+static qboolean MSG_ParseRelayInfo( msgParser_t *p, msg_t *msg )
+{
+	const parseSnapshot_t *snap, *old;
+	const playerState_t *from;
+	playerState_t *to;
+	int i, num, delta, flags, singleClient, index;
+
+	snap = p->parsed;
+	old = p->parsedFrom;
+	if ( !snap ) {
+		return MSG_ParserDrop( p, "svc_relay without snapshot" );
+	}
+	p->parsed = NULL;
+
+	// entity flags are listed in the same order as snapshot entities
+	i = 0;
+	while ( 1 ) {
+		num = MSG_ReadEntitynum( msg );
+		if ( num < 0 ) {
+			return MSG_ParserDrop( p, "end of message in relay info" );
+		}
+		if ( num == MAX_GENTITIES - 1 ) {
+			break;
+		}
+		flags = MSG_ReadLong( msg );
+		if ( flags & ( SVF_SINGLECLIENT | SVF_NOTSINGLECLIENT | SVF_CLIENTMASK ) ) {
+			singleClient = MSG_ReadLong( msg );
+		} else {
+			singleClient = 0;
+		}
+		for ( ; i < snap->numEntities; i++ ) {
+			index = ( snap->parseEntitiesNum + i ) & p->parseEntitiesMask;
+			if ( p->parseEntities[ index ].number >= num ) {
+				if ( p->parseEntities[ index ].number == num && p->entity ) {
+					p->entity( p, index, flags, singleClient );
+				}
+				break;
+			}
+		}
+	}
+
+	// other players
+	while ( 1 ) {
+		num = MSG_ReadShort( msg );
+		if ( num == MAX_SERVER_CLIENTS ) {
+			break;
+		}
+		delta = num & RELAY_PLAYER_DELTA;
+		num &= ~RELAY_PLAYER_DELTA;
+		if ( num < 0 || num >= MAX_SERVER_CLIENTS || msg->readcount > msg->cursize ) {
+			return MSG_ParserDrop( p, "bad player number in relay info" );
+		}
+		from = NULL;
+		to = NULL;
+		if ( snap->valid && p->playerstate ) {
+			if ( delta ) {
+				from = old ? p->playerstate( p, old, num, qfalse ) : NULL;
+				if ( !from ) {
+					// can't happen unless upstream lost track of our frames
+					p->deltaErrors++;
+				}
+			}
+			if ( !delta || from ) {
+				to = p->playerstate( p, snap, num, qtrue );
+			}
+		}
+		// state layout doesn't depend on delta source, so it can be skipped
+		MSG_ReadDeltaPlayerstate( msg, from, to ? to : &skippedPlayerState );
+	}
+
+	return qtrue;
+}
+
+
+/*
+=================
+MSG_ParseServerMessage
+
+Returns qfalse if the owner was dropped
+=================
+*/
+qboolean MSG_ParseServerMessage( msgParser_t *p, msg_t *msg )
+{
+	int cmd, ack;
+
+	MSG_Bitstream( msg );
+
+	// reliable acknowledge
+	ack = MSG_ReadLong( msg );
+	if ( ack - p->reliableAcknowledge > 0 && ack - p->reliableSequence <= 0 ) {
+		p->reliableAcknowledge = ack;
+	}
+
+	p->parsed = NULL;
+
+	while ( 1 ) {
+		if ( msg->readcount > msg->cursize ) {
+			return MSG_ParserDrop( p, "read past end of server message" );
+		}
+
+		cmd = MSG_ReadByte( msg );
+
+		switch ( cmd ) {
+		case svc_EOF:
+			return qtrue;
+		case svc_nop:
+			break;
+		case svc_serverCommand:
+			if ( !MSG_ParseCommandString( p, msg ) )
+				return qfalse;
+			break;
+		case svc_gamestate:
+			if ( !MSG_ParseGamestate( p, msg ) )
+				return qfalse;
+			break;
+		case svc_snapshot:
+			if ( !MSG_ParseSnapshot( p, msg ) )
+				return qfalse;
+			break;
+		case svc_relay:
+			if ( !MSG_ParseRelayInfo( p, msg ) )
+				return qfalse;
+			break;
+		default:
+			return MSG_ParserDrop( p, va( "illegible server message %i", cmd ) );
+		}
+	}
+}
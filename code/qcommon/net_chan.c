@@ -692,6 +692,10 @@ void NET_SendPacket( netsrc_t sock, int length, const void *data, const netadr_t
 	if ( to->type == NA_BAD ) {
 		return;
 	}
+	if ( sock == NS_SERVER && SV_JournalPlaying() ) {
+		// recorded clients are not listening
+		return;
+	}
 #ifndef DEDICATED
 	if ( sock == NS_CLIENT && cl_packetdelay->integer > 0 ) {
 		NET_QueuePacket( sock, length, data, to, cl_packetdelay->integer );
@@ -20,6 +20,10 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 ===========================================================================
 */
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE // recvmmsg(), sendmmsg()
+#endif
+
 #include "../qcommon/q_shared.h"
 #include "../qcommon/qcommon.h"
 
@@ -103,6 +107,13 @@ typedef int	ioctlarg_t;
 
 #endif
 
+#ifdef __linux__
+#define USE_NET_BATCH
+#define USE_EPOLL
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#endif
+
 typedef union {
 	struct sockaddr_in v4;
 	struct sockaddr_in6 v6;
@@ -175,6 +186,8 @@ static cvar_t	*net_mcast6addr;
 static cvar_t	*net_mcast6iface;
 #endif
 static cvar_t	*net_dropsim;
+static cvar_t	*net_batch;
+static cvar_t	*net_epoll;
 
 static sockaddr_t socksRelayAddr;
 
@@ -213,7 +226,45 @@ typedef struct
 static nip_localaddr_t localIP[MAX_IPS];
 static int numIP;
 
+// packets per syscall statistics
+typedef struct {
+	unsigned int	recvCalls;
+	unsigned int	recvPackets;
+	unsigned int	sendCalls;
+	unsigned int	sendPackets;
+} netStats_t;
+
+static netStats_t netStats;
+
+#ifdef USE_NET_BATCH
+#include <sys/uio.h>
+
+#define MAX_NET_BATCH		32
+#define NET_SEND_POOL		(64*1024)
+
+// received datagrams, processed before next recvmmsg() call
+static struct mmsghdr	recvHdr[ MAX_NET_BATCH ];
+static struct iovec		recvIov[ MAX_NET_BATCH ];
+static sockaddr_t		recvFrom[ MAX_NET_BATCH ];
+static byte				recvData[ MAX_NET_BATCH ][ MAX_MSGLEN_BUF ];
+
+// datagrams queued between NET_BeginSendBatch() and NET_FlushSendBatch()
+static struct mmsghdr	sendHdr[ MAX_NET_BATCH ];
+static struct iovec		sendIov[ MAX_NET_BATCH ];
+static sockaddr_t		sendAddr[ MAX_NET_BATCH ];
+static SOCKET			sendSock[ MAX_NET_BATCH ];
+static netadrtype_t		sendType[ MAX_NET_BATCH ];
+static byte				sendPool[ NET_SEND_POOL ];
+static int				sendPoolUsed;
+static int				sendCount;
+static qboolean			sendActive;
+#endif
+
 static void	NET_Restart_f( void );
+static void	NET_Stats_f( void );
+#ifdef USE_EPOLL
+static void	NET_CloseEpoll( void );
+#endif
 
 //=============================================================================
 
@@ -638,126 +689,251 @@ qboolean NET_IsLocalAddress( const netadr_t *adr )
 
 /*
 ==================
-NET_GetPacket
+NET_ProcessPacket
 
-Receive one packet
+Fills net_from and net_message for received datagram,
+returns qfalse if it should be ignored
 ==================
 */
-static qboolean NET_GetPacket( netadr_t *net_from, msg_t *net_message, const fd_set *fdr )
+static qboolean NET_ProcessPacket( SOCKET sock, sockaddr_t *from, socklen_t fromlen, int ret, netadr_t *net_from, msg_t *net_message )
+{
+	if ( sock == ip_socket )
+	{
+		memset( &from->v4.sin_zero, 0, sizeof( from->v4.sin_zero ) );
+
+		if ( usingSocks && memcmp( from, &socksRelayAddr, fromlen ) == 0 ) {
+			if ( ret < 10 || net_message->data[0] != 0 || net_message->data[1] != 0 || net_message->data[2] != 0 || net_message->data[3] != 1 ) {
+				return qfalse;
+			}
+			net_from->type = NA_IP;
+			net_from->ipv._4[0] = net_message->data[4];
+			net_from->ipv._4[1] = net_message->data[5];
+			net_from->ipv._4[2] = net_message->data[6];
+			net_from->ipv._4[3] = net_message->data[7];
+			net_from->port = *(uint16_t *)&net_message->data[8];
+			net_message->readcount = 10;
+		}
+		else {
+			net_from->type = NA_BAD;
+			SockadrToNetadr( from, net_from );
+			net_message->readcount = 0;
+		}
+	}
+	else
+	{
+		net_from->type = NA_BAD;
+		SockadrToNetadr( from, net_from );
+		net_message->readcount = 0;
+	}
+
+	if( ret >= net_message->maxsize ) {
+		Com_Printf( "Oversize packet from %s\n", NET_AdrToString( net_from ) );
+		return qfalse;
+	}
+
+	net_message->cursize = ret;
+	return qtrue;
+}
+
+
+/*
+==================
+NET_RecvFrom
+
+Receive one packet from specified socket,
+returns qfalse if nothing was received
+==================
+*/
+static qboolean NET_RecvFrom( SOCKET sock, netadr_t *net_from, msg_t *net_message, qboolean *received )
 {
 	int 	ret;
 	sockaddr_t	from;
 	socklen_t	fromlen;
 	int		err;
 
-	if(ip_socket != INVALID_SOCKET && FD_ISSET(ip_socket, fdr))
+	fromlen = sizeof(from);
+	ret = recvfrom( sock, (void *)net_message->data, net_message->maxsize, 0, (struct sockaddr *) &from, &fromlen );
+	netStats.recvCalls++;
+
+	if (ret == SOCKET_ERROR)
 	{
-		fromlen = sizeof(from);
-		ret = recvfrom( ip_socket, (void *)net_message->data, net_message->maxsize, 0, (struct sockaddr *) &from, &fromlen );
+		err = socketError;
 
-		if (ret == SOCKET_ERROR)
-		{
-			err = socketError;
+		if( err != EAGAIN && err != ECONNRESET )
+			Com_Printf( "NET_GetPacket: %s\n", NET_ErrorString() );
 
-			if( err != EAGAIN && err != ECONNRESET )
-				Com_Printf( "NET_GetPacket: %s\n", NET_ErrorString() );
-		}
-		else
-		{
-			memset( &from.v4.sin_zero, 0, sizeof( from.v4.sin_zero ) );
+		*received = qfalse;
+		return qfalse;
+	}
 
-			if ( usingSocks && memcmp( &from, &socksRelayAddr, fromlen ) == 0 ) {
-				if ( ret < 10 || net_message->data[0] != 0 || net_message->data[1] != 0 || net_message->data[2] != 0 || net_message->data[3] != 1 ) {
-					return qfalse;
-				}
-				net_from->type = NA_IP;
-				net_from->ipv._4[0] = net_message->data[4];
-				net_from->ipv._4[1] = net_message->data[5];
-				net_from->ipv._4[2] = net_message->data[6];
-				net_from->ipv._4[3] = net_message->data[7];
-				net_from->port = *(uint16_t *)&net_message->data[8];
-				net_message->readcount = 10;
-			}
-			else {
-				net_from->type = NA_BAD;
-				SockadrToNetadr( &from, net_from );
-				net_message->readcount = 0;
-			}
+	netStats.recvPackets++;
+	*received = qtrue;
 
-			if( ret >= net_message->maxsize ) {
-				Com_Printf( "Oversize packet from %s\n", NET_AdrToString( net_from ) );
-				return qfalse;
-			}
+	return NET_ProcessPacket( sock, &from, fromlen, ret, net_from, net_message );
+}
 
-			net_message->cursize = ret;
-			return qtrue;
-		}
+
+/*
+==================
+NET_GetPacket
+
+Receive one packet
+==================
+*/
+static qboolean NET_GetPacket( netadr_t *net_from, msg_t *net_message, const fd_set *fdr )
+{
+	qboolean received;
+	qboolean ret;
+
+	if(ip_socket != INVALID_SOCKET && FD_ISSET(ip_socket, fdr))
+	{
+		ret = NET_RecvFrom( ip_socket, net_from, net_message, &received );
+		if ( received )
+			return ret;
 	}
 
 #ifdef USE_IPV6
 	if(ip6_socket != INVALID_SOCKET && FD_ISSET(ip6_socket, fdr))
 	{
-		fromlen = sizeof(from);
-		ret = recvfrom(ip6_socket, (void *)net_message->data, net_message->maxsize, 0, (struct sockaddr *) &from, &fromlen);
+		ret = NET_RecvFrom( ip6_socket, net_from, net_message, &received );
+		if ( received )
+			return ret;
+	}
 
-		if (ret == SOCKET_ERROR)
-		{
-			err = socketError;
+	if(multicast6_socket != INVALID_SOCKET && multicast6_socket != ip6_socket && FD_ISSET(multicast6_socket, fdr))
+	{
+		ret = NET_RecvFrom( multicast6_socket, net_from, net_message, &received );
+		if ( received )
+			return ret;
+	}
+#endif // USE_IPV6
 
-			if( err != EAGAIN && err != ECONNRESET )
-				Com_Printf( "NET_GetPacket: %s\n", NET_ErrorString() );
-		}
-		else
-		{
-			net_from->type = NA_BAD;
-			SockadrToNetadr( &from, net_from );
-			net_message->readcount = 0;
+	return qfalse;
+}
 
-			if(ret >= net_message->maxsize)
-			{
-				Com_Printf( "Oversize packet from %s\n", NET_AdrToString( net_from ) );
-				return qfalse;
-			}
-			
-			net_message->cursize = ret;
-			return qtrue;
-		}
+//=============================================================================
+
+
+/*
+==================
+NET_SendError
+==================
+*/
+static void NET_SendError( netadrtype_t type )
+{
+	int err = socketError;
+
+	// wouldblock is silent
+	if( err == EAGAIN ) {
+		return;
 	}
 
-	if(multicast6_socket != INVALID_SOCKET && multicast6_socket != ip6_socket && FD_ISSET(multicast6_socket, fdr))
-	{
-		fromlen = sizeof(from);
-		ret = recvfrom(multicast6_socket, (void *)net_message->data, net_message->maxsize, 0, (struct sockaddr *) &from, &fromlen);
+	// some PPP links do not allow broadcasts and return an error
+	if( ( err == EADDRNOTAVAIL ) && ( type == NA_BROADCAST ) ) {
+		return;
+	}
 
-		if (ret == SOCKET_ERROR)
-		{
-			err = socketError;
+	Com_Printf( "Sys_SendPacket: %s\n", NET_ErrorString() );
+}
 
-			if( err != EAGAIN && err != ECONNRESET )
-				Com_Printf( "NET_GetPacket: %s\n", NET_ErrorString() );
-		}
-		else
-		{
-			net_from->type = NA_BAD;
-			SockadrToNetadr( &from, net_from );
-			net_message->readcount = 0;
 
-			if(ret >= net_message->maxsize)
-			{
-				Com_Printf( "Oversize packet from %s\n", NET_AdrToString( net_from ) );
-				return qfalse;
-			}
+#ifdef USE_NET_BATCH
+/*
+==================
+NET_SendBatchSocket
 
-			net_message->cursize = ret;
-			return qtrue;
+Sends all queued datagrams for specified socket
+==================
+*/
+static void NET_SendBatchSocket( SOCKET sock )
+{
+	struct mmsghdr hdr[ MAX_NET_BATCH ];
+	netadrtype_t type[ MAX_NET_BATCH ];
+	int i, n, sent, ret;
+
+	n = 0;
+	for ( i = 0; i < sendCount; i++ ) {
+		if ( sendSock[ i ] == sock ) {
+			hdr[ n ] = sendHdr[ i ];
+			type[ n ] = sendType[ i ];
+			n++;
 		}
 	}
-#endif // USE_IPV6
 
-	return qfalse;
+	sent = 0;
+	while ( sent < n ) {
+		ret = sendmmsg( sock, hdr + sent, n - sent, 0 );
+		netStats.sendCalls++;
+		if ( ret == SOCKET_ERROR ) {
+			NET_SendError( type[ sent ] );
+			sent++; // skip failed datagram
+		} else if ( ret == 0 ) {
+			break;
+		} else {
+			netStats.sendPackets += ret;
+			sent += ret;
+		}
+	}
 }
 
-//=============================================================================
+
+/*
+==================
+NET_SendBatch
+==================
+*/
+static void NET_SendBatch( void )
+{
+	if ( sendCount == 0 )
+		return;
+
+	if ( ip_socket != INVALID_SOCKET )
+		NET_SendBatchSocket( ip_socket );
+#ifdef USE_IPV6
+	if ( ip6_socket != INVALID_SOCKET )
+		NET_SendBatchSocket( ip6_socket );
+#endif
+
+	sendCount = 0;
+	sendPoolUsed = 0;
+}
+
+
+/*
+==================
+NET_QueueBatchPacket
+==================
+*/
+static void NET_QueueBatchPacket( SOCKET sock, const sockaddr_t *addr, socklen_t addrlen, int length, const void *data, netadrtype_t type )
+{
+	struct msghdr *hdr;
+
+	if ( length > NET_SEND_POOL )
+		return;
+
+	if ( sendCount >= net_batch->integer || sendCount >= MAX_NET_BATCH || sendPoolUsed + length > NET_SEND_POOL )
+		NET_SendBatch();
+
+	memcpy( sendPool + sendPoolUsed, data, length );
+	memcpy( &sendAddr[ sendCount ], addr, addrlen );
+
+	sendIov[ sendCount ].iov_base = sendPool + sendPoolUsed;
+	sendIov[ sendCount ].iov_len = length;
+
+	hdr = &sendHdr[ sendCount ].msg_hdr;
+	memset( hdr, 0, sizeof( *hdr ) );
+	hdr->msg_name = &sendAddr[ sendCount ];
+	hdr->msg_namelen = addrlen;
+	hdr->msg_iov = &sendIov[ sendCount ];
+	hdr->msg_iovlen = 1;
+
+	sendSock[ sendCount ] = sock;
+	sendType[ sendCount ] = type;
+
+	sendPoolUsed += length;
+	sendCount++;
+}
+#endif // USE_NET_BATCH
 
 
 /*
@@ -798,6 +974,18 @@ void Sys_SendPacket( int length, const void *data, const netadr_t *to ) {
 
 	NetadrToSockadr( to, &addr );
 
+#ifdef USE_NET_BATCH
+	if ( sendActive && !( usingSocks && to->type == NA_IP ) ) {
+		if ( addr.ss.ss_family == AF_INET )
+			NET_QueueBatchPacket( ip_socket, &addr, sizeof( struct sockaddr_in ), length, data, to->type );
+#ifdef USE_IPV6
+		else if ( addr.ss.ss_family == AF_INET6 )
+			NET_QueueBatchPacket( ip6_socket, &addr, sizeof( struct sockaddr_in6 ), length, data, to->type );
+#endif
+		return;
+	}
+#endif
+
 	if ( usingSocks && to->type == NA_IP ) {
 		socks5_udp_request_t cmd;
 
@@ -821,20 +1009,331 @@ void Sys_SendPacket( int length, const void *data, const netadr_t *to ) {
 #endif
 	}
 
+	netStats.sendCalls++;
+
 	if( ret == SOCKET_ERROR ) {
-		int err = socketError;
+		NET_SendError( to->type );
+	} else {
+		netStats.sendPackets++;
+	}
+}
+
+
+/*
+==================
+NET_BeginSendBatch
+
+Queue outgoing datagrams until NET_FlushSendBatch()
+so they can be sent with as few syscalls as possible
+==================
+*/
+void NET_BeginSendBatch( void )
+{
+#ifdef USE_NET_BATCH
+	NET_SendBatch();
+	sendActive = ( net_batch && net_batch->integer > 1 ) ? qtrue : qfalse;
+#endif
+}
+
+
+/*
+==================
+NET_FlushSendBatch
+==================
+*/
+void NET_FlushSendBatch( void )
+{
+#ifdef USE_NET_BATCH
+	NET_SendBatch();
+	sendActive = qfalse;
+#endif
+}
+
+
+/*
+=============================================================================
+
+AUXILIARY SOCKETS
+
+Unconnected non-blocking datagram sockets bound to their own local port,
+for tools which need many distinct source addresses like the load generator.
+They are polled by the owner and never wake up NET_Sleep(), unless watched
+with NET_WatchAuxSocket(), then the callback reads them on arrival.
+
+=============================================================================
+*/
+
+#define MAX_AUX_SOCKETS 1024
+#define MAX_WATCHED_AUX_SOCKETS 4
+
+static SOCKET	aux_sockets[ MAX_AUX_SOCKETS ];
+static qboolean	aux_used[ MAX_AUX_SOCKETS ];
+
+static int		aux_watched[ MAX_WATCHED_AUX_SOCKETS ];
+static void		(*aux_callbacks[ MAX_WATCHED_AUX_SOCKETS ])( int handle );
+static int		aux_numWatched;
+
+#ifdef USE_EPOLL
+static void NET_EpollWatch( SOCKET s, qboolean add );
+#endif
+
+
+/*
+==================
+NET_OpenAuxSocket
+
+Binds to specified address or to any IPv4 address if NULL,
+returns socket handle or -1 on failure
+==================
+*/
+int NET_OpenAuxSocket( const netadr_t *bindto )
+{
+	SOCKET		newsocket;
+	sockaddr_t	addr;
+	socklen_t	addrlen;
+	ioctlarg_t	_true = 1;
+	int			handle;
+
+	for ( handle = 0; handle < MAX_AUX_SOCKETS; handle++ ) {
+		if ( !aux_used[ handle ] ) {
+			break;
+		}
+	}
+
+	if ( handle == MAX_AUX_SOCKETS ) {
+		Com_Printf( "WARNING: NET_OpenAuxSocket: too many sockets\n" );
+		return -1;
+	}
+
+	Com_Memset( &addr, 0, sizeof( addr ) );
+	if ( bindto ) {
+		NetadrToSockadr( bindto, &addr );
+	} else {
+		addr.v4.sin_family = AF_INET;
+		addr.v4.sin_addr.s_addr = INADDR_ANY;
+	}
+
+	if ( addr.ss.ss_family == AF_INET ) {
+		addrlen = sizeof( struct sockaddr_in );
+	}
+#ifdef USE_IPV6
+	else if ( addr.ss.ss_family == AF_INET6 ) {
+		addrlen = sizeof( struct sockaddr_in6 );
+	}
+#endif
+	else {
+		Com_Printf( "WARNING: NET_OpenAuxSocket: bad address type\n" );
+		return -1;
+	}
+
+	if ( ( newsocket = socket( addr.ss.ss_family, SOCK_DGRAM, IPPROTO_UDP ) ) == INVALID_SOCKET ) {
+		Com_Printf( "WARNING: NET_OpenAuxSocket: socket: %s\n", NET_ErrorString() );
+		return -1;
+	}
+
+	if ( ioctlsocket( newsocket, FIONBIO, &_true ) == SOCKET_ERROR ) {
+		Com_Printf( "WARNING: NET_OpenAuxSocket: ioctl FIONBIO: %s\n", NET_ErrorString() );
+		closesocket( newsocket );
+		return -1;
+	}
 
-		// wouldblock is silent
-		if( err == EAGAIN ) {
+	if ( bind( newsocket, (struct sockaddr *) &addr, addrlen ) == SOCKET_ERROR ) {
+		Com_Printf( "WARNING: NET_OpenAuxSocket: bind: %s\n", NET_ErrorString() );
+		closesocket( newsocket );
+		return -1;
+	}
+
+	aux_sockets[ handle ] = newsocket;
+	aux_used[ handle ] = qtrue;
+
+	return handle;
+}
+
+
+/*
+==================
+NET_CloseAuxSocket
+==================
+*/
+void NET_CloseAuxSocket( int handle )
+{
+	if ( (unsigned)handle >= MAX_AUX_SOCKETS || !aux_used[ handle ] ) {
+		return;
+	}
+
+	NET_WatchAuxSocket( handle, NULL );
+
+	closesocket( aux_sockets[ handle ] );
+	aux_sockets[ handle ] = INVALID_SOCKET;
+	aux_used[ handle ] = qfalse;
+}
+
+
+/*
+==================
+NET_SendAuxPacket
+==================
+*/
+void NET_SendAuxPacket( int handle, int length, const void *data, const netadr_t *to )
+{
+	sockaddr_t addr;
+	socklen_t addrlen;
+
+	if ( (unsigned)handle >= MAX_AUX_SOCKETS || !aux_used[ handle ] ) {
+		return;
+	}
+
+	NetadrToSockadr( to, &addr );
+
+	if ( addr.ss.ss_family == AF_INET ) {
+		addrlen = sizeof( struct sockaddr_in );
+	}
+#ifdef USE_IPV6
+	else if ( addr.ss.ss_family == AF_INET6 ) {
+		addrlen = sizeof( struct sockaddr_in6 );
+	}
+#endif
+	else {
+		return;
+	}
+
+	if ( sendto( aux_sockets[ handle ], data, length, 0, (struct sockaddr *) &addr, addrlen ) == SOCKET_ERROR ) {
+		NET_SendError( to->type );
+	}
+}
+
+
+/*
+==================
+NET_GetAuxPacket
+
+Returns qfalse if there is nothing more to read
+==================
+*/
+qboolean NET_GetAuxPacket( int handle, netadr_t *net_from, msg_t *net_message )
+{
+	sockaddr_t	from;
+	socklen_t	fromlen;
+	int			ret;
+
+	if ( (unsigned)handle >= MAX_AUX_SOCKETS || !aux_used[ handle ] ) {
+		return qfalse;
+	}
+
+	for ( ;; ) {
+		fromlen = sizeof( from );
+		ret = recvfrom( aux_sockets[ handle ], (void *)net_message->data, net_message->maxsize, 0, (struct sockaddr *) &from, &fromlen );
+		if ( ret == SOCKET_ERROR ) {
+			if ( socketError != EAGAIN && socketError != ECONNRESET ) {
+				Com_Printf( "NET_GetAuxPacket: %s\n", NET_ErrorString() );
+			}
+			return qfalse;
+		}
+		if ( ret >= net_message->maxsize ) {
+			continue; // oversize
+		}
+		net_from->type = NA_BAD;
+		SockadrToNetadr( &from, net_from );
+		net_message->readcount = 0;
+		net_message->cursize = ret;
+		return qtrue;
+	}
+}
+
+
+/*
+==================
+NET_WatchAuxSocket
+
+Wakes up NET_Sleep() and calls back when socket becomes readable,
+NULL callback stops watching
+==================
+*/
+void NET_WatchAuxSocket( int handle, void (*callback)( int handle ) )
+{
+	int i;
+
+	if ( (unsigned)handle >= MAX_AUX_SOCKETS || !aux_used[ handle ] ) {
+		return;
+	}
+
+	for ( i = 0; i < aux_numWatched; i++ ) {
+		if ( aux_watched[ i ] == handle ) {
+			break;
+		}
+	}
+
+	if ( !callback ) {
+		if ( i == aux_numWatched ) {
 			return;
 		}
+#ifdef USE_EPOLL
+		NET_EpollWatch( aux_sockets[ handle ], qfalse );
+#endif
+		aux_numWatched--;
+		aux_watched[ i ] = aux_watched[ aux_numWatched ];
+		aux_callbacks[ i ] = aux_callbacks[ aux_numWatched ];
+		return;
+	}
+
+	if ( i < aux_numWatched ) {
+		aux_callbacks[ i ] = callback;
+		return;
+	}
+
+#ifndef _WIN32
+	if ( aux_sockets[ handle ] >= FD_SETSIZE ) {
+		Com_Printf( "WARNING: NET_WatchAuxSocket: descriptor out of select() range\n" );
+		return;
+	}
+#endif
+
+	if ( aux_numWatched == MAX_WATCHED_AUX_SOCKETS ) {
+		Com_Printf( "WARNING: NET_WatchAuxSocket: too many sockets\n" );
+		return;
+	}
+
+	aux_watched[ aux_numWatched ] = handle;
+	aux_callbacks[ aux_numWatched ] = callback;
+	aux_numWatched++;
+
+#ifdef USE_EPOLL
+	NET_EpollWatch( aux_sockets[ handle ], qtrue );
+#endif
+}
+
+
+/*
+==================
+NET_AuxEvent
+
+Calls back watched sockets which have seen action
+==================
+*/
+static void NET_AuxEvent( const fd_set *fdr )
+{
+	int i, handle;
 
-		// some PPP links do not allow broadcasts and return an error
-		if( ( err == EADDRNOTAVAIL ) && ( to->type == NA_BROADCAST ) ) {
-			return;
+	for ( i = aux_numWatched - 1; i >= 0; i-- ) {
+		handle = aux_watched[ i ];
+		if ( FD_ISSET( aux_sockets[ handle ], fdr ) ) {
+			aux_callbacks[ i ]( handle );
 		}
+	}
+}
+
+
+/*
+==================
+NET_CloseAuxSockets
+==================
+*/
+static void NET_CloseAuxSockets( void )
+{
+	int i;
 
-		Com_Printf( "Sys_SendPacket: %s\n", NET_ErrorString() );
+	for ( i = 0; i < MAX_AUX_SOCKETS; i++ ) {
+		NET_CloseAuxSocket( i );
 	}
 }
 
@@ -953,6 +1452,30 @@ void Sys_ShowIP( void ) {
 }
 
 
+/*
+==================
+Sys_LocalAddresses
+
+Fills list with addresses of local network interfaces, returns count
+==================
+*/
+int Sys_LocalAddresses( netadr_t *list, int max ) {
+	int i, count;
+
+	count = 0;
+	for ( i = 0; i < numIP && count < max; i++ ) {
+		Com_Memset( &list[ count ], 0, sizeof( list[ count ] ) );
+		SockadrToNetadr( &localIP[i].addr, &list[ count ] );
+		if ( list[ count ].type == NA_IP || list[ count ].type == NA_IP6 ) {
+			list[ count ].port = 0;
+			count++;
+		}
+	}
+
+	return count;
+}
+
+
 //=============================================================================
 
 
@@ -1678,6 +2201,22 @@ static qboolean NET_GetCvars( void ) {
 	net_dropsim = Cvar_Get( "net_dropsim", "", CVAR_TEMP );
 	Cvar_SetDescription( net_dropsim, "Simulated packet drops." );
 
+#ifdef USE_NET_BATCH
+	net_batch = Cvar_Get( "net_batch", "32", CVAR_ARCHIVE_ND );
+	Cvar_CheckRange( net_batch, "1", XSTRING( MAX_NET_BATCH ), CV_INTEGER );
+#else
+	net_batch = Cvar_Get( "net_batch", "1", CVAR_ROM );
+#endif
+	Cvar_SetDescription( net_batch, "Maximum number of UDP datagrams received or sent with a single syscall, 1 - disable batching." );
+
+#ifdef USE_EPOLL
+	net_epoll = Cvar_Get( "net_epoll", "1", CVAR_ARCHIVE_ND );
+	Cvar_CheckRange( net_epoll, "0", "1", CV_INTEGER );
+#else
+	net_epoll = Cvar_Get( "net_epoll", "0", CVAR_ROM );
+#endif
+	Cvar_SetDescription( net_epoll, "Dedicated server waits for network, console input and next frame with epoll and high-resolution timer instead of select()." );
+
 	return modified ? qtrue : qfalse;
 }
 
@@ -1726,7 +2265,14 @@ static void NET_Config( qboolean enableNetworking ) {
 		networkingEnabled = enableNetworking;
 	}
 
+#ifdef USE_EPOLL
+	// socket set will be changed
+	if ( start || stop )
+		NET_CloseEpoll();
+#endif
+
 	if( stop ) {
+		NET_FlushSendBatch();
 		if ( ip_socket != INVALID_SOCKET ) {
 			closesocket( ip_socket );
 			ip_socket = INVALID_SOCKET;
@@ -1787,6 +2333,7 @@ void NET_Init( void ) {
 	NET_Config( qtrue );
 	
 	Cmd_AddCommand( "net_restart", NET_Restart_f );
+	Cmd_AddCommand( "net_stats", NET_Stats_f );
 }
 
 
@@ -1802,6 +2349,8 @@ void NET_Shutdown( void ) {
 
 	NET_Config( qfalse );
 
+	NET_CloseAuxSockets();
+
 #ifdef _WIN32
 	WSACleanup();
 	winsockInitialized = qfalse;
@@ -1809,6 +2358,122 @@ void NET_Shutdown( void ) {
 }
 
 
+/*
+====================
+NET_DispatchPacket
+====================
+*/
+static void NET_DispatchPacket( netadr_t *from, msg_t *netmsg )
+{
+	if ( net_dropsim->value > 0.0f && net_dropsim->value <= 100.0f )
+	{
+		// com_dropsim->value percent of incoming packets get dropped.
+		if ( rand() < (int) (((double) RAND_MAX) / 100.0 * (double) net_dropsim->value) )
+			return; // drop this packet
+	}
+
+#ifdef DEDICATED
+	Com_RunAndTimeServerPacket( from, netmsg );
+#else
+	if ( com_sv_running->integer || com_dedicated->integer )
+		Com_RunAndTimeServerPacket( from, netmsg );
+	else
+		CL_PacketEvent( from, netmsg );
+#endif
+}
+
+
+#ifdef USE_NET_BATCH
+static SOCKET	recvSock = INVALID_SOCKET;
+static int		recvCount;
+static int		recvIndex;
+
+/*
+====================
+NET_DispatchBatch
+
+Process received datagrams, position is kept in statics so anything
+left after ERR_DROP will be processed on next call
+====================
+*/
+static void NET_DispatchBatch( void )
+{
+	netadr_t from;
+	msg_t netmsg;
+	int i;
+
+	while ( recvIndex < recvCount )
+	{
+		i = recvIndex++;
+		MSG_Init( &netmsg, recvData[ i ], MAX_MSGLEN );
+		if ( NET_ProcessPacket( recvSock, &recvFrom[ i ], recvHdr[ i ].msg_hdr.msg_namelen, recvHdr[ i ].msg_len, &from, &netmsg ) )
+			NET_DispatchPacket( &from, &netmsg );
+	}
+}
+
+
+/*
+====================
+NET_RecvBatch
+
+Receive and process all pending datagrams from socket
+====================
+*/
+static void NET_RecvBatch( SOCKET sock )
+{
+	struct msghdr *hdr;
+	int i, n, count;
+	int err;
+
+	count = net_batch->integer;
+	if ( count > MAX_NET_BATCH )
+		count = MAX_NET_BATCH;
+
+	NET_DispatchBatch();
+
+	for ( ;; )
+	{
+		for ( i = 0; i < count; i++ )
+		{
+			recvIov[ i ].iov_base = recvData[ i ];
+			recvIov[ i ].iov_len = MAX_MSGLEN;
+			hdr = &recvHdr[ i ].msg_hdr;
+			memset( hdr, 0, sizeof( *hdr ) );
+			hdr->msg_name = &recvFrom[ i ];
+			hdr->msg_namelen = sizeof( recvFrom[ i ] );
+			hdr->msg_iov = &recvIov[ i ];
+			hdr->msg_iovlen = 1;
+		}
+
+		n = recvmmsg( sock, recvHdr, count, MSG_DONTWAIT, NULL );
+		netStats.recvCalls++;
+
+		if ( n == SOCKET_ERROR )
+		{
+			err = socketError;
+
+			if( err != EAGAIN && err != ECONNRESET )
+				Com_Printf( "NET_GetPacket: %s\n", NET_ErrorString() );
+
+			return;
+		}
+
+		netStats.recvPackets += n;
+
+		recvSock = sock;
+		recvCount = n;
+		recvIndex = 0;
+
+		NET_DispatchBatch();
+
+		// socket is most likely drained
+		if ( n < count )
+			return;
+	}
+}
+#endif // USE_NET_BATCH
+
+
 /*
 ====================
 NET_Event
@@ -1821,34 +2486,254 @@ static void NET_Event( const fd_set *fdr )
 	byte bufData[ MAX_MSGLEN_BUF ];
 	netadr_t from;
 	msg_t netmsg;
-	
+
+	if ( aux_numWatched ) {
+		NET_AuxEvent( fdr );
+	}
+
+#ifdef USE_NET_BATCH
+	if ( net_batch->integer > 1 )
+	{
+		if ( ip_socket != INVALID_SOCKET && FD_ISSET( ip_socket, fdr ) )
+			NET_RecvBatch( ip_socket );
+#ifdef USE_IPV6
+		if ( ip6_socket != INVALID_SOCKET && FD_ISSET( ip6_socket, fdr ) )
+			NET_RecvBatch( ip6_socket );
+		if ( multicast6_socket != INVALID_SOCKET && multicast6_socket != ip6_socket && FD_ISSET( multicast6_socket, fdr ) )
+			NET_RecvBatch( multicast6_socket );
+#endif
+		return;
+	}
+#endif
+
 	while( 1 )
 	{
 		MSG_Init( &netmsg, bufData, MAX_MSGLEN );
 
 		if ( NET_GetPacket( &from, &netmsg, fdr ) )
-		{
-			if ( net_dropsim->value > 0.0f && net_dropsim->value <= 100.0f )
-			{
-				// com_dropsim->value percent of incoming packets get dropped.
-				if ( rand() < (int) (((double) RAND_MAX) / 100.0 * (double) net_dropsim->value) )
-					continue; // drop this packet
-			}
+			NET_DispatchPacket( &from, &netmsg );
+		else
+			break;
+	}
+}
 
-#ifdef DEDICATED
-			Com_RunAndTimeServerPacket( &from, &netmsg );
-#else
-			if ( com_sv_running->integer || com_dedicated->integer )
-				Com_RunAndTimeServerPacket( &from, &netmsg );
-			else
-				CL_PacketEvent( &from, &netmsg );
+
+#ifdef USE_EPOLL
+static int		epoll_fd = INVALID_SOCKET;
+static int		timer_fd = INVALID_SOCKET;
+static int		console_fd = INVALID_SOCKET;	// console input descriptor we checked
+static qboolean	console_added;					// can be polled
+
+/*
+====================
+NET_EpollAdd
+====================
+*/
+static qboolean NET_EpollAdd( int fd )
+{
+	struct epoll_event ev;
+
+	memset( &ev, 0, sizeof( ev ) );
+	ev.events = EPOLLIN;
+	ev.data.fd = fd;
+
+	return epoll_ctl( epoll_fd, EPOLL_CTL_ADD, fd, &ev ) == 0 ? qtrue : qfalse;
+}
+
+
+/*
+====================
+NET_EpollWatch
+
+Adds or removes watched auxiliary socket, if epoll is open
+====================
+*/
+static void NET_EpollWatch( SOCKET s, qboolean add )
+{
+	if ( epoll_fd == INVALID_SOCKET ) {
+		return;
+	}
+
+	if ( add ) {
+		NET_EpollAdd( s );
+	} else {
+		epoll_ctl( epoll_fd, EPOLL_CTL_DEL, s, NULL );
+	}
+}
+
+
+/*
+====================
+NET_CloseEpoll
+====================
+*/
+static void NET_CloseEpoll( void )
+{
+	if ( timer_fd != INVALID_SOCKET ) {
+		close( timer_fd );
+		timer_fd = INVALID_SOCKET;
+	}
+	if ( epoll_fd != INVALID_SOCKET ) {
+		close( epoll_fd );
+		epoll_fd = INVALID_SOCKET;
+	}
+	console_fd = INVALID_SOCKET;
+	console_added = qfalse;
+}
+
+
+/*
+====================
+NET_OpenEpoll
+
+Creates single wait set for network sockets, console input
+and a timer armed for the next frame deadline
+====================
+*/
+static qboolean NET_OpenEpoll( void )
+{
+	int i;
+
+	epoll_fd = epoll_create1( EPOLL_CLOEXEC );
+	if ( epoll_fd == INVALID_SOCKET ) {
+		Com_Printf( S_COLOR_YELLOW "WARNING: epoll_create1() failed: %s\n", NET_ErrorString() );
+		return qfalse;
+	}
+
+	// Sys_Microseconds() uses gettimeofday() so deadlines are in CLOCK_REALTIME
+	timer_fd = timerfd_create( CLOCK_REALTIME, TFD_NONBLOCK | TFD_CLOEXEC );
+	if ( timer_fd == INVALID_SOCKET || !NET_EpollAdd( timer_fd ) ) {
+		Com_Printf( S_COLOR_YELLOW "WARNING: timerfd setup failed: %s\n", NET_ErrorString() );
+		NET_CloseEpoll();
+		return qfalse;
+	}
+
+	if ( ip_socket != INVALID_SOCKET )
+		NET_EpollAdd( ip_socket );
+#ifdef USE_IPV6
+	if ( ip6_socket != INVALID_SOCKET )
+		NET_EpollAdd( ip6_socket );
+	if ( multicast6_socket != INVALID_SOCKET && multicast6_socket != ip6_socket )
+		NET_EpollAdd( multicast6_socket );
 #endif
+
+	for ( i = 0; i < aux_numWatched; i++ )
+		NET_EpollAdd( aux_sockets[ aux_watched[ i ] ] );
+
+	// timerfd expirations are not subject to timer slack, unlike select()
+	// or epoll_wait() timeouts, so PR_SET_TIMERSLACK is not needed here
+	// and worker threads keep their default slack
+
+	return qtrue;
+}
+
+
+/*
+====================
+NET_EpollActive
+
+Returns qtrue if NET_Sleep() waits with microsecond precision
+and also wakes up on console input
+====================
+*/
+qboolean NET_EpollActive( void )
+{
+	if ( !net_epoll || !net_epoll->integer || !com_dedicated || !com_dedicated->integer ) {
+		if ( epoll_fd != INVALID_SOCKET )
+			NET_CloseEpoll();
+		return qfalse;
+	}
+
+	if ( epoll_fd == INVALID_SOCKET && !NET_OpenEpoll() ) {
+		Cvar_Set( "net_epoll", "0" );
+		return qfalse;
+	}
+
+	return qtrue;
+}
+
+
+/*
+====================
+NET_EpollSleep
+
+Waits until absolute Sys_Microseconds() deadline, 0 only polls
+====================
+*/
+static qboolean NET_EpollSleep( int64_t deadline )
+{
+	struct epoll_event events[ 8 ];
+	struct itimerspec its;
+	uint64_t expirations;
+	qboolean console;
+	qboolean network;
+	fd_set fdr;
+	int i, n, fd;
+
+	// console input may be closed or reopened at any time
+	fd = Sys_ConsoleInputFd();
+	if ( fd != console_fd ) {
+		if ( console_added )
+			epoll_ctl( epoll_fd, EPOLL_CTL_DEL, console_fd, NULL );
+		// regular files and /dev/null can't be polled
+		console_added = ( fd != INVALID_SOCKET && NET_EpollAdd( fd ) ) ? qtrue : qfalse;
+		console_fd = fd;
+	}
+
+	if ( deadline > 0 ) {
+		// already expired deadline fires immediately
+		memset( &its, 0, sizeof( its ) );
+		its.it_value.tv_sec = deadline / 1000000;
+		its.it_value.tv_nsec = ( deadline % 1000000 ) * 1000;
+		timerfd_settime( timer_fd, TFD_TIMER_ABSTIME, &its, NULL );
+		n = epoll_wait( epoll_fd, events, ARRAY_LEN( events ), -1 );
+	} else {
+		n = epoll_wait( epoll_fd, events, ARRAY_LEN( events ), 0 );
+	}
+
+	if ( n == SOCKET_ERROR ) {
+		if ( socketError != EINTR )
+			Com_Printf( S_COLOR_YELLOW "Warning: epoll_wait() syscall failed: %s\n", NET_ErrorString() );
+		return qtrue;
+	}
+
+	FD_ZERO( &fdr );
+	console = qfalse;
+	network = qfalse;
+
+	for ( i = 0; i < n; i++ ) {
+		fd = events[ i ].data.fd;
+		if ( fd == timer_fd ) {
+			read( timer_fd, &expirations, sizeof( expirations ) );
+		} else if ( console_added && fd == console_fd ) {
+			console = qtrue;
+		} else {
+			FD_SET( fd, &fdr );
+			network = qtrue;
 		}
-		else
-			break;
 	}
+
+	if ( network ) {
+		NET_Event( &fdr );
+		return qfalse;
+	}
+
+	// console input will be picked up by the event loop
+	if ( console ) {
+		return qfalse;
+	}
+
+	return qtrue;
+}
+#else
+
+qboolean NET_EpollActive( void )
+{
+	return qfalse;
 }
 
+#endif // USE_EPOLL
+
 
 /*
 ====================
@@ -1863,12 +2748,20 @@ qboolean NET_Sleep( int timeout )
 {
 	struct timeval tv;
 	fd_set fdr;
-	int retval;
+	int retval, i;
 	SOCKET highestfd = INVALID_SOCKET;
 
 	if ( timeout < 0 )
 		timeout = 0;
 
+	// make sure nothing stays queued while we are sleeping
+	NET_FlushSendBatch();
+
+#ifdef USE_EPOLL
+	if ( NET_EpollActive() )
+		return NET_EpollSleep( timeout > 0 ? Sys_Microseconds() + timeout : 0 );
+#endif
+
 	FD_ZERO( &fdr );
 
 	if ( ip_socket != INVALID_SOCKET )
@@ -1888,6 +2781,16 @@ qboolean NET_Sleep( int timeout )
 	}
 #endif
 
+	for ( i = 0; i < aux_numWatched; i++ )
+	{
+		SOCKET s = aux_sockets[ aux_watched[ i ] ];
+
+		FD_SET( s, &fdr );
+
+		if ( highestfd == INVALID_SOCKET || s > highestfd )
+			highestfd = s;
+	}
+
 	if ( highestfd == INVALID_SOCKET )
 	{
 #ifdef _WIN32
@@ -1925,6 +2828,52 @@ qboolean NET_Sleep( int timeout )
 }
 
 
+/*
+====================
+NET_SleepUntil
+
+Same as NET_Sleep() but waits until absolute Sys_Microseconds() time,
+with epoll the timer is armed on the deadline itself so wakeups
+don't drift by time spent between reading the clock and sleeping
+====================
+*/
+qboolean NET_SleepUntil( int64_t deadline )
+{
+	int64_t timeout;
+
+#ifdef USE_EPOLL
+	if ( NET_EpollActive() ) {
+		NET_FlushSendBatch();
+		return NET_EpollSleep( deadline );
+	}
+#endif
+
+	timeout = deadline - Sys_Microseconds();
+	if ( timeout > 3000000 )
+		timeout = 3000000;
+
+	return NET_Sleep( (int)timeout );
+}
+
+
+/*
+====================
+NET_Stats_f
+====================
+*/
+static void NET_Stats_f( void )
+{
+	Com_Printf( "recv: %u packets in %u syscalls (%.2f per call)\n", netStats.recvPackets, netStats.recvCalls,
+		netStats.recvCalls ? (double)netStats.recvPackets / netStats.recvCalls : 0.0 );
+	Com_Printf( "send: %u packets in %u syscalls (%.2f per call)\n", netStats.sendPackets, netStats.sendCalls,
+		netStats.sendCalls ? (double)netStats.sendPackets / netStats.sendCalls : 0.0 );
+
+	if ( Cmd_Argc() > 1 && !Q_stricmp( Cmd_Argv( 1 ), "reset" ) ) {
+		Com_Memset( &netStats, 0, sizeof( netStats ) );
+	}
+}
+
+
 /*
 ====================
 NET_Restart_f
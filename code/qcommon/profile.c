@@ -0,0 +1,347 @@
+// lightweight frame phase profiler with chrome trace-event export
+
+#include "q_shared.h"
+#include "qcommon.h"
+
+/*
+=============================================================================
+
+Keeps timings of the last N frames in a ring buffer. Each frame holds
+a number of timed spans (Com_ProfileStart() + Com_ProfileSpan()) and
+per-frame counters for phases which are repeated many times per frame
+like processing of individual packets (Com_ProfileCount()/Com_ProfileAdd()).
+
+Everything is expected to be called from the main thread only,
+span names must be string literals or otherwise persistent.
+
+=============================================================================
+*/
+
+#define MAX_PROFILE_FRAMES		1024
+#define MAX_PROFILE_SPANS		48
+#define MAX_PROFILE_COUNTERS	8
+
+typedef struct {
+	const char	*name;
+	int64_t		start;
+	int			duration;
+} profSpan_t;
+
+typedef struct {
+	const char	*name;
+	int64_t		total;
+	int			count;
+} profCounter_t;
+
+typedef struct {
+	int64_t			start;
+	int				number;
+	int				numSpans;
+	int				numCounters;
+	int				droppedSpans;
+	profSpan_t		spans[ MAX_PROFILE_SPANS ];
+	profCounter_t	counters[ MAX_PROFILE_COUNTERS ];
+} profFrame_t;
+
+static profFrame_t	*profFrames;
+static int			profNumFrames;		// ring size, 0 = disabled
+static int			profStored;			// frames in the ring
+static int			profHead;			// next frame slot
+static int			profFrameNumber;
+static profFrame_t	*profCurrent;
+
+
+/*
+=================
+Com_ProfileSetFrames
+
+(Re)allocates frame ring, 0 disables profiling
+=================
+*/
+void Com_ProfileSetFrames( int frames )
+{
+	if ( frames < 0 ) {
+		frames = 0;
+	} else if ( frames > MAX_PROFILE_FRAMES ) {
+		frames = MAX_PROFILE_FRAMES;
+	}
+
+	if ( profFrames ) {
+		Z_Free( profFrames );
+		profFrames = NULL;
+	}
+
+	profNumFrames = frames;
+	profStored = 0;
+	profHead = 0;
+	profCurrent = NULL;
+
+	if ( frames ) {
+		profFrames = Z_Malloc( frames * sizeof( profFrame_t ) );
+	}
+}
+
+
+/*
+=================
+Com_ProfileFrame
+
+Starts new frame, overwriting the oldest one
+=================
+*/
+void Com_ProfileFrame( void )
+{
+	if ( !profNumFrames ) {
+		return;
+	}
+
+	profCurrent = &profFrames[ profHead ];
+	profCurrent->start = Sys_Microseconds();
+	profCurrent->number = profFrameNumber++;
+	profCurrent->numSpans = 0;
+	profCurrent->numCounters = 0;
+	profCurrent->droppedSpans = 0;
+
+	if ( ++profHead == profNumFrames ) {
+		profHead = 0;
+	}
+	if ( profStored < profNumFrames ) {
+		profStored++;
+	}
+}
+
+
+/*
+=================
+Com_ProfileStart
+
+Returns current time or 0 if profiling is disabled
+=================
+*/
+int64_t Com_ProfileStart( void )
+{
+	if ( !profCurrent ) {
+		return 0;
+	}
+
+	return Sys_Microseconds();
+}
+
+
+/*
+=================
+Com_ProfileSpan
+
+Records span from start till now
+=================
+*/
+void Com_ProfileSpan( const char *name, int64_t start )
+{
+	profSpan_t *span;
+
+	if ( !start || !profCurrent ) {
+		return;
+	}
+
+	if ( profCurrent->numSpans >= MAX_PROFILE_SPANS ) {
+		profCurrent->droppedSpans++;
+		return;
+	}
+
+	span = &profCurrent->spans[ profCurrent->numSpans++ ];
+	span->name = name;
+	span->start = start;
+	span->duration = (int)( Sys_Microseconds() - start );
+}
+
+
+/*
+=================
+Com_ProfileAdd
+
+Adds time to a per-frame counter
+=================
+*/
+void Com_ProfileAdd( const char *name, int64_t usec )
+{
+	profCounter_t *counter;
+	int i;
+
+	if ( !profCurrent ) {
+		return;
+	}
+
+	for ( i = 0; i < profCurrent->numCounters; i++ ) {
+		counter = &profCurrent->counters[ i ];
+		if ( counter->name == name ) {
+			counter->total += usec;
+			counter->count++;
+			return;
+		}
+	}
+
+	if ( profCurrent->numCounters >= MAX_PROFILE_COUNTERS ) {
+		return;
+	}
+
+	counter = &profCurrent->counters[ profCurrent->numCounters++ ];
+	counter->name = name;
+	counter->total = usec;
+	counter->count = 1;
+}
+
+
+/*
+=================
+Com_ProfileCount
+
+Adds time since start to a per-frame counter,
+returns current time so calls can be chained
+=================
+*/
+int64_t Com_ProfileCount( const char *name, int64_t start )
+{
+	int64_t now;
+
+	if ( !start || !profCurrent ) {
+		return 0;
+	}
+
+	now = Sys_Microseconds();
+	Com_ProfileAdd( name, now - start );
+
+	return now;
+}
+
+
+/*
+=================
+Com_ProfileFrameNum
+
+Returns n-th stored frame, starting from the oldest one
+=================
+*/
+static const profFrame_t *Com_ProfileFrameNum( int n )
+{
+	return &profFrames[ ( profHead - profStored + n + profNumFrames ) % profNumFrames ];
+}
+
+
+/*
+=================
+Com_ProfileSummary
+
+Prints average and worst duration of each span
+=================
+*/
+void Com_ProfileSummary( void )
+{
+	const char *names[ MAX_PROFILE_SPANS ];
+	int64_t total[ MAX_PROFILE_SPANS ];
+	int worst[ MAX_PROFILE_SPANS ];
+	int calls[ MAX_PROFILE_SPANS ];
+	const profFrame_t *frame;
+	const profSpan_t *span;
+	int numNames, numFrames;
+	int i, n, k;
+
+	numFrames = profStored;
+	if ( !numFrames ) {
+		Com_Printf( "No profiled frames.\n" );
+		return;
+	}
+
+	numNames = 0;
+	for ( i = 0; i < numFrames; i++ ) {
+		frame = Com_ProfileFrameNum( i );
+		for ( n = 0, span = frame->spans; n < frame->numSpans; n++, span++ ) {
+			for ( k = 0; k < numNames; k++ ) {
+				if ( names[ k ] == span->name ) {
+					break;
+				}
+			}
+			if ( k == numNames ) {
+				if ( numNames == MAX_PROFILE_SPANS ) {
+					continue;
+				}
+				names[ k ] = span->name;
+				total[ k ] = 0;
+				worst[ k ] = 0;
+				calls[ k ] = 0;
+				numNames++;
+			}
+			total[ k ] += span->duration;
+			calls[ k ]++;
+			if ( worst[ k ] < span->duration ) {
+				worst[ k ] = span->duration;
+			}
+		}
+	}
+
+	Com_Printf( "%i frames:\n", numFrames );
+	for ( k = 0; k < numNames; k++ ) {
+		Com_Printf( " %-20s avg %7.1fus  max %7ius\n", names[ k ], (double)total[ k ] / calls[ k ], worst[ k ] );
+	}
+}
+
+
+/*
+=================
+Com_ProfileDump
+
+Writes stored frames in chrome trace-event format,
+can be opened with chrome://tracing or ui.perfetto.dev
+=================
+*/
+void Com_ProfileDump( const char *filename )
+{
+	const profFrame_t *frame;
+	const profSpan_t *span;
+	const profCounter_t *counter;
+	fileHandle_t f;
+	int64_t base;
+	int numFrames;
+	int i, n;
+	const char *sep;
+
+	numFrames = profStored;
+	if ( !numFrames ) {
+		Com_Printf( "No profiled frames.\n" );
+		return;
+	}
+
+	f = FS_FOpenFileWrite( filename );
+	if ( f == FS_INVALID_HANDLE ) {
+		Com_Printf( "Couldn't write %s.\n", filename );
+		return;
+	}
+
+	frame = Com_ProfileFrameNum( 0 );
+	base = frame->start;
+	sep = "";
+
+	FS_Printf( f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n" );
+
+	for ( i = 0; i < numFrames; i++ ) {
+		frame = Com_ProfileFrameNum( i );
+
+		FS_Printf( f, "%s{\"name\":\"frame\",\"ph\":\"i\",\"s\":\"g\",\"pid\":1,\"tid\":1,\"ts\":%lld,\"args\":{\"frame\":%i,\"dropped\":%i}}",
+			sep, (long long)( frame->start - base ), frame->number, frame->droppedSpans );
+		sep = ",\n";
+
+		for ( n = 0, span = frame->spans; n < frame->numSpans; n++, span++ ) {
+			FS_Printf( f, "%s{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%lld,\"dur\":%i}",
+				sep, span->name, (long long)( span->start - base ), span->duration );
+		}
+
+		for ( n = 0, counter = frame->counters; n < frame->numCounters; n++, counter++ ) {
+			FS_Printf( f, "%s{\"name\":\"%s\",\"ph\":\"C\",\"pid\":1,\"ts\":%lld,\"args\":{\"usec\":%lld,\"count\":%i}}",
+				sep, counter->name, (long long)( frame->start - base ), (long long)counter->total, counter->count );
+		}
+	}
+
+	FS_Printf( f, "\n]}\n" );
+	FS_FCloseFile( f );
+
+	Com_Printf( "Wrote %i frames to %s.\n", numFrames, filename );
+}
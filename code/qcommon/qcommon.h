@@ -62,6 +62,9 @@ typedef struct {
 	qboolean	allowoverflow;	// if false, do a Com_Error
 	qboolean	overflowed;		// set to true if the buffer size failed (with allowoverflow set)
 	qboolean	oob;			// raw out-of-band operation, no static huffman encoding/decoding
+	qboolean	deferError;		// store write errors in error/errorValue instead of a Com_Error, for worker threads
+	const char	*error;			// format string of the first deferred error, with errorValue as argument
+	int		errorValue;
 	byte	*data;
 	int		maxsize;
 	int		maxbits;			// maxsize in bits, for overflow checks
@@ -87,6 +90,7 @@ struct entityState_s;
 struct playerState_s;
 
 void MSG_WriteBits( msg_t *msg, int value, int bits );
+void MSG_WriteBitString( msg_t *msg, const byte *data, int bits );
 
 void MSG_WriteChar (msg_t *sb, int c);
 void MSG_WriteByte (msg_t *sb, int c);
@@ -121,9 +125,11 @@ void MSG_ReadDeltaEntity( msg_t *msg, const entityState_t *from, entityState_t *
 
 void MSG_WriteDeltaPlayerstate( msg_t *msg, const playerState_t *from, const playerState_t *to );
 void MSG_ReadDeltaPlayerstate( msg_t *msg, const playerState_t *from, playerState_t *to );
-
 void MSG_ReportChangeVectors_f( void );
 
+void MSG_Bench_f( void );
+void MSG_InitTables( void );
+
 //============================================================================
 
 /*
@@ -151,6 +157,10 @@ NET
 
 #define	MAX_PACKET_USERCMDS		32		// max number of usercmd_t in a packet
 
+// engine limit of client slots, slots from MAX_CLIENTS on are given only
+// to game modules and clients which support them, see sv_clientLimit
+#define	MAX_SERVER_CLIENTS		256
+
 #define	MAX_SNAPSHOT_ENTITIES	256
 
 #define	PORT_ANY			-1
@@ -196,6 +206,8 @@ typedef struct {
 void		NET_Init( void );
 void		NET_Shutdown( void );
 void		NET_FlushPacketQueue( int time_diff );
+void		NET_BeginSendBatch( void );
+void		NET_FlushSendBatch( void );
 void		NET_QueuePacket( netsrc_t sock, int length, const void *data, const netadr_t *to, int offset );
 void		NET_SendPacket( netsrc_t sock, int length, const void *data, const netadr_t *to );
 void		QDECL NET_OutOfBandPrint( netsrc_t net_socket, const netadr_t *adr, const char *format, ...) __attribute__ ((format (printf, 3, 4)));
@@ -216,6 +228,14 @@ void		NET_JoinMulticast6( void );
 void		NET_LeaveMulticast6( void );
 #endif
 qboolean	NET_Sleep( int timeout );
+qboolean	NET_SleepUntil( int64_t deadline );
+qboolean	NET_EpollActive( void );
+
+int			NET_OpenAuxSocket( const netadr_t *bindto );
+void		NET_CloseAuxSocket( int handle );
+void		NET_SendAuxPacket( int handle, int length, const void *data, const netadr_t *to );
+qboolean	NET_GetAuxPacket( int handle, netadr_t *net_from, msg_t *net_message );
+void		NET_WatchAuxSocket( int handle, void (*callback)( int handle ) );
 
 #define	MAX_PACKETLEN	1400	// max size of a network packet
 
@@ -336,8 +356,18 @@ enum svc_ops_e {
 	// new commands, supported only by ioquake3 protocol but not legacy
 	svc_voipSpeex,     // not wrapped in USE_VOIP, so this value is reserved.
 	svc_voipOpus,      //
+
+	// sent only to relay clients authorized with sv_relayPassword
+	svc_relay,
 };
 
+// svc_relay lists players by short numbers with RELAY_PLAYER_DELTA set
+// if the state is delta compressed, MAX_SERVER_CLIENTS ends the list
+#define RELAY_PLAYER_DELTA		0x4000
+#if MAX_SERVER_CLIENTS >= RELAY_PLAYER_DELTA
+#error overflow: MAX_SERVER_CLIENTS >= RELAY_PLAYER_DELTA
+#endif
+
 
 //
 // client to server
@@ -358,6 +388,68 @@ enum clc_ops_e {
 /*
 ==============================================================
 
+SERVER MESSAGE PARSER
+
+Decodes gamestates and snapshots for headless clients, like the load
+generator and relay, see msg_parse.c
+
+==============================================================
+*/
+
+typedef struct {
+	qboolean		valid;				// delta source was available
+	int				messageNum;
+	int				serverTime;
+	int				parseEntitiesNum;	// first entity in parseEntities ring
+	int				numEntities;
+	playerState_t	ps;
+} parseSnapshot_t;
+
+typedef struct msgParser_s {
+	// set by owner, sinks other than drop may be NULL
+	void			*owner;
+	entityState_t	*baselines;			// [MAX_GENTITIES], may be shared by parsers of the same server
+	entityState_t	*parseEntities;		// ring of parseEntitiesMask + 1 states
+	int				parseEntitiesMask;
+
+	void			(*drop)( struct msgParser_s *p, const char *reason );
+	// gamestate passes every configstring, missing ones as empty strings
+	void			(*configstring)( struct msgParser_s *p, int index, const char *s );
+	void			(*gamestate)( struct msgParser_s *p );
+	// tokenized server command other than "cs" and "disconnect"
+	void			(*command)( struct msgParser_s *p, const char *s );
+	// every snapshot, also ones with lost delta source
+	void			(*snapshot)( struct msgParser_s *p, const parseSnapshot_t *snap );
+	// svFlags and singleClient of snapshot entity, zero unless svc_relay tells otherwise
+	void			(*entity)( struct msgParser_s *p, int index, int svFlags, int singleClient );
+	// svc_relay player state storage of valid snapshot, lookup only if !store
+	playerState_t	*(*playerstate)( struct msgParser_s *p, const parseSnapshot_t *snap, int clientNum, qboolean store );
+
+	int				serverMessageSequence;	// set by owner from netchan
+	int				serverCommandSequence;
+	int				commandKeys[ MAX_RELIABLE_COMMANDS ];	// MSG_HashKey() of received server commands
+	int				reliableSequence;		// last command sent by owner
+	int				reliableAcknowledge;
+
+	int				clientNum;
+	int				checksumFeed;
+
+	parseSnapshot_t	*snap;				// latest valid snapshot, NULL if none
+	parseSnapshot_t	snapshots[ PACKET_BACKUP ];
+	parseSnapshot_t	scratch;			// snapshots with lost delta source are parsed here
+	parseSnapshot_t	*parsed;			// snapshot of current message waiting for svc_relay
+	const parseSnapshot_t *parsedFrom;
+	int				parseEntitiesNum;
+	int				deltaErrors;		// relay player states with lost delta source
+} msgParser_t;
+
+void		MSG_ParserConnect( msgParser_t *p );
+qboolean	MSG_ParseServerMessage( msgParser_t *p, msg_t *msg );
+int			MSG_ParserCommandKey( const msgParser_t *p );
+
+/*
+==============================================================
+
 VIRTUAL MACHINE
 
 ==============================================================
@@ -401,6 +493,7 @@ typedef void (QDECL *dllEntry_t)( dllSyscall_t syscallptr );
 
 void	VM_Init( void );
 vm_t	*VM_Create( vmIndex_t index, syscall_t systemCalls, dllSyscall_t dllSyscalls, vmInterpret_t interpret );
+vm_t	*VM_CreateBuiltin( vmIndex_t index, syscall_t systemCalls, vmMainFunc_t entryPoint );
 
 void	VM_Free( vm_t *vm );
 void	VM_Clear(void);
@@ -610,6 +703,9 @@ unsigned Cvar_Flags( const char *var_name );
 void	Cvar_CommandCompletion( void(*callback)(const char *s) );
 // callback with each valid string
 
+void	Cvar_ForEach( void(*callback)(const cvar_t *var) );
+// callback with each existing cvar
+
 void 	Cvar_Reset( const char *var_name );
 void 	Cvar_ForceReset(const char *var_name);
 
@@ -749,6 +845,7 @@ qboolean FS_SV_FileExists( const char *file );
 
 fileHandle_t FS_SV_FOpenFileWrite( const char *filename );
 int		FS_SV_FOpenFileRead( const char *filename, fileHandle_t *fp );
+const char *FS_SV_OSPath( const char *filename );
 void	FS_SV_Rename( const char *from, const char *to );
 int		FS_FOpenFileRead( const char *qpath, fileHandle_t *file, qboolean uniqueFILE );
 // if uniqueFILE is true, then a new FILE will be fopened even if the file
@@ -790,6 +887,22 @@ int		FS_ReadFile( const char *qpath, void **buffer );
 // the buffer should be considered read-only, because it may be cached
 // for other uses.
 
+int		FS_ReadFileAsync( const char *qpath );
+// starts loading the file on i/o worker thread, returns handle for FS_WaitFile
+
+int		FS_WaitFile( int handle, void **buffer );
+// waits for FS_ReadFileAsync completion, returns the same as FS_ReadFile
+
+void	FS_PrefetchFiles( const char **qpaths, int count );
+// queues files which are about to be loaded, FS_FOpenFileRead and
+// FS_ReadFile pick them up without waiting for disk i/o and decompression
+
+void	FS_FlushPrefetch( void );
+// drops prefetched files which were not used
+
+void	FS_CancelAsyncReads( void );
+// drops all pending files, FS_ReadFileAsync handles become invalid
+
 void	FS_ForceFlush( fileHandle_t f );
 // forces flush on files we're writing to.
 
@@ -962,6 +1075,7 @@ void		Com_GameRestart( int checksumFeed, qboolean clientRestart );
 
 int			Com_EventLoop( void );
 int			Com_Milliseconds( void );	// will be journaled properly
+int64_t		Com_MillisecondsToUsec( int msec );
 
 // MD4 functions
 unsigned	Com_BlockChecksum( const void *buffer, int length );
@@ -1214,8 +1328,13 @@ void SV_Frame( int msec );
 void SV_TrackCvarChanges( void );
 void SV_PacketEvent( const netadr_t *from, msg_t *msg );
 int SV_FrameMsec( void );
+int64_t SV_FrameDeadline( void );
 qboolean SV_GameCommand( void );
 int SV_SendQueuedPackets( void );
+void SV_JournalCommand( const char *text );
+void SV_JournalExecute( void );
+qboolean SV_JournalPlaying( void );
+void SV_JournalPlayback( void );
 
 void SV_AddDedicatedCommands( void );
 void SV_RemoveDedicatedCommands( void );
@@ -1269,6 +1388,9 @@ void	Sys_QueEvent( int evTime, sysEventType_t evType, int value, int value2, int
 void	Sys_SendKeyEvents( void );
 void	Sys_Sleep( int msec );
 char	*Sys_ConsoleInput( void );
+#ifndef _WIN32
+int		Sys_ConsoleInputFd( void );
+#endif
 
 void	NORETURN FORMAT_PRINTF(1, 2) QDECL Sys_Error( const char *error, ... );
 void	NORETURN Sys_Quit( void );
@@ -1285,10 +1407,54 @@ uint64_t Sys_GetAffinityMask( void );
 qboolean Sys_SetAffinityMask( const uint64_t mask );
 #endif
 
+// threads and synchronization primitives, used by worker pools
+typedef struct sysThread_s sysThread_t;
+typedef struct sysMutex_s sysMutex_t;
+typedef struct sysCond_s sysCond_t;
+typedef void (*sysThreadFunc_t)( void *arg );
+
+sysThread_t *Sys_CreateThread( sysThreadFunc_t func, void *arg );
+void	Sys_JoinThread( sysThread_t *thread );
+sysMutex_t *Sys_CreateMutex( void );
+void	Sys_DestroyMutex( sysMutex_t *mutex );
+void	Sys_LockMutex( sysMutex_t *mutex );
+void	Sys_UnlockMutex( sysMutex_t *mutex );
+sysCond_t *Sys_CreateCond( void );
+void	Sys_DestroyCond( sysCond_t *cond );
+void	Sys_CondWait( sysCond_t *cond, sysMutex_t *mutex );
+void	Sys_CondSignal( sysCond_t *cond );
+void	Sys_CondBroadcast( sysCond_t *cond );
+
+// worker pool for data-parallel loops, see jobs.c
+typedef void (*jobFunc_t)( void *arg, int index );
+
+int		Com_SetJobWorkers( int count );
+int		Com_JobWorkers( void );
+void	Com_RunJobs( jobFunc_t func, void *arg, int count );
+void	Com_ShutdownJobs( void );
+
+// frame phase profiler, see profile.c
+void	Com_ProfileSetFrames( int frames );
+void	Com_ProfileFrame( void );
+int64_t	Com_ProfileStart( void );
+void	Com_ProfileSpan( const char *name, int64_t start );
+int64_t	Com_ProfileCount( const char *name, int64_t start );
+void	Com_ProfileAdd( const char *name, int64_t usec );
+void	Com_ProfileSummary( void );
+void	Com_ProfileDump( const char *filename );
+
+// headless load generator, see loadgen.c
+void	LoadGen_Init( void );
+void	LoadGen_Shutdown( void );
+void	LoadGen_Frame( void );
+qboolean LoadGen_Active( void );
+int		LoadGen_FrameMsec( int msec );
+
 // Sys_Milliseconds should only be used for profiling purposes,
 // any game related timing information should come from event timestamps
 int		Sys_Milliseconds( void );
 int64_t	Sys_Microseconds( void );
+int64_t	Sys_ProcessTime( void );	// cpu time used by the process, usec
 
 void	Sys_SnapVector( float *vector );
 
@@ -1307,10 +1473,13 @@ qboolean	Sys_StringToAdr( const char *s, netadr_t *a, netadrtype_t family );
 
 qboolean	Sys_IsLANAddress(const netadr_t *adr);
 void		Sys_ShowIP(void);
+int			Sys_LocalAddresses( netadr_t *list, int max );
 
 qboolean	Sys_Mkdir( const char *path );
 FILE	*Sys_FOpen( const char *ospath, const char *mode );
 qboolean Sys_ResetReadOnlyAttribute( const char *ospath );
+void	*Sys_MapFile( FILE *f, size_t length );	// read-only view, NULL on failure
+void	Sys_UnmapFile( void *base, size_t length );
 
 const char *Sys_Pwd( void );
 const char *Sys_DefaultBasePath( void );
@@ -1347,6 +1516,9 @@ void HuffmanPutBit( byte* fout, int32_t bitIndex, int bit );
 int HuffmanPutSymbol( byte* fout, uint32_t offset, int symbol );
 int HuffmanGetBit( const byte* buffer, int bitIndex );
 int HuffmanGetSymbol( unsigned int* symbol, const byte* buffer, int bitIndex );
+void HuffmanInit( void );
+int HuffmanPutBits( byte* fout, int32_t bitIndex, uint32_t value, int bits );
+int HuffmanGetBits( uint32_t* value, const byte* buffer, int32_t bitIndex, int bits );
 
 #define	SV_ENCODE_START		4
 #define	SV_DECODE_START		12
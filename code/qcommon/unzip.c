@@ -2127,6 +2127,111 @@ extern int unzReadCurrentFile  (unzFile file, void *buf, unsigned len)
 }
 
 
+
+static void *unzlocal_malloc (void *opaque, unsigned items, unsigned size)
+{
+	return malloc( (size_t)items * size );
+}
+
+static void unzlocal_free (void *opaque, void *ptr)
+{
+	free( ptr );
+}
+
+
+extern int unzReadFileAtPosition (FILE *fin, unsigned long pos, void *buf, unsigned len)
+{
+	unz_s s;
+	z_stream stream;
+	uInt iSizeVar;
+	uLong offset_local_extrafield;
+	uInt size_local_extrafield;
+	uLong rest_read_compressed;
+	char *read_buffer;
+	int err;
+
+	Com_Memset( &s, 0, sizeof( s ) );
+	s.file = fin;
+	s.pos_in_central_dir = pos;
+
+	err = unzlocal_GetCurrentFileInfoInternal( &s, &s.cur_file_info, &s.cur_file_info_internal,
+		NULL, 0, NULL, 0, NULL, 0 );
+	if ( err != UNZ_OK )
+		return err;
+
+	if ( s.cur_file_info.uncompressed_size != len )
+		return UNZ_BADZIPFILE;
+
+	err = unzlocal_CheckCurrentFileCoherencyHeader( &s, &iSizeVar, &offset_local_extrafield, &size_local_extrafield );
+	if ( err != UNZ_OK )
+		return err;
+
+	if ( fseek( fin, s.cur_file_info_internal.offset_curfile + SIZEZIPLOCALHEADER + iSizeVar, SEEK_SET ) != 0 )
+		return UNZ_ERRNO;
+
+	if ( s.cur_file_info.compression_method == 0 )
+	{
+		if ( len && fread( buf, len, 1, fin ) != 1 )
+			return UNZ_ERRNO;
+		return UNZ_OK;
+	}
+
+	read_buffer = malloc( UNZ_BUFSIZE );
+	if ( read_buffer == NULL )
+		return UNZ_INTERNALERROR;
+
+	Com_Memset( &stream, 0, sizeof( stream ) );
+	stream.zalloc = unzlocal_malloc;
+	stream.zfree = unzlocal_free;
+
+	err = inflateInit2( &stream, -MAX_WBITS );
+	if ( err != Z_OK )
+	{
+		free( read_buffer );
+		return UNZ_INTERNALERROR;
+	}
+
+	stream.next_out = (Byte*)buf;
+	stream.avail_out = (uInt)len;
+	rest_read_compressed = s.cur_file_info.compressed_size;
+
+	while ( stream.avail_out > 0 )
+	{
+		if ( stream.avail_in == 0 && rest_read_compressed > 0 )
+		{
+			uInt uReadThis = UNZ_BUFSIZE;
+			if ( rest_read_compressed < uReadThis )
+				uReadThis = (uInt)rest_read_compressed;
+			if ( fread( read_buffer, uReadThis, 1, fin ) != 1 )
+			{
+				err = UNZ_ERRNO;
+				break;
+			}
+			rest_read_compressed -= uReadThis;
+			stream.next_in = (Byte*)read_buffer;
+			stream.avail_in = uReadThis;
+		}
+
+		err = inflate( &stream, Z_SYNC_FLUSH );
+		if ( err == Z_STREAM_END )
+		{
+			err = Z_OK;
+			break;
+		}
+		if ( err != Z_OK )
+			break;
+	}
+
+	if ( err == Z_OK && stream.avail_out != 0 )
+		err = UNZ_BADZIPFILE;
+
+	inflateEnd( &stream );
+	free( read_buffer );
+
+	return err;
+}
+
+
 /*
   Give the current position in uncompressed data
 */
@@ -308,6 +308,18 @@ extern int unzReadCurrentFile (unzFile file, void* buf, unsigned len);
     (UNZ_ERRNO for IO error, or zLib error for uncompress error)
 */
 
+extern int unzReadFileAtPosition (FILE *fin, unsigned long pos, void *buf, unsigned len);
+
+/*
+  Read the whole file which info is at pos in the central directory
+  (as returned by unzGetCurrentFileInfoPosition) into buf of len bytes.
+  Uses only the given FILE and malloc() so it is safe to call from any thread,
+  the zip file is expected to have no data before its first local header.
+
+  return UNZ_OK if the file was read completely
+  return <0 with error code if there is an error
+*/
+
 extern long unztell(unzFile file);
 
 /*
@@ -1660,6 +1660,11 @@ This allows a server to do a map_restart without changing memory allocation
 vm_t *VM_Restart( vm_t *vm ) {
 	vmHeader_t	*header;
 
+	// nothing to reload for modules linked into executable
+	if ( vm->entryPoint && !vm->dllHandle ) {
+		return vm;
+	}
+
 	// DLL's can't be restarted in place
 	if ( vm->dllHandle ) {
 		syscall_t		systemCall;
@@ -1851,6 +1856,50 @@ vm_t *VM_Create( vmIndex_t index, syscall_t systemCalls, dllSyscall_t dllSyscall
 }
 
 
+/*
+================
+VM_CreateBuiltin
+
+Sets up a module which is linked into executable, it is called
+like a dll with native pointers but nothing is loaded from disk
+================
+*/
+vm_t *VM_CreateBuiltin( vmIndex_t index, syscall_t systemCalls, vmMainFunc_t entryPoint ) {
+	vm_t		*vm;
+
+	if ( !systemCalls || !entryPoint ) {
+		Com_Error( ERR_FATAL, "VM_CreateBuiltin: bad parms" );
+	}
+
+	if ( (unsigned)index >= VM_COUNT ) {
+		Com_Error( ERR_DROP, "VM_CreateBuiltin: bad vm index %i", index );
+	}
+
+	vm = &vmTable[ index ];
+
+	// see if we already have the VM
+	if ( vm->name ) {
+		if ( vm->entryPoint != entryPoint ) {
+			Com_Error( ERR_DROP, "VM_CreateBuiltin: vm %s is already loaded", vm->name );
+		}
+		return vm;
+	}
+
+	vm->name = vmName[ index ];
+	vm->index = index;
+	vm->systemCall = systemCalls;
+	vm->entryPoint = entryPoint;
+	vm->privateFlag = 0;
+	vm->dataAlloc = ~0U;
+	vm->dataMask = ~0U;
+	vm->dataBase = 0;
+
+	Com_Printf( "Using built-in %s module.\n", vm->name );
+
+	return vm;
+}
+
+
 /*
 ==============
 VM_Free
@@ -2112,13 +2112,13 @@ static void R_LoadEntities( const lump_t *l ) {
 	w->lightGridSize[1] = 64;
 	w->lightGridSize[2] = 128;
 
-	p = (const char *)(fileBase + l->fileofs);
-
 	// store for reference by the cgame
 	w->entityString = ri.Hunk_Alloc( l->filelen + 1, h_low );
-	strcpy( w->entityString, p );
+	Com_Memcpy( w->entityString, fileBase + l->fileofs, l->filelen );
 	w->entityParsePoint = w->entityString;
 
+	p = w->entityString;
+
 	token = COM_ParseExt( &p, qtrue );
 	if (*token != '{') {
 		return;
@@ -2210,7 +2210,7 @@ Called directly from cgame
 void RE_LoadWorldMap( const char *name ) {
 	int			i;
 	int32_t		size;
-	dheader_t	*header;
+	dheader_t	*header, fileHeader;
 	union {
 		byte *b;
 		void *v;
@@ -2255,8 +2255,10 @@ void RE_LoadWorldMap( const char *name ) {
 	startMarker = ri.Hunk_Alloc(0, h_low);
 	c_gridVerts = 0;
 
-	header = (dheader_t *)buffer.b;
-	fileBase = (byte *)header;
+	// buffer may be a read-only file mapping
+	fileHeader = *(dheader_t *)buffer.b;
+	header = &fileHeader;
+	fileBase = buffer.b;
 
 	// swap all the lumps
 	for ( i = 0; i < sizeof( dheader_t ) / 4; i++ ) {
@@ -3541,6 +3541,14 @@ static int loadShaderBuffers( char **shaderFiles, const int numShaderFiles, char
 	const char *shaderStart;
 	qboolean denyErrors;
 
+	// let i/o workers read and decompress files while they are parsed
+	for ( i = 0; i < numShaderFiles; i++ )
+	{
+		Com_sprintf( filename, sizeof( filename ), "scripts/%s", shaderFiles[i] );
+		p = filename;
+		ri.FS_PrefetchFiles( &p, 1 );
+	}
+
 	// load and parse shader files
 	for ( i = 0; i < numShaderFiles; i++ )
 	{
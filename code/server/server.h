@@ -32,10 +32,15 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 #define	PERS_SCORE				0		// !!! MUST NOT CHANGE, SERVER AND
 										// GAME BOTH REFERENCE !!!
 
+#if CS_PLAYERS_EXT + MAX_SERVER_CLIENTS - MAX_CLIENTS > MAX_CONFIGSTRINGS
+#error overflow: (CS_PLAYERS_EXT + MAX_SERVER_CLIENTS - MAX_CLIENTS) > MAX_CONFIGSTRINGS
+#endif
+
 #define	MAX_ENT_CLUSTERS	16
 
 typedef struct svEntity_s {
 	struct worldSector_s *worldSector;
+	struct worldOctant_s *worldOctant;
 	struct svEntity_s *nextEntityInWorldSector;
 
 	entityState_t	baseline;		// for delta compression of initial sighting
@@ -43,7 +48,6 @@ typedef struct svEntity_s {
 	int			clusternums[MAX_ENT_CLUSTERS];
 	int			lastCluster;		// if all the clusters don't fit in clusternums
 	int			areanum, areanum2;
-	int			snapshotCounter;	// used to prevent double adding from portal views
 } svEntity_t;
 
 typedef enum {
@@ -71,7 +75,6 @@ typedef struct {
 	int				serverId;			// changes each server start
 	int				restartedServerId;	// changes each map restart
 	int				checksumFeed;		// the feed key that we use to compute the pure checksum strings
-	int				snapshotCounter;	// incremented for each snapshot built
 	int				timeResidual;		// <= 1000 / sv_frame->value
 	char			*configstrings[MAX_CONFIGSTRINGS];
 	svEntity_t		svEntities[MAX_GENTITIES];
@@ -85,11 +88,17 @@ typedef struct {
 
 	playerState_t	*gameClients;
 	int				gameClientSize;		// will be > sizeof(playerState_t) due to game private data
+	int				gameClientLimit;	// client slots game module supports, MAX_CLIENTS unless negotiated
 
 	int				restartTime;
 	int				time;
 
 	byte			baselineUsed[ MAX_GENTITIES ];
+
+	// configstring changes not yet sent to active clients
+	int				csPending[ MAX_CONFIGSTRINGS ];
+	int				numCsPending;
+	byte			csDirty[ MAX_CONFIGSTRINGS ];
 } server_t;
 
 typedef struct {
@@ -156,11 +165,32 @@ typedef enum {
 	GSA_ACKED		// gamestate acknowledged, no retansmissions needed
 } gameStateAck_t;
 
+// broadcast reliable server command, shared by all clients it was sent to
+typedef struct {
+	int				refCount;
+	int				bits;			// Huffman encoded string, 0 if not encoded
+	byte			*data;
+	char			text[1];		// variable sized
+} svCommand_t;
+
+// snapshot entity changes deferred because of client's rate
+typedef struct {
+	int				priority;		// accumulated while deferred
+	int				deferTime;		// svs.time of first deferral, 0 if sent
+} entityPriority_t;
+
+// other players seen by relay client, delta source for svc_relay
+typedef struct {
+	uint32_t		valid[MAX_SERVER_CLIENTS/32];	// bit per client number
+	playerState_t	ps[MAX_SERVER_CLIENTS];
+} relayFrame_t;
+
 typedef struct client_s {
 	clientState_t	state;
 	char			userinfo[MAX_INFO_STRING];		// name, etc
 
 	char			reliableCommands[MAX_RELIABLE_COMMANDS][MAX_STRING_CHARS];
+	svCommand_t		*sharedCommands[MAX_RELIABLE_COMMANDS];	// broadcast stored instead of reliableCommands, if set
 	int				reliableSequence;		// last added reliable message, not necessarily sent or acknowledged yet
 	int				reliableAcknowledge;	// last acknowledged reliable message
 	int				messageAcknowledge;
@@ -202,6 +232,7 @@ typedef struct client_s {
 	int				ping;
 	int				rate;				// bytes / second, 0 - unlimited
 	int				snapshotMsec;		// requests a snapshot every snapshotMsec unless rate choked
+	entityPriority_t	entityPriority[MAX_GENTITIES];	// see SV_LimitSnapshotEntities()
 	qboolean		pureAuthentic;
 	qboolean		gotCP;				// TTimo - additional flag to distinguish between a bad pure checksum, and no cp command at all
 	netchan_t		netchan;
@@ -229,6 +260,10 @@ typedef struct client_s {
 	char			tld[3]; // "XX\0"
 	const char		*country;
 
+	// authorized with sv_relayPassword, gets all entities and players
+	qboolean		relay;
+	relayFrame_t	*relayFrames;		// [PACKET_BACKUP]
+
 } client_t;
 
 //=============================================================================
@@ -260,8 +295,37 @@ typedef struct {
 	snapshotFrame_t	snapFrames[ NUM_SNAPSHOT_FRAMES ];
 	snapshotFrame_t	*currFrame; // current frame that clients can refer
 
+	// idle hibernation, game time is frozen while hibernating
+	qboolean	hibernating;
+	int			lastHumanTime;			// svs.time when last human client was seen
+	int			hibernateStart;			// svs.time when hibernation started
+	int			hibernateFrames;		// game frames skipped so far
+	int64_t		hibernateCPU;			// Sys_ProcessTime() when hibernation started
+
+	int			queryTime;				// usec spent on getinfo/getstatus in current frame
+
+	int64_t		nextFrameUsec;			// absolute Sys_Microseconds() time of next game frame, 0 if unknown
+
+	// configstring update statistics, see SV_FlushConfigstrings()
+	int			csChanges;				// configstring changes during game
+	int			csCoalesced;			// changes that replaced a pending one
+	int			csUpdatesSent;			// per-client updates sent
+	int			csUpdatesSaved;			// per-client updates skipped by coalescing
+
+	// client numbers in use, see SV_SetClientState(), may also
+	// contain slots released since last SV_UpdateClientLists()
+	int			numConnectedClients;	// state != CS_FREE
+	int			connectedClients[ MAX_SERVER_CLIENTS ];
+	int			numActiveClients;		// state == CS_ACTIVE
+	int			activeClients[ MAX_SERVER_CLIENTS ];
+	byte		clientListed[ MAX_SERVER_CLIENTS ];	// CLIENT_LISTED_* bits
+	qboolean	clientListsChanged;
+
 } serverStatic_t;
 
+#define CLIENT_LISTED_CONNECTED	1
+#define CLIENT_LISTED_ACTIVE	2
+
 #ifdef USE_BANS
 #define SERVER_MAXBANS	1024
 // Structure for managing bans
@@ -289,6 +353,7 @@ extern	cvar_t	*sv_privatePassword;
 extern	cvar_t	*sv_allowDownload;
 extern	cvar_t	*sv_maxclients;
 extern	cvar_t	*sv_maxclientsPerIP;
+extern	cvar_t	*sv_clientLimit;
 extern	cvar_t	*sv_clientTLD;
 
 extern	cvar_t	*sv_privateClients;
@@ -312,6 +377,26 @@ extern	cvar_t	*sv_lanForceRate;
 extern	cvar_t *sv_levelTimeReset;
 extern	cvar_t *sv_filter;
 
+extern	cvar_t	*sv_snapshotThreads;
+extern	cvar_t	*sv_snapshotVerify;
+extern	cvar_t	*sv_visCache;
+extern	cvar_t	*sv_deltaCache;
+extern	cvar_t	*sv_worldIndex;
+extern	cvar_t	*sv_traceBatchJobs;
+extern	cvar_t	*sv_profileFrames;
+extern	cvar_t	*sv_hibernateTime;
+extern	cvar_t	*sv_queryBudget;
+extern	cvar_t	*sv_coalesceConfigstrings;
+extern	cvar_t	*sv_snapshotBudget;
+extern	cvar_t	*sv_dlURL;
+extern	cvar_t	*sv_httpServer;
+extern	cvar_t	*sv_httpPort;
+extern	cvar_t	*sv_httpRate;
+extern	cvar_t	*sv_httpURL;
+extern	cvar_t	*sv_relayPassword;
+extern	cvar_t	*sv_relayName;
+extern	cvar_t	*sv_relayRate;
+
 #ifdef USE_BANS
 extern	cvar_t	*sv_banFile;
 extern	serverBan_t serverBans[SERVER_MAXBANS];
@@ -328,6 +413,8 @@ qboolean SVC_RateLimitAddress( const netadr_t *from, int burst, int period );
 void SVC_RateRestoreBurstAddress( const netadr_t *from, int burst, int period );
 void SVC_RateRestoreToxicAddress( const netadr_t *from, int burst, int period );
 void SVC_RateDropAddress( const netadr_t *from, int burst, int period );
+void SV_InvalidateQueryCache( void );
+void SV_HibernateBench_f( void );
 
 void QDECL SV_SendServerCommand( client_t *cl, const char *fmt, ...) __attribute__ ((format (printf, 2, 3)));
 
@@ -336,6 +423,7 @@ void SV_RemoveOperatorCommands( void );
 
 void SV_MasterShutdown( void );
 int SV_RateMsec( const client_t *client );
+int SV_RateBytes( const client_t *client, int msec );
 
 
 //
@@ -344,6 +432,7 @@ int SV_RateMsec( const client_t *client );
 void SV_SetConfigstring( int index, const char *val );
 void SV_GetConfigstring( int index, char *buffer, int bufferSize );
 void SV_UpdateConfigstrings( client_t *client );
+void SV_FlushConfigstrings( void );
 
 void SV_SetUserinfo( int index, const char *val );
 void SV_GetUserinfo( int index, char *buffer, int bufferSize );
@@ -360,11 +449,18 @@ void SV_InitChallenger( void );
 
 void SV_DirectConnect( const netadr_t *from );
 void SV_PrintClientStateChange( const client_t *cl, clientState_t newState );
+int SV_ClientSlotLimit( const char *userinfo );
+void SV_SetClientState( client_t *client, clientState_t state );
+void SV_UpdateClientLists( void );
 
 void SV_ExecuteClientMessage( client_t *cl, msg_t *msg );
 void SV_UserinfoChanged( client_t *cl, qboolean updateUserinfo, qboolean runFilter );
 
 void SV_ClientEnterWorld( client_t *client );
+void SV_WriteGamestateConfigstring( msg_t *msg, int index );
+void SV_WriteGamestateConfigstrings( msg_t *msg );
+void SV_WriteGamestateBaselines( msg_t *msg );
+void SV_InvalidateGamestateCache( qboolean baselines );
 void SV_FreeClient( client_t *client );
 void SV_DropClient( client_t *drop, const char *reason );
 
@@ -387,11 +483,19 @@ client_t *SV_GetPlayerByHandle( void );
 // sv_snapshot.c
 //
 void SV_AddServerCommand( client_t *client, const char *cmd );
-void SV_UpdateServerCommandsToClient( client_t *client, msg_t *msg );
+svCommand_t *SV_CreateServerCommand( const char *text, qboolean encode );
+void SV_ReleaseServerCommand( svCommand_t *command );
+void SV_AddSharedServerCommand( client_t *client, svCommand_t *command );
+void SV_SetReliableCommand( client_t *client, int sequence, svCommand_t *command );
+void SV_ClearReliableCommands( client_t *client );
+const char *SV_ReliableCommand( const client_t *client, int sequence );
+void SV_UpdateServerCommandsToClient( const client_t *client, msg_t *msg );
 void SV_WriteFrameToClient( client_t *client, msg_t *msg );
 void SV_SendMessageToClient( msg_t *msg, client_t *client );
 void SV_SendClientMessages( void );
 void SV_SendClientSnapshot( client_t *client );
+void SV_ShutdownSnapshotThreads( void );
+void SV_SnapshotBench_f( void );
 
 void SV_InitSnapshotStorage( void );
 void SV_IssueNewSnapshot( void );
@@ -409,6 +513,7 @@ sharedEntity_t *SV_GEntityForSvEntity( svEntity_t *svEnt );
 void		SV_InitGameProgs ( void );
 void		SV_ShutdownGameProgs ( void );
 void		SV_RestartGameProgs( void );
+void		SV_LocateGameData( sharedEntity_t *gEnts, int numGEntities, int sizeofGEntity_t, playerState_t *clients, int sizeofGameClient );
 qboolean	SV_inPVS (const vec3_t p1, const vec3_t p2);
 
 //
@@ -453,6 +558,7 @@ clipHandle_t SV_ClipHandleForEntity( const sharedEntity_t *ent );
 
 
 void SV_SectorList_f( void );
+void SV_WorldBench_f( void );
 
 
 int SV_AreaEntities( const vec3_t mins, const vec3_t maxs, int *entityList, int maxcount );
@@ -479,6 +585,9 @@ void SV_Trace( trace_t *results, const vec3_t start, const vec3_t mins, const ve
 
 // passEntityNum is explicitly excluded from clipping checks (normally ENTITYNUM_NONE)
 
+void SV_TraceBatch( trace_t *results, const traceRequest_t *requests, int count );
+// same as SV_Trace() for each request, world clipping may run on job workers
+
 
 void SV_ClipToEntity( trace_t *trace, const vec3_t start, const vec3_t mins, const vec3_t maxs, const vec3_t end, int entityNum, int contentmask, qboolean capsule );
 // clip to a specific entity
@@ -491,6 +600,52 @@ int SV_Netchan_TransmitNextFragment( client_t *client );
 qboolean SV_Netchan_Process( client_t *client, msg_t *msg );
 void SV_Netchan_FreeQueue( client_t *client );
 
+//
+// sv_demo.c
+//
+void SV_Record_f( void );
+void SV_StopRecord_f( void );
+void SV_StopClientDemo( client_t *client );
+void SV_WriteDemoMessage( const client_t *client, const msg_t *msg );
+qboolean SV_DemoKeyframe( const client_t *client );
+void SV_ShutdownDemos( void );
+
+//
+// sv_journal.c
+//
+void SV_Journal_f( void );
+void SV_StopJournal_f( void );
+void SV_PlayJournal_f( void );
+void SV_JournalStart( const char *command );
+void SV_StopJournal( void );
+qboolean SV_JournalActive( void );
+int SV_JournalInt( int value );
+int SV_Milliseconds( void );
+void SV_JournalPacket( const netadr_t *from, const msg_t *msg );
+void SV_JournalIdle( void );
+void SV_JournalFrame( int msec );
+
+//
+// sv_http.c
+//
+void SV_HttpFrame( void );
+void SV_HttpShutdown( void );
+const char *SV_HttpServerInfo( const char *info );
+void SV_HttpStatus_f( void );
+
+//
+// sv_relay.c
+//
+qboolean SV_RelayActive( void );
+int SV_RelayClientNum( void );
+void SV_RelayFrame( void );
+void SV_RelayShutdown( void );
+intptr_t QDECL SV_RelayGameMain( int command, int arg0, int arg1, int arg2 );
+void SV_Relay_f( void );
+void SV_StopRelay_f( void );
+void SV_RelayCmd_f( void );
+void SV_RelayStatus_f( void );
+
 //
 // sv_filter.c
 //
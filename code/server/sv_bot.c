@@ -45,23 +45,26 @@ SV_BotAllocateClient
 ==================
 */
 int SV_BotAllocateClient( void ) {
-	int			i;
+	int			i, limit;
 	client_t	*cl;
 
+	// bots are handled by game module only
+	limit = SV_ClientSlotLimit( NULL );
+
 	// find a client slot
-	for ( i = 0, cl = svs.clients; i < sv.maxclients; i++, cl++ ) {
+	for ( i = 0, cl = svs.clients; i < limit; i++, cl++ ) {
 		if ( cl->state == CS_FREE ) {
 			break;
 		}
 	}
 
-	if ( i == sv.maxclients ) {
+	if ( i == limit ) {
 		return -1;
 	}
 
 	cl->gentity = SV_GentityNum( i );
 	cl->gentity->s.number = i;
-	cl->state = CS_ACTIVE;
+	SV_SetClientState( cl, CS_ACTIVE );
 	cl->lastPacketTime = svs.time;
 	cl->snapshotMsec = 1000 / sv_fps->integer;
 	cl->netchan.remoteAddress.type = NA_BOT;
@@ -87,7 +90,7 @@ void SV_BotFreeClient( int clientNum ) {
 	}
 
 	cl = &svs.clients[clientNum];
-	cl->state = CS_FREE;
+	SV_SetClientState( cl, CS_FREE );
 	cl->name[0] = '\0';
 	if ( cl->gentity ) {
 		cl->gentity->r.svFlags &= ~SVF_BOT;
@@ -574,7 +577,7 @@ void SV_BotInitBotLib(void) {
 	botlib_import.DebugPolygonCreate = BotImport_DebugPolygonCreate;
 	botlib_import.DebugPolygonDelete = BotImport_DebugPolygonDelete;
 
-	botlib_import.Sys_Milliseconds = Sys_Milliseconds;
+	botlib_import.Sys_Milliseconds = SV_Milliseconds;
 
 	botlib_export = (botlib_export_t *)GetBotLibAPI( BOTLIB_API_VERSION, &botlib_import );
 	assert(botlib_export); 	// somehow we end up with a zero import.
@@ -594,7 +597,7 @@ int SV_BotGetConsoleMessage( int client, char *buf, int size )
 {
 	if ( (unsigned) client < sv.maxclients ) {
 		client_t* cl;
-		int index;
+		const char *cmd;
 
 		cl = &svs.clients[client];
 		cl->lastPacketTime = svs.time;
@@ -604,13 +607,13 @@ int SV_BotGetConsoleMessage( int client, char *buf, int size )
 		}
 
 		cl->reliableAcknowledge++;
-		index = cl->reliableAcknowledge & ( MAX_RELIABLE_COMMANDS - 1 );
+		cmd = SV_ReliableCommand( cl, cl->reliableAcknowledge );
 
-		if ( !cl->reliableCommands[index][0] ) {
+		if ( !cmd[0] ) {
 			return qfalse;
 		}
 
-		Q_strncpyz( buf, cl->reliableCommands[index], size );
+		Q_strncpyz( buf, cmd, size );
 		return qtrue;
 	} else {
 		return qfalse;
@@ -211,6 +211,9 @@ static void SV_Map_f( void ) {
 	// and thus nuke the arguments of the map command
 	Q_strncpyz(mapname, map, sizeof(mapname));
 
+	// start armed server journal
+	SV_JournalStart( va( "%s %s", Cmd_Argv( 0 ), mapname ) );
+
 	// start up the map
 	SV_SpawnServer( mapname, killBots );
 
@@ -1196,8 +1199,8 @@ static void SV_Status_f( void ) {
 	const char *s;
 	int max_namelength;
 	int max_addrlength;
-	char names[ MAX_CLIENTS * MAX_NAME_LENGTH ], *np[ MAX_CLIENTS ], nl[ MAX_CLIENTS ], *nc;
-	char addrs[ MAX_CLIENTS * 48 ], *ap[ MAX_CLIENTS ], al[ MAX_CLIENTS ], *ac;
+	char names[ MAX_SERVER_CLIENTS * MAX_NAME_LENGTH ], *np[ MAX_SERVER_CLIENTS ], nl[ MAX_SERVER_CLIENTS ], *nc;
+	char addrs[ MAX_SERVER_CLIENTS * 48 ], *ap[ MAX_SERVER_CLIENTS ], al[ MAX_SERVER_CLIENTS ], *ac;
 
 	// make sure server is running
 	if ( !com_sv_running->integer ) {
@@ -1510,6 +1513,66 @@ static void SV_Locations_f( void ) {
 	SV_PrintLocations_f( NULL );
 }
 
+
+/*
+==================
+SV_Profile_f
+
+sv_profile [dump [filename]]
+==================
+*/
+static void SV_Profile_f( void ) {
+	char filename[ MAX_QPATH ];
+	const char *cmd;
+
+	if ( !sv_profileFrames->integer ) {
+		Com_Printf( "Profiler is disabled, set sv_profileFrames to enable it.\n" );
+		return;
+	}
+
+	cmd = Cmd_Argv( 1 );
+
+	if ( !*cmd ) {
+		Com_ProfileSummary();
+		return;
+	}
+
+	if ( !Q_stricmp( cmd, "dump" ) ) {
+		if ( Cmd_Argc() > 2 ) {
+			Q_strncpyz( filename, Cmd_Argv( 2 ), sizeof( filename ) );
+		} else {
+			Com_sprintf( filename, sizeof( filename ), "profile-%i.json", svs.time );
+		}
+		COM_DefaultExtension( filename, sizeof( filename ), ".json" );
+		Com_ProfileDump( filename );
+		return;
+	}
+
+	Com_Printf( "usage: sv_profile [dump [filename]]\n" );
+}
+
+
+/*
+=================
+SV_ConfigstringStats_f
+
+Prints configstring update statistics
+=================
+*/
+static void SV_ConfigstringStats_f( void ) {
+
+	if ( !Q_stricmp( Cmd_Argv( 1 ), "reset" ) ) {
+		svs.csChanges = 0;
+		svs.csCoalesced = 0;
+		svs.csUpdatesSent = 0;
+		svs.csUpdatesSaved = 0;
+		return;
+	}
+
+	Com_Printf( "configstring changes: %i, coalesced: %i\n", svs.csChanges, svs.csCoalesced );
+	Com_Printf( "client updates sent: %i, saved: %i\n", svs.csUpdatesSent, svs.csUpdatesSaved );
+}
+
 //===========================================================
 
 /*
@@ -1582,6 +1645,21 @@ void SV_AddOperatorCommands( void ) {
 #endif
 	Cmd_AddCommand( "filter", SV_AddFilter_f );
 	Cmd_AddCommand( "filtercmd", SV_AddFilterCmd_f );
+	Cmd_AddCommand( "sv_record", SV_Record_f );
+	Cmd_AddCommand( "sv_stoprecord", SV_StopRecord_f );
+	Cmd_AddCommand( "snapshotbench", SV_SnapshotBench_f );
+	Cmd_AddCommand( "hibernatebench", SV_HibernateBench_f );
+	Cmd_AddCommand( "worldbench", SV_WorldBench_f );
+	Cmd_AddCommand( "sv_profile", SV_Profile_f );
+	Cmd_AddCommand( "sv_journal", SV_Journal_f );
+	Cmd_AddCommand( "sv_stopjournal", SV_StopJournal_f );
+	Cmd_AddCommand( "sv_playjournal", SV_PlayJournal_f );
+	Cmd_AddCommand( "sv_csstats", SV_ConfigstringStats_f );
+	Cmd_AddCommand( "sv_httpstatus", SV_HttpStatus_f );
+	Cmd_AddCommand( "sv_relay", SV_Relay_f );
+	Cmd_AddCommand( "sv_stoprelay", SV_StopRelay_f );
+	Cmd_AddCommand( "sv_relaycmd", SV_RelayCmd_f );
+	Cmd_AddCommand( "sv_relaystatus", SV_RelayStatus_f );
 }
 
 
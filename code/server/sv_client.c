@@ -376,7 +376,7 @@ static void SV_SetTLD( char *str, const netadr_t *from, qboolean isLAN )
 }
 
 
-static int seqs[ MAX_CLIENTS ];
+static int seqs[ MAX_SERVER_CLIENTS ];
 
 static void SV_SaveSequences( void ) {
 	int i;
@@ -387,24 +387,48 @@ static void SV_SaveSequences( void ) {
 
 
 static void SV_InjectLocation( const char *tld, const char *country ) {
-	const char *cmd;
-	char *str;
+	svCommand_t *shared, *from, *to;
+	char text[ MAX_STRING_CHARS ];
+	char *cmd, *str;
 	int i, n;
+	// broadcast message is shared so replace it only once
+	from = to = NULL;
 	for ( i = 0; i < sv.maxclients; i++ ) {
 		if ( seqs[i] != svs.clients[i].reliableSequence ) {
 			for ( n = seqs[i]; n != svs.clients[i].reliableSequence + 1; n++ ) {
-				cmd = svs.clients[i].reliableCommands[n & (MAX_RELIABLE_COMMANDS-1)];
+				shared = svs.clients[i].sharedCommands[n & (MAX_RELIABLE_COMMANDS-1)];
+				if ( shared && shared == from ) {
+					SV_SetReliableCommand( &svs.clients[i], n, to );
+					break;
+				}
+				if ( shared ) {
+					Q_strncpyz( text, shared->text, sizeof( text ) );
+					cmd = text;
+				} else {
+					cmd = svs.clients[i].reliableCommands[n & (MAX_RELIABLE_COMMANDS-1)];
+				}
 				str = strstr( cmd, "connected\n\"" );
 				if ( str && str[11] == '\0' && str < cmd + 512 ) {
 					if ( *tld == '\0' )
 						sprintf( str, S_COLOR_WHITE "connected (%s)\n\"", country );
 					else
 						sprintf( str, S_COLOR_WHITE "connected (" S_COLOR_RED "%s" S_COLOR_WHITE ", %s)\n\"", tld, country );
+					if ( shared ) {
+						if ( to ) {
+							SV_ReleaseServerCommand( to );
+						}
+						from = shared;
+						to = SV_CreateServerCommand( text, qtrue );
+						SV_SetReliableCommand( &svs.clients[i], n, to );
+					}
 					break;
 				}
 			}
 		}
 	}
+	if ( to ) {
+		SV_ReleaseServerCommand( to );
+	}
 }
 
 
@@ -457,6 +481,102 @@ void SV_PrintClientStateChange( const client_t *cl, clientState_t newState ) {
 }
 
 
+/*
+==================
+SV_ClientSlotLimit
+
+Returns number of slots which can be given to client with userinfo,
+slots from MAX_CLIENTS on need support from both game module and client
+which advertises it with "clientLimit" userinfo key. NULL userinfo
+checks game module only (bots).
+==================
+*/
+int SV_ClientSlotLimit( const char *userinfo ) {
+	int limit, clientLimit;
+
+	limit = sv.gameClientLimit > MAX_CLIENTS ? sv.gameClientLimit : MAX_CLIENTS;
+
+	if ( userinfo && limit > MAX_CLIENTS ) {
+		clientLimit = atoi( Info_ValueForKey( userinfo, "clientLimit" ) );
+		if ( clientLimit < MAX_CLIENTS ) {
+			clientLimit = MAX_CLIENTS;
+		}
+		if ( limit > clientLimit ) {
+			limit = clientLimit;
+		}
+	}
+
+	if ( limit > sv.maxclients ) {
+		limit = sv.maxclients;
+	}
+
+	return limit;
+}
+
+
+/*
+==================
+SV_SetClientState
+
+Every client state change goes through here to maintain lists of
+connected and active clients. New entries are appended immediately
+so loops over the lists will see them, released slots are removed
+by SV_UpdateClientLists() so loops never see the list shrinking.
+==================
+*/
+void SV_SetClientState( client_t *client, clientState_t state ) {
+	const int clientNum = client - svs.clients;
+
+	client->state = state;
+
+	if ( state != CS_FREE && !( svs.clientListed[ clientNum ] & CLIENT_LISTED_CONNECTED ) ) {
+		svs.clientListed[ clientNum ] |= CLIENT_LISTED_CONNECTED;
+		svs.connectedClients[ svs.numConnectedClients++ ] = clientNum;
+	}
+
+	if ( state == CS_ACTIVE && !( svs.clientListed[ clientNum ] & CLIENT_LISTED_ACTIVE ) ) {
+		svs.clientListed[ clientNum ] |= CLIENT_LISTED_ACTIVE;
+		svs.activeClients[ svs.numActiveClients++ ] = clientNum;
+	}
+
+	svs.clientListsChanged = qtrue;
+}
+
+
+/*
+==================
+SV_UpdateClientLists
+
+Drops released slots from client lists and restores slot order,
+must not be called while iterating over the lists
+==================
+*/
+void SV_UpdateClientLists( void ) {
+	const client_t *cl;
+	int i;
+
+	if ( !svs.clientListsChanged ) {
+		return;
+	}
+
+	svs.clientListsChanged = qfalse;
+	svs.numConnectedClients = 0;
+	svs.numActiveClients = 0;
+
+	for ( i = 0, cl = svs.clients; i < sv.maxclients; i++, cl++ ) {
+		svs.clientListed[ i ] = 0;
+		if ( cl->state != CS_FREE ) {
+			svs.clientListed[ i ] |= CLIENT_LISTED_CONNECTED;
+			svs.connectedClients[ svs.numConnectedClients++ ] = i;
+		}
+		if ( cl->state == CS_ACTIVE ) {
+			svs.clientListed[ i ] |= CLIENT_LISTED_ACTIVE;
+			svs.activeClients[ svs.numActiveClients++ ] = i;
+		}
+	}
+}
+
+
 /*
 ==================
 SV_DirectConnect
@@ -474,13 +594,14 @@ void SV_DirectConnect( const netadr_t *from ) {
 	int			qport;
 	int			challenge;
 	const char		*password;
-	int			startIndex;
+	int			startIndex, limit;
 	intptr_t	denied;
 	int			count;
 	int			cl_proto, sv_proto;
 	const char	*ip, *info, *v;
 	qboolean	compat;
 	qboolean	longstr;
+	qboolean	relay;
 
 	Com_DPrintf( "SVC_DirectConnect()\n" );
 
@@ -535,7 +656,7 @@ void SV_DirectConnect( const netadr_t *from ) {
 	if ( !NET_IsLocalAddress( from ) )
 	{
 		// Verify the received challenge against the expected challenge
-		if ( !SV_VerifyChallenge( challenge, from ) )
+		if ( !SV_JournalInt( SV_VerifyChallenge( challenge, from ) ) )
 		{
 			// avoid excessive outgoing traffic
 			if ( !SVC_RateLimit( &bucket, 10, 200 ) )
@@ -613,6 +734,11 @@ void SV_DirectConnect( const netadr_t *from ) {
 	Info_RemoveKey( userinfo, "protocol" );
 	Info_RemoveKey( userinfo, "client" );
 
+	// relay proxy sees everything, relays can't be chained
+	v = Info_ValueForKey( userinfo, "relay" );
+	relay = ( *v && sv_relayPassword->string[0] && !strcmp( v, sv_relayPassword->string ) && !SV_RelayActive() );
+	Info_RemoveKey( userinfo, "relay" );
+
 	// don't let "ip" overflow userinfo string
 	if ( NET_IsLocalAddress( from ) )
 		ip = "localhost";
@@ -698,14 +824,17 @@ void SV_DirectConnect( const netadr_t *from ) {
 
 	// check for privateClient password
 	password = Info_ValueForKey( userinfo, "password" );
-	if ( *password && !strcmp( password, sv_privatePassword->string ) ) {
+	if ( relay || ( *password && !strcmp( password, sv_privatePassword->string ) ) ) {
 		startIndex = 0;
 	} else {
 		// skip past the reserved slots
 		startIndex = sv_privateClients->integer;
 	}
 
-	if ( newcl && newcl >= svs.clients + startIndex && newcl->state == CS_FREE ) {
+	// slots above MAX_CLIENTS only for clients which support them
+	limit = SV_ClientSlotLimit( userinfo );
+
+	if ( newcl && newcl >= svs.clients + startIndex && newcl < svs.clients + limit && newcl->state == CS_FREE ) {
 		Com_Printf( "%s: reuse slot %i\n", NET_AdrToString( from ), (int)(newcl - svs.clients) );
 		goto gotnewcl;
 	}
@@ -713,7 +842,7 @@ void SV_DirectConnect( const netadr_t *from ) {
 	// select least used free slot
 	n = 0;
 	newcl = NULL;
-	for ( i = startIndex; i < sv.maxclients; i++ ) {
+	for ( i = startIndex; i < limit; i++ ) {
 		cl = &svs.clients[i];
 		if ( cl->state == CS_FREE && ( newcl == NULL || svs.time - cl->lastDisconnectTime > n ) ) {
 			n = svs.time - cl->lastDisconnectTime;
@@ -724,22 +853,27 @@ void SV_DirectConnect( const netadr_t *from ) {
 	if ( !newcl ) {
 		if ( NET_IsLocalAddress( from ) ) {
 			count = 0;
-			for ( i = startIndex; i < sv.maxclients; i++ ) {
+			for ( i = startIndex; i < limit; i++ ) {
 				cl = &svs.clients[i];
 				if (cl->netchan.remoteAddress.type == NA_BOT) {
 					count++;
 				}
 			}
 			// if they're all bots
-			if (count >= sv.maxclients - startIndex) {
-				SV_DropClient(&svs.clients[sv.maxclients - 1], "only bots on server");
-				newcl = &svs.clients[sv.maxclients - 1];
+			if (count >= limit - startIndex) {
+				SV_DropClient(&svs.clients[limit - 1], "only bots on server");
+				newcl = &svs.clients[limit - 1];
 			}
 			else {
 				Com_Error( ERR_DROP, "server is full on local connect" );
 				return;
 			}
 		}
+		else if ( limit < sv.maxclients ) {
+			NET_OutOfBandPrint( NS_SERVER, from, "print\nServer is full for clients supporting only %i players.\n", limit );
+			Com_DPrintf( "Rejected a connection, no free slot below %i.\n", limit );
+			return;
+		}
 		else {
 			NET_OutOfBandPrint( NS_SERVER, from, "print\nServer is full.\n" );
 			Com_DPrintf ("Rejected a connection.\n");
@@ -752,6 +886,7 @@ gotnewcl:
 	// accept the new client
 	// this is the only place a client_t is ever initialized
 	// we got a newcl, so reset the reliableSequence and reliableAcknowledge
+	SV_ClearReliableCommands( newcl );
 	Com_Memset( newcl, 0, sizeof( *newcl ) );
 	clientNum = newcl - svs.clients;
 #if 0 // skip this until CS_PRIMED
@@ -759,6 +894,12 @@ gotnewcl:
 	//newcl->gentity = ent;
 #endif
 
+	if ( relay ) {
+		Com_Printf( "%s: relay client\n", NET_AdrToString( from ) );
+		newcl->relay = qtrue;
+		newcl->relayFrames = Z_Malloc( PACKET_BACKUP * sizeof( relayFrame_t ) );
+	}
+
 	// save the challenge
 	newcl->challenge = challenge;
 
@@ -807,10 +948,11 @@ gotnewcl:
 
 	SV_PrintClientStateChange( newcl, CS_CONNECTED );
 
-	newcl->state = CS_CONNECTED;
+	SV_SetClientState( newcl, CS_CONNECTED );
 	newcl->lastSnapshotTime = svs.time - 9999; // generate a snapshot immediately
 	newcl->lastPacketTime = svs.time;
 	newcl->lastConnectTime = svs.time;
+	SV_InvalidateQueryCache();
 	newcl->lastDisconnectTime = svs.time;
 
 	SVC_RateRestoreToxicAddress( &newcl->netchan.remoteAddress, 10, 1000 );
@@ -846,6 +988,12 @@ void SV_FreeClient(client_t *client)
 {
 	SV_Netchan_FreeQueue(client);
 	SV_CloseDownload(client);
+	SV_StopClientDemo(client);
+
+	if ( client->relayFrames ) {
+		Z_Free( client->relayFrames );
+		client->relayFrames = NULL;
+	}
 }
 
 
@@ -901,13 +1049,15 @@ void SV_DropClient( client_t *drop, const char *reason ) {
 
 	if ( isBot ) {
 		// bots shouldn't go zombie, as there's no real net connection.
-		drop->state = CS_FREE;
+		SV_SetClientState( drop, CS_FREE );
 	} else {
 		Q_strncpyz( drop->name, name, sizeof( name ) );
 		SV_PrintClientStateChange( drop, CS_ZOMBIE );
-		drop->state = CS_ZOMBIE;		// become free in a few seconds
+		SV_SetClientState( drop, CS_ZOMBIE );		// become free in a few seconds
 	}
 
+	SV_InvalidateQueryCache();
+
 	if ( !reason ) {
 		return;
 	}
@@ -937,8 +1087,6 @@ int SV_RemainingGameState( void )
 {
 	int			len;
 	int			start, i;
-	entityState_t nullstate;
-	const svEntity_t *svEnt;
 	msg_t		msg;
 	byte		msgBuffer[ MAX_MSGLEN_BUF ];
 
@@ -975,15 +1123,7 @@ int SV_RemainingGameState( void )
 	}
 
 	// write the baselines
-	Com_Memset( &nullstate, 0, sizeof( nullstate ) );
-	for ( start = 0 ; start < MAX_GENTITIES; start++ ) {
-		if ( !sv.baselineUsed[ start ] ) {
-			continue;
-		}
-		svEnt = &sv.svEntities[ start ];
-		MSG_WriteByte( &msg, svc_baseline );
-		MSG_WriteDeltaEntity( &msg, &nullstate, &svEnt->baseline, qtrue );
-	}
+	SV_WriteGamestateBaselines( &msg );
 
 	MSG_WriteByte( &msg, svc_EOF );
 
@@ -1004,6 +1144,136 @@ int SV_RemainingGameState( void )
 }
 
 
+/*
+================
+SV_WriteGamestateConfigstring
+================
+*/
+void SV_WriteGamestateConfigstring( msg_t *msg, int index ) {
+
+	MSG_WriteByte( msg, svc_configstring );
+	MSG_WriteShort( msg, index );
+
+	if ( index == CS_SYSTEMINFO && sv.pure != sv_pure->integer ) {
+		// make sure we send latched sv.pure, not forced cvar value
+		char systemInfo[BIG_INFO_STRING];
+		Q_strncpyz( systemInfo, sv.configstrings[ index ], sizeof( systemInfo ) );
+		Info_SetValueForKey_s( systemInfo, sizeof( systemInfo ), "sv_pure", va( "%i", sv.pure ) );
+		MSG_WriteBigString( msg, systemInfo );
+	} else {
+		MSG_WriteBigString( msg, sv.configstrings[ index ] );
+	}
+}
+
+
+/*
+================
+GAMESTATE CACHE
+
+Configstrings and baselines are the same for all clients so they are
+encoded once and appended to each client gamestate as a bit string,
+Huffman coding is position-independent so the result is identical.
+Configstrings part is invalidated by SV_SetConfigstring(), baselines
+by SV_CreateBaseline()
+================
+*/
+typedef struct {
+	qboolean	valid;
+	int			pure;		// sv.pure used for CS_SYSTEMINFO
+	int			bits;
+	byte		data[ MAX_MSGLEN_BUF ];
+} gamestatePart_t;
+
+static gamestatePart_t gamestateConfigstrings;
+static gamestatePart_t gamestateBaselines;
+
+
+/*
+================
+SV_InvalidateGamestateCache
+================
+*/
+void SV_InvalidateGamestateCache( qboolean baselines ) {
+	if ( baselines ) {
+		gamestateBaselines.valid = qfalse;
+	} else {
+		gamestateConfigstrings.valid = qfalse;
+	}
+}
+
+
+/*
+================
+SV_WriteGamestateConfigstrings
+
+Writes all non-empty configstrings
+================
+*/
+void SV_WriteGamestateConfigstrings( msg_t *msg ) {
+	gamestatePart_t *part = &gamestateConfigstrings;
+	msg_t	cache;
+	int		pure;
+	int		i;
+
+	// latched sv.pure may be written instead of forced cvar value
+	pure = ( sv.pure != sv_pure->integer ) ? sv.pure : -1;
+
+	if ( !part->valid || part->pure != pure ) {
+		MSG_Init( &cache, part->data, MAX_MSGLEN );
+		for ( i = 0; i < MAX_CONFIGSTRINGS; i++ ) {
+			if ( *sv.configstrings[ i ] != '\0' ) {
+				SV_WriteGamestateConfigstring( &cache, i );
+			}
+		}
+		if ( cache.overflowed ) {
+			// let the caller handle overflow
+			msg->overflowed = qtrue;
+			return;
+		}
+		part->bits = cache.bit;
+		part->pure = pure;
+		part->valid = qtrue;
+	}
+
+	MSG_WriteBitString( msg, part->data, part->bits );
+}
+
+
+/*
+================
+SV_WriteGamestateBaselines
+
+Writes baselines of all entities linked on map load
+================
+*/
+void SV_WriteGamestateBaselines( msg_t *msg ) {
+	gamestatePart_t *part = &gamestateBaselines;
+	entityState_t nullstate;
+	msg_t	cache;
+	int		i;
+
+	if ( !part->valid ) {
+		MSG_Init( &cache, part->data, MAX_MSGLEN );
+		Com_Memset( &nullstate, 0, sizeof( nullstate ) );
+		for ( i = 0; i < MAX_GENTITIES; i++ ) {
+			if ( !sv.baselineUsed[ i ] ) {
+				continue;
+			}
+			MSG_WriteByte( &cache, svc_baseline );
+			MSG_WriteDeltaEntity( &cache, &nullstate, &sv.svEntities[ i ].baseline, qtrue );
+		}
+		if ( cache.overflowed ) {
+			msg->overflowed = qtrue;
+			return;
+		}
+		part->bits = cache.bit;
+		part->valid = qtrue;
+	}
+
+	MSG_WriteBitString( msg, part->data, part->bits );
+}
+
+
 /*
 ================
 SV_SendClientGameState
@@ -1017,8 +1287,6 @@ the wrong gamestate.
 */
 static void SV_SendClientGameState( client_t *client ) {
 	int			start;
-	entityState_t nullstate;
-	const svEntity_t *svEnt;
 	msg_t		msg;
 	byte		msgBuffer[ MAX_MSGLEN_BUF ];
 	qboolean	csUpdated;
@@ -1027,7 +1295,7 @@ static void SV_SendClientGameState( client_t *client ) {
 
 	SV_PrintClientStateChange( client, CS_PRIMED );
 
-	client->state = CS_PRIMED;
+	SV_SetClientState( client, CS_PRIMED );
 
 	client->downloading = qfalse;
 
@@ -1046,6 +1314,9 @@ static void SV_SendClientGameState( client_t *client ) {
 	Com_Memset( &client->lastUsercmd, 0x0, sizeof( client->lastUsercmd ) );
 	client->lastUsercmd.serverTime = sv.time - 1;
 
+	// entity numbers may refer to anything after map change
+	Com_Memset( client->entityPriority, 0, sizeof( client->entityPriority ) );
+
 	MSG_Init( &msg, msgBuffer, MAX_MSGLEN );
 
 	// NOTE, MRE: all server->client messages now acknowledge
@@ -1063,21 +1334,10 @@ static void SV_SendClientGameState( client_t *client ) {
 	MSG_WriteLong( &msg, client->reliableSequence );
 
 	// write the configstrings
+	SV_WriteGamestateConfigstrings( &msg );
+
 	csUpdated = qfalse;
 	for ( start = 0 ; start < MAX_CONFIGSTRINGS ; start++ ) {
-		if ( *sv.configstrings[ start ] != '\0' ) {
-			MSG_WriteByte( &msg, svc_configstring );
-			MSG_WriteShort( &msg, start );
-			if ( start == CS_SYSTEMINFO && sv.pure != sv_pure->integer ) {
-				// make sure we send latched sv.pure, not forced cvar value
-				char systemInfo[BIG_INFO_STRING];
-				Q_strncpyz( systemInfo, sv.configstrings[ start ], sizeof( systemInfo ) );
-				Info_SetValueForKey_s( systemInfo, sizeof( systemInfo ), "sv_pure", va( "%i", sv.pure ) );
-				MSG_WriteBigString( &msg, systemInfo );
-			} else {
-				MSG_WriteBigString( &msg, sv.configstrings[start] );
-			}
-		}
 		if ( client->csUpdated[start] ) {
 			csUpdated = qtrue;
 		}
@@ -1097,19 +1357,16 @@ static void SV_SendClientGameState( client_t *client ) {
 	}
 
 	// write the baselines
-	Com_Memset( &nullstate, 0, sizeof( nullstate ) );
-	for ( start = 0 ; start < MAX_GENTITIES; start++ ) {
-		if ( !sv.baselineUsed[ start ] ) {
-			continue;
-		}
-		svEnt = &sv.svEntities[ start ];
-		MSG_WriteByte( &msg, svc_baseline );
-		MSG_WriteDeltaEntity( &msg, &nullstate, &svEnt->baseline, qtrue );
-	}
+	SV_WriteGamestateBaselines( &msg );
 
 	MSG_WriteByte( &msg, svc_EOF );
 
-	MSG_WriteLong( &msg, client - svs.clients );
+	// relay viewers share upstream slot of the relay itself
+	if ( SV_RelayActive() ) {
+		MSG_WriteLong( &msg, SV_RelayClientNum() );
+	} else {
+		MSG_WriteLong( &msg, client - svs.clients );
+	}
 
 	// write the checksum feed
 	MSG_WriteLong( &msg, sv.checksumFeed );
@@ -1150,7 +1407,7 @@ void SV_ClientEnterWorld( client_t *client ) {
 		// client->serverId = sv.serverId;
 	}
 
-	client->state = CS_ACTIVE;
+	SV_SetClientState( client, CS_ACTIVE );
 	client->gamestateAck = GSA_ACKED;
 
 	client->oldServerTime = 0;
@@ -1295,7 +1552,7 @@ static void SV_BeginDownload_f( client_t *cl ) {
 	Q_strncpyz( cl->downloadName, Cmd_Argv(1), sizeof(cl->downloadName) );
 
 	SV_PrintClientStateChange( cl, CS_CONNECTED );
-	cl->state = CS_CONNECTED;
+	SV_SetClientState( cl, CS_CONNECTED );
 	cl->gentity = NULL;
 
 	cl->downloading = qtrue;
@@ -1527,9 +1784,9 @@ int SV_SendQueuedMessages( void )
 	int i, retval = -1, nextFragT;
 	client_t *cl;
 
-	for( i = 0; i < sv.maxclients; i++ )
+	for( i = 0; i < svs.numConnectedClients; i++ )
 	{
-		cl = &svs.clients[i];
+		cl = &svs.clients[ svs.connectedClients[ i ] ];
 
 		if ( cl->state )
 		{
@@ -1559,9 +1816,9 @@ int SV_SendDownloadMessages( void )
 	int i, numDLs = 0;
 	client_t *cl;
 
-	for( i = 0; i < sv.maxclients; i++ )
+	for( i = 0; i < svs.numConnectedClients; i++ )
 	{
-		cl = &svs.clients[ i ];
+		cl = &svs.clients[ svs.connectedClients[ i ] ];
 		if ( cl->state >= CS_CONNECTED && *cl->downloadName )
 		{
 			numDLs += SV_WriteDownloadToClient( cl );
@@ -1721,9 +1978,9 @@ static void SV_VerifyPaks_f( client_t *cl ) {
 		} else {
 			cl->pureAuthentic = qfalse;
 			cl->lastSnapshotTime = svs.time - 9999; // generate a snapshot immediately
-			cl->state = CS_ZOMBIE; // skip delta generation
+			SV_SetClientState( cl, CS_ZOMBIE ); // skip delta generation
 			SV_SendClientSnapshot( cl );
-			cl->state = CS_ACTIVE;
+			SV_SetClientState( cl, CS_ACTIVE );
 			SV_DropClient( cl, "Unpure client detected. Invalid .PK3 files referenced!" );
 		}
 	}
@@ -1775,7 +2032,8 @@ void SV_UserinfoChanged( client_t *cl, qboolean updateUserinfo, qboolean runFilt
 		else
 			cl->rate = 10000; // was 3000
 
-		if ( sv_maxRate->integer ) {
+		// relays carry every player of the server, sv_relayPassword lifts the cap
+		if ( sv_maxRate->integer && !cl->relay ) {
 			if ( cl->rate > sv_maxRate->integer )
 				cl->rate = sv_maxRate->integer;
 		}
@@ -1819,7 +2077,10 @@ void SV_UserinfoChanged( client_t *cl, qboolean updateUserinfo, qboolean runFilt
 		Info_SetValueForKey( cl->userinfo, "name", buf );
 		val = buf;
 	}
-	Q_strncpyz( cl->name, val, sizeof( cl->name ) );
+	if ( strcmp( cl->name, val ) ) {
+		Q_strncpyz( cl->name, val, sizeof( cl->name ) );
+		SV_InvalidateQueryCache();
+	}
 
 	val = Info_ValueForKey( cl->userinfo, "handicap" );
 	if ( val[0] ) {
@@ -2158,7 +2419,7 @@ static void SV_UserMove( client_t *cl, msg_t *msg, qboolean delta ) {
 	// also use the message acknowledge
 	key ^= cl->messageAcknowledge;
 	// also use the last acknowledged server command in the key
-	key ^= MSG_HashKey(cl->reliableCommands[ cl->reliableAcknowledge & (MAX_RELIABLE_COMMANDS-1) ], 32);
+	key ^= MSG_HashKey(SV_ReliableCommand( cl, cl->reliableAcknowledge ), 32);
 
 	oldcmd = &nullcmd;
 	for ( i = 0 ; i < cmdCount ; i++ ) {
@@ -2169,13 +2430,14 @@ static void SV_UserMove( client_t *cl, msg_t *msg, qboolean delta ) {
 
 	// save time for ping calculation
 	if ( cl->frames[ cl->messageAcknowledge & PACKET_MASK ].messageAcked == 0 ) {
-		cl->frames[ cl->messageAcknowledge & PACKET_MASK ].messageAcked = Sys_Milliseconds();
+		cl->frames[ cl->messageAcknowledge & PACKET_MASK ].messageAcked = SV_Milliseconds();
 	}
 
 	// if this is the first usercmd we have received
 	// this gamestate, put the client into the world
 	if ( cl->state == CS_PRIMED ) {
-		if ( sv.pure != 0 && !cl->gotCP ) {
+		// relays don't load game code so there are no paks to validate
+		if ( sv.pure != 0 && !cl->gotCP && !cl->relay ) {
 			// we didn't get a cp yet, don't assume anything and just send the gamestate all over again
 			if ( !SVC_RateLimit( &cl->gamestate_rate, 2, 1000 ) ) {
 				Com_DPrintf( "%s: didn't get cp command, resending gamestate\n", cl->name );
@@ -2188,7 +2450,7 @@ static void SV_UserMove( client_t *cl, msg_t *msg, qboolean delta ) {
 	}
 
 	// a bad cp command was sent, drop the client
-	if ( sv.pure != 0 && !cl->pureAuthentic ) {
+	if ( sv.pure != 0 && !cl->pureAuthentic && !cl->relay ) {
 		SV_DropClient( cl, "Cannot validate pure client!" );
 		return;
 	}
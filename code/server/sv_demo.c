@@ -0,0 +1,710 @@
+// server-side demo recording
+
+#include "server.h"
+
+/*
+=============================================================================
+
+Demos are recorded from the perspective of a single client by copying
+messages sent to that client right before netchan encoding, so resulting
+files are identical to ones recorded on the client side and can be played
+back with "demo" command. "sv_record all" records separate demo for each
+active client.
+
+Messages are copied into a bounded ring buffer and written to disk by
+a background thread so server frames never wait for disk I/O. If writer
+can't keep up and buffer overflows - recording is stopped.
+
+=============================================================================
+*/
+
+#define DEMO_BUFFER_SIZE	0x200000
+
+typedef enum {
+	DR_MESSAGE,
+	DR_CLOSE
+} demoRecordType_t;
+
+typedef struct {
+	FILE				*file;
+	demoRecordType_t	type;
+	int					sequence;
+	int					length;		// following data length
+} demoRecord_t;
+
+// space left for closing all demos on overflow
+#define DEMO_RESERVE		( MAX_SERVER_CLIENTS * ( sizeof( demoRecord_t ) + 2 * MAX_OSPATH ) )
+
+typedef struct {
+	FILE		*file;
+	qboolean	waiting;		// for uncompressed snapshot
+	int			keySequence;	// sequence of uncompressed snapshot
+	char		name[ MAX_QPATH ];
+	char		tempPath[ MAX_OSPATH ];
+	char		finalPath[ MAX_OSPATH ];
+} svDemo_t;
+
+typedef struct {
+	sysThread_t		*thread;
+	sysMutex_t		*lock;
+	sysCond_t		*wake;
+	byte			*buffer;
+	unsigned int	head;		// advanced by main thread
+	unsigned int	tail;		// advanced by writer thread
+	int				errors;
+	qboolean		shutdown;
+} demoWriter_t;
+
+static void SV_StopDemo( svDemo_t *demo );
+
+static svDemo_t		demos[ MAX_SERVER_CLIENTS ];
+static int			numDemos;
+static demoWriter_t	writer;
+
+
+/*
+=================
+SV_DemoBufferRead
+=================
+*/
+static void SV_DemoBufferRead( unsigned int offset, void *data, int length ) {
+	unsigned int pos = offset % DEMO_BUFFER_SIZE;
+	unsigned int part = DEMO_BUFFER_SIZE - pos;
+
+	if ( part >= length ) {
+		Com_Memcpy( data, writer.buffer + pos, length );
+	} else {
+		Com_Memcpy( data, writer.buffer + pos, part );
+		Com_Memcpy( (byte *)data + part, writer.buffer, length - part );
+	}
+}
+
+
+/*
+=================
+SV_DemoBufferWrite
+=================
+*/
+static void SV_DemoBufferWrite( unsigned int offset, const void *data, int length ) {
+	unsigned int pos = offset % DEMO_BUFFER_SIZE;
+	unsigned int part = DEMO_BUFFER_SIZE - pos;
+
+	if ( part >= length ) {
+		Com_Memcpy( writer.buffer + pos, data, length );
+	} else {
+		Com_Memcpy( writer.buffer + pos, data, part );
+		Com_Memcpy( writer.buffer, (const byte *)data + part, length - part );
+	}
+}
+
+
+/*
+=================
+SV_DemoFileWrite
+
+Writes buffer contents to file, returns qfalse on error
+=================
+*/
+static qboolean SV_DemoFileWrite( FILE *f, unsigned int offset, int length ) {
+	unsigned int pos = offset % DEMO_BUFFER_SIZE;
+	unsigned int part = DEMO_BUFFER_SIZE - pos;
+
+	if ( part >= length ) {
+		return fwrite( writer.buffer + pos, 1, length, f ) == length;
+	} else {
+		if ( fwrite( writer.buffer + pos, 1, part, f ) != part )
+			return qfalse;
+		return fwrite( writer.buffer, 1, length - part, f ) == length - part;
+	}
+}
+
+
+/*
+=================
+SV_DemoProcessRecord
+
+Executed by writer thread, returns qfalse on error
+=================
+*/
+static qboolean SV_DemoProcessRecord( const demoRecord_t *rec, unsigned int offset ) {
+	char paths[ MAX_OSPATH * 2 ];
+	const char *finalPath;
+	int header[2];
+	qboolean ok;
+
+	switch ( rec->type ) {
+
+	case DR_MESSAGE:
+		header[0] = LittleLong( rec->sequence );
+		header[1] = LittleLong( rec->length );
+		if ( fwrite( header, 1, sizeof( header ), rec->file ) != sizeof( header ) )
+			return qfalse;
+		return SV_DemoFileWrite( rec->file, offset, rec->length );
+
+	case DR_CLOSE:
+		// end of demo marker
+		header[0] = -1;
+		header[1] = -1;
+		ok = fwrite( header, 1, sizeof( header ), rec->file ) == sizeof( header );
+		if ( fclose( rec->file ) != 0 )
+			ok = qfalse;
+
+		// temporary and final file names
+		SV_DemoBufferRead( offset, paths, rec->length );
+		finalPath = paths + strlen( paths ) + 1;
+
+		remove( finalPath );
+		if ( rename( paths, finalPath ) != 0 )
+			ok = qfalse;
+
+		return ok;
+	}
+
+	return qfalse;
+}
+
+
+/*
+=================
+SV_DemoWriter
+
+Writer thread, exits after shutdown request
+when all queued records are processed
+=================
+*/
+static void SV_DemoWriter( void *unused ) {
+	demoRecord_t rec;
+	unsigned int head, tail;
+	int errors;
+
+	Sys_LockMutex( writer.lock );
+
+	for ( ;; ) {
+		while ( writer.head == writer.tail && !writer.shutdown ) {
+			Sys_CondWait( writer.wake, writer.lock );
+		}
+
+		if ( writer.head == writer.tail ) {
+			break;
+		}
+
+		head = writer.head;
+		tail = writer.tail;
+
+		Sys_UnlockMutex( writer.lock );
+
+		errors = 0;
+		while ( tail != head ) {
+			SV_DemoBufferRead( tail, &rec, sizeof( rec ) );
+			tail += sizeof( rec );
+			if ( !SV_DemoProcessRecord( &rec, tail ) ) {
+				errors++;
+			}
+			tail += rec.length;
+		}
+
+		Sys_LockMutex( writer.lock );
+
+		writer.tail = tail;
+		writer.errors += errors;
+	}
+
+	Sys_UnlockMutex( writer.lock );
+}
+
+
+/*
+=================
+SV_StartDemoWriter
+=================
+*/
+static qboolean SV_StartDemoWriter( void ) {
+
+	if ( writer.thread ) {
+		return qtrue;
+	}
+
+	writer.lock = Sys_CreateMutex();
+	writer.wake = Sys_CreateCond();
+
+	if ( writer.lock && writer.wake ) {
+		writer.buffer = Z_Malloc( DEMO_BUFFER_SIZE );
+		writer.thread = Sys_CreateThread( SV_DemoWriter, NULL );
+		if ( writer.thread ) {
+			return qtrue;
+		}
+		Z_Free( writer.buffer );
+	}
+
+	Com_Printf( S_COLOR_YELLOW "WARNING: failed to start demo writer thread\n" );
+
+	if ( writer.wake ) Sys_DestroyCond( writer.wake );
+	if ( writer.lock ) Sys_DestroyMutex( writer.lock );
+	Com_Memset( &writer, 0, sizeof( writer ) );
+
+	return qfalse;
+}
+
+
+/*
+=================
+SV_QueueDemoRecord
+
+Never blocks, returns qfalse if there is not enough space in buffer
+=================
+*/
+static qboolean SV_QueueDemoRecord( FILE *file, demoRecordType_t type, int sequence, const void *data, int length, int reserve ) {
+	demoRecord_t rec;
+	unsigned int used;
+	unsigned int head;
+
+	Sys_LockMutex( writer.lock );
+	used = writer.head - writer.tail;
+	Sys_UnlockMutex( writer.lock );
+
+	if ( used + sizeof( rec ) + length + reserve > DEMO_BUFFER_SIZE ) {
+		return qfalse;
+	}
+
+	rec.file = file;
+	rec.type = type;
+	rec.sequence = sequence;
+	rec.length = length;
+
+	// only main thread advances head so we can fill the space without lock
+	head = writer.head;
+	SV_DemoBufferWrite( head, &rec, sizeof( rec ) );
+	SV_DemoBufferWrite( head + sizeof( rec ), data, length );
+
+	Sys_LockMutex( writer.lock );
+	writer.head = head + sizeof( rec ) + length;
+	Sys_CondSignal( writer.wake );
+	Sys_UnlockMutex( writer.lock );
+
+	return qtrue;
+}
+
+
+/*
+=================
+SV_DemoWriteErrors
+
+Returns number of write errors since last call
+=================
+*/
+static int SV_DemoWriteErrors( void ) {
+	int errors;
+
+	if ( !writer.thread ) {
+		return 0;
+	}
+
+	Sys_LockMutex( writer.lock );
+	errors = writer.errors;
+	writer.errors = 0;
+	Sys_UnlockMutex( writer.lock );
+
+	return errors;
+}
+
+
+/*
+=================
+SV_ShutdownDemos
+
+Waits until all queued data is written to disk
+=================
+*/
+void SV_ShutdownDemos( void ) {
+	int i;
+
+	for ( i = 0; i < MAX_SERVER_CLIENTS && numDemos > 0; i++ ) {
+		SV_StopDemo( &demos[ i ] );
+	}
+
+	if ( !writer.thread ) {
+		return;
+	}
+
+	Sys_LockMutex( writer.lock );
+	writer.shutdown = qtrue;
+	Sys_CondSignal( writer.wake );
+	Sys_UnlockMutex( writer.lock );
+
+	Sys_JoinThread( writer.thread );
+
+	if ( writer.errors ) {
+		Com_Printf( S_COLOR_YELLOW "WARNING: %i demo write errors\n", writer.errors );
+	}
+
+	Sys_DestroyCond( writer.wake );
+	Sys_DestroyMutex( writer.lock );
+	Z_Free( writer.buffer );
+
+	Com_Memset( &writer, 0, sizeof( writer ) );
+}
+
+
+/*
+=================
+SV_WriteDemoGamestate
+
+Writes gamestate message in the same way as CL_WriteGamestate() does
+=================
+*/
+static qboolean SV_WriteDemoGamestate( const client_t *client, svDemo_t *demo ) {
+	byte			msgBuffer[ MAX_MSGLEN_BUF ];
+	msg_t			msg;
+
+	MSG_Init( &msg, msgBuffer, MAX_MSGLEN );
+
+	// NOTE, MRE: all server->client messages now acknowledge
+	MSG_WriteLong( &msg, client->lastClientCommand );
+
+	MSG_WriteByte( &msg, svc_gamestate );
+	MSG_WriteLong( &msg, client->reliableSequence );
+
+	// configstrings
+	SV_WriteGamestateConfigstrings( &msg );
+
+	// baselines
+	SV_WriteGamestateBaselines( &msg );
+
+	MSG_WriteByte( &msg, svc_EOF );
+
+	MSG_WriteLong( &msg, client - svs.clients );
+
+	// write the checksum feed
+	MSG_WriteLong( &msg, sv.checksumFeed );
+
+	// finished writing the client packet
+	MSG_WriteByte( &msg, svc_EOF );
+
+	if ( msg.overflowed ) {
+		Com_Printf( S_COLOR_YELLOW "WARNING: demo gamestate overflow\n" );
+		return qfalse;
+	}
+
+	// use sequence that will never be sent to the client
+	return SV_QueueDemoRecord( demo->file, DR_MESSAGE, client->netchan.outgoingSequence - 1,
+		msg.data, msg.cursize, DEMO_RESERVE );
+}
+
+
+/*
+=================
+SV_StartClientDemo
+
+Starts recording of demos/<name>.dm_68 from the perspective of client
+=================
+*/
+static void SV_StartClientDemo( client_t *client, const char *name, qboolean explicitName ) {
+	svDemo_t *demo;
+	fileHandle_t f;
+	char tempName[ MAX_QPATH ];
+	const char *homepath;
+	const char *gamedir;
+	int protocol;
+	int sequence;
+
+	demo = &demos[ client - svs.clients ];
+
+	if ( demo->file ) {
+		Com_Printf( "Already recording %s.\n", client->name );
+		return;
+	}
+
+	if ( client->state != CS_ACTIVE ) {
+		Com_Printf( "Client %s is not active.\n", client->name );
+		return;
+	}
+
+	if ( client->netchan.remoteAddress.type == NA_BOT ) {
+		Com_Printf( "Can't record bot %s.\n", client->name );
+		return;
+	}
+
+	// select proper extension
+	protocol = OLD_PROTOCOL_VERSION;
+	if ( com_protocol->integer != DEFAULT_PROTOCOL_VERSION ) {
+		protocol = com_protocol->integer;
+	}
+
+	Com_sprintf( demo->name, sizeof( demo->name ), "%s.%s%d", name, DEMOEXT, protocol );
+
+	if ( !explicitName ) {
+		// add sequence suffix to avoid overwrite
+		sequence = 0;
+		while ( FS_FileExists( demo->name ) && ++sequence < 1000 ) {
+			Com_sprintf( demo->name, sizeof( demo->name ), "%s-%02d.%s%d", name, sequence, DEMOEXT, protocol );
+		}
+	}
+
+	Com_sprintf( tempName, sizeof( tempName ), "%s.tmp", name );
+
+	// let filesystem create the path
+	f = FS_FOpenFileWrite( tempName );
+	if ( f == FS_INVALID_HANDLE ) {
+		Com_Printf( "ERROR: couldn't open %s.\n", tempName );
+		return;
+	}
+	FS_FCloseFile( f );
+
+	homepath = Cvar_VariableString( "fs_homepath" );
+	gamedir = FS_GetCurrentGameDir();
+
+	Q_strncpyz( demo->tempPath, FS_BuildOSPath( homepath, gamedir, tempName ), sizeof( demo->tempPath ) );
+	Q_strncpyz( demo->finalPath, FS_BuildOSPath( homepath, gamedir, demo->name ), sizeof( demo->finalPath ) );
+
+	if ( !SV_StartDemoWriter() ) {
+		return;
+	}
+
+	demo->file = Sys_FOpen( demo->tempPath, "wb" );
+	if ( !demo->file ) {
+		Com_Printf( "ERROR: couldn't open %s.\n", demo->tempPath );
+		return;
+	}
+
+	numDemos++;
+
+	if ( !SV_WriteDemoGamestate( client, demo ) ) {
+		SV_StopDemo( demo );
+		return;
+	}
+
+	// force uncompressed snapshot
+	demo->waiting = qtrue;
+	demo->keySequence = client->netchan.outgoingSequence - 1;
+
+	Com_Printf( "recording %s to %s.\n", client->name, demo->name );
+}
+
+
+/*
+=================
+SV_StopDemo
+=================
+*/
+static void SV_StopDemo( svDemo_t *demo ) {
+	char paths[ MAX_OSPATH * 2 ];
+	int len;
+
+	if ( !demo->file ) {
+		return;
+	}
+
+	len = Com_sprintf( paths, sizeof( paths ), "%s", demo->tempPath ) + 1;
+	len += Com_sprintf( paths + len, sizeof( paths ) - len, "%s", demo->finalPath ) + 1;
+
+	// always fits because of reserved space
+	SV_QueueDemoRecord( demo->file, DR_CLOSE, 0, paths, len, 0 );
+
+	Com_Printf( "Stopped recording %s.\n", demo->name );
+
+	Com_Memset( demo, 0, sizeof( *demo ) );
+	numDemos--;
+}
+
+
+/*
+=================
+SV_StopClientDemo
+=================
+*/
+void SV_StopClientDemo( client_t *client ) {
+
+	if ( !numDemos ) {
+		return;
+	}
+
+	SV_StopDemo( &demos[ client - svs.clients ] );
+}
+
+
+/*
+=================
+SV_DemoKeyframe
+
+Returns qtrue if next snapshot for the client should be uncompressed
+=================
+*/
+qboolean SV_DemoKeyframe( const client_t *client ) {
+	svDemo_t *demo;
+
+	if ( !numDemos ) {
+		return qfalse;
+	}
+
+	demo = &demos[ client - svs.clients ];
+	if ( !demo->file || !demo->waiting ) {
+		return qfalse;
+	}
+
+	// message may be delayed by netchan queue so request it again
+	// until we will see exactly this sequence in SV_WriteDemoMessage()
+	demo->keySequence = client->netchan.outgoingSequence;
+
+	return qtrue;
+}
+
+
+/*
+=================
+SV_WriteDemoMessage
+
+Called with complete message right before its encoding and transmission
+=================
+*/
+void SV_WriteDemoMessage( const client_t *client, const msg_t *msg ) {
+	svDemo_t *demo;
+	int sequence;
+
+	if ( !numDemos ) {
+		return;
+	}
+
+	demo = &demos[ client - svs.clients ];
+	if ( !demo->file ) {
+		return;
+	}
+
+	sequence = client->netchan.outgoingSequence;
+
+	if ( demo->waiting ) {
+		if ( sequence != demo->keySequence ) {
+			return;
+		}
+		demo->waiting = qfalse;
+	}
+
+	if ( !SV_QueueDemoRecord( demo->file, DR_MESSAGE, sequence, msg->data, msg->cursize, DEMO_RESERVE ) ) {
+		Com_Printf( S_COLOR_YELLOW "WARNING: demo buffer overflow\n" );
+		SV_StopDemo( demo );
+	}
+}
+
+
+/*
+=================
+SV_DemoName
+
+Builds demo name without extension
+=================
+*/
+static void SV_DemoName( char *name, int size, const char *base, int clientNum, qboolean all ) {
+	char demoName[ MAX_QPATH ];
+	char demoExt[ 16 ];
+	const char *ext;
+	qtime_t t;
+
+	if ( base && *base ) {
+		Q_strncpyz( demoName, base, sizeof( demoName ) );
+		ext = COM_GetExtension( demoName );
+		if ( *ext ) {
+			// strip demo extension
+			Com_sprintf( demoExt, sizeof( demoExt ), "%s%d", DEMOEXT, OLD_PROTOCOL_VERSION );
+			if ( Q_stricmp( ext, demoExt ) == 0 ) {
+				*(strrchr( demoName, '.' )) = '\0';
+			}
+		}
+		if ( all ) {
+			Com_sprintf( name, size, "demos/%s-%02d", demoName, clientNum );
+		} else {
+			Com_sprintf( name, size, "demos/%s", demoName );
+		}
+	} else {
+		Com_RealTime( &t );
+		Com_sprintf( name, size, "demos/sv-%04d%02d%02d-%02d%02d%02d-%02d",
+			1900 + t.tm_year, 1 + t.tm_mon, t.tm_mday, t.tm_hour, t.tm_min, t.tm_sec, clientNum );
+	}
+}
+
+
+/*
+=================
+SV_Record_f
+
+sv_record <player|all> [demoname]
+=================
+*/
+void SV_Record_f( void ) {
+	char name[ MAX_QPATH ];
+	const char *base;
+	client_t *cl;
+	int i;
+
+	if ( Cmd_Argc() < 2 || Cmd_Argc() > 3 ) {
+		Com_Printf( "Usage: sv_record <player|all> [demoname]\n" );
+		return;
+	}
+
+	if ( !com_sv_running->integer ) {
+		Com_Printf( "Server is not running.\n" );
+		return;
+	}
+
+	base = Cmd_Argv( 2 );
+
+	if ( !Q_stricmp( Cmd_Argv( 1 ), "all" ) ) {
+		for ( i = 0, cl = svs.clients; i < sv.maxclients; i++, cl++ ) {
+			if ( cl->state != CS_ACTIVE || cl->netchan.remoteAddress.type == NA_BOT ) {
+				continue;
+			}
+			if ( demos[ i ].file ) {
+				continue;
+			}
+			SV_DemoName( name, sizeof( name ), base, i, qtrue );
+			SV_StartClientDemo( cl, name, *base ? qtrue : qfalse );
+		}
+		return;
+	}
+
+	cl = SV_GetPlayerByHandle();
+	if ( !cl ) {
+		return;
+	}
+
+	SV_DemoName( name, sizeof( name ), base, cl - svs.clients, qfalse );
+	SV_StartClientDemo( cl, name, *base ? qtrue : qfalse );
+}
+
+
+/*
+=================
+SV_StopRecord_f
+
+sv_stoprecord [player|all]
+=================
+*/
+void SV_StopRecord_f( void ) {
+	client_t *cl;
+	int errors;
+	int i;
+
+	if ( !numDemos ) {
+		Com_Printf( "Not recording any demo.\n" );
+		return;
+	}
+
+	if ( Cmd_Argc() < 2 || !Q_stricmp( Cmd_Argv( 1 ), "all" ) ) {
+		for ( i = 0; i < sv.maxclients; i++ ) {
+			SV_StopClientDemo( svs.clients + i );
+		}
+	} else {
+		cl = SV_GetPlayerByHandle();
+		if ( !cl ) {
+			return;
+		}
+		if ( !demos[ cl - svs.clients ].file ) {
+			Com_Printf( "Not recording %s.\n", cl->name );
+			return;
+		}
+		SV_StopClientDemo( cl );
+	}
+
+	errors = SV_DemoWriteErrors();
+	if ( errors ) {
+		Com_Printf( S_COLOR_YELLOW "WARNING: %i demo write errors\n", errors );
+	}
+}
@@ -722,7 +722,7 @@ static qboolean parse_file( const char *filename )
 		t.tm_year + 1900, t.tm_mon + 1, t.tm_mday,
 		t.tm_hour, t.tm_min );
 
-	filterDateMsec = Sys_Milliseconds();
+	filterDateMsec = SV_Milliseconds();
 
 	return qtrue;
 }
@@ -841,7 +841,7 @@ const char *SV_RunFilters( const char *userinfo, const netadr_t *addr )
 
 	filterName[0] = '\0';
 	filterMessage[0] = '\0';
-	filterCurrMsec = Sys_Milliseconds();
+	filterCurrMsec = SV_Milliseconds();
 
 	if ( walk_nodes( nodes ) != 0 )
 	{
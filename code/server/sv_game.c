@@ -257,7 +257,9 @@ SV_LocateGameData
 
 ===============
 */
-static void SV_LocateGameData( sharedEntity_t *gEnts, int numGEntities, int sizeofGEntity_t, playerState_t *clients, int sizeofGameClient ) {
+void SV_LocateGameData( sharedEntity_t *gEnts, int numGEntities, int sizeofGEntity_t, playerState_t *clients, int sizeofGameClient ) {
+	// game module has to provide state for every client slot it may get
+	const int numClients = SV_ClientSlotLimit( NULL ) > MAX_CLIENTS ? SV_ClientSlotLimit( NULL ) : MAX_CLIENTS;
 
 	if ( !gvm->entryPoint ) {
 		if ( numGEntities > MAX_GENTITIES ) {
@@ -270,9 +272,9 @@ static void SV_LocateGameData( sharedEntity_t *gEnts, int numGEntities, int size
 			}
 		}
 
-		if ( sizeofGameClient > gvm->exactDataLength / MAX_CLIENTS ) {
+		if ( sizeofGameClient > gvm->exactDataLength / numClients ) {
 			Com_Error( ERR_DROP, "%s: bad game client size %i", __func__, sizeofGameClient );	
-		} else if ( (byte*)clients + (sizeofGameClient * MAX_CLIENTS) > gvm->dataBase + gvm->exactDataLength ) {
+		} else if ( (byte*)clients + (sizeofGameClient * numClients) > gvm->dataBase + gvm->exactDataLength ) {
 			Com_Error( ERR_DROP, "%s: clients located out of data segment", __func__ );
 		}
 	}
@@ -353,6 +355,22 @@ static qboolean SV_GetValue( char* value, int valueSize, const char* key )
 		return qtrue;
 	}
 
+	if ( !Q_stricmp( key, "trap_TraceBatch_Q3E" ) )
+	{
+		Com_sprintf( value, valueSize, "%i", G_TRACE_BATCH );
+		return qtrue;
+	}
+
+	// module which asks for this before trap_LocateGameData() may get client
+	// slots up to returned value, it must keep player info of slots from
+	// MAX_CLIENTS on at CS_PLAYER_INFO() and refuse slots it can't handle
+	if ( !Q_stricmp( key, "MAX_SERVER_CLIENTS_Q3E" ) )
+	{
+		sv.gameClientLimit = sv_clientLimit->integer;
+		Com_sprintf( value, valueSize, "%i", sv.gameClientLimit );
+		return qtrue;
+	}
+
 	return qfalse;
 }
 
@@ -373,7 +391,7 @@ static intptr_t SV_GameSystemCalls( intptr_t *args ) {
 		Com_Error( ERR_DROP, "%s", (const char*)VMA(1) );
 		return 0;
 	case G_MILLISECONDS:
-		return Sys_Milliseconds();
+		return SV_Milliseconds();
 	case G_CVAR_REGISTER:
 		Cvar_Register( VMA(1), VMA(2), VMA(3), args[4], gvm->privateFlag ); 
 		return 0;
@@ -960,6 +978,15 @@ static intptr_t SV_GameSystemCalls( intptr_t *args ) {
 		Cvar_SetDescription2( (const char*)VMA(1), (const char*)VMA(2) );
 		return 0;
 
+	case G_TRACE_BATCH:
+		if ( (unsigned int)args[3] > MAX_TRACE_BATCH ) {
+			Com_Error( ERR_DROP, "G_TRACE_BATCH: bad count %i", (int)args[3] );
+		}
+		VM_CHECKBOUNDS( gvm, args[1], args[3] * sizeof( trace_t ) );
+		VM_CHECKBOUNDS( gvm, args[2], args[3] * sizeof( traceRequest_t ) );
+		SV_TraceBatch( VMA(1), VMA(2), args[3] );
+		return 0;
+
 	case G_TRAP_GETVALUE:
 		VM_CHECKBOUNDS( gvm, args[1], args[2] );
 		return SV_GetValue( VMA(1), args[2], VMA(3) );
@@ -1033,10 +1060,17 @@ static void SV_InitGameVM( qboolean restart ) {
 	for ( i = 0; i < sv.maxclients; i++ ) {
 		svs.clients[i].gentity = NULL;
 	}
-	
+
+	// module has to ask for more client slots again
+	sv.gameClientLimit = MAX_CLIENTS;
+
 	// use the current msec count for a random seed
 	// init for this gamestate
-	VM_Call( gvm, 3, GAME_INIT, sv.time, Com_Milliseconds(), restart );
+	VM_Call( gvm, 3, GAME_INIT, sv.time, SV_JournalInt( Com_Milliseconds() ), restart );
+
+	if ( sv.maxclients > sv.gameClientLimit ) {
+		Com_Printf( S_COLOR_YELLOW "WARNING: game module supports only %i of %i client slots\n", sv.gameClientLimit, sv.maxclients );
+	}
 }
 
 
@@ -1086,8 +1120,12 @@ void SV_InitGameProgs( void ) {
 		bot_enable = 0;
 	}
 
-	// load the dll or bytecode
-	gvm = VM_Create( VM_GAME, SV_GameSystemCalls, SV_DllSyscall, Cvar_VariableIntegerValue( "vm_game" ) );
+	// load the dll or bytecode, relay proxy has its own game logic
+	if ( SV_RelayActive() ) {
+		gvm = VM_CreateBuiltin( VM_GAME, SV_GameSystemCalls, SV_RelayGameMain );
+	} else {
+		gvm = VM_Create( VM_GAME, SV_GameSystemCalls, SV_DllSyscall, Cvar_VariableIntegerValue( "vm_game" ) );
+	}
 	if ( !gvm ) {
 		Com_Error( ERR_DROP, "VM_Create on game failed" );
 	}
@@ -0,0 +1,1118 @@
+// embedded HTTP server for pk3 downloads
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE // accept4()
+#endif
+
+#include "server.h"
+
+/*
+=============================================================================
+
+Serves referenced pk3 files to clients redirected with sv_dlURL so they
+don't have to be pushed block by block through the game channel by
+SV_WriteDownloadToClient().
+
+The list of files that can be downloaded is built by the main thread from
+sv_referencedPakNames with the same rules as UDP downloads, the server
+thread never touches the engine filesystem and only opens files from this
+list. The thread handles non-blocking sockets with poll(), supports
+HTTP/1.1 keep-alive, HEAD requests and single byte ranges (so interrupted
+downloads can be resumed) and sends file data with sendfile() on Linux.
+Bandwidth is limited per client address with a token bucket refilled at
+sv_httpRate bytes per second.
+
+Unless sv_dlURL is set by administrator the server URL is added to
+serverinfo configstring in its place, the sv_dlURL cvar itself is never
+changed so the advertised address doesn't end up in config files. The
+address is taken from sv_httpURL, net_ip or the first public address of
+local interfaces.
+
+=============================================================================
+*/
+
+#ifndef _WIN32
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+#ifndef O_CLOEXEC
+#define O_CLOEXEC 0
+#endif
+
+#define MAX_HTTP_CONNECTIONS	64
+#define MAX_HTTP_PER_HOST		4
+#define HTTP_REQUEST_SIZE		2048
+#define HTTP_HEADER_SIZE		512
+#define HTTP_CHUNK_SIZE			0x10000
+#define HTTP_IDLE_TIMEOUT		15000000	// usec
+#define HTTP_POLL_TIMEOUT		100			// msec
+
+typedef struct {
+	char		name[ MAX_QPATH ];		// gamedir/pakname.pk3
+	char		path[ MAX_OSPATH ];
+} httpFile_t;
+
+typedef struct {
+	uint32_t	addr;
+	int			connections;
+	int64_t		tokens;					// bytes that can be sent now
+	int64_t		refillTime;
+} httpHost_t;
+
+typedef enum {
+	HC_FREE,
+	HC_READING,
+	HC_SENDING
+} httpConnState_t;
+
+typedef enum {
+	HR_IGNORED,							// whole file is sent with 200
+	HR_SATISFIABLE,
+	HR_UNSATISFIABLE
+} httpRange_t;
+
+typedef struct {
+	httpConnState_t	state;
+	int			socket;
+	int			file;					// -1 if there is no body to send
+	httpHost_t	*host;
+	qboolean	keepAlive;
+	int64_t		lastActive;
+	char		request[ HTTP_REQUEST_SIZE ];
+	int			requestLength;
+	char		header[ HTTP_HEADER_SIZE ];
+	int			headerLength;
+	int			headerSent;
+	off_t		offset;					// next byte of file to send
+	off_t		end;					// one past last byte to send
+} httpConn_t;
+
+typedef struct {
+	int			requests;
+	int			rejected;				// connection or request refused
+	int			connections;			// currently open
+	int64_t		bytesSent;
+} httpStats_t;
+
+static struct {
+	sysThread_t	*thread;
+	sysMutex_t	*lock;
+	int			socket;
+	int			port;
+
+	// protected by lock
+	qboolean	shutdown;
+	httpFile_t	*files;
+	int			numFiles;
+	int			rate;					// bytes per second for each host, 0 - unlimited
+	httpStats_t	stats;
+
+	// owned by server thread
+	int			threadRate;
+	httpConn_t	conns[ MAX_HTTP_CONNECTIONS ];
+	httpHost_t	hosts[ MAX_HTTP_CONNECTIONS ];
+	httpStats_t	localStats;
+
+	// main thread only
+	int			filesModified;			// modification counts files were listed with
+	int			downloadModified;
+	char		url[ MAX_CVAR_VALUE_STRING ];	// advertised in serverinfo as sv_dlURL
+} http = { .socket = -1 };
+
+
+/*
+=================
+SV_HttpFindFile
+
+Copies OS path of downloadable file, called by server thread
+=================
+*/
+static qboolean SV_HttpFindFile( const char *name, char *path, int pathSize ) {
+	qboolean found;
+	int i;
+
+	found = qfalse;
+
+	Sys_LockMutex( http.lock );
+	for ( i = 0; i < http.numFiles; i++ ) {
+		if ( !Q_stricmp( http.files[ i ].name, name ) ) {
+			Q_strncpyz( path, http.files[ i ].path, pathSize );
+			found = qtrue;
+			break;
+		}
+	}
+	Sys_UnlockMutex( http.lock );
+
+	return found;
+}
+
+
+/*
+=================
+SV_HttpHost
+
+Returns rate limiting slot for client address
+=================
+*/
+static httpHost_t *SV_HttpHost( uint32_t addr ) {
+	httpHost_t *host, *unused;
+	int i;
+
+	unused = NULL;
+	for ( i = 0, host = http.hosts; i < MAX_HTTP_CONNECTIONS; i++, host++ ) {
+		if ( host->addr == addr && ( host->connections || host->refillTime ) ) {
+			return host;
+		}
+		// prefer the slot which was idle for longest time
+		if ( !host->connections && ( !unused || host->refillTime < unused->refillTime ) ) {
+			unused = host;
+		}
+	}
+
+	// there are never more hosts than connections
+	unused->addr = addr;
+	unused->connections = 0;
+	unused->tokens = http.threadRate;
+	unused->refillTime = Sys_Microseconds();
+
+	return unused;
+}
+
+
+/*
+=================
+SV_HttpRefill
+
+Returns number of bytes host can send now
+=================
+*/
+static int64_t SV_HttpRefill( httpHost_t *host, int64_t now ) {
+
+	if ( !http.threadRate ) {
+		return HTTP_CHUNK_SIZE;
+	}
+
+	host->tokens += ( now - host->refillTime ) * http.threadRate / 1000000;
+	if ( host->tokens > http.threadRate ) {
+		host->tokens = http.threadRate; // one second burst
+	}
+	host->refillTime = now;
+
+	return host->tokens;
+}
+
+
+/*
+=================
+SV_HttpClose
+=================
+*/
+static void SV_HttpClose( httpConn_t *conn ) {
+	if ( conn->file != -1 ) {
+		close( conn->file );
+	}
+	close( conn->socket );
+	conn->host->connections--;
+	conn->state = HC_FREE;
+	http.localStats.connections--;
+}
+
+
+/*
+=================
+SV_HttpSetResponse
+
+Prepares response header, body is sent from conn->file if it's open
+=================
+*/
+static void SV_HttpSetResponse( httpConn_t *conn, const char *status, const char *extra, off_t length ) {
+	conn->headerLength = Com_sprintf( conn->header, sizeof( conn->header ),
+		"HTTP/1.1 %s\r\n"
+		"Server: " Q3_VERSION "\r\n"
+		"%s"
+		"Content-Length: %lld\r\n"
+		"Connection: %s\r\n"
+		"\r\n",
+		status, extra, (long long)length, conn->keepAlive ? "keep-alive" : "close" );
+	conn->headerSent = 0;
+	conn->state = HC_SENDING;
+}
+
+
+/*
+=================
+SV_HttpParseRange
+
+Parses "bytes=first-last", "bytes=first-" or "bytes=-suffix",
+other units and multiple ranges are ignored
+=================
+*/
+static httpRange_t SV_HttpParseRange( const char *s, off_t size, off_t *first, off_t *last ) {
+	char *end;
+	long long a, b;
+
+	while ( *s == ' ' ) {
+		s++;
+	}
+
+	if ( Q_stricmpn( s, "bytes=", 6 ) || strchr( s, ',' ) ) {
+		// multiple ranges are not supported, whole file is sent instead
+		return HR_IGNORED;
+	}
+	s += 6;
+
+	if ( *s == '-' ) {
+		b = strtoll( s + 1, &end, 10 );
+		if ( end == s + 1 || b <= 0 || size <= 0 ) {
+			return HR_UNSATISFIABLE;
+		}
+		*first = b >= size ? 0 : size - b;
+		*last = size - 1;
+		return HR_SATISFIABLE;
+	}
+
+	a = strtoll( s, &end, 10 );
+	if ( end == s || *end != '-' || a < 0 || a >= size ) {
+		return HR_UNSATISFIABLE;
+	}
+	s = end + 1;
+
+	b = size - 1;
+	if ( *s >= '0' && *s <= '9' ) {
+		b = strtoll( s, &end, 10 );
+		if ( b < a ) {
+			return HR_UNSATISFIABLE;
+		}
+		if ( b >= size ) {
+			b = size - 1;
+		}
+	}
+
+	*first = a;
+	*last = b;
+
+	return HR_SATISFIABLE;
+}
+
+
+/*
+=================
+SV_HttpDecodePath
+
+Decodes percent-encoded request path without leading slash
+and query string, returns qfalse if it's malformed or unsafe
+=================
+*/
+static qboolean SV_HttpDecodePath( const char *s, char *out, int size ) {
+	int i, hi, lo;
+
+	if ( *s++ != '/' ) {
+		return qfalse;
+	}
+
+	for ( i = 0; *s && *s != '?' && *s != ' '; s++ ) {
+		if ( i >= size - 1 ) {
+			return qfalse;
+		}
+		if ( *s == '%' ) {
+			hi = s[1]; lo = s[2];
+			if ( !isxdigit( hi ) || !isxdigit( lo ) ) {
+				return qfalse;
+			}
+			hi = isdigit( hi ) ? hi - '0' : ( tolower( hi ) - 'a' + 10 );
+			lo = isdigit( lo ) ? lo - '0' : ( tolower( lo ) - 'a' + 10 );
+			out[ i++ ] = hi * 16 + lo;
+			s += 2;
+		} else {
+			out[ i++ ] = *s;
+		}
+	}
+	out[ i ] = '\0';
+
+	if ( out[ 0 ] == '\0' || strstr( out, ".." ) || strchr( out, '\\' ) || strchr( out, ':' ) ) {
+		return qfalse;
+	}
+
+	return qtrue;
+}
+
+
+/*
+=================
+SV_HttpRequest
+
+Handles complete request header
+=================
+*/
+static void SV_HttpRequest( httpConn_t *conn, char *request ) {
+	char name[ MAX_QPATH ], path[ MAX_OSPATH ];
+	char extra[ 256 ];
+	char *line, *next, *value, *range;
+	qboolean head;
+	struct stat st;
+	off_t first, last;
+	httpRange_t rangeType;
+	int fd;
+
+	http.localStats.requests++;
+
+	// request line
+	next = strstr( request, "\r\n" );
+	*next = '\0';
+	line = request;
+	request = next + 2;
+
+	conn->keepAlive = strstr( line, " HTTP/1.1" ) != NULL;
+
+	// headers
+	range = NULL;
+	for ( ; *request; request = next + 2 ) {
+		next = strstr( request, "\r\n" );
+		*next = '\0';
+		value = strchr( request, ':' );
+		if ( !value ) {
+			continue;
+		}
+		*value++ = '\0';
+		while ( *value == ' ' ) {
+			value++;
+		}
+		if ( !Q_stricmp( request, "Range" ) ) {
+			range = value;
+		} else if ( !Q_stricmp( request, "Connection" ) ) {
+			if ( !Q_stricmp( value, "close" ) ) {
+				conn->keepAlive = qfalse;
+			} else if ( !Q_stricmp( value, "keep-alive" ) ) {
+				conn->keepAlive = qtrue;
+			}
+		}
+	}
+
+	if ( !Q_strncmp( line, "GET ", 4 ) ) {
+		head = qfalse;
+		line += 4;
+	} else if ( !Q_strncmp( line, "HEAD ", 5 ) ) {
+		head = qtrue;
+		line += 5;
+	} else {
+		http.localStats.rejected++;
+		conn->keepAlive = qfalse;
+		SV_HttpSetResponse( conn, "405 Method Not Allowed", "Allow: GET, HEAD\r\n", 0 );
+		return;
+	}
+
+	if ( !SV_HttpDecodePath( line, name, sizeof( name ) ) || !SV_HttpFindFile( name, path, sizeof( path ) ) ) {
+		http.localStats.rejected++;
+		SV_HttpSetResponse( conn, "404 Not Found", "", 0 );
+		return;
+	}
+
+	fd = open( path, O_RDONLY | O_CLOEXEC );
+	if ( fd == -1 || fstat( fd, &st ) == -1 ) {
+		if ( fd != -1 ) {
+			close( fd );
+		}
+		http.localStats.rejected++;
+		SV_HttpSetResponse( conn, "404 Not Found", "", 0 );
+		return;
+	}
+
+	rangeType = range ? SV_HttpParseRange( range, st.st_size, &first, &last ) : HR_IGNORED;
+
+	if ( rangeType == HR_UNSATISFIABLE ) {
+		close( fd );
+		Com_sprintf( extra, sizeof( extra ), "Content-Range: bytes */%lld\r\n", (long long)st.st_size );
+		SV_HttpSetResponse( conn, "416 Range Not Satisfiable", extra, 0 );
+		return;
+	}
+
+	if ( rangeType == HR_SATISFIABLE ) {
+		Com_sprintf( extra, sizeof( extra ), "Content-Type: application/octet-stream\r\n"
+			"Accept-Ranges: bytes\r\nContent-Range: bytes %lld-%lld/%lld\r\n",
+			(long long)first, (long long)last, (long long)st.st_size );
+		SV_HttpSetResponse( conn, "206 Partial Content", extra, last - first + 1 );
+	} else {
+		first = 0;
+		last = st.st_size - 1;
+		SV_HttpSetResponse( conn, "200 OK", "Content-Type: application/octet-stream\r\nAccept-Ranges: bytes\r\n", st.st_size );
+	}
+
+	if ( head || last < first ) {
+		close( fd );
+		return;
+	}
+
+	conn->file = fd;
+	conn->offset = first;
+	conn->end = last + 1;
+}
+
+
+/*
+=================
+SV_HttpProcess
+
+Handles buffered request if its header is complete
+=================
+*/
+static void SV_HttpProcess( httpConn_t *conn ) {
+	char *end;
+	int length;
+
+	end = strstr( conn->request, "\r\n\r\n" );
+	if ( !end ) {
+		if ( conn->requestLength >= sizeof( conn->request ) - 1 ) {
+			http.localStats.rejected++;
+			conn->keepAlive = qfalse;
+			SV_HttpSetResponse( conn, "431 Request Header Fields Too Large", "", 0 );
+		}
+		return;
+	}
+
+	// keep pipelined data after the header
+	end[ 2 ] = '\0';
+	length = end + 4 - conn->request;
+	SV_HttpRequest( conn, conn->request );
+	conn->requestLength -= length;
+	memmove( conn->request, conn->request + length, conn->requestLength + 1 );
+}
+
+
+/*
+=================
+SV_HttpRead
+
+Returns qfalse if connection should be closed
+=================
+*/
+static qboolean SV_HttpRead( httpConn_t *conn ) {
+	int n;
+
+	n = recv( conn->socket, conn->request + conn->requestLength, sizeof( conn->request ) - 1 - conn->requestLength, 0 );
+	if ( n == 0 || ( n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR ) ) {
+		return qfalse;
+	}
+	if ( n < 0 ) {
+		return qtrue;
+	}
+
+	conn->requestLength += n;
+	conn->request[ conn->requestLength ] = '\0';
+
+	SV_HttpProcess( conn );
+
+	return qtrue;
+}
+
+
+/*
+=================
+SV_HttpWrite
+
+Returns qfalse if connection should be closed
+=================
+*/
+static qboolean SV_HttpWrite( httpConn_t *conn, int64_t now ) {
+#ifndef __linux__
+	static byte buffer[ HTTP_CHUNK_SIZE ];
+#endif
+	int64_t count;
+	ssize_t n;
+
+	if ( conn->headerSent < conn->headerLength ) {
+		n = send( conn->socket, conn->header + conn->headerSent, conn->headerLength - conn->headerSent, MSG_NOSIGNAL );
+		if ( n < 0 ) {
+			return ( errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR );
+		}
+		conn->headerSent += n;
+		http.localStats.bytesSent += n;
+		if ( conn->headerSent < conn->headerLength ) {
+			return qtrue;
+		}
+	}
+
+	if ( conn->file != -1 && conn->offset < conn->end ) {
+		count = SV_HttpRefill( conn->host, now );
+		if ( count <= 0 ) {
+			return qtrue;
+		}
+		if ( count > HTTP_CHUNK_SIZE ) {
+			count = HTTP_CHUNK_SIZE;
+		}
+		if ( count > conn->end - conn->offset ) {
+			count = conn->end - conn->offset;
+		}
+#ifdef __linux__
+		n = sendfile( conn->socket, conn->file, &conn->offset, count );
+		if ( n < 0 ) {
+			return ( errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR );
+		}
+		if ( n == 0 ) {
+			return qfalse; // file was truncated
+		}
+#else
+		n = pread( conn->file, buffer, count, conn->offset );
+		if ( n <= 0 ) {
+			return qfalse;
+		}
+		n = send( conn->socket, buffer, n, MSG_NOSIGNAL );
+		if ( n < 0 ) {
+			return ( errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR );
+		}
+		conn->offset += n;
+#endif
+		if ( http.threadRate ) {
+			conn->host->tokens -= n;
+		}
+		http.localStats.bytesSent += n;
+		if ( conn->offset < conn->end ) {
+			return qtrue;
+		}
+	}
+
+	// response complete
+	if ( conn->file != -1 ) {
+		close( conn->file );
+		conn->file = -1;
+	}
+
+	if ( !conn->keepAlive ) {
+		return qfalse;
+	}
+
+	conn->state = HC_READING;
+	conn->headerLength = conn->headerSent = 0;
+
+	// pipelined request may be buffered already
+	SV_HttpProcess( conn );
+
+	return qtrue;
+}
+
+
+/*
+=================
+SV_HttpAccept
+=================
+*/
+static void SV_HttpAccept( int64_t now ) {
+	static const char busy[] = "HTTP/1.1 503 Service Unavailable\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+	struct sockaddr_in addr;
+	socklen_t addrlen;
+	httpConn_t *conn;
+	httpHost_t *host;
+	int sock, i;
+
+	for ( ;; ) {
+		addrlen = sizeof( addr );
+#ifdef __linux__
+		sock = accept4( http.socket, (struct sockaddr *)&addr, &addrlen, SOCK_NONBLOCK | SOCK_CLOEXEC );
+		if ( sock == -1 ) {
+			return;
+		}
+#else
+		sock = accept( http.socket, (struct sockaddr *)&addr, &addrlen );
+		if ( sock == -1 ) {
+			return;
+		}
+
+		fcntl( sock, F_SETFD, FD_CLOEXEC );
+		fcntl( sock, F_SETFL, fcntl( sock, F_GETFL, 0 ) | O_NONBLOCK );
+#endif
+
+		conn = NULL;
+		for ( i = 0; i < MAX_HTTP_CONNECTIONS; i++ ) {
+			if ( http.conns[ i ].state == HC_FREE ) {
+				conn = &http.conns[ i ];
+				break;
+			}
+		}
+
+		host = conn ? SV_HttpHost( addr.sin_addr.s_addr ) : NULL;
+
+		if ( !conn || host->connections >= MAX_HTTP_PER_HOST ) {
+			http.localStats.rejected++;
+			send( sock, busy, sizeof( busy ) - 1, MSG_NOSIGNAL );
+			close( sock );
+			continue;
+		}
+
+		Com_Memset( conn, 0, sizeof( *conn ) );
+		conn->state = HC_READING;
+		conn->socket = sock;
+		conn->file = -1;
+		conn->host = host;
+		conn->lastActive = now;
+		host->connections++;
+		http.localStats.connections++;
+	}
+}
+
+
+/*
+=================
+SV_HttpThread
+=================
+*/
+static void SV_HttpThread( void *unused ) {
+	struct pollfd fds[ MAX_HTTP_CONNECTIONS + 1 ];
+	httpConn_t *list[ MAX_HTTP_CONNECTIONS + 1 ];
+	httpConn_t *conn;
+	sigset_t set;
+	int64_t now;
+	int i, n, timeout;
+	qboolean ok;
+
+	// peer closing connection in the middle of a send must not kill the process
+	sigemptyset( &set );
+	sigaddset( &set, SIGPIPE );
+	pthread_sigmask( SIG_BLOCK, &set, NULL );
+
+	for ( ;; ) {
+		Sys_LockMutex( http.lock );
+		if ( http.shutdown ) {
+			Sys_UnlockMutex( http.lock );
+			break;
+		}
+		http.threadRate = http.rate;
+		http.stats = http.localStats;
+		Sys_UnlockMutex( http.lock );
+
+		now = Sys_Microseconds();
+		timeout = HTTP_POLL_TIMEOUT;
+
+		fds[ 0 ].fd = http.socket;
+		fds[ 0 ].events = POLLIN;
+		n = 1;
+
+		for ( i = 0, conn = http.conns; i < MAX_HTTP_CONNECTIONS; i++, conn++ ) {
+			if ( conn->state == HC_FREE ) {
+				continue;
+			}
+			if ( now - conn->lastActive > HTTP_IDLE_TIMEOUT ) {
+				SV_HttpClose( conn );
+				continue;
+			}
+			fds[ n ].fd = conn->socket;
+			fds[ n ].events = 0;
+			if ( conn->state == HC_READING ) {
+				fds[ n ].events = POLLIN;
+			} else if ( conn->headerSent < conn->headerLength || SV_HttpRefill( conn->host, now ) > 0 ) {
+				fds[ n ].events = POLLOUT;
+			} else {
+				// wake up when bucket has enough tokens for a packet
+				timeout = 1 + ( MAX_PACKETLEN - conn->host->tokens ) * 1000 / http.threadRate;
+				if ( timeout > HTTP_POLL_TIMEOUT ) {
+					timeout = HTTP_POLL_TIMEOUT;
+				}
+				conn->lastActive = now; // throttled, not idle
+			}
+			list[ n++ ] = conn;
+		}
+
+		if ( poll( fds, n, timeout ) < 0 ) {
+			continue;
+		}
+
+		now = Sys_Microseconds();
+
+		for ( i = 1; i < n; i++ ) {
+			conn = list[ i ];
+			if ( conn->state == HC_FREE ) {
+				continue;
+			}
+			if ( fds[ i ].revents & ( POLLERR | POLLHUP | POLLNVAL ) ) {
+				SV_HttpClose( conn );
+				continue;
+			}
+			if ( conn->state == HC_READING && ( fds[ i ].revents & POLLIN ) ) {
+				ok = SV_HttpRead( conn );
+			} else if ( conn->state == HC_SENDING && ( fds[ i ].revents & POLLOUT ) ) {
+				ok = SV_HttpWrite( conn, now );
+			} else {
+				continue;
+			}
+			conn->lastActive = now;
+			if ( !ok ) {
+				SV_HttpClose( conn );
+			}
+		}
+
+		if ( fds[ 0 ].revents & POLLIN ) {
+			SV_HttpAccept( now );
+		}
+	}
+
+	for ( i = 0, conn = http.conns; i < MAX_HTTP_CONNECTIONS; i++, conn++ ) {
+		if ( conn->state != HC_FREE ) {
+			SV_HttpClose( conn );
+		}
+	}
+}
+
+
+/*
+=================
+SV_HttpUpdateFiles
+
+Lists referenced pk3 files which may be downloaded
+=================
+*/
+static void SV_HttpUpdateFiles( void ) {
+	httpFile_t *files, *oldFiles;
+	const char *text, *name, *path;
+	int numFiles, count;
+
+	http.filesModified = sv_referencedPakNames->modificationCount;
+	http.downloadModified = sv_allowDownload->modificationCount;
+
+	files = NULL;
+	numFiles = 0;
+
+	if ( ( sv_allowDownload->integer & DLF_ENABLE ) && !( sv_allowDownload->integer & DLF_NO_REDIRECT ) ) {
+		// parse locally to keep Cmd_Argv() state of the caller intact
+		count = 0;
+		text = sv_referencedPakNames->string;
+		while ( *COM_ParseExt( &text, qfalse ) ) {
+			count++;
+		}
+		if ( count ) {
+			files = Z_Malloc( count * sizeof( *files ) );
+		}
+		text = sv_referencedPakNames->string;
+		while ( numFiles < count ) {
+			name = COM_ParseExt( &text, qfalse );
+			if ( !*name ) {
+				break;
+			}
+			// same rules as in SV_WriteDownloadToClient()
+			if ( FS_idPak( name, BASEGAME, NUM_ID_PAKS ) || FS_idPak( name, BASETA, NUM_TA_PAKS ) ) {
+				continue;
+			}
+			Com_sprintf( files[ numFiles ].name, sizeof( files[ numFiles ].name ), "%s.pk3", name );
+			path = FS_SV_OSPath( files[ numFiles ].name );
+			if ( !path ) {
+				continue;
+			}
+			Q_strncpyz( files[ numFiles ].path, path, sizeof( files[ numFiles ].path ) );
+			numFiles++;
+		}
+	}
+
+	Sys_LockMutex( http.lock );
+	oldFiles = http.files;
+	http.files = files;
+	http.numFiles = numFiles;
+	Sys_UnlockMutex( http.lock );
+
+	if ( oldFiles ) {
+		Z_Free( oldFiles );
+	}
+}
+
+
+/*
+=================
+SV_HttpServerInfo
+
+Adds sv_dlURL pointing to this server to serverinfo string unless it was
+set by administrator
+=================
+*/
+const char *SV_HttpServerInfo( const char *info ) {
+	static char buf[ MAX_INFO_STRING ];
+
+	if ( !http.url[0] || sv_dlURL->string[0] ) {
+		return info;
+	}
+
+	Q_strncpyz( buf, info, sizeof( buf ) );
+	Info_SetValueForKey( buf, "sv_dlURL", http.url );
+
+	return buf;
+}
+
+
+/*
+=================
+SV_HttpAdvertise
+
+Sets URL which SV_HttpServerInfo() adds to serverinfo
+=================
+*/
+static void SV_HttpAdvertise( qboolean enable ) {
+	netadr_t list[ 16 ], *adr;
+	const char *host;
+	int i, count;
+
+	// update serverinfo configstring
+	cvar_modifiedFlags |= CVAR_SERVERINFO;
+
+	if ( !enable ) {
+		http.url[0] = '\0';
+		return;
+	}
+
+	if ( sv_httpURL->string[0] ) {
+		Q_strncpyz( http.url, sv_httpURL->string, sizeof( http.url ) );
+	} else {
+		host = Cvar_VariableString( "net_ip" );
+		if ( !host[0] || !strcmp( host, "0.0.0.0" ) || !Q_stricmp( host, "localhost" ) ) {
+			// first public address, first private one otherwise
+			host = NULL;
+			count = Sys_LocalAddresses( list, ARRAY_LEN( list ) );
+			for ( i = 0, adr = list; i < count; i++, adr++ ) {
+				if ( adr->type != NA_IP || adr->ipv._4[0] == 127 ) {
+					continue;
+				}
+				if ( !Sys_IsLANAddress( adr ) ) {
+					host = NET_AdrToString( adr );
+					break;
+				}
+				if ( !host ) {
+					host = va( "%s", NET_AdrToString( adr ) );
+				}
+			}
+		}
+		if ( !host ) {
+			Com_Printf( S_COLOR_YELLOW "WARNING: HTTP server address is unknown, set sv_httpURL\n" );
+			http.url[0] = '\0';
+			return;
+		}
+		Com_sprintf( http.url, sizeof( http.url ), "http://%s:%i", host, http.port );
+	}
+
+	// leave manually configured value alone
+	if ( sv_dlURL->string[0] ) {
+		Com_Printf( "HTTP server: sv_dlURL is set manually, not advertising %s\n", http.url );
+	}
+}
+
+
+/*
+=================
+SV_HttpStop
+=================
+*/
+static void SV_HttpStop( void ) {
+
+	if ( !http.thread ) {
+		return;
+	}
+
+	Sys_LockMutex( http.lock );
+	http.shutdown = qtrue;
+	Sys_UnlockMutex( http.lock );
+
+	Sys_JoinThread( http.thread );
+	Sys_DestroyMutex( http.lock );
+	close( http.socket );
+
+	if ( http.files ) {
+		Z_Free( http.files );
+	}
+
+	SV_HttpAdvertise( qfalse );
+
+	http.thread = NULL;
+	http.lock = NULL;
+	http.socket = -1;
+	http.files = NULL;
+	http.numFiles = 0;
+	http.shutdown = qfalse;
+
+	Com_Printf( "HTTP server stopped\n" );
+}
+
+
+/*
+=================
+SV_HttpStart
+=================
+*/
+static void SV_HttpStart( void ) {
+	struct sockaddr_in addr;
+	const char *ip;
+	int sock, one;
+
+	http.port = sv_httpPort->integer ? sv_httpPort->integer : Cvar_VariableIntegerValue( "net_port" );
+
+	Com_Memset( &addr, 0, sizeof( addr ) );
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons( http.port );
+	addr.sin_addr.s_addr = INADDR_ANY;
+
+	ip = Cvar_VariableString( "net_ip" );
+	if ( ip[0] && Q_stricmp( ip, "localhost" ) && inet_pton( AF_INET, ip, &addr.sin_addr ) != 1 ) {
+		Com_Printf( S_COLOR_YELLOW "WARNING: HTTP server: can't bind to net_ip %s\n", ip );
+		return;
+	}
+
+	sock = socket( AF_INET, SOCK_STREAM, IPPROTO_TCP );
+	if ( sock == -1 ) {
+		Com_Printf( S_COLOR_YELLOW "WARNING: HTTP server: socket: %s\n", strerror( errno ) );
+		return;
+	}
+
+	one = 1;
+	setsockopt( sock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof( one ) );
+	fcntl( sock, F_SETFD, FD_CLOEXEC );
+	fcntl( sock, F_SETFL, fcntl( sock, F_GETFL, 0 ) | O_NONBLOCK );
+
+	if ( bind( sock, (struct sockaddr *)&addr, sizeof( addr ) ) == -1 || listen( sock, 16 ) == -1 ) {
+		Com_Printf( S_COLOR_YELLOW "WARNING: HTTP server: can't listen on port %i: %s\n", http.port, strerror( errno ) );
+		close( sock );
+		return;
+	}
+
+	http.lock = Sys_CreateMutex();
+	if ( !http.lock ) {
+		close( sock );
+		return;
+	}
+
+	http.socket = sock;
+	http.rate = sv_httpRate->integer;
+	Com_Memset( &http.stats, 0, sizeof( http.stats ) );
+	Com_Memset( &http.localStats, 0, sizeof( http.localStats ) );
+	Com_Memset( http.conns, 0, sizeof( http.conns ) );
+	Com_Memset( http.hosts, 0, sizeof( http.hosts ) );
+
+	SV_HttpUpdateFiles();
+
+	http.thread = Sys_CreateThread( SV_HttpThread, NULL );
+	if ( !http.thread ) {
+		Com_Printf( S_COLOR_YELLOW "WARNING: HTTP server: failed to start thread\n" );
+		Sys_DestroyMutex( http.lock );
+		close( sock );
+		if ( http.files ) {
+			Z_Free( http.files );
+		}
+		http.lock = NULL;
+		http.socket = -1;
+		http.files = NULL;
+		http.numFiles = 0;
+		return;
+	}
+
+	Com_Printf( "HTTP server listening on TCP port %i\n", http.port );
+
+	SV_HttpAdvertise( qtrue );
+}
+
+
+/*
+=================
+SV_HttpFrame
+
+Starts, stops or updates HTTP server after cvar or map changes
+=================
+*/
+void SV_HttpFrame( void ) {
+
+	if ( sv_httpServer->modified || sv_httpPort->modified || sv_httpURL->modified ) {
+		sv_httpServer->modified = qfalse;
+		sv_httpPort->modified = qfalse;
+		sv_httpURL->modified = qfalse;
+		SV_HttpStop();
+		if ( sv_httpServer->integer ) {
+			SV_HttpStart();
+		}
+	}
+
+	if ( !http.thread ) {
+		return;
+	}
+
+	if ( http.filesModified != sv_referencedPakNames->modificationCount || http.downloadModified != sv_allowDownload->modificationCount ) {
+		SV_HttpUpdateFiles();
+	}
+
+	if ( http.rate != sv_httpRate->integer ) {
+		Sys_LockMutex( http.lock );
+		http.rate = sv_httpRate->integer;
+		Sys_UnlockMutex( http.lock );
+	}
+}
+
+
+/*
+=================
+SV_HttpShutdown
+=================
+*/
+void SV_HttpShutdown( void ) {
+	SV_HttpStop();
+	// restart with next map
+	sv_httpServer->modified = qtrue;
+}
+
+
+/*
+=================
+SV_HttpStatus_f
+=================
+*/
+void SV_HttpStatus_f( void ) {
+	httpStats_t stats;
+	int i;
+
+	if ( !http.thread ) {
+		Com_Printf( "HTTP server is not running.\n" );
+		return;
+	}
+
+	Sys_LockMutex( http.lock );
+	stats = http.stats;
+	Sys_UnlockMutex( http.lock );
+
+	Com_Printf( "HTTP server on port %i, URL: %s%s\n", http.port, http.url[0] ? http.url : "not advertised",
+		http.url[0] && sv_dlURL->string[0] ? " (overridden by sv_dlURL)" : "" );
+	Com_Printf( "%i open connections, %i requests, %i rejected, %lld bytes sent\n",
+		stats.connections, stats.requests, stats.rejected, (long long)stats.bytesSent );
+	Com_Printf( "%i files:\n", http.numFiles );
+	for ( i = 0; i < http.numFiles; i++ ) {
+		Com_Printf( " %s\n", http.files[ i ].name );
+	}
+}
+
+#else // _WIN32
+
+void SV_HttpFrame( void ) {
+	if ( sv_httpServer->modified ) {
+		sv_httpServer->modified = qfalse;
+		if ( sv_httpServer->integer ) {
+			Com_Printf( S_COLOR_YELLOW "WARNING: HTTP server is not supported on this platform\n" );
+		}
+	}
+}
+
+void SV_HttpShutdown( void ) {
+}
+
+const char *SV_HttpServerInfo( const char *info ) {
+	return info;
+}
+
+void SV_HttpStatus_f( void ) {
+	Com_Printf( "HTTP server is not supported on this platform.\n" );
+}
+
+#endif // _WIN32
@@ -23,15 +23,40 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 #include "server.h"
 
 
+/*
+===============
+SV_SendConfigstringCommand
+
+Adds command to all listed clients, encoding it once if there are many
+===============
+*/
+static void SV_SendConfigstringCommand( client_t **clients, int count, const char *text )
+{
+	svCommand_t *command;
+	int i;
+
+	if ( count == 1 ) {
+		SV_AddServerCommand( clients[ 0 ], text );
+		return;
+	}
+
+	command = SV_CreateServerCommand( text, qtrue );
+	for ( i = 0; i < count; i++ ) {
+		SV_AddSharedServerCommand( clients[ i ], command );
+	}
+	SV_ReleaseServerCommand( command );
+}
+
+
 /*
 ===============
 SV_SendConfigstring
 
 Creates and sends the server command necessary to update the CS index for the
-given client
+given clients
 ===============
 */
-static void SV_SendConfigstring(client_t *client, int index)
+static void SV_SendConfigstring( client_t **clients, int count, int index )
 {
 	int maxChunkSize = MAX_STRING_CHARS - 24;
 	int len;
@@ -57,16 +82,16 @@ static void SV_SendConfigstring(client_t *client, int index)
 			Q_strncpyz( buf, &sv.configstrings[index][sent],
 				maxChunkSize );
 
-			SV_SendServerCommand( client, "%s %i \"%s\"", cmd,
-				index, buf );
+			SV_SendConfigstringCommand( clients, count, va( "%s %i \"%s\"", cmd,
+				index, buf ) );
 
 			sent += (maxChunkSize - 1);
 			remaining -= (maxChunkSize - 1);
 		}
 	} else {
 		// standard cs, just send it
-		SV_SendServerCommand( client, "cs %i \"%s\"", index,
-			sv.configstrings[index] );
+		SV_SendConfigstringCommand( clients, count, va( "cs %i \"%s\"", index,
+			sv.configstrings[index] ) );
 	}
 }
 
@@ -92,11 +117,72 @@ void SV_UpdateConfigstrings(client_t *client)
 			continue;
 		}
 
-		SV_SendConfigstring(client, index);
+		SV_SendConfigstring(&client, 1, index);
 		client->csUpdated[index] = qfalse;
 	}
 }
 
+/*
+===============
+SV_SendConfigstringToActive
+
+Sends current configstring value to all active clients or just counts
+them if send is false, returns number of recipients
+===============
+*/
+static int SV_SendConfigstringToActive( int index, qboolean send )
+{
+	client_t	*list[ MAX_SERVER_CLIENTS ];
+	client_t	*client;
+	int		i, n, count;
+
+	count = 0;
+	for ( n = 0; n < svs.numActiveClients; n++ ) {
+		i = svs.activeClients[ n ];
+		client = &svs.clients[ i ];
+		if ( client->state < CS_ACTIVE ) {
+			continue;
+		}
+		// do not always send server info to all clients
+		if ( index == CS_SERVERINFO && ( SV_GentityNum( i )->r.svFlags & SVF_NOSERVERINFO ) ) {
+			continue;
+		}
+		list[ count++ ] = client;
+	}
+
+	if ( send && count ) {
+		SV_SendConfigstring( list, count, index );
+	}
+
+	return count;
+}
+
+
+/*
+===============
+SV_FlushConfigstrings
+
+Sends queued configstring changes to active clients, called before
+snapshots are transmitted and before any other server command is
+queued so the order of reliable commands is preserved
+===============
+*/
+void SV_FlushConfigstrings( void )
+{
+	int		i, n, index;
+
+	// reset first as SV_SendConfigstring() will get back here
+	n = sv.numCsPending;
+	sv.numCsPending = 0;
+
+	for ( i = 0; i < n; i++ ) {
+		index = sv.csPending[ i ];
+		sv.csDirty[ index ] = 0;
+		svs.csUpdatesSent += SV_SendConfigstringToActive( index, qtrue );
+	}
+}
+
+
 /*
 ===============
 SV_SetConfigstring
@@ -124,26 +210,37 @@ void SV_SetConfigstring (int index, const char *val) {
 	Z_Free( sv.configstrings[index] );
 	sv.configstrings[index] = CopyString( val );
 
+	SV_InvalidateGamestateCache( qfalse );
+
 	// send it to all the clients if we aren't
 	// spawning a new server
 	if ( sv.state == SS_GAME || sv.restarting ) {
 
-		// send the data to all relevant clients
-		for (i = 0, client = svs.clients; i < sv.maxclients; i++, client++) {
-			if ( client->state < CS_ACTIVE ) {
-				if ( client->state == CS_PRIMED || client->state == CS_CONNECTED ) {
-					// track CS_CONNECTED clients as well to optimize gamestate acknowledge after downloading/retransmission
-					client->csUpdated[index] = qtrue;
-				}
-				continue;
-			}
-			// do not always send server info to all clients
-			if ( index == CS_SERVERINFO && ( SV_GentityNum( i )->r.svFlags & SVF_NOSERVERINFO ) ) {
-				continue;
+		for ( i = 0; i < svs.numConnectedClients; i++ ) {
+			client = &svs.clients[ svs.connectedClients[ i ] ];
+			if ( client->state == CS_PRIMED || client->state == CS_CONNECTED ) {
+				// track CS_CONNECTED clients as well to optimize gamestate acknowledge after downloading/retransmission
+				client->csUpdated[index] = qtrue;
 			}
+		}
+
+		svs.csChanges++;
+
+		if ( sv.csDirty[ index ] ) {
+			// previous value was not sent yet
+			svs.csCoalesced++;
+			svs.csUpdatesSaved += SV_SendConfigstringToActive( index, qfalse );
+			return;
+		}
 
-			SV_SendConfigstring(client, index);
+		if ( sv_coalesceConfigstrings->integer ) {
+			sv.csDirty[ index ] = 1;
+			sv.csPending[ sv.numCsPending++ ] = index;
+			return;
 		}
+
+		// send the data to all relevant clients
+		svs.csUpdatesSent += SV_SendConfigstringToActive( index, qtrue );
 	}
 }
 
@@ -233,6 +330,8 @@ static void SV_CreateBaseline( void ) {
 		sv.svEntities[ entnum ].baseline = ent->s;
 		sv.baselineUsed[ entnum ] = 1;
 	}
+
+	SV_InvalidateGamestateCache( qtrue );
 }
 
 
@@ -279,6 +378,9 @@ static void SV_AllocClients( int count )
 	svs.clients = Z_TagMalloc( count * sizeof( client_t ), TAG_CLIENTS );
 	Com_Memset( svs.clients, 0x0, count * sizeof( client_t ) );
 	sv.maxclients = count;
+
+	svs.clientListsChanged = qtrue;
+	SV_UpdateClientLists();
 	SV_SetSnapshotParams();
 }
 
@@ -358,6 +460,13 @@ static void SV_ChangeMaxClients( void ) {
 		}
 	}
 
+	// release commands of slots that are not copied
+	for ( i = 0; i < sv.maxclients; i++ ) {
+		if ( svs.clients[i].state < CS_CONNECTED ) {
+			SV_ClearReliableCommands( &svs.clients[i] );
+		}
+	}
+
 	// free old clients arrays
 	Z_Free( svs.clients );
 
@@ -371,6 +480,9 @@ static void SV_ChangeMaxClients( void ) {
 		}
 	}
 
+	svs.clientListsChanged = qtrue;
+	SV_UpdateClientLists();
+
 	// free the old clients on the hunk
 	Hunk_FreeTempMemory( oldClients );
 }
@@ -397,6 +509,9 @@ static void SV_ClearServer( void ) {
 	} else {
 		Com_Memset( &sv, 0, sizeof( sv ) );
 	}
+
+	SV_InvalidateGamestateCache( qfalse );
+	SV_InvalidateGamestateCache( qtrue );
 }
 
 
@@ -454,6 +569,8 @@ void SV_SpawnServer( const char *mapname, qboolean killBots ) {
 		}
 	}
 
+	svs.time = SV_JournalInt( svs.time );
+
 #ifndef DEDICATED
 	// remove pure paks that may left from client-side
 	FS_PureServerSetLoadedPaks( "", "" );
@@ -520,8 +637,9 @@ void SV_SpawnServer( const char *mapname, qboolean killBots ) {
 	sv.pure = sv_pure->integer;
 
 	// get a new checksum feed and restart the file system
-	srand( Com_Milliseconds() );
+	srand( SV_JournalInt( Com_Milliseconds() ) );
 	Com_RandomBytes( (byte*)&sv.checksumFeed, sizeof( sv.checksumFeed ) );
+	sv.checksumFeed = SV_JournalInt( sv.checksumFeed );
 	FS_Restart( sv.checksumFeed );
 
 	Sys_SetStatus( "Loading map %s", mapname );
@@ -594,7 +712,7 @@ void SV_SpawnServer( const char *mapname, qboolean killBots ) {
 					svs.clients[i].gamestateAck = GSA_INIT; // resend gamestate, accept first correct serverId
 					// when we get the next packet from a connected client,
 					// the new gamestate will be sent
-					svs.clients[i].state = CS_CONNECTED;
+					SV_SetClientState( &svs.clients[i], CS_CONNECTED );
 					svs.clients[i].gentity = NULL;
 				} else {
 					SV_ClientEnterWorld( &svs.clients[i] );
@@ -610,6 +728,10 @@ void SV_SpawnServer( const char *mapname, qboolean killBots ) {
 	SV_BotFrame( sv.time );
 	svs.time += 100;
 
+	// give new map full idle period before hibernation
+	svs.hibernating = qfalse;
+	svs.lastHumanTime = svs.time;
+
 	// we need to touch the cgame and ui qvm because they could be in
 	// separate pk3 files and the client will need to download the pk3
 	// files with the latest cgame and ui qvm to pass the pure check
@@ -668,8 +790,9 @@ void SV_SpawnServer( const char *mapname, qboolean killBots ) {
 	SV_SetConfigstring( CS_SYSTEMINFO, Cvar_InfoString_Big( CVAR_SYSTEMINFO, NULL ) );
 	cvar_modifiedFlags &= ~CVAR_SYSTEMINFO;
 
-	SV_SetConfigstring( CS_SERVERINFO, Cvar_InfoString( CVAR_SERVERINFO, NULL ) );
+	SV_SetConfigstring( CS_SERVERINFO, SV_HttpServerInfo( Cvar_InfoString( CVAR_SERVERINFO, NULL ) ) );
 	cvar_modifiedFlags &= ~CVAR_SERVERINFO;
+	SV_InvalidateQueryCache();
 
 	// any media configstring setting now should issue a warning
 	// and any configstring changes should be reliably transmitted
@@ -717,12 +840,15 @@ void SV_Init( void )
 	sv_mapname = Cvar_Get ("mapname", "nomap", CVAR_SERVERINFO | CVAR_ROM);
 	Cvar_SetDescription( sv_mapname, "Display the name of the current map being used on a server." );
 	sv_privateClients = Cvar_Get( "sv_privateClients", "0", CVAR_SERVERINFO );
-	Cvar_CheckRange( sv_privateClients, "0", va( "%i", MAX_CLIENTS-1 ), CV_INTEGER );
+	Cvar_CheckRange( sv_privateClients, "0", va( "%i", MAX_SERVER_CLIENTS-1 ), CV_INTEGER );
 	Cvar_SetDescription( sv_privateClients, "The number of spots, out of sv_maxclients, reserved for players with the server password (sv_privatePassword)." );
 	sv_hostname = Cvar_Get ("sv_hostname", "noname", CVAR_SERVERINFO | CVAR_ARCHIVE );
 	Cvar_SetDescription( sv_hostname, "Sets the name of the server." );
+	sv_clientLimit = Cvar_Get( "sv_clientLimit", XSTRING(MAX_CLIENTS), CVAR_INIT | CVAR_PROTECTED );
+	Cvar_CheckRange( sv_clientLimit, XSTRING(MAX_CLIENTS), XSTRING(MAX_SERVER_CLIENTS), CV_INTEGER );
+	Cvar_SetDescription( sv_clientLimit, "Upper limit of sv_maxclients, can be set only from command line. Slots from " XSTRING(MAX_CLIENTS) " on are given only if game module asks for MAX_SERVER_CLIENTS_Q3E value and client sends \"clientLimit\" userinfo key with its own limit." );
 	sv_maxclients = Cvar_Get ("sv_maxclients", "8", CVAR_SERVERINFO | CVAR_LATCH);
-	Cvar_CheckRange( sv_maxclients, "1", XSTRING(MAX_CLIENTS), CV_INTEGER );
+	Cvar_CheckRange( sv_maxclients, "1", sv_clientLimit->string, CV_INTEGER );
 	Cvar_SetDescription( sv_maxclients, "Maximum number of people allowed to join the server." );
 
 	sv_maxclientsPerIP = Cvar_Get( "sv_maxclientsPerIP", "3", CVAR_ARCHIVE );
@@ -772,7 +898,7 @@ void SV_Init( void )
 
 	sv_allowDownload = Cvar_Get ("sv_allowDownload", "1", CVAR_SERVERINFO);
 	Cvar_SetDescription( sv_allowDownload, "Toggle the ability for clients to download files maps etc. from server." );
-	Cvar_Get ("sv_dlURL", "", CVAR_SERVERINFO | CVAR_ARCHIVE);
+	sv_dlURL = Cvar_Get ("sv_dlURL", "", CVAR_SERVERINFO | CVAR_ARCHIVE);
 
 	// moved to Com_Init()
 	//sv_master[0] = Cvar_Get( "sv_master1", MASTER_SERVER_NAME, CVAR_INIT | CVAR_ARCHIVE_ND );
@@ -806,6 +932,54 @@ void SV_Init( void )
 	sv_filter = Cvar_Get( "sv_filter", "filter.txt", CVAR_ARCHIVE );
 	Cvar_SetDescription( sv_filter, "Cvar that point on filter file, if it is "" then filtering will be disabled." );
 
+	sv_snapshotThreads = Cvar_Get( "sv_snapshotThreads", "0", CVAR_ARCHIVE_ND );
+	Cvar_CheckRange( sv_snapshotThreads, "0", "16", CV_INTEGER );
+	Cvar_SetDescription( sv_snapshotThreads, "Number of worker threads used to build and encode client snapshots, 0 - build them on main thread only." );
+	sv_snapshotVerify = Cvar_Get( "sv_snapshotVerify", "0", CVAR_DEVELOPER );
+	Cvar_SetDescription( sv_snapshotVerify, "Debug option, compares each threaded snapshot message against serial build and encoding." );
+	sv_visCache = Cvar_Get( "sv_visCache", "1", CVAR_DEVELOPER );
+	Cvar_SetDescription( sv_visCache, "Debug option, computes entities visible from each cluster once per snapshot and shares them between clients." );
+	sv_deltaCache = Cvar_Get( "sv_deltaCache", "1", CVAR_DEVELOPER );
+	Cvar_SetDescription( sv_deltaCache, "Debug option, encodes each entity delta once per snapshot and copies resulting bits for other clients." );
+	sv_worldIndex = Cvar_Get( "sv_worldIndex", "0", CVAR_ARCHIVE_ND );
+	Cvar_CheckRange( sv_worldIndex, "0", "1", CV_INTEGER );
+	Cvar_SetDescription( sv_worldIndex, "Spatial index used for entity collision queries, applied on next map load:\n 0 - fixed depth sector tree\n 1 - dynamic loose octree, area queries return entities in a different order which may change game behavior" );
+	sv_traceBatchJobs = Cvar_Get( "sv_traceBatchJobs", "1", CVAR_ARCHIVE_ND );
+	Cvar_SetDescription( sv_traceBatchJobs, "Clip batched game module traces to the world on job worker threads, requires sv_snapshotThreads > 0." );
+	sv_profileFrames = Cvar_Get( "sv_profileFrames", "0", CVAR_ARCHIVE_ND );
+	Cvar_CheckRange( sv_profileFrames, "0", "1024", CV_INTEGER );
+	Cvar_SetDescription( sv_profileFrames, "Number of last server frames kept by phase profiler, 0 - disabled. Use sv_profile command to inspect or dump them." );
+	sv_hibernateTime = Cvar_Get( "sv_hibernateTime", "0", CVAR_ARCHIVE_ND );
+	Cvar_CheckRange( sv_hibernateTime, "0", NULL, CV_INTEGER );
+	Cvar_SetDescription( sv_hibernateTime, "Dedicated server stops running game frames after specified number of seconds without human clients and sleeps until someone connects, 0 - disabled." );
+	sv_queryBudget = Cvar_Get( "sv_queryBudget", "2000", CVAR_ARCHIVE_ND );
+	Cvar_CheckRange( sv_queryBudget, "0", NULL, CV_INTEGER );
+	Cvar_SetDescription( sv_queryBudget, "Maximum time in microseconds spent on answering getinfo/getstatus requests per server frame, requests above it are dropped, 0 - unlimited." );
+	sv_coalesceConfigstrings = Cvar_Get( "sv_coalesceConfigstrings", "1", CVAR_ARCHIVE_ND );
+	Cvar_CheckRange( sv_coalesceConfigstrings, "0", "1", CV_INTEGER );
+	Cvar_SetDescription( sv_coalesceConfigstrings, "Configstring changes are sent to active clients once per server frame so only the last value set within a frame is transmitted, 0 - send every change immediately." );
+	sv_snapshotBudget = Cvar_Get( "sv_snapshotBudget", "0", CVAR_ARCHIVE_ND );
+	Cvar_CheckRange( sv_snapshotBudget, "0", "1", CV_INTEGER );
+	Cvar_SetDescription( sv_snapshotBudget, "When snapshot doesn't fit into client's rate, send most important entity changes and defer the rest instead of delaying whole snapshot." );
+	sv_httpServer = Cvar_Get( "sv_httpServer", "0", CVAR_ARCHIVE_ND );
+	Cvar_CheckRange( sv_httpServer, "0", "1", CV_INTEGER );
+	Cvar_SetDescription( sv_httpServer, "Run embedded HTTP server which serves referenced pk3 files to downloading clients and advertise it via sv_dlURL." );
+	sv_httpPort = Cvar_Get( "sv_httpPort", "0", CVAR_ARCHIVE_ND );
+	Cvar_CheckRange( sv_httpPort, "0", "65535", CV_INTEGER );
+	Cvar_SetDescription( sv_httpPort, "TCP port of embedded HTTP server, 0 - same as net_port." );
+	sv_httpRate = Cvar_Get( "sv_httpRate", "0", CVAR_ARCHIVE_ND );
+	Cvar_CheckRange( sv_httpRate, "0", NULL, CV_INTEGER );
+	Cvar_SetDescription( sv_httpRate, "Download rate limit of embedded HTTP server per client IP address in bytes per second, 0 - unlimited." );
+	sv_httpURL = Cvar_Get( "sv_httpURL", "", CVAR_ARCHIVE_ND );
+	Cvar_SetDescription( sv_httpURL, "URL advertised in sv_dlURL for embedded HTTP server, empty - detected from server address." );
+	sv_relayPassword = Cvar_Get( "sv_relayPassword", "", CVAR_TEMP );
+	Cvar_SetDescription( sv_relayPassword, "Password for relay proxies, connected relays receive all entities and players, skip pure checks and aren't limited by sv_maxRate.\nAlso sent to upstream server by sv_relay command." );
+	sv_relayName = Cvar_Get( "sv_relayName", "RelayTV", CVAR_ARCHIVE_ND );
+	Cvar_SetDescription( sv_relayName, "Player name of this relay on upstream server." );
+	sv_relayRate = Cvar_Get( "sv_relayRate", "100000", CVAR_ARCHIVE_ND );
+	Cvar_CheckRange( sv_relayRate, "25000", "1000000", CV_INTEGER );
+	Cvar_SetDescription( sv_relayRate, "Rate requested by this relay from upstream server, bytes per second." );
+
 	// initialize bot cvars so they are listed and can be set before loading the botlib
 	SV_BotInitCvars();
 
@@ -855,7 +1029,7 @@ static void SV_FinalMessage( const char *message ) {
 				}
 				// force a snapshot to be sent
 				cl->lastSnapshotTime = svs.time - 9999; // generate a snapshot immediately
-				cl->state = CS_ZOMBIE; // skip delta generation
+				SV_SetClientState( cl, CS_ZOMBIE ); // skip delta generation
 				SV_SendClientSnapshot( cl );
 			}
 		}
@@ -874,6 +1048,13 @@ before Sys_Quit or Sys_Error
 ================
 */
 void SV_Shutdown( const char *finalmsg ) {
+
+	// nothing to record or play without running server
+	SV_StopJournal();
+
+	// disconnect from upstream server, if any
+	SV_RelayShutdown();
+
 	if ( !com_sv_running || !com_sv_running->integer ) {
 		return;
 	}
@@ -898,15 +1079,23 @@ void SV_Shutdown( const char *finalmsg ) {
 
 	SV_FreeIP4DB();
 
+	SV_ShutdownSnapshotThreads();
+
 	// free server static data
 	if ( svs.clients ) {
 		int index;
 
-		for ( index = 0; index < sv.maxclients; index++ )
+		for ( index = 0; index < sv.maxclients; index++ ) {
 			SV_FreeClient( &svs.clients[ index ] );
+			SV_ClearReliableCommands( &svs.clients[ index ] );
+		}
 
 		Z_Free( svs.clients );
 	}
+
+	// flush recorded demos
+	SV_ShutdownDemos();
+	SV_HttpShutdown();
 	Com_Memset( &svs, 0, sizeof( svs ) );
 	sv.time = 0;
 
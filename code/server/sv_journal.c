@@ -0,0 +1,780 @@
+// server journal recording and deterministic playback
+
+#include "server.h"
+
+/*
+=============================================================================
+
+Server journal captures every input which affects server simulation:
+inbound packets, console commands and points where the command buffer
+is executed, frame times and all clock readings done by server code
+(SV_Milliseconds()), so a recorded session can be played back later
+with exactly the same sequence of SV_PacketEvent(), Cbuf_Execute()
+and SV_Frame() calls. Playback doesn't wait for anything and doesn't
+send any packets, so it may be used to compare server performance on
+the very same workload.
+
+Recording is armed with "sv_journal <name>" and starts with the next
+"map" command issued when server has no connected clients, e.g.:
+
+	quake3e.ded +sv_journal match +map q3dm17
+
+Snapshot of server-related cvars is stored on start, so journal should
+be played back with "sv_playjournal <name>" on an idle server with the
+same game data. Note that snapshot includes rconPassword, so rcon
+commands received during recording can be replayed.
+
+Things which are not reproduced: bot library file I/O timing, profiler
+and com_speeds timings, snapshot threads scheduling (which doesn't
+affect results) and anything which was executed from command buffer
+right after starting "map" command.
+
+=============================================================================
+*/
+
+#define JOURNAL_MAGIC		0x324A5653	// "SVJ2"
+#define JOURNAL_BUFFER_SIZE	0x10000
+
+typedef enum {
+	JR_CVAR = 1,		// name, value: cvar snapshot
+	JR_START,			// command which starts recorded server
+	JR_FRAME,			// frameTime, msec: SV_Frame() call
+	JR_PACKET,			// address, length, data: SV_PacketEvent() call
+	JR_COMMAND,			// text: console input
+	JR_IDLE,			// SV_SendQueuedPackets() call
+	JR_VALUE,			// single value returned by SV_JournalInt()
+	JR_EXECUTE			// Cbuf_Execute() call from main loop
+} journalRecord_t;
+
+typedef enum {
+	JOURNAL_OFF,
+	JOURNAL_ARMED,
+	JOURNAL_RECORDING,
+	JOURNAL_PLAYING
+} journalState_t;
+
+typedef struct {
+	journalState_t	state;
+	char			name[ MAX_QPATH ];
+	fileHandle_t	file;
+
+	byte			buffer[ JOURNAL_BUFFER_SIZE ];
+	int				used;			// bytes stored in buffer
+	int				offset;			// read position in buffer
+	int				fileOffset;		// file position of buffer start
+	qboolean		eof;
+
+	qboolean		quit;			// quit after playback
+	int				frames;
+	int				packets;
+	int				values;
+	int64_t			startTime;
+	int64_t			frameTime;		// total SV_Frame() time
+	int				worstFrame;
+} journal_t;
+
+static journal_t journal;
+
+
+/*
+=================
+SV_JournalFlush
+=================
+*/
+static void SV_JournalFlush( void ) {
+	if ( journal.used ) {
+		FS_Write( journal.buffer, journal.used, journal.file );
+		journal.used = 0;
+	}
+}
+
+
+/*
+=================
+SV_JournalWrite
+=================
+*/
+static void SV_JournalWrite( const void *data, int length ) {
+	if ( journal.used + length > JOURNAL_BUFFER_SIZE ) {
+		SV_JournalFlush();
+		if ( length > JOURNAL_BUFFER_SIZE ) {
+			FS_Write( data, length, journal.file );
+			return;
+		}
+	}
+	Com_Memcpy( journal.buffer + journal.used, data, length );
+	journal.used += length;
+}
+
+
+static void SV_JournalWriteByte( int value ) {
+	byte b = value;
+	SV_JournalWrite( &b, 1 );
+}
+
+
+static void SV_JournalWriteShort( int value ) {
+	byte b[2];
+	b[0] = value & 255;
+	b[1] = ( value >> 8 ) & 255;
+	SV_JournalWrite( b, 2 );
+}
+
+
+static void SV_JournalWriteLong( int value ) {
+	value = LittleLong( value );
+	SV_JournalWrite( &value, 4 );
+}
+
+
+static void SV_JournalWriteString( const char *s ) {
+	SV_JournalWrite( s, strlen( s ) + 1 );
+}
+
+
+/*
+=================
+SV_JournalRead
+
+Returns qfalse if end of file is reached
+=================
+*/
+static qboolean SV_JournalRead( void *data, int length ) {
+	byte *out = data;
+	int n;
+
+	while ( length > 0 ) {
+		if ( journal.offset == journal.used ) {
+			if ( journal.eof ) {
+				return qfalse;
+			}
+			journal.fileOffset += journal.used;
+			journal.used = FS_Read( journal.buffer, JOURNAL_BUFFER_SIZE, journal.file );
+			journal.offset = 0;
+			if ( journal.used < JOURNAL_BUFFER_SIZE ) {
+				journal.eof = qtrue;
+			}
+			if ( journal.used <= 0 ) {
+				journal.used = 0;
+				return qfalse;
+			}
+		}
+		n = journal.used - journal.offset;
+		if ( n > length ) {
+			n = length;
+		}
+		Com_Memcpy( out, journal.buffer + journal.offset, n );
+		journal.offset += n;
+		out += n;
+		length -= n;
+	}
+
+	return qtrue;
+}
+
+
+/*
+=================
+SV_JournalPeek
+
+Returns type of the next record or 0 at the end of file
+=================
+*/
+static int SV_JournalPeek( void ) {
+	byte b;
+
+	if ( !SV_JournalRead( &b, 1 ) ) {
+		return 0;
+	}
+	journal.offset--;
+
+	return b;
+}
+
+
+static int SV_JournalReadByte( void ) {
+	byte b;
+	if ( !SV_JournalRead( &b, 1 ) )
+		Com_Error( ERR_DROP, "Unexpected end of server journal" );
+	return b;
+}
+
+
+static int SV_JournalReadShort( void ) {
+	byte b[2];
+	if ( !SV_JournalRead( b, 2 ) )
+		Com_Error( ERR_DROP, "Unexpected end of server journal" );
+	return b[0] | ( b[1] << 8 );
+}
+
+
+static int SV_JournalReadLong( void ) {
+	int value;
+	if ( !SV_JournalRead( &value, 4 ) )
+		Com_Error( ERR_DROP, "Unexpected end of server journal" );
+	return LittleLong( value );
+}
+
+
+static qboolean SV_JournalReadString( char *s, int size ) {
+	byte c;
+	int i;
+
+	for ( i = 0; ; i++ ) {
+		if ( !SV_JournalRead( &c, 1 ) ) {
+			return qfalse;
+		}
+		if ( i < size - 1 ) {
+			s[i] = c;
+		}
+		if ( c == '\0' ) {
+			break;
+		}
+	}
+	s[ size - 1 ] = '\0';
+
+	return qtrue;
+}
+
+
+/*
+=================
+SV_JournalDesync
+=================
+*/
+static void NORETURN SV_JournalDesync( const char *expected, int found ) {
+	Com_Error( ERR_DROP, "Server journal desync at frame %i offset %i: expected %s, got record %i",
+		journal.frames, journal.fileOffset + journal.offset, expected, found );
+}
+
+
+/*
+=================
+SV_JournalName
+=================
+*/
+static const char *SV_JournalName( const char *name ) {
+	return va( "journals/%s.svj", name );
+}
+
+
+/*
+=================
+SV_JournalCvar
+
+Writes cvars which may affect server simulation
+=================
+*/
+static void SV_JournalCvar( const cvar_t *var ) {
+
+	if ( var->flags & ( CVAR_ROM | CVAR_INIT ) ) {
+		return;
+	}
+
+	if ( ( var->flags & ( CVAR_SERVERINFO | CVAR_SYSTEMINFO | CVAR_VM_CREATED | CVAR_USER_CREATED ) ) == 0 ) {
+		if ( Q_stricmpn( var->name, "sv_", 3 ) && Q_stricmpn( var->name, "g_", 2 )
+			&& Q_stricmpn( var->name, "bot_", 4 ) && Q_stricmp( var->name, "rconPassword" ) ) {
+			return;
+		}
+	}
+
+	SV_JournalWriteByte( JR_CVAR );
+	SV_JournalWriteString( var->name );
+	// write the latched value, it will be applied by map command
+	SV_JournalWriteString( var->latchedString ? var->latchedString : var->string );
+}
+
+
+/*
+=================
+SV_JournalStart
+
+Called from map command, starts armed recording
+=================
+*/
+void SV_JournalStart( const char *command ) {
+	int i;
+
+	if ( journal.state != JOURNAL_ARMED ) {
+		return;
+	}
+
+	if ( com_sv_running->integer && svs.clients ) {
+		for ( i = 0; i < sv.maxclients; i++ ) {
+			if ( svs.clients[i].state >= CS_CONNECTED ) {
+				Com_Printf( "Server journal will start on map load without connected clients.\n" );
+				return;
+			}
+		}
+	}
+
+	journal.file = FS_FOpenFileWrite( SV_JournalName( journal.name ) );
+	if ( journal.file == FS_INVALID_HANDLE ) {
+		Com_Printf( S_COLOR_YELLOW "WARNING: couldn't open %s\n", SV_JournalName( journal.name ) );
+		journal.state = JOURNAL_OFF;
+		return;
+	}
+
+	journal.used = 0;
+	journal.frames = 0;
+	journal.packets = 0;
+	journal.values = 0;
+	journal.state = JOURNAL_RECORDING;
+
+	SV_JournalWriteLong( JOURNAL_MAGIC );
+	SV_JournalWriteLong( com_frameTime );
+
+	Cvar_ForEach( SV_JournalCvar );
+
+	SV_JournalWriteByte( JR_START );
+	SV_JournalWriteString( command );
+
+	Com_Printf( "Recording server journal to %s.\n", SV_JournalName( journal.name ) );
+}
+
+
+/*
+=================
+SV_JournalPlaying
+=================
+*/
+qboolean SV_JournalPlaying( void ) {
+	return journal.state == JOURNAL_PLAYING;
+}
+
+
+/*
+=================
+SV_JournalActive
+=================
+*/
+qboolean SV_JournalActive( void ) {
+	return journal.state == JOURNAL_RECORDING || journal.state == JOURNAL_PLAYING;
+}
+
+
+/*
+=================
+SV_JournalInt
+
+Records value or replaces it with recorded one during playback,
+must be called from main thread only
+=================
+*/
+int SV_JournalInt( int value ) {
+	int type;
+
+	switch ( journal.state ) {
+	case JOURNAL_RECORDING:
+		SV_JournalWriteByte( JR_VALUE );
+		SV_JournalWriteLong( value );
+		break;
+	case JOURNAL_PLAYING:
+		type = SV_JournalReadByte();
+		if ( type != JR_VALUE ) {
+			SV_JournalDesync( "value", type );
+		}
+		value = SV_JournalReadLong();
+		journal.values++;
+		break;
+	default:
+		break;
+	}
+
+	return value;
+}
+
+
+/*
+=================
+SV_Milliseconds
+
+Journaled Sys_Milliseconds() for everything which may affect simulation
+=================
+*/
+int SV_Milliseconds( void ) {
+	if ( journal.state < JOURNAL_RECORDING ) {
+		return Sys_Milliseconds();
+	}
+	return SV_JournalInt( Sys_Milliseconds() );
+}
+
+
+/*
+=================
+SV_JournalPacket
+=================
+*/
+void SV_JournalPacket( const netadr_t *from, const msg_t *msg ) {
+
+	if ( journal.state != JOURNAL_RECORDING ) {
+		return;
+	}
+
+	SV_JournalWriteByte( JR_PACKET );
+	SV_JournalWriteByte( from->type );
+	SV_JournalWriteShort( from->port );
+#ifdef USE_IPV6
+	if ( from->type == NA_IP6 || from->type == NA_MULTICAST6 ) {
+		SV_JournalWrite( from->ipv._6, 16 );
+		SV_JournalWriteLong( from->scope_id );
+	} else
+#endif
+	SV_JournalWrite( from->ipv._4, 4 );
+	SV_JournalWriteShort( msg->cursize );
+	SV_JournalWrite( msg->data, msg->cursize );
+
+	journal.packets++;
+}
+
+
+/*
+=================
+SV_JournalCommand
+=================
+*/
+void SV_JournalCommand( const char *text ) {
+
+	if ( journal.state != JOURNAL_RECORDING ) {
+		return;
+	}
+
+	SV_JournalWriteByte( JR_COMMAND );
+	SV_JournalWriteString( text );
+}
+
+
+/*
+=================
+SV_JournalExecute
+
+Command buffer is executed by main loop before each server frame,
+but commands may also record values or packets, so the execution
+point is stored explicitly and replayed at the very same position
+=================
+*/
+void SV_JournalExecute( void ) {
+
+	if ( journal.state != JOURNAL_RECORDING ) {
+		return;
+	}
+
+	SV_JournalWriteByte( JR_EXECUTE );
+}
+
+
+/*
+=================
+SV_JournalIdle
+=================
+*/
+void SV_JournalIdle( void ) {
+
+	if ( journal.state != JOURNAL_RECORDING ) {
+		return;
+	}
+
+	SV_JournalWriteByte( JR_IDLE );
+}
+
+
+/*
+=================
+SV_JournalFrame
+=================
+*/
+void SV_JournalFrame( int msec ) {
+
+	if ( journal.state != JOURNAL_RECORDING ) {
+		return;
+	}
+
+	SV_JournalWriteByte( JR_FRAME );
+	SV_JournalWriteLong( com_frameTime );
+	SV_JournalWriteLong( msec );
+
+	journal.frames++;
+}
+
+
+/*
+=================
+SV_JournalReport
+=================
+*/
+static void SV_JournalReport( void ) {
+	int64_t total;
+
+	total = Sys_Microseconds() - journal.startTime;
+
+	Com_Printf( "Server journal %s: %i frames, %i packets, %i values in %.3f seconds\n",
+		journal.name, journal.frames, journal.packets, journal.values, (double)total / 1000000.0 );
+
+	if ( journal.frames ) {
+		Com_Printf( "SV_Frame avg %.1fus max %ius, %.1f frames/sec\n",
+			(double)journal.frameTime / journal.frames, journal.worstFrame,
+			total > 0 ? (double)journal.frames * 1000000.0 / total : 0.0 );
+	}
+}
+
+
+/*
+=================
+SV_StopJournal
+
+Stops recording or playback, called on server shutdown
+=================
+*/
+void SV_StopJournal( void ) {
+
+	if ( journal.state == JOURNAL_RECORDING ) {
+		SV_JournalFlush();
+		FS_FCloseFile( journal.file );
+		Com_Printf( "Stopped server journal %s: %i frames, %i packets.\n",
+			journal.name, journal.frames, journal.packets );
+	} else if ( journal.state == JOURNAL_PLAYING ) {
+		FS_FCloseFile( journal.file );
+		SV_JournalReport();
+		if ( journal.quit ) {
+			Cbuf_AddText( "quit\n" );
+		}
+	} else {
+		return;
+	}
+
+	journal.state = JOURNAL_OFF;
+	journal.file = FS_INVALID_HANDLE;
+}
+
+
+/*
+=================
+SV_JournalPlayback
+
+Executes journal records up to and including next server frame
+=================
+*/
+void SV_JournalPlayback( void ) {
+	static byte data[ MAX_MSGLEN ];
+	char text[ MAX_CMD_LINE ];
+	netadr_t from;
+	msg_t msg;
+	int64_t start;
+	int type, msec, length;
+
+	while ( journal.state == JOURNAL_PLAYING ) {
+		type = SV_JournalPeek();
+		if ( !type ) {
+			SV_Shutdown( "Server journal playback finished" );
+			return;
+		}
+		journal.offset++;
+
+		switch ( type ) {
+
+		case JR_FRAME:
+			com_frameTime = SV_JournalReadLong();
+			msec = SV_JournalReadLong();
+
+			Com_ProfileFrame();
+
+			start = Sys_Microseconds();
+			SV_Frame( msec );
+			start = Sys_Microseconds() - start;
+
+			journal.frameTime += start;
+			if ( journal.worstFrame < start ) {
+				journal.worstFrame = start;
+			}
+			journal.frames++;
+
+			Cbuf_Wait();
+			return;
+
+		case JR_PACKET:
+			Com_Memset( &from, 0, sizeof( from ) );
+			from.type = SV_JournalReadByte();
+			from.port = SV_JournalReadShort();
+#ifdef USE_IPV6
+			if ( from.type == NA_IP6 || from.type == NA_MULTICAST6 ) {
+				if ( !SV_JournalRead( from.ipv._6, 16 ) )
+					Com_Error( ERR_DROP, "Unexpected end of server journal" );
+				from.scope_id = SV_JournalReadLong();
+			} else
+#endif
+			if ( !SV_JournalRead( from.ipv._4, 4 ) )
+				Com_Error( ERR_DROP, "Unexpected end of server journal" );
+			length = SV_JournalReadShort();
+			if ( length > sizeof( data ) || !SV_JournalRead( data, length ) ) {
+				Com_Error( ERR_DROP, "Bad packet in server journal" );
+			}
+			MSG_Init( &msg, data, sizeof( data ) );
+			msg.cursize = length;
+			SV_PacketEvent( &from, &msg );
+			journal.packets++;
+			break;
+
+		case JR_COMMAND:
+			if ( !SV_JournalReadString( text, sizeof( text ) ) )
+				Com_Error( ERR_DROP, "Unexpected end of server journal" );
+			Cbuf_AddText( text );
+			Cbuf_AddText( "\n" );
+			break;
+
+		case JR_IDLE:
+			SV_SendQueuedPackets();
+			break;
+
+		case JR_EXECUTE:
+			Cbuf_Execute();
+			break;
+
+		default:
+			SV_JournalDesync( "frame", type );
+			break;
+		}
+	}
+}
+
+
+/*
+=================
+SV_Journal_f
+
+sv_journal <name>
+=================
+*/
+void SV_Journal_f( void ) {
+
+	if ( Cmd_Argc() != 2 ) {
+		Com_Printf( "Usage: sv_journal <name>\n" );
+		return;
+	}
+
+	if ( !com_dedicated->integer ) {
+		Com_Printf( "Server journal is supported only on dedicated server.\n" );
+		return;
+	}
+
+	if ( journal.state != JOURNAL_OFF ) {
+		Com_Printf( "Server journal is already active.\n" );
+		return;
+	}
+
+	Q_strncpyz( journal.name, Cmd_Argv( 1 ), sizeof( journal.name ) );
+	COM_StripExtension( journal.name, journal.name, sizeof( journal.name ) );
+	journal.state = JOURNAL_ARMED;
+
+	Com_Printf( "Server journal %s will start with next map command.\n", journal.name );
+}
+
+
+/*
+=================
+SV_StopJournal_f
+=================
+*/
+void SV_StopJournal_f( void ) {
+
+	if ( journal.state == JOURNAL_OFF ) {
+		Com_Printf( "Server journal is not active.\n" );
+	} else if ( journal.state == JOURNAL_ARMED ) {
+		journal.state = JOURNAL_OFF;
+	} else if ( journal.state == JOURNAL_PLAYING ) {
+		SV_Shutdown( "Server journal playback stopped" );
+	} else {
+		SV_StopJournal();
+	}
+}
+
+
+/*
+=================
+SV_PlayJournal_f
+
+sv_playjournal <name> [quit]
+=================
+*/
+void SV_PlayJournal_f( void ) {
+	char name[ MAX_CVAR_VALUE_STRING ];
+	char value[ MAX_CVAR_VALUE_STRING ];
+	char command[ MAX_CMD_LINE ];
+	int header[2];
+	int type;
+
+	if ( Cmd_Argc() < 2 || Cmd_Argc() > 3 ) {
+		Com_Printf( "Usage: sv_playjournal <name> [quit]\n" );
+		return;
+	}
+
+	if ( !com_dedicated->integer ) {
+		Com_Printf( "Server journal is supported only on dedicated server.\n" );
+		return;
+	}
+
+	if ( journal.state != JOURNAL_OFF ) {
+		Com_Printf( "Server journal is already active.\n" );
+		return;
+	}
+
+	Q_strncpyz( journal.name, Cmd_Argv( 1 ), sizeof( journal.name ) );
+	COM_StripExtension( journal.name, journal.name, sizeof( journal.name ) );
+
+	FS_FOpenFileRead( SV_JournalName( journal.name ), &journal.file, qtrue );
+	if ( journal.file == FS_INVALID_HANDLE ) {
+		Com_Printf( "Couldn't open %s.\n", SV_JournalName( journal.name ) );
+		return;
+	}
+
+	SV_Shutdown( "Server journal playback" );
+
+	journal.used = 0;
+	journal.offset = 0;
+	journal.fileOffset = 0;
+	journal.eof = qfalse;
+	journal.quit = !Q_stricmp( Cmd_Argv( 2 ), "quit" );
+	journal.frames = 0;
+	journal.packets = 0;
+	journal.values = 0;
+	journal.frameTime = 0;
+	journal.worstFrame = 0;
+
+	if ( !SV_JournalRead( header, sizeof( header ) ) || LittleLong( header[0] ) != JOURNAL_MAGIC ) {
+		FS_FCloseFile( journal.file );
+		journal.file = FS_INVALID_HANDLE;
+		Com_Printf( "%s is not a server journal.\n", SV_JournalName( journal.name ) );
+		return;
+	}
+
+	com_frameTime = LittleLong( header[1] );
+
+	while ( ( type = SV_JournalPeek() ) == JR_CVAR ) {
+		journal.offset++;
+		if ( !SV_JournalReadString( name, sizeof( name ) ) || !SV_JournalReadString( value, sizeof( value ) ) ) {
+			break;
+		}
+		Cvar_Set( name, value );
+	}
+
+	if ( type != JR_START ) {
+		FS_FCloseFile( journal.file );
+		journal.file = FS_INVALID_HANDLE;
+		Com_Printf( "Broken server journal %s.\n", SV_JournalName( journal.name ) );
+		return;
+	}
+
+	journal.offset++;
+	SV_JournalReadString( command, sizeof( command ) );
+
+	Com_Printf( "Playing server journal %s: %s\n", journal.name, command );
+
+	// values read by map command are taken from journal already
+	journal.state = JOURNAL_PLAYING;
+	journal.startTime = Sys_Microseconds();
+
+	Cmd_ExecuteString( command );
+
+	if ( !com_sv_running->integer ) {
+		SV_StopJournal();
+	}
+}
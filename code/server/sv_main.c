@@ -34,6 +34,7 @@ cvar_t	*sv_privatePassword;	// password for the privateClient slots
 cvar_t	*sv_allowDownload;
 cvar_t	*sv_maxclients;
 cvar_t	*sv_maxclientsPerIP;
+cvar_t	*sv_clientLimit;		// upper limit of sv_maxclients
 cvar_t	*sv_clientTLD;
 
 cvar_t	*sv_privateClients;		// number of clients reserved for password
@@ -57,6 +58,26 @@ cvar_t	*sv_lanForceRate; // dedicated 1 (LAN) server forces local client rates t
 cvar_t *sv_levelTimeReset;
 cvar_t *sv_filter;
 
+cvar_t	*sv_snapshotThreads;	// worker threads used to build and encode snapshots
+cvar_t	*sv_snapshotVerify;		// compare threaded snapshots against serial encoding
+cvar_t	*sv_visCache;			// share visible entity sets between clients in the same cluster
+cvar_t	*sv_deltaCache;			// share encoded entity deltas between clients
+cvar_t	*sv_worldIndex;			// spatial index used for entity linking
+cvar_t	*sv_traceBatchJobs;		// clip batched game traces to the world on job workers
+cvar_t	*sv_profileFrames;		// number of frames kept by phase profiler
+cvar_t	*sv_hibernateTime;		// seconds without human clients before hibernation
+cvar_t	*sv_queryBudget;		// usec per frame for getinfo/getstatus responses
+cvar_t	*sv_coalesceConfigstrings;	// send only the last configstring value set within a frame
+cvar_t	*sv_snapshotBudget;		// defer entity changes which don't fit into client's rate
+cvar_t	*sv_dlURL;
+cvar_t	*sv_httpServer;		// embedded HTTP server for pk3 downloads
+cvar_t	*sv_httpPort;		// TCP port of HTTP server, 0 - same as net_port
+cvar_t	*sv_httpRate;		// HTTP download rate limit per IP address, bytes per second
+cvar_t	*sv_httpURL;		// advertised HTTP server URL
+cvar_t	*sv_relayPassword;	// grants relay privileges to upstream connections
+cvar_t	*sv_relayName;		// name used by relay on upstream server
+cvar_t	*sv_relayRate;		// rate requested by relay from upstream server
+
 #ifdef USE_BANS
 cvar_t	*sv_banFile;
 serverBan_t serverBans[SERVER_MAXBANS];
@@ -133,24 +154,145 @@ static int SV_ReplacePendingServerCommands( client_t *client, const char *cmd )
 
 /*
 ======================
-SV_AddServerCommand
+SV_CreateServerCommand
 
-The given command will be transmitted to the client, and is guaranteed to
-not have future snapshot_t executed before it is executed
+Allocates broadcast command that can be shared by many clients, caller
+owns one reference. If encode is set the string is also Huffman-encoded
+once so it can be appended to client messages with MSG_WriteBitString()
 ======================
 */
-void SV_AddServerCommand( client_t *client, const char *cmd ) {
-	int		index, i, n;
+svCommand_t *SV_CreateServerCommand( const char *text, qboolean encode ) {
+	static byte	buf[ MAX_MSGLEN_BUF ];
+	char		truncated[ MAX_STRING_CHARS ];
+	svCommand_t	*command;
+	msg_t		msg;
+	int			len, size;
+
+	len = (int)strlen( text );
+	if ( len >= MAX_STRING_CHARS ) {
+		Q_strncpyz( truncated, text, sizeof( truncated ) );
+		text = truncated;
+		len = MAX_STRING_CHARS - 1;
+	}
+
+	size = 0;
+	if ( encode ) {
+		MSG_Init( &msg, buf, MAX_MSGLEN );
+		MSG_WriteString( &msg, text );
+		if ( !msg.overflowed ) {
+			size = ( msg.bit + 7 ) >> 3;
+		}
+	}
+
+	command = Z_Malloc( sizeof( *command ) + len + size );
+	command->refCount = 1;
+	Com_Memcpy( command->text, text, len );
+	command->text[ len ] = '\0';
+
+	if ( size ) {
+		command->data = (byte *)command->text + len + 1;
+		command->bits = msg.bit;
+		Com_Memcpy( command->data, buf, size );
+	}
+
+	return command;
+}
+
+
+/*
+======================
+SV_ReleaseServerCommand
+======================
+*/
+void SV_ReleaseServerCommand( svCommand_t *command ) {
+	if ( --command->refCount == 0 ) {
+		Z_Free( command );
+	}
+}
+
+
+/*
+======================
+SV_SetReliableCommand
+
+Stores shared command in the client reliable slot for sequence,
+releasing the previous one
+======================
+*/
+void SV_SetReliableCommand( client_t *client, int sequence, svCommand_t *command ) {
+	svCommand_t **slot;
+
+	slot = &client->sharedCommands[ sequence & ( MAX_RELIABLE_COMMANDS - 1 ) ];
+	command->refCount++;
+	if ( *slot ) {
+		SV_ReleaseServerCommand( *slot );
+	}
+	*slot = command;
+}
+
+
+/*
+======================
+SV_ClearReliableCommands
+
+Must be called before client_t is reused or freed
+======================
+*/
+void SV_ClearReliableCommands( client_t *client ) {
+	int i;
+
+	for ( i = 0; i < MAX_RELIABLE_COMMANDS; i++ ) {
+		if ( client->sharedCommands[ i ] ) {
+			SV_ReleaseServerCommand( client->sharedCommands[ i ] );
+			client->sharedCommands[ i ] = NULL;
+		}
+	}
+}
+
+
+/*
+======================
+SV_ReliableCommand
+
+Returns text of reliable command for sequence
+======================
+*/
+const char *SV_ReliableCommand( const client_t *client, int sequence ) {
+	const int index = sequence & ( MAX_RELIABLE_COMMANDS - 1 );
+
+	if ( client->sharedCommands[ index ] ) {
+		return client->sharedCommands[ index ]->text;
+	}
+
+	return client->reliableCommands[ index ];
+}
+
+
+/*
+======================
+SV_NextServerCommand
+
+Allocates next reliable sequence for cmd, returns qfalse if command
+should not or can not be queued
+======================
+*/
+static qboolean SV_NextServerCommand( client_t *client, const char *cmd ) {
+	int		i, n;
 
 	// this is very ugly but it's also a waste to for instance send multiple config string updates
 	// for the same config string index in one snapshot
 //	if ( SV_ReplacePendingServerCommands( client, cmd ) ) {
-//		return;
+//		return qfalse;
 //	}
 
+	// queued configstring updates must arrive before any later command
+	if ( sv.numCsPending ) {
+		SV_FlushConfigstrings();
+	}
+
 	// do not send commands until the gamestate has been sent
 	if ( client->state < CS_PRIMED )
-		return;
+		return qfalse;
 
 	client->reliableSequence++;
 	// if we would be losing an old command that hasn't been acknowledged,
@@ -162,17 +304,58 @@ void SV_AddServerCommand( client_t *client, const char *cmd ) {
 		n = client->reliableSequence - client->reliableAcknowledge;
 		for ( i = 0; i < n; i++ ) {
 			const int idx = client->reliableAcknowledge + 1 + i;
-			Com_Printf( "cmd %5d: %s\n", i, client->reliableCommands[ idx & ( MAX_RELIABLE_COMMANDS - 1 ) ] );
+			Com_Printf( "cmd %5d: %s\n", i, SV_ReliableCommand( client, idx ) );
 		}
 		Com_Printf( "cmd %5d: %s\n", i, cmd );
 		SV_DropClient( client, "Server command overflow" );
-		return;
+		return qfalse;
 	}
+
+	return qtrue;
+}
+
+
+/*
+======================
+SV_AddServerCommand
+
+The given command will be transmitted to the client, and is guaranteed to
+not have future snapshot_t executed before it is executed
+======================
+*/
+void SV_AddServerCommand( client_t *client, const char *cmd ) {
+	svCommand_t **slot;
+	int		index;
+
+	if ( !SV_NextServerCommand( client, cmd ) )
+		return;
+
 	index = client->reliableSequence & ( MAX_RELIABLE_COMMANDS - 1 );
+	slot = &client->sharedCommands[ index ];
+	if ( *slot ) {
+		SV_ReleaseServerCommand( *slot );
+		*slot = NULL;
+	}
 	Q_strncpyz( client->reliableCommands[ index ], cmd, sizeof( client->reliableCommands[ index ] ) );
 }
 
 
+/*
+======================
+SV_AddSharedServerCommand
+
+Same as SV_AddServerCommand() but stores reference to broadcast command
+======================
+*/
+void SV_AddSharedServerCommand( client_t *client, svCommand_t *command ) {
+
+	if ( !SV_NextServerCommand( client, command->text ) )
+		return;
+
+	SV_SetReliableCommand( client, client->reliableSequence, command );
+}
+
+
 /*
 =================
 SV_SendServerCommand
@@ -185,6 +368,7 @@ A NULL client will broadcast to all clients
 void QDECL SV_SendServerCommand( client_t *cl, const char *fmt, ... ) {
 	va_list		argptr;
 	char		message[MAX_STRING_CHARS+128]; // slightly larger than allowed, to detect overflows
+	svCommand_t	*command;
 	client_t	*client;
 	int			j, len;
 	
@@ -206,12 +390,15 @@ void QDECL SV_SendServerCommand( client_t *cl, const char *fmt, ... ) {
 		Com_Printf( "broadcast: %s\n", SV_ExpandNewlines( message ) );
 	}
 
-	// send the data to all relevant clients
-	for ( j = 0, client = svs.clients; j < sv.maxclients; j++, client++ ) {
+	// send the data to all relevant clients, sharing single encoded copy
+	command = SV_CreateServerCommand( message, qtrue );
+	for ( j = 0; j < svs.numConnectedClients; j++ ) {
+		client = &svs.clients[ svs.connectedClients[ j ] ];
 		if ( len <= 1022 || client->longstr ) {
-			SV_AddServerCommand( client, message );
+			SV_AddSharedServerCommand( client, command );
 		}
 	}
+	SV_ReleaseServerCommand( command );
 }
 
 
@@ -235,6 +422,7 @@ but not on every player enter or exit.
 ================
 */
 #define	HEARTBEAT_MSEC	(300*1000)
+#define	HIBERNATE_MSEC	1000		// max.sleep time while hibernating
 #define	MASTERDNS_MSEC	(24*60*60*1000)
 static void SV_MasterHeartbeat( const char *message )
 {
@@ -249,6 +437,9 @@ static void SV_MasterHeartbeat( const char *message )
 	if (!com_dedicated || com_dedicated->integer != 2 || !(netenabled & (NET_ENABLEV4 | NET_ENABLEV6)))
 		return;		// only dedicated servers send heartbeats
 
+	if ( SV_JournalPlaying() )
+		return;		// journal playback is offline
+
 	// if not time yet, don't send anything
 	if ( svs.nextHeartbeatTime - svs.time > 0 )
 		return;
@@ -429,7 +620,7 @@ static leakyBucket_t *SVC_BucketForAddress( const netadr_t *address, int burst,
 	static leakyBucket_t dummy = { 0 };
 	static int		start = 0;
 	const int		hash = SVC_HashForAddress( address );
-	const int		now = Sys_Milliseconds();
+	const int		now = SV_Milliseconds();
 	leakyBucket_t	*bucket;
 	int				i, n;
 
@@ -520,7 +711,7 @@ SVC_RateLimit
 ================
 */
 qboolean SVC_RateLimit( rateLimit_t *bucket, int burst, int period ) {
-	int now = Sys_Milliseconds();
+	int now = SV_Milliseconds();
 	int interval = now - bucket->lastTime;
 	int expired = interval / period;
 	int expiredRemainder = interval % period;
@@ -552,7 +743,7 @@ static void SVC_RateDrop( leakyBucket_t *bucket, int burst ) {
 		if ( bucket->toxic < 10000 )
 			++bucket->toxic;
 		bucket->rate.burst = burst * bucket->toxic;
-		bucket->rate.lastTime = Sys_Milliseconds();
+		bucket->rate.lastTime = SV_Milliseconds();
 	}
 }
 
@@ -639,6 +830,195 @@ void SVC_RateDropAddress( const netadr_t *from, int burst, int period ) {
 }
 
 
+/*
+==============================================================================
+
+CONNECTIONLESS QUERY CACHE
+
+getstatus and getinfo responses are formatted once and reused until
+serverinfo, client list, player names, scores or pings change, so
+each request only splices in its challenge string before sending.
+
+==============================================================================
+*/
+
+typedef struct {
+	qboolean	valid;
+	char		info[ MAX_INFO_STRING ];		// infoResponse without challenge
+	char		serverinfo[ MAX_INFO_STRING ];	// statusResponse infostring without challenge
+	int			serverinfoLength;
+	char		players[ MAX_PACKETLEN ];		// statusResponse player lines
+	int			playerEnd[ MAX_SERVER_CLIENTS ];		// length of players after each line
+	int			numPlayers;
+
+	// volatile player data cached responses are built from
+	int			numConnected;
+	qboolean	connected[ MAX_SERVER_CLIENTS ];
+	int			score[ MAX_SERVER_CLIENTS ];
+	int			ping[ MAX_SERVER_CLIENTS ];
+} queryCache_t;
+
+static queryCache_t queryCache;
+
+
+/*
+================
+SV_InvalidateQueryCache
+================
+*/
+void SV_InvalidateQueryCache( void ) {
+	queryCache.valid = qfalse;
+}
+
+
+/*
+================
+SV_CheckQueryCache
+
+Called after each server frame to catch score and ping changes
+================
+*/
+static void SV_CheckQueryCache( void ) {
+	const client_t *cl;
+	qboolean connected;
+	int i, n, count;
+
+	if ( !queryCache.valid ) {
+		return;
+	}
+
+	// slots which are not listed can't be connected
+	count = 0;
+	for ( n = 0; n < svs.numConnectedClients; n++ ) {
+		i = svs.connectedClients[ n ];
+		cl = &svs.clients[ i ];
+		connected = ( cl->state >= CS_CONNECTED );
+		if ( connected != queryCache.connected[i] ) {
+			break;
+		}
+		if ( !connected ) {
+			continue;
+		}
+		if ( cl->ping != queryCache.ping[i] || SV_GameClientNum( i )->persistant[ PERS_SCORE ] != queryCache.score[i] ) {
+			break;
+		}
+		count++;
+	}
+
+	if ( n != svs.numConnectedClients || count != queryCache.numConnected ) {
+		queryCache.valid = qfalse;
+	}
+}
+
+
+/*
+================
+SV_BuildQueryCache
+================
+*/
+static void SV_BuildQueryCache( void ) {
+	char	player[MAX_NAME_LENGTH + 32]; // score + ping + name
+	char	*s;
+	int		i, count, humans;
+	int		playersLength, playerLength;
+	qboolean	full;
+	const char	*gamedir;
+	client_t	*cl;
+	playerState_t	*ps;
+
+	// statusResponse
+	Q_strncpyz( queryCache.serverinfo, Cvar_InfoString( CVAR_SERVERINFO, NULL ), sizeof( queryCache.serverinfo ) );
+	Info_RemoveKey( queryCache.serverinfo, "challenge" );
+	queryCache.serverinfoLength = strlen( queryCache.serverinfo );
+
+	s = queryCache.players;
+	*s = '\0';
+	playersLength = 0;
+	queryCache.numPlayers = 0;
+	queryCache.numConnected = 0;
+	full = qfalse;
+
+	for ( i = 0, cl = svs.clients; i < sv.maxclients; i++, cl++ ) {
+		queryCache.connected[i] = ( cl->state >= CS_CONNECTED );
+		if ( !queryCache.connected[i] ) {
+			continue;
+		}
+
+		queryCache.numConnected++;
+
+		ps = SV_GameClientNum( i );
+		queryCache.score[i] = ps->persistant[ PERS_SCORE ];
+		queryCache.ping[i] = cl->ping;
+
+		playerLength = Com_sprintf( player, sizeof( player ), "%i %i \"%s\"\n",
+			ps->persistant[ PERS_SCORE ], cl->ping, cl->name );
+
+		if ( full || playersLength + playerLength >= sizeof( queryCache.players ) ) {
+			full = qtrue; // can't hold any more, but keep fingerprint
+			continue;
+		}
+
+		s = Q_stradd( s, player );
+		playersLength += playerLength;
+		queryCache.playerEnd[ queryCache.numPlayers++ ] = playersLength;
+	}
+
+	// infoResponse, don't count privateclients
+	count = humans = 0;
+	for ( i = sv_privateClients->integer; i < sv.maxclients; i++ ) {
+		if ( svs.clients[i].state >= CS_CONNECTED ) {
+			count++;
+			if (svs.clients[i].netchan.remoteAddress.type != NA_BOT) {
+				humans++;
+			}
+		}
+	}
+
+	queryCache.info[0] = '\0';
+
+	Info_SetValueForKey( queryCache.info, "protocol", va( "%i", com_protocol->integer ) );
+	Info_SetValueForKey( queryCache.info, "hostname", sv_hostname->string );
+	Info_SetValueForKey( queryCache.info, "mapname", sv_mapname->string );
+	Info_SetValueForKey( queryCache.info, "clients", va("%i", count) );
+	Info_SetValueForKey( queryCache.info, "g_humanplayers", va( "%i", humans ) );
+	Info_SetValueForKey( queryCache.info, "sv_maxclients", va( "%i", sv.maxclients - sv_privateClients->integer ) );
+	Info_SetValueForKey( queryCache.info, "gametype", va( "%i", sv_gametype->integer ) );
+	Info_SetValueForKey( queryCache.info, "pure", va( "%i", sv.pure ) );
+	Info_SetValueForKey( queryCache.info, "g_needpass", va( "%d", Cvar_VariableIntegerValue( "g_needpass" ) ) );
+	gamedir = Cvar_VariableString( "fs_game" );
+	if ( *gamedir != '\0' ) {
+		Info_SetValueForKey( queryCache.info, "game", gamedir );
+	}
+
+	queryCache.valid = qtrue;
+}
+
+
+/*
+================
+SV_QueryChallenge
+
+Returns "\challenge\<value>" key to splice into infostring of given length
+or empty string if it can't be added, like Info_SetValueForKey() does
+================
+*/
+static const char *SV_QueryChallenge( int infoLength ) {
+	const char *challenge = Cmd_Argv( 1 );
+	int len;
+
+	if ( *challenge == '\0' || !Info_ValidateKeyValue( challenge ) ) {
+		return "";
+	}
+
+	len = strlen( challenge ) + 11; // strlen( "\\challenge\\" )
+	if ( infoLength + len >= MAX_INFO_STRING ) {
+		return "";
+	}
+
+	return va( "\\challenge\\%s", challenge );
+}
+
+
 /*
 ================
 SVC_Status
@@ -649,15 +1029,9 @@ the simple info query.
 ================
 */
 static void SVC_Status( const netadr_t *from ) {
-	char	player[MAX_NAME_LENGTH + 32]; // score + ping + name
-	char	status[MAX_PACKETLEN];
-	char	*s;
-	int		i;
-	client_t	*cl;
-	playerState_t	*ps;
+	const char	*challenge;
 	int		statusLength;
-	int		playerLength;
-	char	infostring[MAX_INFO_STRING+160]; // add some space for challenge string
+	int		numPlayers;
 
 	// ignore if we are in single player
 #ifndef DEDICATED
@@ -686,33 +1060,24 @@ static void SVC_Status( const netadr_t *from ) {
 	if ( strlen( Cmd_Argv( 1 ) ) > 128 )
 		return;
 
-	Q_strncpyz( infostring, Cvar_InfoString( CVAR_SERVERINFO, NULL ), sizeof( infostring ) );
+	if ( !queryCache.valid || ( cvar_modifiedFlags & CVAR_SERVERINFO ) ) {
+		SV_BuildQueryCache();
+	}
 
 	// echo back the parameter to status. so master servers can use it as a challenge
 	// to prevent timed spoofed reply packets that add ghost servers
-	Info_SetValueForKey( infostring, "challenge", Cmd_Argv( 1 ) );
-
-	s = status;
-	status[0] = '\0';
-	statusLength = strlen( infostring ) + 16; // strlen( "statusResponse\n\n" )
+	challenge = SV_QueryChallenge( queryCache.serverinfoLength );
 
-	for ( i = 0; i < sv.maxclients; i++ ) {
-		cl = &svs.clients[i];
-		if ( cl->state >= CS_CONNECTED ) {
+	statusLength = queryCache.serverinfoLength + strlen( challenge ) + 16; // strlen( "statusResponse\n\n" )
 
-			ps = SV_GameClientNum( i );
-			playerLength = Com_sprintf( player, sizeof( player ), "%i %i \"%s\"\n", 
-				ps->persistant[ PERS_SCORE ], cl->ping, cl->name );
-			
-			if ( statusLength + playerLength >= MAX_PACKETLEN-4 )
-				break; // can't hold any more
-			
-			s = Q_stradd( s, player );
-			statusLength += playerLength;
-		}
+	// send as many players as fit in the packet
+	numPlayers = queryCache.numPlayers;
+	while ( numPlayers > 0 && statusLength + queryCache.playerEnd[ numPlayers - 1 ] >= MAX_PACKETLEN-4 ) {
+		numPlayers--;
 	}
 
-	NET_OutOfBandPrint( NS_SERVER, from, "statusResponse\n%s\n%s", infostring, status );
+	NET_OutOfBandPrint( NS_SERVER, from, "statusResponse\n%s%s\n%.*s", queryCache.serverinfo, challenge,
+		numPlayers ? queryCache.playerEnd[ numPlayers - 1 ] : 0, queryCache.players );
 }
 
 
@@ -725,9 +1090,6 @@ if a user is interested in a server to do a full status
 ================
 */
 static void SVC_Info( const netadr_t *from ) {
-	int		i, count, humans;
-	const char	*gamedir;
-	char	infostring[MAX_INFO_STRING];
 
 	// ignore if we are in single player
 #ifndef DEDICATED
@@ -761,38 +1123,34 @@ static void SVC_Info( const netadr_t *from ) {
 	if ( strlen( Cmd_Argv( 1 ) ) > 128 )
 		return;
 
-	// don't count privateclients
-	count = humans = 0;
-	for ( i = sv_privateClients->integer; i < sv.maxclients; i++ ) {
-		if ( svs.clients[i].state >= CS_CONNECTED ) {
-			count++;
-			if (svs.clients[i].netchan.remoteAddress.type != NA_BOT) {
-				humans++;
-			}
-		}
+	if ( !queryCache.valid || ( cvar_modifiedFlags & CVAR_SERVERINFO ) ) {
+		SV_BuildQueryCache();
 	}
 
-	infostring[0] = '\0';
-
 	// echo back the parameter to status. so servers can use it as a challenge
 	// to prevent timed spoofed reply packets that add ghost servers
-	Info_SetValueForKey( infostring, "challenge", Cmd_Argv(1) );
-
-	Info_SetValueForKey( infostring, "protocol", va( "%i", com_protocol->integer ) );
-	Info_SetValueForKey( infostring, "hostname", sv_hostname->string );
-	Info_SetValueForKey( infostring, "mapname", sv_mapname->string );
-	Info_SetValueForKey( infostring, "clients", va("%i", count) );
-	Info_SetValueForKey( infostring, "g_humanplayers", va( "%i", humans ) );
-	Info_SetValueForKey( infostring, "sv_maxclients", va( "%i", sv.maxclients - sv_privateClients->integer ) );
-	Info_SetValueForKey( infostring, "gametype", va( "%i", sv_gametype->integer ) );
-	Info_SetValueForKey( infostring, "pure", va( "%i", sv.pure ) );
-	Info_SetValueForKey( infostring, "g_needpass", va( "%d", Cvar_VariableIntegerValue( "g_needpass" ) ) );
-	gamedir = Cvar_VariableString( "fs_game" );
-	if ( *gamedir != '\0' ) {
-		Info_SetValueForKey( infostring, "game", gamedir );
+	NET_OutOfBandPrint( NS_SERVER, from, "infoResponse\n%s%s", SV_QueryChallenge( 0 ), queryCache.info );
+}
+
+
+/*
+================
+SVC_Query
+
+Runs getinfo/getstatus handler within per-frame time budget
+================
+*/
+static void SVC_Query( const netadr_t *from, void (*handler)( const netadr_t *from ) ) {
+	int64_t start;
+
+	// decision depends on real time, keep journal playback in sync
+	if ( sv_queryBudget->integer && SV_JournalInt( svs.queryTime >= sv_queryBudget->integer ) ) {
+		return;
 	}
 
-	NET_OutOfBandPrint( NS_SERVER, from, "infoResponse\n%s", infostring );
+	start = Sys_Microseconds();
+	handler( from );
+	svs.queryTime += (int)( Sys_Microseconds() - start );
 }
 
 
@@ -939,9 +1297,9 @@ static void SV_ConnectionlessPacket( const netadr_t *from, msg_t *msg ) {
 	}
 
 	if (!Q_stricmp(c, "getstatus")) {
-		SVC_Status( from );
+		SVC_Query( from, SVC_Status );
 	} else if (!Q_stricmp(c, "getinfo")) {
-		SVC_Info( from );
+		SVC_Query( from, SVC_Info );
 	} else if (!Q_stricmp(c, "getchallenge")) {
 		SV_GetChallenge( from );
 	} else if (!Q_stricmp(c, "connect")) {
@@ -977,6 +1335,8 @@ void SV_PacketEvent( const netadr_t *from, msg_t *msg ) {
 	if ( msg->cursize < 6 ) // too short for anything
 		return;
 
+	SV_JournalPacket( from, msg );
+
 	// check for connectionless packet (0xffffffff) first
 	if ( *(int32_t *)msg->data == -1 ) {
 		SV_ConnectionlessPacket( from, msg );
@@ -994,7 +1354,8 @@ void SV_PacketEvent( const netadr_t *from, msg_t *msg ) {
 	qport = MSG_ReadShort( msg ) & 0xffff;
 
 	// find which client the message is from
-	for ( i = 0, cl = svs.clients; i < sv.maxclients; i++, cl++ ) {
+	for ( i = 0; i < svs.numConnectedClients; i++ ) {
+		cl = &svs.clients[ svs.connectedClients[ i ] ];
 		if ( cl->state == CS_FREE ) {
 			continue;
 		}
@@ -1037,13 +1398,14 @@ Updates the cl->ping variables
 ===================
 */
 static void SV_CalcPings( void ) {
-	int			i, j;
+	int			i, j, n;
 	client_t	*cl;
 	int			total, count;
 	int			delta;
 	playerState_t	*ps;
 
-	for ( i = 0; i < sv.maxclients; i++ ) {
+	for ( n = 0; n < svs.numConnectedClients; n++ ) {
+		i = svs.connectedClients[ n ];
 		cl = &svs.clients[i];
 		if ( cl->state != CS_ACTIVE ) {
 			cl->ping = 999;
@@ -1105,7 +1467,8 @@ static void SV_CheckTimeouts( void ) {
 	droppoint = svs.time - 1000 * sv_timeout->integer;
 	zombiepoint = svs.time - 1000 * sv_zombietime->integer;
 
-	for ( i = 0, cl = svs.clients ; i < sv.maxclients; i++, cl++ ) {
+	for ( i = 0; i < svs.numConnectedClients; i++ ) {
+		cl = &svs.clients[ svs.connectedClients[ i ] ];
 		if ( cl->state == CS_FREE ) {
 			continue;
 		}
@@ -1117,14 +1480,14 @@ static void SV_CheckTimeouts( void ) {
 		if ( cl->state == CS_ZOMBIE && cl->lastPacketTime - zombiepoint < 0 ) {
 			// using the client id cause the cl->name is empty at this point
 			SV_PrintClientStateChange( cl, CS_FREE );
-			cl->state = CS_FREE;	// can now be reused
+			SV_SetClientState( cl, CS_FREE );	// can now be reused
 			continue;
 		}
 		if ( cl->justConnected && svs.time - cl->lastPacketTime > 4000 ) {
 			// for real client 4 seconds is more than enough to respond
 			SVC_RateDropAddress( &cl->netchan.remoteAddress, 10, 1000 ); // enforce burst with progressive multiplier
 			SV_DropClient( cl, NULL ); // drop silently
-			cl->state = CS_FREE;
+			SV_SetClientState( cl, CS_FREE );
 			continue;
 		}
 		if ( cl->state >= CS_CONNECTED && cl->lastPacketTime - droppoint < 0 ) {
@@ -1132,7 +1495,7 @@ static void SV_CheckTimeouts( void ) {
 			// cause a timeout
 			if ( ++cl->timeoutCount > 5 ) {
 				SV_DropClient( cl, "timed out" );
-				cl->state = CS_FREE;	// don't bother with zombie state
+				SV_SetClientState( cl, CS_FREE );	// don't bother with zombie state
 			}
 		} else {
 			cl->timeoutCount = 0;
@@ -1183,6 +1546,197 @@ static qboolean SV_CheckPaused( void ) {
 }
 
 
+/*
+==================
+SV_HumansConnected
+==================
+*/
+static qboolean SV_HumansConnected( void ) {
+	const client_t *cl;
+	int	i;
+
+	for ( i = 0; i < svs.numConnectedClients; i++ ) {
+		cl = &svs.clients[ svs.connectedClients[ i ] ];
+		if ( cl->state != CS_FREE && cl->netchan.remoteAddress.type != NA_BOT ) {
+			return qtrue;
+		}
+	}
+
+	return qfalse;
+}
+
+
+typedef enum {
+	HB_OFF,
+	HB_AWAKE,		// hibernation is disabled
+	HB_ASLEEP		// hibernation is forced
+} hibernateBenchPhase_t;
+
+static struct {
+	hibernateBenchPhase_t phase;
+	int			msec;			// length of each phase
+	int			start;			// Sys_Milliseconds() when phase started
+	int64_t		cpu;			// Sys_ProcessTime() when phase started
+	int			elapsed[2];
+	int64_t		used[2];
+} hibernateBench;
+
+
+/*
+==================
+SV_HibernateBench_f
+
+Compares cpu time used by idle server with and without hibernation
+==================
+*/
+void SV_HibernateBench_f( void ) {
+	int seconds;
+
+	if ( !com_sv_running->integer || sv.state != SS_GAME ) {
+		Com_Printf( "Server is not running.\n" );
+		return;
+	}
+
+	if ( !com_dedicated->integer || SV_RelayActive() ) {
+		Com_Printf( "hibernatebench: only dedicated servers hibernate.\n" );
+		return;
+	}
+
+	if ( SV_HumansConnected() ) {
+		Com_Printf( "hibernatebench: server must have no human clients.\n" );
+		return;
+	}
+
+	seconds = Cmd_Argc() > 1 ? atoi( Cmd_Argv( 1 ) ) : 10;
+	if ( seconds < 1 ) {
+		seconds = 1;
+	}
+
+	hibernateBench.phase = HB_AWAKE;
+	hibernateBench.msec = seconds * 1000;
+	hibernateBench.start = Sys_Milliseconds();
+	hibernateBench.cpu = Sys_ProcessTime();
+
+	Com_Printf( "hibernatebench: measuring awake server for %i seconds\n", seconds );
+}
+
+
+/*
+==================
+SV_HibernateBenchFrame
+==================
+*/
+static void SV_HibernateBenchFrame( void ) {
+	int now, i;
+
+	if ( hibernateBench.phase == HB_OFF ) {
+		return;
+	}
+
+	if ( SV_HumansConnected() ) {
+		Com_Printf( "hibernatebench: aborted, human client connected\n" );
+		hibernateBench.phase = HB_OFF;
+		return;
+	}
+
+	now = Sys_Milliseconds();
+	if ( now - hibernateBench.start < hibernateBench.msec ) {
+		return;
+	}
+
+	i = hibernateBench.phase - HB_AWAKE;
+	hibernateBench.elapsed[i] = now - hibernateBench.start;
+	hibernateBench.used[i] = Sys_ProcessTime() - hibernateBench.cpu;
+	hibernateBench.start = now;
+	hibernateBench.cpu = Sys_ProcessTime();
+
+	if ( hibernateBench.phase == HB_AWAKE ) {
+		hibernateBench.phase = HB_ASLEEP;
+		Com_Printf( "hibernatebench: measuring hibernating server\n" );
+		return;
+	}
+
+	hibernateBench.phase = HB_OFF;
+
+	Com_Printf( "hibernatebench: %i clients, sv_fps %i\n", svs.numActiveClients, sv_fps->integer );
+	Com_Printf( " awake:       %.3fs cpu in %.1fs (%.2f%%)\n", hibernateBench.used[0] / 1000000.0,
+		hibernateBench.elapsed[0] / 1000.0, hibernateBench.used[0] / ( hibernateBench.elapsed[0] * 10.0 ) );
+	Com_Printf( " hibernating: %.3fs cpu in %.1fs (%.2f%%)\n", hibernateBench.used[1] / 1000000.0,
+		hibernateBench.elapsed[1] / 1000.0, hibernateBench.used[1] / ( hibernateBench.elapsed[1] * 10.0 ) );
+}
+
+
+/*
+==================
+SV_Hibernate
+
+Stops game simulation on idle dedicated server, sv.time is frozen
+while svs.time keeps going so heartbeats are still sent in time.
+Returns qtrue if current frame should be skipped
+==================
+*/
+static qboolean SV_Hibernate( int *msec ) {
+	client_t *cl;
+	qboolean humans, enabled;
+	int64_t cpu;
+	int	elapsed;
+	int	i;
+
+	humans = SV_HumansConnected();
+
+	if ( hibernateBench.phase != HB_OFF ) {
+		enabled = ( hibernateBench.phase == HB_ASLEEP );
+	} else {
+		enabled = ( sv_hibernateTime->integer != 0 );
+	}
+
+	if ( !svs.hibernating ) {
+		if ( humans || !com_dedicated->integer || !enabled || sv.state != SS_GAME || SV_RelayActive() ) {
+			svs.lastHumanTime = svs.time;
+			return qfalse;
+		}
+		if ( hibernateBench.phase == HB_OFF ) {
+			if ( svs.time - svs.lastHumanTime < sv_hibernateTime->integer * 1000 ) {
+				return qfalse;
+			}
+			Com_Printf( "No human clients for %i seconds, hibernating.\n", sv_hibernateTime->integer );
+		}
+		svs.hibernating = qtrue;
+		svs.hibernateStart = svs.time;
+		svs.hibernateFrames = 0;
+		svs.hibernateCPU = Sys_ProcessTime();
+		sv.timeResidual = 0;
+	}
+
+	// time spent sleeping is not seen by game module
+	svs.time += *msec;
+
+	if ( !humans && enabled ) {
+		svs.hibernateFrames += *msec * sv_fps->integer / 1000;
+		return qtrue;
+	}
+
+	elapsed = svs.time - svs.hibernateStart;
+	cpu = Sys_ProcessTime() - svs.hibernateCPU;
+
+	Com_Printf( "Leaving hibernation after %i seconds, %i game frames skipped, %.2fs cpu time used (%.2f%%).\n",
+		elapsed / 1000, svs.hibernateFrames, cpu / 1000000.0, elapsed > 0 ? cpu / ( elapsed * 10.0 ) : 0.0 );
+
+	svs.hibernating = qfalse;
+	svs.lastHumanTime = svs.time;
+	*msec = 0;
+
+	// bots were not updated while sleeping, don't let them time out
+	for ( i = 0, cl = svs.clients ; i < sv.maxclients; i++, cl++ ) {
+		if ( cl->state != CS_FREE ) {
+			cl->lastPacketTime = svs.time;
+		}
+	}
+
+	return qfalse;
+}
+
+
 /*
 ==================
 SV_FrameMsec
@@ -1191,6 +1745,15 @@ Return time in millseconds until processing of the next server frame.
 */
 int SV_FrameMsec( void )
 {
+	if ( svs.hibernating )
+	{
+		// wake up as soon as somebody connects
+		if ( SV_HumansConnected() )
+			return 0;
+		else
+			return HIBERNATE_MSEC;
+	}
+
 	if ( sv_fps )
 	{
 		int frameMsec;
@@ -1207,6 +1770,23 @@ int SV_FrameMsec( void )
 }
 
 
+/*
+==================
+SV_FrameDeadline
+
+Returns absolute Sys_Microseconds() time of the next server frame,
+0 if main loop should poll SV_FrameMsec() instead
+==================
+*/
+int64_t SV_FrameDeadline( void )
+{
+	if ( svs.hibernating )
+		return 0;
+
+	return svs.nextFrameUsec;
+}
+
+
 /*
 ==================
 SV_TrackCvarChanges
@@ -1285,6 +1865,15 @@ void SV_Frame( int msec ) {
 	int		frameMsec;
 	int		startTime;
 	int		i;
+	int64_t	start;
+
+	SV_JournalFrame( msec );
+
+	// new budget for connectionless queries
+	svs.queryTime = 0;
+
+	// will be set after running game frames
+	svs.nextFrameUsec = 0;
 
 	if ( Cvar_CheckGroup( CVG_SERVER ) )
 		SV_TrackCvarChanges(); // update rate settings, etc.
@@ -1296,9 +1885,12 @@ void SV_Frame( int msec ) {
 		return;
 	}
 
+	// read upstream server, may start or change the map
+	SV_RelayFrame();
+
 	if ( !com_sv_running->integer )
 	{
-		if ( com_dedicated->integer )
+		if ( com_dedicated->integer && !LoadGen_Active() && !SV_RelayActive() )
 		{
 			// Block indefinitely until something interesting happens
 			// on STDIN.
@@ -1307,11 +1899,29 @@ void SV_Frame( int msec ) {
 		return;
 	}
 
+	if ( sv_profileFrames->modified ) {
+		sv_profileFrames->modified = qfalse;
+		Com_ProfileSetFrames( sv_profileFrames->integer );
+	}
+
+	// start, stop or update download server
+	SV_HttpFrame();
+
+	// forget clients released during previous frame
+	SV_UpdateClientLists();
+
 	// allow pause if only the local client is connected
 	if ( SV_CheckPaused() ) {
 		return;
 	}
 
+	// skip game frames while there is nobody to play with
+	SV_HibernateBenchFrame();
+	if ( SV_Hibernate( &msec ) ) {
+		SV_MasterHeartbeat( HEARTBEAT_FOR_MASTER );
+		return;
+	}
+
 	// if it isn't time for the next frame, do nothing
 
 	frameMsec = 1000 / sv_fps->integer * com_timescale->value;
@@ -1338,7 +1948,8 @@ void SV_Frame( int msec ) {
 	}
 
 	// try to do silent restart earlier if possible
-	if ( sv.time > (12*3600*1000) && ( sv_levelTimeReset->integer == 0 || sv.time > 0x40000000 ) ) {
+	// relay time follows upstream server
+	if ( sv.time > (12*3600*1000) && ( sv_levelTimeReset->integer == 0 || sv.time > 0x40000000 ) && !SV_RelayActive() ) {
 		if ( svs.clients ) {
 			for ( i = 0; i < sv.maxclients; i++ ) {
 				// FIXME: deal with bots (reconnect?)
@@ -1361,8 +1972,9 @@ void SV_Frame( int msec ) {
 
 	// update infostrings if anything has been changed
 	if ( cvar_modifiedFlags & CVAR_SERVERINFO ) {
-		SV_SetConfigstring( CS_SERVERINFO, Cvar_InfoString( CVAR_SERVERINFO, NULL ) );
+		SV_SetConfigstring( CS_SERVERINFO, SV_HttpServerInfo( Cvar_InfoString( CVAR_SERVERINFO, NULL ) ) );
 		cvar_modifiedFlags &= ~CVAR_SERVERINFO;
+		SV_InvalidateQueryCache();
 	}
 	if ( cvar_modifiedFlags & CVAR_SYSTEMINFO ) {
 		SV_SetConfigstring( CS_SYSTEMINFO, Cvar_InfoString_Big( CVAR_SYSTEMINFO, NULL ) );
@@ -1378,7 +1990,11 @@ void SV_Frame( int msec ) {
 	// update ping based on the all received frames
 	SV_CalcPings();
 
-	if (com_dedicated->integer) SV_BotFrame (sv.time);
+	if (com_dedicated->integer) {
+		start = Com_ProfileStart();
+		SV_BotFrame (sv.time);
+		Com_ProfileSpan( "bot frame", start );
+	}
 
 	// run the game simulation in chunks
 	while ( sv.timeResidual >= frameMsec ) {
@@ -1387,9 +2003,16 @@ void SV_Frame( int msec ) {
 		sv.time += frameMsec;
 
 		// let everything in the world think and move
+		start = Com_ProfileStart();
 		VM_Call( gvm, 1, GAME_RUN_FRAME, sv.time );
+		Com_ProfileSpan( "GAME_RUN_FRAME", start );
 	}
 
+	// game time advances in whole milliseconds, so next frame starts exactly
+	// when sv.timeResidual accounting reaches frameMsec, this keeps the
+	// schedule absolute instead of accumulating wakeup latency
+	svs.nextFrameUsec = Com_MillisecondsToUsec( com_frameTime + SV_FrameMsec() );
+
 	if ( com_speeds->integer ) {
 		time_game = Sys_Milliseconds () - startTime;
 	}
@@ -1397,14 +2020,21 @@ void SV_Frame( int msec ) {
 	// check timeouts
 	SV_CheckTimeouts();
 
+	// scores and pings might be changed
+	SV_CheckQueryCache();
+
 	// reset current and build new snapshot on first query
 	SV_IssueNewSnapshot();
 
 	// send messages back to the clients
+	start = Com_ProfileStart();
 	SV_SendClientMessages();
+	Com_ProfileSpan( "snapshots", start );
 
 	// send a heartbeat to the master if needed
+	start = Com_ProfileStart();
 	SV_MasterHeartbeat(HEARTBEAT_FOR_MASTER);
+	Com_ProfileSpan( "heartbeat", start );
 }
 
 
@@ -1438,7 +2068,7 @@ int SV_RateMsec( const client_t *client )
 		messageSize += UDPIP_HEADER_SIZE;
 		
 	rateMsec = messageSize * 1000 / ((int) (client->rate * com_timescale->value));
-	rate = Sys_Milliseconds() - client->netchan.lastSentTime;
+	rate = SV_Milliseconds() - client->netchan.lastSentTime;
 	
 	if ( rate > rateMsec )
 		return 0;
@@ -1447,6 +2077,34 @@ int SV_RateMsec( const client_t *client )
 }
 
 
+/*
+====================
+SV_RateBytes
+
+Return the number of message bytes which can be sent to a client
+every msec without being delayed by its rate, 0 if unlimited
+====================
+*/
+int SV_RateBytes( const client_t *client, int msec )
+{
+	int bytes;
+
+	if ( !client->rate || msec <= 0 )
+		return 0;
+
+	bytes = (int)( (int64_t)client->rate * com_timescale->value * msec / 1000 );
+
+#ifdef USE_IPV6
+	if ( client->netchan.remoteAddress.type == NA_IP6 )
+		bytes -= UDPIP6_HEADER_SIZE;
+	else
+#endif
+		bytes -= UDPIP_HEADER_SIZE;
+
+	return bytes > 1 ? bytes : 1;
+}
+
+
 /*
 ====================
 SV_SendQueuedPackets
@@ -1463,6 +2121,8 @@ int SV_SendQueuedPackets( void )
 	static int dlNextRound = 0;
 	int timeVal = INT_MAX;
 
+	SV_JournalIdle();
+
 	// Send out fragmented packets now that we're idle
 	delayT = SV_SendQueuedMessages();
 	if(delayT >= 0)
@@ -1472,7 +2132,7 @@ int SV_SendQueuedPackets( void )
 	{
 		// Rate limiting. This is very imprecise for high
 		// download rates due to millisecond timedelta resolution
-		dlStart = Sys_Milliseconds();
+		dlStart = SV_Milliseconds();
 		deltaT = dlNextRound - dlStart;
 
 		if(deltaT > 0)
@@ -1487,7 +2147,7 @@ int SV_SendQueuedPackets( void )
 			if(numBlocks)
 			{
 				// There are active downloads
-				deltaT = Sys_Milliseconds() - dlStart;
+				deltaT = SV_Milliseconds() - dlStart;
 
 				delayT = 1000 * numBlocks * MAX_DOWNLOAD_BLKSIZE;
 				delayT /= sv_dlRate->integer * 1024;
@@ -93,7 +93,8 @@ static void SV_Netchan_Decode( client_t *client, msg_t *msg ) {
 	int serverId, messageAcknowledge, reliableAcknowledge;
 	int i, index, srdc, sbit;
 	qboolean soob;
-	byte key, *string;
+	byte key;
+	const byte *string;
 
 	srdc = msg->readcount;
 	sbit = msg->bit;
@@ -109,7 +110,7 @@ static void SV_Netchan_Decode( client_t *client, msg_t *msg ) {
 	msg->bit = sbit;
 	msg->readcount = srdc;
 
-	string = (byte *)client->reliableCommands[ reliableAcknowledge & (MAX_RELIABLE_COMMANDS-1) ];
+	string = (const byte *)SV_ReliableCommand( client, reliableAcknowledge );
 	index = 0;
 	//
 	key = client->challenge ^ serverId ^ messageAcknowledge;
@@ -149,6 +150,20 @@ void SV_Netchan_FreeQueue(client_t *client)
 	client->netchan_end_queue = &client->netchan_start_queue;
 }
 
+/*
+=================
+SV_Netchan_SentTime
+
+Netchan stamps sent packets with Sys_Milliseconds(),
+replace it with journaled time used for rate control
+=================
+*/
+static void SV_Netchan_SentTime( client_t *client )
+{
+	if ( SV_JournalActive() )
+		client->netchan.lastSentTime = SV_Milliseconds();
+}
+
 /*
 =================
 SV_Netchan_TransmitNextInQueue
@@ -161,10 +176,13 @@ static void SV_Netchan_TransmitNextInQueue(client_t *client)
 	Com_DPrintf("#462 Netchan_TransmitNextFragment: popping a queued message for transmit\n");
 	netbuf = client->netchan_start_queue;
 
+	SV_WriteDemoMessage( client, &netbuf->msg );
+
 	if( client->compat )
 		SV_Netchan_Encode(client, &netbuf->msg, netbuf->clientCommandString);
 
 	Netchan_Transmit(&client->netchan, netbuf->msg.cursize, netbuf->msg.data);
+	SV_Netchan_SentTime(client);
 
 	// pop from queue
 	client->netchan_start_queue = netbuf->next;
@@ -193,6 +211,7 @@ int SV_Netchan_TransmitNextFragment(client_t *client)
 	if(client->netchan.unsentFragments)
 	{
 		Netchan_TransmitNextFragment(&client->netchan);
+		SV_Netchan_SentTime(client);
 		return SV_RateMsec(client);
 	}
 	else if(client->netchan_start_queue)
@@ -239,9 +258,11 @@ void SV_Netchan_Transmit( client_t *client, msg_t *msg)
 	}
 	else
 	{
+		SV_WriteDemoMessage( client, msg );
 		if ( client->compat )
 			SV_Netchan_Encode(client, msg, client->lastClientCommandString);
 		Netchan_Transmit( &client->netchan, msg->cursize, msg->data );
+		SV_Netchan_SentTime( client );
 	}
 }
 
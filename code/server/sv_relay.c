@@ -0,0 +1,1275 @@
+// relay proxy for mass spectators
+
+#include "server.h"
+
+/*
+=============================================================================
+
+Connects to an upstream server as a single client authorized with
+sv_relayPassword and serves the game to local clients, so the upstream
+server pays for one connection no matter how many spectators are watching.
+
+Upstream connection is a headless client like qcommon/loadgen.c, it decodes
+gamestates and snapshots with the shared parser of qcommon/msg_parse.c.
+Relay clients get all entities of the upstream snapshot and svc_relay with
+entity flags and states of all players, see SV_WriteRelayInfo().
+
+Local side replaces the game module with SV_RelayGameMain(), which rebuilds
+the world from the latest upstream snapshot every frame: entities are linked
+at positions evaluated from their trajectories, so the regular snapshot code
+does PVS culling, rate control and delta compression for each viewer.
+Viewers are spectators following the relay camera or any player, upstream
+configstrings and server commands known to cgame are mirrored to them.
+
+Relays can't be chained.
+
+=============================================================================
+*/
+
+#define RELAY_PARSE_ENTITIES	( MAX_SNAPSHOT_ENTITIES * 8 )	// must be power of two
+#define RELAY_RETRY_MSEC		1000
+#define RELAY_RECONNECT_MSEC	5000
+#define RELAY_TIMEOUT_MSEC		30000
+#define RELAY_PACKET_MSEC		25
+#define RELAY_SCORE_MSEC		1000
+#define RELAY_INFO_MISSING		PACKET_BACKUP	// snapshots before warning, first ones come while primed upstream
+
+#define RELAY_DIRECTOR			-1		// view of relay client itself
+
+typedef enum {
+	RS_DISCONNECTED,	// waiting to reconnect
+	RS_CHALLENGING,		// waiting for challengeResponse
+	RS_CONNECTING,		// waiting for connectResponse
+	RS_CONNECTED,		// netchan is up, waiting for gamestate
+	RS_PRIMED,			// got gamestate, waiting for first snapshot
+	RS_ACTIVE
+} relayState_t;
+
+static const char *relayStateNames[] = {
+	"disconnected",
+	"challenging",
+	"connecting",
+	"connected",
+	"primed",
+	"active"
+};
+
+// other players of parser snapshot with the same messageNum
+typedef struct {
+	uint32_t		valid[ MAX_SERVER_CLIENTS / 32 ];	// bit per client number
+	playerState_t	ps[ MAX_SERVER_CLIENTS ];
+} relayPlayers_t;
+
+typedef struct {
+	relayState_t	state;
+	netadr_t		server;
+	int				socket;
+	char			message[ MAX_STRING_CHARS ];	// last drop reason
+
+	int				qport;
+	int				clientChallenge;
+	int				challenge;
+	int				lastSendTime;
+	int				lastRecvTime;
+	netchan_t		netchan;
+
+	int				serverId;
+	msgParser_t		parser;
+
+	char			reliableCommands[ MAX_RELIABLE_COMMANDS ][ MAX_STRING_CHARS ];
+	int				scoreTime;		// last forwarded score request
+
+	usercmd_t		lastCmd;
+
+	char			*configstrings[ MAX_CONFIGSTRINGS ];
+	qboolean		csModified[ MAX_CONFIGSTRINGS ];
+	qboolean		csAnyModified;
+	qboolean		newGamestate;	// map must be checked after the first snapshot
+	entityState_t	baselines[ MAX_GENTITIES ];
+
+	int				snapTime;		// realtime of latest snapshot
+	int				realtime;		// of packet being parsed
+	relayPlayers_t	players[ PACKET_BACKUP ];
+	entityState_t	parseEntities[ RELAY_PARSE_ENTITIES ];
+	int				parseFlags[ RELAY_PARSE_ENTITIES ];			// r.svFlags
+	int				parseSingleClient[ RELAY_PARSE_ENTITIES ];	// r.singleClient
+	int				infoMissing;	// snapshots in a row without svc_relay
+
+	int				snapshotCount;
+	int				deltaErrors;
+	int				bytesIn;
+	int				startTime;
+} relay_t;
+
+static relay_t *rl;	// allocated while relay is active
+
+// local game state
+static struct {
+	sharedEntity_t	entities[ MAX_GENTITIES ];
+	playerState_t	clients[ MAX_SERVER_CLIENTS ];
+	int				follow[ MAX_SERVER_CLIENTS ];	// followed player or RELAY_DIRECTOR
+	int				clientLimit[ MAX_SERVER_CLIENTS ];	// upstream client numbers viewer's cgame supports
+	int				time;
+} rg;
+
+
+/*
+=================
+SV_RelayDrop
+=================
+*/
+static void SV_RelayDrop( const char *reason )
+{
+	if ( rl->state == RS_DISCONNECTED ) {
+		return;
+	}
+
+	rl->state = RS_DISCONNECTED;
+	rl->lastSendTime = Sys_Milliseconds();
+	Q_strncpyz( rl->message, reason, sizeof( rl->message ) );
+
+	Com_Printf( "relay: %s, reconnecting in %i seconds\n", reason, RELAY_RECONNECT_MSEC / 1000 );
+}
+
+
+/*
+=================
+SV_RelayAddCommand
+
+Queues reliable command to upstream server
+=================
+*/
+static void SV_RelayAddCommand( const char *cmd )
+{
+	if ( rl->parser.reliableSequence - rl->parser.reliableAcknowledge >= MAX_RELIABLE_COMMANDS - 1 ) {
+		Com_Printf( "relay: command overflow, '%s' dropped\n", cmd );
+		return;
+	}
+
+	rl->parser.reliableSequence++;
+	Q_strncpyz( rl->reliableCommands[ rl->parser.reliableSequence & ( MAX_RELIABLE_COMMANDS - 1 ) ], cmd, MAX_STRING_CHARS );
+}
+
+
+/*
+=================
+SV_RelaySetConfigstring
+=================
+*/
+static void SV_RelaySetConfigstring( msgParser_t *p, int index, const char *s )
+{
+	if ( rl->configstrings[ index ] ) {
+		if ( !strcmp( rl->configstrings[ index ], s ) ) {
+			return;
+		}
+		Z_Free( rl->configstrings[ index ] );
+	}
+
+	rl->configstrings[ index ] = CopyString( s );
+	rl->csModified[ index ] = qtrue;
+	rl->csAnyModified = qtrue;
+
+	if ( index == CS_SYSTEMINFO ) {
+		rl->serverId = atoi( Info_ValueForKey( s, "sv_serverid" ) );
+	}
+}
+
+
+/*
+=================
+SV_RelayParserDrop
+=================
+*/
+static void SV_RelayParserDrop( msgParser_t *p, const char *reason )
+{
+	SV_RelayDrop( reason );
+}
+
+
+/*
+=================
+SV_RelayCommand
+
+Passes upstream command to viewers if their cgame knows it,
+anything else may be meant for relay client only
+=================
+*/
+static void SV_RelayCommand( msgParser_t *p, const char *s )
+{
+	static const char *cgameCommands[] = {
+		"cp", "print", "chat", "tchat", "vchat", "vtchat",
+		"scores", "tinfo", "map_restart", "remapShader", "loaddefered"
+	};
+	const char *cmd;
+	int i;
+
+	if ( !com_sv_running->integer || sv.state != SS_GAME ) {
+		return;
+	}
+
+	cmd = Cmd_Argv( 0 );
+
+	for ( i = 0; i < ARRAY_LEN( cgameCommands ); i++ ) {
+		if ( !strcmp( cmd, cgameCommands[ i ] ) ) {
+			SV_SendServerCommand( NULL, "%s", s );
+			return;
+		}
+	}
+
+	Com_DPrintf( "relay: upstream command '%s' not forwarded\n", cmd );
+}
+
+
+/*
+=================
+SV_RelayGamestate
+=================
+*/
+static void SV_RelayGamestate( msgParser_t *p )
+{
+	rl->lastCmd.serverTime = 0;
+
+	rl->newGamestate = qtrue;
+	rl->state = RS_PRIMED;
+}
+
+
+/*
+=================
+SV_RelaySnapshot
+=================
+*/
+static void SV_RelaySnapshot( msgParser_t *p, const parseSnapshot_t *snap )
+{
+	if ( !snap->valid ) {
+		rl->deltaErrors++;
+		return;
+	}
+
+	// svc_relay follows in the same message
+	Com_Memset( rl->players[ snap->messageNum & PACKET_MASK ].valid, 0, sizeof( rl->players[0].valid ) );
+
+	rl->snapTime = rl->realtime;
+	rl->snapshotCount++;
+
+	if ( rl->state == RS_PRIMED ) {
+		rl->state = RS_ACTIVE;
+		Com_Printf( "relay: entered game on %s\n", NET_AdrToStringwPort( &rl->server ) );
+		// don't block any slots
+		SV_RelayAddCommand( "team spectator" );
+	}
+}
+
+
+/*
+=================
+SV_RelayEntity
+=================
+*/
+static void SV_RelayEntity( msgParser_t *p, int index, int svFlags, int singleClient )
+{
+	rl->parseFlags[ index ] = svFlags;
+	rl->parseSingleClient[ index ] = singleClient;
+}
+
+
+/*
+=================
+SV_RelayPlayerstate
+=================
+*/
+static playerState_t *SV_RelayPlayerstate( msgParser_t *p, const parseSnapshot_t *snap, int clientNum, qboolean store )
+{
+	relayPlayers_t *players = &rl->players[ snap->messageNum & PACKET_MASK ];
+
+	if ( store ) {
+		players->valid[ clientNum >> 5 ] |= 1U << ( clientNum & 31 );
+	} else if ( !( players->valid[ clientNum >> 5 ] & ( 1U << ( clientNum & 31 ) ) ) ) {
+		return NULL;
+	}
+
+	return &players->ps[ clientNum ];
+}
+
+
+/*
+=================
+SV_RelayHasPlayer
+=================
+*/
+static qboolean SV_RelayHasPlayer( const parseSnapshot_t *snap, int clientNum )
+{
+	const relayPlayers_t *players = &rl->players[ snap->messageNum & PACKET_MASK ];
+
+	if ( (unsigned) clientNum >= MAX_SERVER_CLIENTS ) {
+		return qfalse;
+	}
+
+	return ( players->valid[ clientNum >> 5 ] & ( 1U << ( clientNum & 31 ) ) ) ? qtrue : qfalse;
+}
+
+
+/*
+=================
+SV_RelayConnectionlessPacket
+=================
+*/
+static void SV_RelayConnectionlessPacket( msg_t *msg )
+{
+	const char *s, *c;
+
+	MSG_BeginReadingOOB( msg );
+	MSG_ReadLong( msg ); // skip the -1
+
+	s = MSG_ReadStringLine( msg );
+	Cmd_TokenizeString( s );
+	c = Cmd_Argv( 0 );
+
+	if ( !Q_stricmp( c, "challengeResponse" ) ) {
+		if ( rl->state != RS_CHALLENGING || atoi( Cmd_Argv( 2 ) ) != rl->clientChallenge ) {
+			return;
+		}
+		if ( Cmd_Argc() < 4 || atoi( Cmd_Argv( 3 ) ) != NEW_PROTOCOL_VERSION ) {
+			SV_RelayDrop( va( "server protocol %s is not supported", Cmd_Argv( 3 ) ) );
+			return;
+		}
+		rl->challenge = atoi( Cmd_Argv( 1 ) );
+		rl->state = RS_CONNECTING;
+		rl->lastSendTime = 0;
+	} else if ( !Q_stricmp( c, "connectResponse" ) ) {
+		if ( rl->state != RS_CONNECTING || atoi( Cmd_Argv( 1 ) ) != rl->challenge ) {
+			return;
+		}
+		Netchan_Setup( NS_CLIENT, &rl->netchan, &rl->server, rl->qport, rl->challenge, qfalse );
+		MSG_ParserConnect( &rl->parser );
+		rl->state = RS_CONNECTED;
+		rl->lastSendTime = 0;
+	} else if ( !Q_stricmp( c, "print" ) ) {
+		s = MSG_ReadString( msg );
+		Q_strncpyz( rl->message, s, sizeof( rl->message ) );
+		Com_Printf( "relay: %s", s );
+	} else if ( !Q_stricmp( c, "disconnect" ) ) {
+		if ( rl->state >= RS_CONNECTED ) {
+			SV_RelayDrop( "server disconnected" );
+		}
+	}
+}
+
+
+/*
+=================
+SV_RelayReadPackets
+=================
+*/
+static void SV_RelayReadPackets( int realtime )
+{
+	static byte buf[ MAX_MSGLEN_BUF ];
+	netadr_t from;
+	msg_t msg;
+
+	MSG_Init( &msg, buf, MAX_MSGLEN );
+
+	while ( NET_GetAuxPacket( rl->socket, &from, &msg ) ) {
+		if ( !NET_CompareAdr( &from, &rl->server ) || msg.cursize < 4 ) {
+			continue;
+		}
+
+		rl->lastRecvTime = realtime;
+
+		if ( *(int32_t *)msg.data == -1 ) {
+			SV_RelayConnectionlessPacket( &msg );
+			continue;
+		}
+
+		if ( rl->state < RS_CONNECTED ) {
+			continue;
+		}
+
+		rl->bytesIn += msg.cursize;
+
+		if ( !Netchan_Process( &rl->netchan, &msg ) ) {
+			continue; // out of order, duplicated, fragment, etc.
+		}
+
+		rl->parser.serverMessageSequence = rl->netchan.incomingSequence;
+		rl->realtime = realtime;
+
+		if ( !MSG_ParseServerMessage( &rl->parser, &msg ) ) {
+			continue;
+		}
+
+		if ( !rl->parser.parsed ) {
+			rl->infoMissing = 0;
+		} else if ( ++rl->infoMissing == RELAY_INFO_MISSING ) {
+			Com_Printf( S_COLOR_YELLOW "WARNING: upstream server doesn't send relay info, check sv_relayPassword\n" );
+		}
+	}
+}
+
+
+/*
+=================
+SV_RelayPacketEvent
+
+Upstream socket wakes up main loop like the server sockets
+=================
+*/
+static void SV_RelayPacketEvent( int handle )
+{
+	SV_RelayReadPackets( Sys_Milliseconds() );
+}
+
+
+/*
+=================
+SV_RelayTransmit
+
+Non-fragmenting part of Netchan_Transmit() for own socket
+=================
+*/
+static void SV_RelayTransmit( const msg_t *buf )
+{
+	byte data[ MAX_MSGLEN_BUF + 16 ];
+	msg_t send;
+
+	MSG_InitOOB( &send, data, sizeof( data ) );
+
+	MSG_WriteLong( &send, rl->netchan.outgoingSequence );
+	MSG_WriteShort( &send, rl->qport );
+	MSG_WriteLong( &send, NETCHAN_GENCHECKSUM( rl->challenge, rl->netchan.outgoingSequence ) );
+	MSG_WriteData( &send, buf->data, buf->cursize );
+
+	rl->netchan.outgoingSequence++;
+
+	NET_SendAuxPacket( rl->socket, send.cursize, send.data, &rl->server );
+}
+
+
+/*
+=================
+SV_RelaySendCmd
+
+Sends unacknowledged reliable commands and a still usercmd
+=================
+*/
+static void SV_RelaySendCmd( int realtime )
+{
+	static const usercmd_t nullcmd = { 0 };
+	const parseSnapshot_t *snap = rl->parser.snap;
+	byte data[ MAX_MSGLEN_BUF ];
+	usercmd_t cmd;
+	msg_t buf;
+	int i, key;
+
+	MSG_Init( &buf, data, MAX_MSGLEN );
+	MSG_Bitstream( &buf );
+
+	MSG_WriteLong( &buf, rl->serverId );
+	MSG_WriteLong( &buf, rl->parser.serverMessageSequence );
+	MSG_WriteLong( &buf, rl->parser.serverCommandSequence );
+
+	for ( i = rl->parser.reliableAcknowledge + 1; i <= rl->parser.reliableSequence; i++ ) {
+		MSG_WriteByte( &buf, clc_clientCommand );
+		MSG_WriteLong( &buf, i );
+		MSG_WriteString( &buf, rl->reliableCommands[ i & ( MAX_RELIABLE_COMMANDS - 1 ) ] );
+	}
+
+	if ( rl->state >= RS_PRIMED ) {
+		Com_Memset( &cmd, 0, sizeof( cmd ) );
+
+		// extrapolate server time from the last snapshot
+		if ( snap ) {
+			cmd.serverTime = snap->serverTime + ( realtime - rl->snapTime );
+			cmd.weapon = snap->ps.weapon;
+		}
+		if ( cmd.serverTime <= rl->lastCmd.serverTime ) {
+			cmd.serverTime = rl->lastCmd.serverTime + 1;
+		}
+
+		if ( !snap || rl->parser.serverMessageSequence != snap->messageNum ) {
+			MSG_WriteByte( &buf, clc_moveNoDelta );
+		} else {
+			MSG_WriteByte( &buf, clc_move );
+		}
+
+		key = MSG_ParserCommandKey( &rl->parser );
+
+		MSG_WriteByte( &buf, 1 );
+		MSG_WriteDeltaUsercmdKey( &buf, key, &nullcmd, &cmd );
+
+		rl->lastCmd = cmd;
+	}
+
+	MSG_WriteByte( &buf, clc_EOF );
+
+	SV_RelayTransmit( &buf );
+
+	rl->lastSendTime = realtime;
+}
+
+
+/*
+=================
+SV_RelaySendConnect
+=================
+*/
+static void SV_RelaySendConnect( void )
+{
+	char info[ MAX_INFO_STRING ];
+	byte data[ MAX_INFO_STRING * 2 ];
+	msg_t msg;
+	int len;
+
+	info[0] = '\0';
+	Info_SetValueForKey( info, "name", sv_relayName->string );
+	Info_SetValueForKey( info, "rate", sv_relayRate->string );
+	Info_SetValueForKey( info, "snaps", "1000" );
+	Info_SetValueForKey( info, "relay", sv_relayPassword->string );
+	Info_SetValueForKey( info, "protocol", XSTRING( NEW_PROTOCOL_VERSION ) );
+	Info_SetValueForKey( info, "qport", va( "%i", rl->qport ) );
+	Info_SetValueForKey( info, "challenge", va( "%i", rl->challenge ) );
+	Info_SetValueForKey( info, "client", Q3_VERSION );
+	Info_SetValueForKey( info, "clientLimit", XSTRING( MAX_SERVER_CLIENTS ) );
+
+	data[0] = data[1] = data[2] = data[3] = 0xff;
+	len = Com_sprintf( (char *)data + 4, sizeof( data ) - 4, "connect \"%s\"", info );
+
+	// same as NET_OutOfBandCompress()
+	msg.data = data;
+	msg.cursize = len + 4;
+	Huff_Compress( &msg, 12 );
+
+	NET_SendAuxPacket( rl->socket, msg.cursize, msg.data, &rl->server );
+}
+
+
+/*
+=================
+SV_RelayGetChallenge
+=================
+*/
+static void SV_RelayGetChallenge( void )
+{
+	char string[ MAX_PACKETLEN ];
+	int len;
+
+	string[0] = string[1] = string[2] = string[3] = -1;
+	len = Com_sprintf( string + 4, sizeof( string ) - 4, "getchallenge %d %s", rl->clientChallenge, GAMENAME_FOR_MASTER ) + 4;
+
+	NET_SendAuxPacket( rl->socket, len, string, &rl->server );
+}
+
+
+/*
+=================
+SV_RelayCheckMap
+
+Loads upstream map after its gamestate and the first snapshot
+have been received, so the world can be built at once
+=================
+*/
+static void SV_RelayCheckMap( void )
+{
+	const char *mapname, *s;
+
+	if ( !rl->newGamestate || !rl->parser.snap ) {
+		return;
+	}
+	rl->newGamestate = qfalse;
+
+	mapname = Info_ValueForKey( rl->configstrings[ CS_SERVERINFO ], "mapname" );
+
+	// it goes to command buffer
+	for ( s = mapname; *s; s++ ) {
+		if ( !isalnum( *s ) && *s != '_' && *s != '-' && *s != '/' && *s != '.' ) {
+			break;
+		}
+	}
+	if ( *s || !*mapname ) {
+		SV_RelayDrop( va( "bad map name '%s'", mapname ) );
+		return;
+	}
+
+	if ( com_sv_running->integer && sv.state == SS_GAME && !Q_stricmp( sv_mapname->string, mapname ) ) {
+		// same world, upstream configstrings are applied on next frame
+		return;
+	}
+
+	Cbuf_AddText( va( "map %s\n", mapname ) );
+}
+
+
+/*
+=================
+SV_RelayFrame
+=================
+*/
+void SV_RelayFrame( void )
+{
+	int realtime;
+
+	if ( !rl ) {
+		return;
+	}
+
+	realtime = Sys_Milliseconds();
+
+	SV_RelayReadPackets( realtime );
+
+	switch ( rl->state ) {
+	case RS_DISCONNECTED:
+		if ( realtime - rl->lastSendTime < RELAY_RECONNECT_MSEC ) {
+			break;
+		}
+		rl->state = RS_CHALLENGING;
+		rl->clientChallenge = ( ( rand() << 16 ) ^ rand() ^ realtime ) & 0x7fffffff;
+		rl->lastRecvTime = realtime;
+		rl->lastSendTime = realtime - RELAY_RETRY_MSEC;
+		// fall through
+	case RS_CHALLENGING:
+	case RS_CONNECTING:
+		if ( realtime - rl->lastSendTime < RELAY_RETRY_MSEC ) {
+			break;
+		}
+		if ( rl->state == RS_CHALLENGING ) {
+			SV_RelayGetChallenge();
+		} else {
+			SV_RelaySendConnect();
+		}
+		rl->lastSendTime = realtime;
+		break;
+
+	default:
+		if ( realtime - rl->lastRecvTime > RELAY_TIMEOUT_MSEC ) {
+			SV_RelayDrop( "server connection timed out" );
+			break;
+		}
+		if ( realtime - rl->lastSendTime >= RELAY_PACKET_MSEC ) {
+			SV_RelaySendCmd( realtime );
+		}
+		SV_RelayCheckMap();
+		break;
+	}
+}
+
+
+/*
+=================
+SV_RelayActive
+=================
+*/
+qboolean SV_RelayActive( void )
+{
+	return rl != NULL;
+}
+
+
+/*
+=================
+SV_RelayClientNum
+
+Client number of relay on upstream server, viewers get it in gamestate
+=================
+*/
+int SV_RelayClientNum( void )
+{
+	if ( !rl ) {
+		return 0;
+	}
+
+	return rl->parser.clientNum;
+}
+
+
+/*
+=================
+SV_RelayShutdown
+=================
+*/
+void SV_RelayShutdown( void )
+{
+	int i;
+
+	if ( !rl ) {
+		return;
+	}
+
+	if ( rl->state >= RS_CONNECTED ) {
+		// like CL_Disconnect(), repeat in case of packet loss
+		SV_RelayAddCommand( "disconnect" );
+		for ( i = 0; i < 3; i++ ) {
+			SV_RelaySendCmd( Sys_Milliseconds() );
+		}
+	}
+
+	NET_CloseAuxSocket( rl->socket );
+
+	for ( i = 0; i < MAX_CONFIGSTRINGS; i++ ) {
+		if ( rl->configstrings[ i ] ) {
+			Z_Free( rl->configstrings[ i ] );
+		}
+	}
+
+	Z_Free( rl );
+	rl = NULL;
+
+	Com_Printf( "Relay stopped.\n" );
+}
+
+
+/*
+=============================================================================
+
+Local game
+
+=============================================================================
+*/
+
+/*
+=================
+SV_RelayEvaluateTrajectory
+
+Same as BG_EvaluateTrajectory() of the game module
+=================
+*/
+static void SV_RelayEvaluateTrajectory( const trajectory_t *tr, int atTime, vec3_t result )
+{
+	float deltaTime, phase;
+
+	switch ( tr->trType ) {
+	case TR_LINEAR:
+		deltaTime = ( atTime - tr->trTime ) * 0.001f;
+		VectorMA( tr->trBase, deltaTime, tr->trDelta, result );
+		break;
+	case TR_SINE:
+		deltaTime = ( atTime - tr->trTime ) / (float) tr->trDuration;
+		phase = sin( deltaTime * M_PI * 2 );
+		VectorMA( tr->trBase, phase, tr->trDelta, result );
+		break;
+	case TR_LINEAR_STOP:
+		if ( atTime > tr->trTime + tr->trDuration ) {
+			atTime = tr->trTime + tr->trDuration;
+		}
+		deltaTime = ( atTime - tr->trTime ) * 0.001f;
+		if ( deltaTime < 0 ) {
+			deltaTime = 0;
+		}
+		VectorMA( tr->trBase, deltaTime, tr->trDelta, result );
+		break;
+	case TR_GRAVITY:
+		deltaTime = ( atTime - tr->trTime ) * 0.001f;
+		VectorMA( tr->trBase, deltaTime, tr->trDelta, result );
+		result[2] -= 0.5f * DEFAULT_GRAVITY * deltaTime * deltaTime;
+		break;
+	default: // TR_STATIONARY, TR_INTERPOLATE
+		VectorCopy( tr->trBase, result );
+		break;
+	}
+}
+
+
+/*
+=================
+SV_RelayLinkEntity
+
+Sets up bounds for visibility checks, relay entities never collide
+=================
+*/
+static void SV_RelayLinkEntity( sharedEntity_t *ent, const entityState_t *es, int svFlags, int singleClient )
+{
+	int x, zd, zu;
+
+	ent->s = *es;
+	ent->r.svFlags = svFlags;
+	ent->r.singleClient = singleClient;
+	ent->r.contents = 0;
+
+	if ( es->solid == SOLID_BMODEL ) {
+		ent->r.bmodel = qtrue;
+		if ( es->modelindex > 0 && es->modelindex < CM_NumInlineModels() ) {
+			CM_ModelBounds( CM_InlineModel( es->modelindex ), ent->r.mins, ent->r.maxs );
+		} else {
+			VectorClear( ent->r.mins );
+			VectorClear( ent->r.maxs );
+		}
+	} else {
+		ent->r.bmodel = qfalse;
+		if ( es->solid ) {
+			// decode what SV_LinkEntity() has encoded
+			x = es->solid & 255;
+			zd = ( es->solid >> 8 ) & 255;
+			zu = ( ( es->solid >> 16 ) & 255 ) - 32;
+			VectorSet( ent->r.mins, -x, -x, -zd );
+			VectorSet( ent->r.maxs, x, x, zu );
+		} else {
+			VectorSet( ent->r.mins, -15, -15, -15 );
+			VectorSet( ent->r.maxs, 15, 15, 15 );
+		}
+	}
+
+	SV_RelayEvaluateTrajectory( &es->pos, sv.time, ent->r.currentOrigin );
+	SV_RelayEvaluateTrajectory( &es->apos, sv.time, ent->r.currentAngles );
+
+	SV_LinkEntity( ent );
+
+	// restore encoded size for clients
+	ent->s.solid = es->solid;
+}
+
+
+/*
+=================
+SV_RelayUpdateWorld
+
+Mirrors the latest upstream snapshot
+=================
+*/
+static void SV_RelayUpdateWorld( void )
+{
+	byte present[ MAX_GENTITIES ];
+	const parseSnapshot_t *snap;
+	const entityState_t *es;
+	const playerState_t *src;
+	playerState_t *ps;
+	client_t *cl;
+	int i, num, index, ping;
+
+	if ( !rl ) {
+		return;
+	}
+
+	// upstream configstrings, serverinfo is also reset by the engine
+	// from local cvars, local systeminfo is needed for pure checks
+	if ( rl->csAnyModified ) {
+		rl->csAnyModified = qfalse;
+		for ( i = 0; i < MAX_CONFIGSTRINGS; i++ ) {
+			if ( rl->csModified[ i ] ) {
+				rl->csModified[ i ] = qfalse;
+				if ( i != CS_SYSTEMINFO && i != CS_SERVERINFO ) {
+					SV_SetConfigstring( i, rl->configstrings[ i ] );
+				}
+			}
+		}
+	}
+	if ( rl->configstrings[ CS_SERVERINFO ] && strcmp( sv.configstrings[ CS_SERVERINFO ], rl->configstrings[ CS_SERVERINFO ] ) ) {
+		SV_SetConfigstring( CS_SERVERINFO, rl->configstrings[ CS_SERVERINFO ] );
+	}
+
+	snap = rl->parser.snap;
+	if ( !snap ) {
+		return;
+	}
+
+	// level time follows upstream
+	if ( snap->serverTime - rg.time > 0 ) {
+		rg.time = snap->serverTime;
+	}
+	sv.time = rg.time;
+
+	Com_Memset( present, 0, sizeof( present ) );
+
+	for ( i = 0; i < snap->numEntities; i++ ) {
+		index = ( snap->parseEntitiesNum + i ) & ( RELAY_PARSE_ENTITIES - 1 );
+		es = &rl->parseEntities[ index ];
+		num = es->number;
+		SV_RelayLinkEntity( &rg.entities[ num ], es, rl->parseFlags[ index ], rl->parseSingleClient[ index ] );
+		present[ num ] = 1;
+	}
+
+	for ( num = 0; num < MAX_GENTITIES; num++ ) {
+		if ( rg.entities[ num ].r.linked && !present[ num ] ) {
+			SV_UnlinkEntity( &rg.entities[ num ] );
+		}
+	}
+
+	// viewers see relay camera or followed player
+	for ( i = 0; i < svs.numConnectedClients; i++ ) {
+		num = svs.connectedClients[ i ];
+		cl = &svs.clients[ num ];
+		if ( cl->state < CS_PRIMED ) {
+			continue;
+		}
+
+		if ( rg.follow[ num ] != RELAY_DIRECTOR && !SV_RelayHasPlayer( snap, rg.follow[ num ] ) ) {
+			SV_SendServerCommand( cl, "print \"Followed player has left, back to relay view.\n\"" );
+			rg.follow[ num ] = RELAY_DIRECTOR;
+		}
+
+		if ( rg.follow[ num ] == RELAY_DIRECTOR ) {
+			src = &snap->ps;
+		} else {
+			src = &rl->players[ snap->messageNum & PACKET_MASK ].ps[ rg.follow[ num ] ];
+		}
+
+		ps = &rg.clients[ num ];
+		ping = ps->ping;
+		*ps = *src;
+		ps->ping = ping;
+		// no prediction on viewer's side
+		ps->pm_flags |= PMF_FOLLOW;
+	}
+}
+
+
+/*
+=================
+SV_RelayPlayerName
+=================
+*/
+static const char *SV_RelayPlayerName( int num )
+{
+	static char name[ MAX_NAME_LENGTH ];
+
+	Q_strncpyz( name, Info_ValueForKey( rl->configstrings[ CS_PLAYER_INFO( num ) ], "n" ), sizeof( name ) );
+
+	return name;
+}
+
+
+/*
+=================
+SV_RelayCanFollow
+=================
+*/
+static qboolean SV_RelayCanFollow( int clientNum, int num )
+{
+	const parseSnapshot_t *snap = rl ? rl->parser.snap : NULL;
+
+	if ( !snap || num >= rg.clientLimit[ clientNum ] || !SV_RelayHasPlayer( snap, num ) ) {
+		return qfalse;
+	}
+
+	return rl->players[ snap->messageNum & PACKET_MASK ].ps[ num ].persistant[ PERS_TEAM ] != TEAM_SPECTATOR;
+}
+
+
+/*
+=================
+SV_RelayFollow
+=================
+*/
+static void SV_RelayFollow( client_t *cl, int clientNum, const char *arg )
+{
+	char name[ MAX_NAME_LENGTH ], test[ MAX_NAME_LENGTH ];
+	int i, num;
+
+	num = -1;
+	if ( *arg >= '0' && *arg <= '9' ) {
+		num = atoi( arg );
+	} else {
+		Q_strncpyz( name, arg, sizeof( name ) );
+		Q_CleanStr( name );
+		for ( i = 0; i < rg.clientLimit[ clientNum ]; i++ ) {
+			if ( !SV_RelayCanFollow( clientNum, i ) ) {
+				continue;
+			}
+			Q_strncpyz( test, SV_RelayPlayerName( i ), sizeof( test ) );
+			Q_CleanStr( test );
+			if ( !Q_stricmp( name, test ) ) {
+				num = i;
+				break;
+			}
+		}
+	}
+
+	if ( !SV_RelayCanFollow( clientNum, num ) ) {
+		SV_SendServerCommand( cl, "print \"No such player: %s\n\"", arg );
+		return;
+	}
+
+	rg.follow[ clientNum ] = num;
+}
+
+
+/*
+=================
+SV_RelayFollowCycle
+=================
+*/
+static void SV_RelayFollowCycle( int clientNum, int dir )
+{
+	int i, num, limit;
+
+	num = rg.follow[ clientNum ];
+	limit = rg.clientLimit[ clientNum ];
+
+	// relay camera is between the last and the first player
+	for ( i = 0; i < limit + 1; i++ ) {
+		num += dir;
+		if ( num >= limit ) {
+			num = RELAY_DIRECTOR;
+		} else if ( num < RELAY_DIRECTOR ) {
+			num = limit - 1;
+		}
+		if ( num == RELAY_DIRECTOR || SV_RelayCanFollow( clientNum, num ) ) {
+			break;
+		}
+	}
+
+	rg.follow[ clientNum ] = num;
+}
+
+
+/*
+=================
+SV_RelayClientCommand
+=================
+*/
+static void SV_RelayClientCommand( int clientNum )
+{
+	client_t *cl = &svs.clients[ clientNum ];
+	const char *cmd = Cmd_Argv( 0 );
+
+	if ( !Q_stricmp( cmd, "follow" ) ) {
+		if ( Cmd_Argc() < 2 ) {
+			SV_SendServerCommand( cl, "print \"usage: follow <player number|name>\n\"" );
+			return;
+		}
+		SV_RelayFollow( cl, clientNum, Cmd_Argv( 1 ) );
+	} else if ( !Q_stricmp( cmd, "follownext" ) ) {
+		SV_RelayFollowCycle( clientNum, 1 );
+	} else if ( !Q_stricmp( cmd, "followprev" ) ) {
+		SV_RelayFollowCycle( clientNum, -1 );
+	} else if ( !Q_stricmp( cmd, "team" ) ) {
+		if ( Q_stricmp( Cmd_Argv( 1 ), "spectator" ) && Q_stricmp( Cmd_Argv( 1 ), "s" ) ) {
+			SV_SendServerCommand( cl, "print \"This is a relay server, you can only spectate.\n\"" );
+			return;
+		}
+		rg.follow[ clientNum ] = RELAY_DIRECTOR;
+	} else if ( !Q_stricmp( cmd, "score" ) ) {
+		// everybody gets the same scores, ask once in a while
+		if ( rl && rl->state == RS_ACTIVE && svs.time - rl->scoreTime >= RELAY_SCORE_MSEC ) {
+			rl->scoreTime = svs.time;
+			SV_RelayAddCommand( "score" );
+		}
+	} else {
+		SV_SendServerCommand( cl, "print \"unknown cmd %s\n\"", cmd );
+	}
+}
+
+
+/*
+=================
+SV_RelayGameMain
+
+Entry point of the built-in game module, see VM_CreateBuiltin()
+=================
+*/
+intptr_t QDECL SV_RelayGameMain( int command, int arg0, int arg1, int arg2 )
+{
+	int i, limit;
+
+	switch ( command ) {
+	case GAME_INIT:
+		if ( arg2 && sv.gentities == rg.entities ) {
+			// map_restart keeps the world
+			for ( i = 0; i < MAX_GENTITIES; i++ ) {
+				if ( rg.entities[ i ].r.linked ) {
+					SV_UnlinkEntity( &rg.entities[ i ] );
+				}
+			}
+		}
+		Com_Memset( &rg, 0, sizeof( rg ) );
+		for ( i = 0; i < MAX_SERVER_CLIENTS; i++ ) {
+			rg.follow[ i ] = RELAY_DIRECTOR;
+		}
+		// spectators don't need player info configstrings
+		sv.gameClientLimit = sv_clientLimit->integer;
+		SV_LocateGameData( rg.entities, MAX_GENTITIES, sizeof( rg.entities[0] ), rg.clients, sizeof( rg.clients[0] ) );
+		if ( rl ) {
+			rl->csAnyModified = qtrue;
+			Com_Memset( rl->csModified, qtrue, sizeof( rl->csModified ) );
+		}
+		SV_RelayUpdateWorld();
+		return 0;
+
+	case GAME_RUN_FRAME:
+		SV_RelayUpdateWorld();
+		return 0;
+
+	case GAME_CLIENT_CONNECT:
+		if ( arg2 ) {
+			return (intptr_t)"Bots are not allowed on relay.";
+		}
+		if ( !rl || !rl->parser.snap ) {
+			return (intptr_t)"Relay is not connected to game server.";
+		}
+		// legacy cgame can't show players from MAX_CLIENTS on
+		limit = atoi( Info_ValueForKey( svs.clients[ arg0 ].userinfo, "clientLimit" ) );
+		if ( limit < MAX_CLIENTS ) {
+			limit = MAX_CLIENTS;
+		} else if ( limit > MAX_SERVER_CLIENTS ) {
+			limit = MAX_SERVER_CLIENTS;
+		}
+		rg.clientLimit[ arg0 ] = limit;
+		if ( rl->parser.clientNum >= rg.clientLimit[ arg0 ] ) {
+			return (intptr_t)va( "Relay needs a client supporting more than %i players.", rg.clientLimit[ arg0 ] );
+		}
+		return 0;
+
+	case GAME_CLIENT_BEGIN:
+	case GAME_CLIENT_DISCONNECT:
+		if ( (unsigned) arg0 < MAX_SERVER_CLIENTS ) {
+			rg.follow[ arg0 ] = RELAY_DIRECTOR;
+		}
+		return 0;
+
+	case GAME_CLIENT_COMMAND:
+		SV_RelayClientCommand( arg0 );
+		return 0;
+
+	default: // GAME_SHUTDOWN, GAME_CLIENT_THINK, GAME_CONSOLE_COMMAND, etc.
+		return 0;
+	}
+}
+
+
+/*
+=============================================================================
+
+Operator commands
+
+=============================================================================
+*/
+
+/*
+=================
+SV_Relay_f
+
+sv_relay <server[:port]>
+=================
+*/
+void SV_Relay_f( void )
+{
+	netadr_t adr;
+	int socket, realtime;
+
+	if ( Cmd_Argc() < 2 ) {
+		Com_Printf( "usage: sv_relay <server[:port]>\n" );
+		return;
+	}
+
+	if ( !NET_StringToAdr( Cmd_Argv( 1 ), &adr, NA_UNSPEC ) || adr.type == NA_LOOPBACK ) {
+		Com_Printf( "Bad server address %s.\n", Cmd_Argv( 1 ) );
+		return;
+	}
+
+	if ( !sv_relayPassword->string[0] ) {
+		Com_Printf( S_COLOR_YELLOW "WARNING: sv_relayPassword is empty, upstream server will send only entities visible to relay\n" );
+	}
+
+	// also stops previous relay, game module will be replaced
+	SV_Shutdown( "Server is switching to relay mode" );
+
+	socket = NET_OpenAuxSocket( NULL );
+	if ( socket < 0 ) {
+		return;
+	}
+	NET_WatchAuxSocket( socket, SV_RelayPacketEvent );
+
+	realtime = Sys_Milliseconds();
+
+	rl = Z_Malloc( sizeof( *rl ) );
+	rl->server = adr;
+	rl->socket = socket;
+	rl->qport = ( rand() ^ realtime ) & 0xffff;
+	rl->startTime = realtime;
+	rl->state = RS_DISCONNECTED;
+	rl->lastSendTime = realtime - RELAY_RECONNECT_MSEC;
+
+	rl->parser.baselines = rl->baselines;
+	rl->parser.parseEntities = rl->parseEntities;
+	rl->parser.parseEntitiesMask = RELAY_PARSE_ENTITIES - 1;
+	rl->parser.drop = SV_RelayParserDrop;
+	rl->parser.configstring = SV_RelaySetConfigstring;
+	rl->parser.gamestate = SV_RelayGamestate;
+	rl->parser.command = SV_RelayCommand;
+	rl->parser.snapshot = SV_RelaySnapshot;
+	rl->parser.entity = SV_RelayEntity;
+	rl->parser.playerstate = SV_RelayPlayerstate;
+
+	Com_Printf( "Relaying %s\n", NET_AdrToStringwPort( &rl->server ) );
+}
+
+
+/*
+=================
+SV_StopRelay_f
+=================
+*/
+void SV_StopRelay_f( void )
+{
+	if ( !rl ) {
+		Com_Printf( "Relay is not running.\n" );
+		return;
+	}
+
+	SV_Shutdown( "Relay stopped" );
+}
+
+
+/*
+=================
+SV_RelayCmd_f
+
+Sends command to upstream server as relay client, e.g. "follow 3"
+=================
+*/
+void SV_RelayCmd_f( void )
+{
+	if ( !rl ) {
+		Com_Printf( "Relay is not running.\n" );
+		return;
+	}
+
+	if ( Cmd_Argc() < 2 ) {
+		Com_Printf( "usage: sv_relaycmd <command>\n" );
+		return;
+	}
+
+	SV_RelayAddCommand( Cmd_ArgsFrom( 1 ) );
+}
+
+
+/*
+=================
+SV_RelayStatus_f
+=================
+*/
+void SV_RelayStatus_f( void )
+{
+	float seconds;
+	int i, viewers, players;
+
+	if ( !rl ) {
+		Com_Printf( "Relay is not running.\n" );
+		return;
+	}
+
+	seconds = ( Sys_Milliseconds() - rl->startTime ) * 0.001f;
+	if ( seconds <= 0.0f ) {
+		seconds = 0.001f;
+	}
+
+	viewers = 0;
+	for ( i = 0; i < svs.numConnectedClients; i++ ) {
+		if ( svs.clients[ svs.connectedClients[ i ] ].state == CS_ACTIVE ) {
+			viewers++;
+		}
+	}
+
+	Com_Printf( "relay %s: %s, client %i, %s\n", NET_AdrToStringwPort( &rl->server ),
+		relayStateNames[ rl->state ], rl->parser.clientNum, rl->message[0] ? rl->message : "no messages" );
+	Com_Printf( " %i snapshots, %i with lost delta source, %.1f KB/s in\n",
+		rl->snapshotCount, rl->deltaErrors + rl->parser.deltaErrors, rl->bytesIn / seconds / 1024.0f );
+	if ( rl->parser.snap ) {
+		for ( i = 0, players = 0; i < MAX_SERVER_CLIENTS; i++ ) {
+			if ( SV_RelayHasPlayer( rl->parser.snap, i ) ) {
+				players++;
+			}
+		}
+		Com_Printf( " latest snapshot: time %i, %i entities, %i players\n", rl->parser.snap->serverTime,
+			rl->parser.snap->numEntities, players );
+	}
+	Com_Printf( " %i viewers\n", viewers );
+}
@@ -45,6 +45,161 @@ A normal server packet will look like:
 =============================================================================
 */
 
+/*
+=============================================================================
+
+Most clients delta compress against the same few common snapshots so
+identical (from, to) entity deltas are encoded many times per frame.
+Encoded bits are cached by entityState_t pointers, which stay valid until
+snapshot storage is overwritten by SV_BuildCommonSnapshot(), and spliced
+into messages of other clients.
+
+=============================================================================
+*/
+
+#define DELTA_CACHE_SIZE	4096		// must be power of two
+#define DELTA_CACHE_DATA	0x40000
+#define MAX_DELTA_BYTES		1024		// enough for any entity delta
+
+typedef struct {
+	const entityState_t	*from;
+	const entityState_t	*to;
+	qboolean			force;
+	int					generation;
+	int					offset;
+	int					bits;
+} deltaCacheEntry_t;
+
+static deltaCacheEntry_t	deltaCache[ DELTA_CACHE_SIZE ];
+static byte					deltaCacheData[ DELTA_CACHE_DATA ];
+static int					deltaCacheUsed;
+static int					deltaCacheCount;
+static int					deltaCacheGeneration;
+static sysMutex_t			*deltaCacheLock;	// only needed with snapshot workers
+static qboolean				deltaCacheBypass;	// encode everything directly
+
+
+/*
+=============
+SV_ClearDeltaCache
+=============
+*/
+static void SV_ClearDeltaCache( void ) {
+	deltaCacheGeneration++;
+	deltaCacheUsed = 0;
+	deltaCacheCount = 0;
+}
+
+
+/*
+=============
+SV_FindDeltaEntry
+
+Returns entry for specified key or free slot to insert it,
+NULL if cache is full. Must be called with cache lock held.
+=============
+*/
+static deltaCacheEntry_t *SV_FindDeltaEntry( const entityState_t *from, const entityState_t *to, qboolean force ) {
+	deltaCacheEntry_t *entry;
+	unsigned int hash;
+	int i;
+
+	hash = (unsigned int)( ( (intptr_t)from >> 4 ) * 31 + ( (intptr_t)to >> 4 ) ) + force;
+
+	for ( i = 0; i < 16; i++ ) {
+		entry = &deltaCache[ ( hash + i ) & ( DELTA_CACHE_SIZE - 1 ) ];
+		if ( entry->generation != deltaCacheGeneration ) {
+			return entry;
+		}
+		if ( entry->from == from && entry->to == to && entry->force == force ) {
+			return entry;
+		}
+	}
+
+	return NULL;
+}
+
+
+/*
+=============
+SV_WriteDeltaEntity
+
+Same as MSG_WriteDeltaEntity() but shares encoded
+bits between clients, worker threads may call it
+=============
+*/
+static void SV_WriteDeltaEntity( msg_t *msg, const entityState_t *from, const entityState_t *to, qboolean force ) {
+	byte		buf[ MAX_DELTA_BYTES ];
+	msg_t		delta;
+	deltaCacheEntry_t *entry;
+	int			offset, bits;
+	int			size;
+
+	if ( !sv_deltaCache->integer || deltaCacheBypass ) {
+		MSG_WriteDeltaEntity( msg, from, to, force );
+		return;
+	}
+
+	if ( deltaCacheLock ) {
+		Sys_LockMutex( deltaCacheLock );
+	}
+
+	entry = SV_FindDeltaEntry( from, to, force );
+	if ( entry && entry->generation == deltaCacheGeneration ) {
+		// cached data is never modified after insertion
+		offset = entry->offset;
+		bits = entry->bits;
+		if ( deltaCacheLock ) {
+			Sys_UnlockMutex( deltaCacheLock );
+		}
+		MSG_WriteBitString( msg, deltaCacheData + offset, bits );
+		return;
+	}
+
+	if ( deltaCacheLock ) {
+		Sys_UnlockMutex( deltaCacheLock );
+	}
+
+	MSG_Init( &delta, buf, sizeof( buf ) );
+	delta.allowoverflow = qtrue;
+	delta.deferError = msg->deferError;
+	MSG_WriteDeltaEntity( &delta, from, to, force );
+
+	if ( delta.overflowed ) {
+		// also records errors in the target message
+		MSG_WriteDeltaEntity( msg, from, to, force );
+		return;
+	}
+
+	MSG_WriteBitString( msg, delta.data, delta.bit );
+
+	size = ( delta.bit + 7 ) >> 3;
+
+	if ( deltaCacheLock ) {
+		Sys_LockMutex( deltaCacheLock );
+	}
+
+	// other thread may have inserted it meanwhile
+	entry = SV_FindDeltaEntry( from, to, force );
+	if ( entry && entry->generation != deltaCacheGeneration
+		&& deltaCacheUsed + size <= DELTA_CACHE_DATA && deltaCacheCount < DELTA_CACHE_SIZE / 2 ) {
+		Com_Memcpy( deltaCacheData + deltaCacheUsed, delta.data, size );
+		entry->from = from;
+		entry->to = to;
+		entry->force = force;
+		entry->offset = deltaCacheUsed;
+		entry->bits = delta.bit;
+		entry->generation = deltaCacheGeneration;
+		deltaCacheUsed += size;
+		deltaCacheCount++;
+	}
+
+	if ( deltaCacheLock ) {
+		Sys_UnlockMutex( deltaCacheLock );
+	}
+}
+
+
 /*
 =============
 SV_EmitPacketEntities
@@ -53,7 +208,7 @@ Writes a delta update of an entityState_t list to the message.
 =============
 */
 static void SV_EmitPacketEntities( const clientSnapshot_t *from, const clientSnapshot_t *to, msg_t *msg ) {
-	entityState_t	*oldent, *newent;
+	const entityState_t	*oldent, *newent;
 	int		oldindex, newindex;
 	int		oldnum, newnum;
 	int		from_num_entities;
@@ -88,7 +243,9 @@ static void SV_EmitPacketEntities( const clientSnapshot_t *from, const clientSna
 			// delta update from old position
 			// because the force parm is qfalse, this will not result
 			// in any bytes being emitted if the entity has not changed at all
-			MSG_WriteDeltaEntity (msg, oldent, newent, qfalse );
+			if ( oldent != newent ) {
+				SV_WriteDeltaEntity( msg, oldent, newent, qfalse );
+			}
 			oldindex++;
 			newindex++;
 			continue;
@@ -96,7 +253,7 @@ static void SV_EmitPacketEntities( const clientSnapshot_t *from, const clientSna
 
 		if ( newnum < oldnum ) {
 			// this is a new entity, send it from the baseline
-			MSG_WriteDeltaEntity (msg, &sv.svEntities[newnum].baseline, newent, qtrue );
+			SV_WriteDeltaEntity( msg, &sv.svEntities[newnum].baseline, newent, qtrue );
 			newindex++;
 			continue;
 		}
@@ -115,24 +272,24 @@ static void SV_EmitPacketEntities( const clientSnapshot_t *from, const clientSna
 
 /*
 ==================
-SV_WriteSnapshotToClient
+SV_GetDeltaFrame
+
+Selects previous frame to delta compress the snapshot from
 ==================
 */
-static void SV_WriteSnapshotToClient( const client_t *client, msg_t *msg ) {
+static const clientSnapshot_t *SV_GetDeltaFrame( const client_t *client, int *deltaframe ) {
 	const clientSnapshot_t	*oldframe;
-	const clientSnapshot_t	*frame;
 	int					lastframe;
-	int					i;
-	int					snapFlags;
-
-	// this is the snapshot we are creating
-	frame = &client->frames[ client->netchan.outgoingSequence & PACKET_MASK ];
 
 	// try to use a previous frame as the source for delta compressing the snapshot
 	if ( /* client->deltaMessage <= 0 || */ client->state != CS_ACTIVE ) {
 		// client is asking for a retransmit
 		oldframe = NULL;
 		lastframe = 0;
+	} else if ( SV_DemoKeyframe( client ) ) {
+		// server-side demo starts from uncompressed snapshot
+		oldframe = NULL;
+		lastframe = 0;
 	} else if ( client->netchan.outgoingSequence - client->deltaMessage >= (PACKET_BACKUP - 3) ) {
 		// client hasn't gotten a good message through in a long time
 		if ( com_developer->integer ) {
@@ -154,6 +311,21 @@ static void SV_WriteSnapshotToClient( const client_t *client, msg_t *msg ) {
 		}
 	}
 
+	*deltaframe = lastframe;
+
+	return oldframe;
+}
+
+
+/*
+==================
+SV_WriteSnapshotToClient
+==================
+*/
+static void SV_WriteSnapshotToClient( const client_t *client, const clientSnapshot_t *frame, const clientSnapshot_t *oldframe, int lastframe, msg_t *msg ) {
+	int					i;
+	int					snapFlags;
+
 	MSG_WriteByte( msg, svc_snapshot );
 
 	// NOTE, MRE: now sent at the start of every message from server to client
@@ -227,7 +399,7 @@ SV_UpdateServerCommandsToClient
 (re)send all server commands the client hasn't acknowledged yet
 ==================
 */
-void SV_UpdateServerCommandsToClient( client_t *client, msg_t *msg ) {
+void SV_UpdateServerCommandsToClient( const client_t *client, msg_t *msg ) {
 	int i, n;
 
 	// write any unacknowledged serverCommands
@@ -235,12 +407,301 @@ void SV_UpdateServerCommandsToClient( client_t *client, msg_t *msg ) {
 
 	for ( i = 0; i < n; i++ ) {
 		const int index = client->reliableAcknowledge + 1 + i;
+		const svCommand_t *command = client->sharedCommands[ index & (MAX_RELIABLE_COMMANDS-1) ];
 		MSG_WriteByte( msg, svc_serverCommand );
 		MSG_WriteLong( msg, index );
-		MSG_WriteString( msg, client->reliableCommands[ index & (MAX_RELIABLE_COMMANDS-1) ] );
+		if ( command && command->bits ) {
+			// reuse string encoded on creation
+			MSG_WriteBitString( msg, command->data, command->bits );
+		} else {
+			MSG_WriteString( msg, SV_ReliableCommand( client, index ) );
+		}
+	}
+}
+
+
+/*
+=============================================================================
+
+Bandwidth limited snapshots
+
+When the whole snapshot doesn't fit into client's rate it would be
+delayed, so instead less important entity changes are deferred: changed
+entities keep their previous state in the new frame, so nothing is
+written for them and stock clients simply don't see the change yet, and
+new entities are left out of the frame. Each deferred entity accumulates
+priority from distance, player and SVF_* hints until it gets sent.
+
+=============================================================================
+*/
+
+#define MAX_DEFER_MSEC		150		// well below lifetime of temporary event entities
+#define SNAPSHOT_HEADER_BITS	( 8 * 16 )	// sequence, acks, snapshot header
+
+typedef struct {
+	entityState_t		**ent;		// frame slot
+	entityState_t		*oldent;	// NULL for new entity
+	int					priority;
+	int					bits;
+} deferCandidate_t;
+
+
+/*
+=============
+SV_EntityPriority
+
+Priority added to entity change each time it has been deferred
+=============
+*/
+static int SV_EntityPriority( const clientSnapshot_t *frame, const entityState_t *ent ) {
+	const sharedEntity_t *gent;
+	vec3_t	delta;
+	int		priority;
+	int		dist;
+
+	priority = 256;
+
+	// other players are what everybody looks at
+	if ( ent->number < sv.maxclients ) {
+		priority *= 4;
+	}
+
+	gent = SV_GentityNum( ent->number );
+	if ( gent->r.svFlags & ( SVF_BROADCAST | SVF_PORTAL | SVF_SELF_PORTAL2 ) ) {
+		priority *= 2;
+	}
+
+	// closer entities are more important
+	VectorSubtract( ent->pos.trBase, frame->ps.origin, delta );
+	dist = (int)VectorLength( delta );
+
+	return priority * 512 / ( 256 + dist );
+}
+
+
+/*
+=============
+SV_KeepDeferredError
+
+Passes write error of a scratch message to the message being built,
+which gets it raised on main thread
+=============
+*/
+static void SV_KeepDeferredError( msg_t *out, const msg_t *scratch ) {
+	if ( scratch->error && !out->error ) {
+		out->error = scratch->error;
+		out->errorValue = scratch->errorValue;
+		out->overflowed = qtrue;
+	}
+}
+
+
+/*
+=============
+SV_DeltaBits
+
+Returns size of encoded entity delta, encoding also
+puts it into delta cache for the following message write
+=============
+*/
+static int SV_DeltaBits( msg_t *out, const entityState_t *from, const entityState_t *to, qboolean force ) {
+	byte	buf[ MAX_DELTA_BYTES ];
+	msg_t	msg;
+
+	MSG_Init( &msg, buf, sizeof( buf ) );
+	msg.allowoverflow = qtrue;
+	msg.deferError = out->deferError;
+	SV_WriteDeltaEntity( &msg, from, to, force );
+	SV_KeepDeferredError( out, &msg );
+
+	return msg.bit;
+}
+
+
+/*
+=============
+SV_EntityStorageFrame
+
+Returns number of common snapshot which holds entity state
+=============
+*/
+static int SV_EntityStorageFrame( const entityState_t *ent ) {
+	const snapshotFrame_t *sf;
+	int index, offset, n;
+
+	index = ent - svs.snapshotEntities;
+
+	// deferred states are recent so it won't take long
+	for ( n = svs.snapshotFrame - 1; n - svs.lastValidFrame >= 0; n-- ) {
+		sf = &svs.snapFrames[ n % NUM_SNAPSHOT_FRAMES ];
+		offset = index - sf->start;
+		if ( offset < 0 ) {
+			offset += svs.numSnapshotEntities;
+		}
+		if ( offset < sf->count ) {
+			return sf->frameNum;
+		}
+	}
+
+	return svs.lastValidFrame;
+}
+
+
+/*
+=============
+SV_CompareCandidates
+=============
+*/
+static int QDECL SV_CompareCandidates( const void *a, const void *b ) {
+	return ((const deferCandidate_t *)b)->priority - ((const deferCandidate_t *)a)->priority;
+}
+
+
+/*
+=============
+SV_LimitSnapshotEntities
+
+Defers entity changes which don't fit into bytes client's rate allows
+per snapshot, returns qtrue if frame has been modified. Touches only
+client's own state so it can be called from worker threads, encoding
+errors are stored in out message if it defers them.
+=============
+*/
+static qboolean SV_LimitSnapshotEntities( client_t *client, clientSnapshot_t *frame, const clientSnapshot_t *oldframe, msg_t *out ) {
+	deferCandidate_t	candidates[ MAX_SNAPSHOT_ENTITIES ];
+	deferCandidate_t	*c;
+	entityPriority_t	*p;
+	entityState_t		*newent;
+	entityState_t		*oldent;
+	byte				buf[ MAX_MSGLEN_BUF ];
+	msg_t				msg;
+	int					numCandidates;
+	int					oldindex, newindex, oldnum, newnum;
+	int					budget, used, total;
+	int					frameNum;
+	int					i, n;
+
+	if ( !sv_snapshotBudget->integer || !oldframe || client->netchan.remoteAddress.type == NA_BOT || client->state != CS_ACTIVE ) {
+		return qfalse;
+	}
+
+	budget = SV_RateBytes( client, client->snapshotMsec ) * 8;
+	if ( budget <= 0 ) {
+		return qfalse; // unlimited rate
+	}
+
+	// everything else the message will carry
+	MSG_Init( &msg, buf, MAX_MSGLEN );
+	msg.allowoverflow = qtrue;
+	msg.deferError = out->deferError;
+	SV_UpdateServerCommandsToClient( client, &msg );
+	MSG_WriteDeltaPlayerstate( &msg, &oldframe->ps, &frame->ps );
+	SV_KeepDeferredError( out, &msg );
+	used = msg.bit + SNAPSHOT_HEADER_BITS + frame->areabytes * 8 + GENTITYNUM_BITS;
+
+	// collect changed and new entities
+	numCandidates = 0;
+	total = used;
+	oldindex = 0;
+	newindex = 0;
+	while ( newindex < frame->num_entities || oldindex < oldframe->num_entities ) {
+		newnum = newindex < frame->num_entities ? frame->ents[ newindex ]->number : MAX_GENTITIES+1;
+		oldnum = oldindex < oldframe->num_entities ? oldframe->ents[ oldindex ]->number : MAX_GENTITIES+1;
+		if ( newnum > oldnum ) {
+			// removal is always sent
+			total += GENTITYNUM_BITS + 1;
+			oldindex++;
+			continue;
+		}
+		newent = frame->ents[ newindex ];
+		p = &client->entityPriority[ newnum ];
+		c = &candidates[ numCandidates ];
+		if ( newnum == oldnum ) {
+			oldent = oldframe->ents[ oldindex++ ];
+			c->bits = ( oldent != newent ) ? SV_DeltaBits( out, oldent, newent, qfalse ) : 0;
+			if ( !c->bits ) {
+				// unchanged
+				p->priority = 0;
+				p->deferTime = 0;
+				newindex++;
+				continue;
+			}
+		} else {
+			oldent = NULL;
+			c->bits = SV_DeltaBits( out, &sv.svEntities[ newnum ].baseline, newent, qtrue );
+		}
+		c->ent = &frame->ents[ newindex++ ];
+		c->oldent = oldent;
+		p->priority += SV_EntityPriority( frame, newent );
+		if ( p->deferTime && svs.time - p->deferTime >= MAX_DEFER_MSEC ) {
+			c->priority = INT_MAX;
+		} else {
+			c->priority = p->priority;
+		}
+		total += c->bits;
+		numCandidates++;
+	}
+
+	if ( out->error ) {
+		return qfalse;
+	}
+
+	if ( total <= budget ) {
+		// everything fits
+		for ( i = 0, c = candidates; i < numCandidates; i++, c++ ) {
+			p = &client->entityPriority[ (*c->ent)->number ];
+			p->priority = 0;
+			p->deferTime = 0;
+		}
+		return qfalse;
+	}
+
+	qsort( candidates, numCandidates, sizeof( candidates[0] ), SV_CompareCandidates );
+
+	used = total;
+	for ( i = 0, c = candidates; i < numCandidates; i++, c++ ) {
+		used -= c->bits;
+	}
+
+	frameNum = frame->frameNum;
+	for ( i = 0, c = candidates; i < numCandidates; i++, c++ ) {
+		p = &client->entityPriority[ (*c->ent)->number ];
+		if ( c->priority == INT_MAX || used + c->bits <= budget ) {
+			used += c->bits;
+			p->priority = 0;
+			p->deferTime = 0;
+			continue;
+		}
+		if ( !p->deferTime ) {
+			p->deferTime = svs.time ? svs.time : 1;
+		}
+		if ( c->oldent ) {
+			// client keeps previous state
+			*c->ent = c->oldent;
+			n = SV_EntityStorageFrame( c->oldent );
+			if ( n - frameNum < 0 ) {
+				frameNum = n;
+			}
+		} else {
+			*c->ent = NULL;
+		}
+	}
+
+	// drop deferred new entities
+	for ( i = 0, n = 0; i < frame->num_entities; i++ ) {
+		if ( frame->ents[ i ] ) {
+			frame->ents[ n++ ] = frame->ents[ i ];
+		}
 	}
+	frame->num_entities = n;
+
+	// frame may refer to older snapshot storage now
+	frame->frameNum = frameNum;
+
+	return qtrue;
 }
 
+
 /*
 =============================================================================
 
@@ -255,8 +716,24 @@ typedef struct {
 	int		numSnapshotEntities;
 	entityNum_t	snapshotEntities[ MAX_SNAPSHOT_ENTITIES ];
 	qboolean unordered;
+	qboolean badClientMask;
+	uint32_t added[ MAX_GENTITIES / 32 ];	// used to prevent double adding from portal views
 } snapshotEntityNumbers_t;
 
+// entities of the common snapshot that pass area and PVS checks
+// for a viewpoint, client-specific flags are not checked here
+typedef struct {
+	int			cluster;
+	int			area;
+	uint32_t	bits[ MAX_GENTITIES / 32 ];
+} visibleEntities_t;
+
+static visibleEntities_t	visCache[ MAX_SERVER_CLIENTS ];
+static int					visCacheCount;
+
+// entity number -> index in common snapshot
+static int					snapshotIndex[ MAX_GENTITIES ];
+
 
 /*
 =============
@@ -293,9 +770,9 @@ static void SV_SortEntityNumbers( entityNum_t *num, const int size ) {
 SV_AddIndexToSnapshot
 ===============
 */
-static void SV_AddIndexToSnapshot( svEntity_t *svEnt, int index, snapshotEntityNumbers_t *eNums ) {
+static void SV_AddIndexToSnapshot( int entityNum, int index, snapshotEntityNumbers_t *eNums ) {
 
-	svEnt->snapshotCounter = sv.snapshotCounter;
+	eNums->added[ entityNum >> 5 ] |= 1U << ( entityNum & 31 );
 
 	// if we are full, silently discard entities
 	if ( eNums->numSnapshotEntities >= MAX_SNAPSHOT_ENTITIES ) {
@@ -309,129 +786,243 @@ static void SV_AddIndexToSnapshot( svEntity_t *svEnt, int index, snapshotEntityN
 
 /*
 ===============
-SV_AddEntitiesVisibleFromPoint
+SV_EntityVisibleFromCluster
 ===============
 */
-static void SV_AddEntitiesVisibleFromPoint( const vec3_t origin, clientSnapshot_t *frame,
-									snapshotEntityNumbers_t *eNums, qboolean portal ) {
-	int		e, i;
-	sharedEntity_t *ent;
-	svEntity_t	*svEnt;
-	entityState_t  *es;
-	int		l;
-	int		clientarea, clientcluster;
-	int		leafnum;
-	byte	*clientpvs;
-	byte	*bitvector;
+static qboolean SV_EntityVisibleFromCluster( const svEntity_t *svEnt, const byte *bitvector ) {
+	int		i, l;
 
-	// during an error shutdown message we may need to transmit
-	// the shutdown message after the server has shutdown, so
-	// specifically check for it
-	if ( sv.state == SS_DEAD ) {
-		return;
+	// check individual leafs
+	if ( !svEnt->numClusters ) {
+		return qfalse;
+	}
+	l = 0;
+	for ( i=0 ; i < svEnt->numClusters ; i++ ) {
+		l = svEnt->clusternums[i];
+		if ( bitvector[l >> 3] & (1 << (l&7) ) ) {
+			return qtrue;
+		}
 	}
 
-	leafnum = CM_PointLeafnum (origin);
-	clientarea = CM_LeafArea (leafnum);
-	clientcluster = CM_LeafCluster (leafnum);
+	// if we haven't found it to be visible,
+	// check overflow clusters that couldn't be stored
+	if ( svEnt->lastCluster ) {
+		for ( ; l <= svEnt->lastCluster ; l++ ) {
+			if ( bitvector[l >> 3] & (1 << (l&7) ) ) {
+				break;
+			}
+		}
+		if ( l == svEnt->lastCluster ) {
+			return qfalse;	// not visible
+		}
+		return qtrue;
+	}
 
-	// calculate the visible areas
-	frame->areabytes = CM_WriteAreaBits( frame->areabits, clientarea );
+	return qfalse;
+}
 
-	clientpvs = CM_ClusterPVS (clientcluster);
 
-	for ( e = 0 ; e < svs.currFrame->count; e++ ) {
-		es = svs.currFrame->ents[ e ];
-		ent = SV_GentityNum( es->number );
+/*
+===============
+SV_ComputeVisibleEntities
 
-		// entities can be flagged to be sent to only one client
-		if ( ent->r.svFlags & SVF_SINGLECLIENT ) {
-			if ( ent->r.singleClient != frame->ps.clientNum ) {
-				continue;
-			}
-		}
-		// entities can be flagged to be sent to everyone but one client
-		if ( ent->r.svFlags & SVF_NOTSINGLECLIENT ) {
-			if ( ent->r.singleClient == frame->ps.clientNum ) {
-				continue;
-			}
-		}
-		// entities can be flagged to be sent to a given mask of clients
-		if ( ent->r.svFlags & SVF_CLIENTMASK ) {
-			if (frame->ps.clientNum >= 32)
-				Com_Error( ERR_DROP, "SVF_CLIENTMASK: clientNum >= 32" );
-			if (~ent->r.singleClient & (1 << frame->ps.clientNum))
-				continue;
-		}
+Performs area and PVS checks for every entity in the common snapshot
+===============
+*/
+static void SV_ComputeVisibleEntities( int clientcluster, int clientarea, uint32_t *bits ) {
+	const sharedEntity_t *ent;
+	const svEntity_t *svEnt;
+	const byte	*clientpvs;
+	int		e, num;
 
-		svEnt = &sv.svEntities[ es->number ];
+	Com_Memset( bits, 0, MAX_GENTITIES / 8 );
 
-		// don't double add an entity through portals
-		if ( svEnt->snapshotCounter == sv.snapshotCounter ) {
-			continue;
-		}
+	clientpvs = CM_ClusterPVS( clientcluster );
+
+	for ( e = 0 ; e < svs.currFrame->count; e++ ) {
+		num = svs.currFrame->ents[ e ]->number;
+		ent = SV_GentityNum( num );
 
 		// broadcast entities are always sent
-		if ( ent->r.svFlags & SVF_BROADCAST ) {
-			SV_AddIndexToSnapshot( svEnt, e, eNums );
-			continue;
-		}
+		if ( !( ent->r.svFlags & SVF_BROADCAST ) ) {
+			svEnt = &sv.svEntities[ num ];
+
+			// ignore if not touching a PV leaf
+			// check area
+			if ( !CM_AreasConnected( clientarea, svEnt->areanum ) ) {
+				// doors can legally straddle two areas, so
+				// we may need to check another one
+				if ( !CM_AreasConnected( clientarea, svEnt->areanum2 ) ) {
+					continue;		// blocked by a door
+				}
+			}
 
-		// ignore if not touching a PV leaf
-		// check area
-		if ( !CM_AreasConnected( clientarea, svEnt->areanum ) ) {
-			// doors can legally straddle two areas, so
-			// we may need to check another one
-			if ( !CM_AreasConnected( clientarea, svEnt->areanum2 ) ) {
-				continue;		// blocked by a door
+			if ( !SV_EntityVisibleFromCluster( svEnt, clientpvs ) ) {
+				continue;
 			}
 		}
 
-		bitvector = clientpvs;
-
-		// check individual leafs
-		if ( !svEnt->numClusters ) {
-			continue;
+		bits[ num >> 5 ] |= 1U << ( num & 31 );
+	}
+}
+
+
+/*
+===============
+SV_FindVisibleEntities
+
+Returns cached entity set, may be called from worker threads
+===============
+*/
+static const uint32_t *SV_FindVisibleEntities( int clientcluster, int clientarea ) {
+	int i;
+
+	for ( i = 0; i < visCacheCount; i++ ) {
+		if ( visCache[ i ].cluster == clientcluster && visCache[ i ].area == clientarea ) {
+			return visCache[ i ].bits;
 		}
-		l = 0;
-		for ( i=0 ; i < svEnt->numClusters ; i++ ) {
-			l = svEnt->clusternums[i];
-			if ( bitvector[l >> 3] & (1 << (l&7) ) ) {
-				break;
+	}
+
+	return NULL;
+}
+
+
+/*
+===============
+SV_CacheVisibleEntities
+
+Computes entity set for the client's viewpoint if nobody else did
+it for the current common snapshot, must be called from main thread
+===============
+*/
+static void SV_CacheVisibleEntities( const clientSnapshot_t *frame ) {
+	visibleEntities_t *vis;
+	vec3_t	org;
+	int		leafnum;
+	int		clientarea, clientcluster;
+
+	if ( sv.state == SS_DEAD || visCacheCount >= ARRAY_LEN( visCache ) ) {
+		return;
+	}
+
+	VectorCopy( frame->ps.origin, org );
+	org[2] += frame->ps.viewheight;
+
+	leafnum = CM_PointLeafnum( org );
+	clientarea = CM_LeafArea( leafnum );
+	clientcluster = CM_LeafCluster( leafnum );
+
+	if ( SV_FindVisibleEntities( clientcluster, clientarea ) ) {
+		return;
+	}
+
+	vis = &visCache[ visCacheCount ];
+	vis->cluster = clientcluster;
+	vis->area = clientarea;
+	SV_ComputeVisibleEntities( clientcluster, clientarea, vis->bits );
+
+	visCacheCount++;
+}
+
+
+/*
+===============
+SV_AddEntitiesVisibleFromPoint
+
+Must not modify any shared state as it may be called from worker threads
+===============
+*/
+static void SV_AddEntitiesVisibleFromPoint( const vec3_t origin, clientSnapshot_t *frame,
+									snapshotEntityNumbers_t *eNums, qboolean portal ) {
+	uint32_t	localBits[ MAX_GENTITIES / 32 ];
+	const uint32_t	*visBits;
+	uint32_t	bits;
+	int		e, w, num;
+	sharedEntity_t *ent;
+	int		clientarea, clientcluster;
+	int		leafnum;
+
+	// during an error shutdown message we may need to transmit
+	// the shutdown message after the server has shutdown, so
+	// specifically check for it
+	if ( sv.state == SS_DEAD ) {
+		return;
+	}
+
+	leafnum = CM_PointLeafnum (origin);
+	clientarea = CM_LeafArea (leafnum);
+	clientcluster = CM_LeafCluster (leafnum);
+
+	// calculate the visible areas
+	frame->areabytes = CM_WriteAreaBits( frame->areabits, clientarea );
+
+	// other clients in the same cluster may have done the job already
+	visBits = SV_FindVisibleEntities( clientcluster, clientarea );
+	if ( !visBits ) {
+		SV_ComputeVisibleEntities( clientcluster, clientarea, localBits );
+		visBits = localBits;
+	}
+
+	for ( w = 0; w < ARRAY_LEN( localBits ); w++ ) {
+		// don't double add an entity through portals
+		bits = visBits[ w ] & ~eNums->added[ w ];
+
+		for ( num = w * 32; bits; num++, bits >>= 1 ) {
+			if ( !( bits & 1 ) ) {
+				continue;
 			}
-		}
 
-		// if we haven't found it to be visible,
-		// check overflow clusters that couldn't be stored
-		if ( i == svEnt->numClusters ) {
-			if ( svEnt->lastCluster ) {
-				for ( ; l <= svEnt->lastCluster ; l++ ) {
-					if ( bitvector[l >> 3] & (1 << (l&7) ) ) {
-						break;
-					}
+			ent = SV_GentityNum( num );
+
+			// entities can be flagged to be sent to only one client
+			if ( ent->r.svFlags & SVF_SINGLECLIENT ) {
+				if ( ent->r.singleClient != frame->ps.clientNum ) {
+					continue;
+				}
+			}
+			// entities can be flagged to be sent to everyone but one client
+			if ( ent->r.svFlags & SVF_NOTSINGLECLIENT ) {
+				if ( ent->r.singleClient == frame->ps.clientNum ) {
+					continue;
 				}
-				if ( l == svEnt->lastCluster ) {
-					continue;	// not visible
+			}
+			// entities can be flagged to be sent to a given mask of clients
+			if ( ent->r.svFlags & SVF_CLIENTMASK ) {
+				if (frame->ps.clientNum >= 32) {
+					// reported by caller
+					eNums->badClientMask = qtrue;
+					continue;
 				}
-			} else {
+				if (~ent->r.singleClient & (1 << frame->ps.clientNum))
+					continue;
+			}
+
+			// may be added by portal view in this loop
+			if ( eNums->added[ w ] & ( 1U << ( num & 31 ) ) ) {
 				continue;
 			}
-		}
 
-		// add it
-		SV_AddIndexToSnapshot( svEnt, e, eNums );
+			e = snapshotIndex[ num ];
 
-		// if it's a portal entity, add everything visible from its camera position
-		if ( ent->r.svFlags & SVF_PORTAL && !portal ) {
-			if ( ent->s.generic1 ) {
-				vec3_t dir;
-				VectorSubtract(ent->s.origin, origin, dir);
-				if ( VectorLengthSquared(dir) > (float) ent->s.generic1 * ent->s.generic1 ) {
-					continue;
+			// add it
+			SV_AddIndexToSnapshot( num, e, eNums );
+
+			if ( ent->r.svFlags & SVF_BROADCAST ) {
+				continue;
+			}
+
+			// if it's a portal entity, add everything visible from its camera position
+			if ( ent->r.svFlags & SVF_PORTAL && !portal ) {
+				if ( ent->s.generic1 ) {
+					vec3_t dir;
+					VectorSubtract(ent->s.origin, origin, dir);
+					if ( VectorLengthSquared(dir) > (float) ent->s.generic1 * ent->s.generic1 ) {
+						continue;
+					}
 				}
+				eNums->unordered = qtrue;
+				SV_AddEntitiesVisibleFromPoint( ent->s.origin2, frame, eNums, portal );
 			}
-			eNums->unordered = qtrue;
-			SV_AddEntitiesVisibleFromPoint( ent->s.origin2, frame, eNums, portal );
 		}
 	}
 
@@ -461,6 +1052,8 @@ void SV_InitSnapshotStorage( void )
 	svs.lastValidFrame = 0;
 
 	svs.currFrame = NULL;
+
+	SV_ClearDeltaCache();
 }
 
 
@@ -524,12 +1117,9 @@ static void SV_BuildCommonSnapshot( void )
 			}
 
 			list[ count++ ] = ent;
-			sv.svEntities[ num ].snapshotCounter = -1;
 		}
 	}
 
-	sv.snapshotCounter = -1;
-
 	sf = &svs.snapFrames[ svs.snapshotFrame % NUM_SNAPSHOT_FRAMES ];
 	
 	// track last valid frame
@@ -572,31 +1162,29 @@ static void SV_BuildCommonSnapshot( void )
 		//index %= svs.numSnapshotEntities;
 		svs.snapshotEntities[ index ] = list[ i ]->s;
 		sf->ents[ i ] = &svs.snapshotEntities[ index ];
+		snapshotIndex[ list[ i ]->s.number ] = i;
 	}
+
+	// visible entity sets must be recomputed for new frame
+	visCacheCount = 0;
+
+	// snapshot storage has been overwritten
+	SV_ClearDeltaCache();
 }
 
 
 /*
 =============
-SV_BuildClientSnapshot
+SV_PrepareClientSnapshot
 
-Decides which entities are going to be visible to the client, and
-copies off the playerstate and areabits.
-
-This properly handles multiple recursive portals, but the render
-currently doesn't.
-
-For viewing through other player's eyes, clent can be something other than client->gentity
+Clears the frame we are creating and copies off the playerstate,
+returns qtrue if visible entities should be added to the frame
 =============
 */
-static void SV_BuildClientSnapshot( client_t *client ) {
-	vec3_t						org;
+static qboolean SV_PrepareClientSnapshot( client_t *client ) {
 	clientSnapshot_t			*frame;
-	snapshotEntityNumbers_t		entityNumbers;
-	int							i, cl;
-	svEntity_t					*svEnt;
 	int							clientNum;
-	playerState_t				*ps;
+	int							cl;
 
 	// this is the frame we are creating
 	frame = &client->frames[ client->netchan.outgoingSequence & PACKET_MASK ];
@@ -611,11 +1199,10 @@ static void SV_BuildClientSnapshot( client_t *client ) {
 	frame->frameNum = svs.currentSnapshotFrame;
 	
 	if ( client->state == CS_ZOMBIE )
-		return;
+		return qfalse;
 
 	// grab the current playerState_t
-	ps = SV_GameClientNum( cl );
-	frame->ps = *ps;
+	frame->ps = *SV_GameClientNum( cl );
 
 	clientNum = frame->ps.clientNum;
 	if ( clientNum < 0 || clientNum >= MAX_GENTITIES ) {
@@ -626,7 +1213,7 @@ static void SV_BuildClientSnapshot( client_t *client ) {
 	// so don't send any packetentities changes until CS_PRIMED
 	// because new gamestate will invalidate them anyway
 	if ( !client->gentity ) {
-		return;
+		return qfalse;
 	}
 
 	if ( svs.currFrame == NULL ) {
@@ -634,26 +1221,54 @@ static void SV_BuildClientSnapshot( client_t *client ) {
 		SV_BuildCommonSnapshot();
 	}
 
-	// bump the counter used to prevent double adding
-	sv.snapshotCounter++;
+	frame->frameNum = svs.currFrame->frameNum;
+
+	if ( sv_visCache->integer ) {
+		SV_CacheVisibleEntities( frame );
+	}
+
+	return qtrue;
+}
+
+
+/*
+=============
+SV_AddClientEntities
+
+Decides which entities are going to be visible to the client
+and adds them from the common snapshot.
+
+This properly handles multiple recursive portals, but the render
+currently doesn't.
+
+Only reads shared server state so it can be called from worker threads,
+returns qfalse if SVF_CLIENTMASK entity can't be checked for this client
+=============
+*/
+static qboolean SV_AddClientEntities( clientSnapshot_t *frame ) {
+	vec3_t						org;
+	snapshotEntityNumbers_t		entityNumbers;
+	int							i;
+	int							clientNum;
+
+	clientNum = frame->ps.clientNum;
 
 	// empty entities before visibility check
 	entityNumbers.numSnapshotEntities = 0;
-
-	frame->frameNum = svs.currFrame->frameNum;
+	entityNumbers.unordered = qfalse;
+	entityNumbers.badClientMask = qfalse;
+	Com_Memset( entityNumbers.added, 0, sizeof( entityNumbers.added ) );
 
 	// never send client's own entity, because it can
 	// be regenerated from the playerstate
-	svEnt = &sv.svEntities[ clientNum ];
-	svEnt->snapshotCounter = sv.snapshotCounter;
+	entityNumbers.added[ clientNum >> 5 ] |= 1U << ( clientNum & 31 );
 
 	// find the client's viewpoint
-	VectorCopy( ps->origin, org );
-	org[2] += ps->viewheight;
+	VectorCopy( frame->ps.origin, org );
+	org[2] += frame->ps.viewheight;
 
 	// add all the entities directly visible to the eye, which
 	// may include portal entities that merge other viewpoints
-	entityNumbers.unordered = qfalse;
 	SV_AddEntitiesVisibleFromPoint( org, frame, &entityNumbers, qfalse );
 
 	// if there were portals visible, there may be out of order entities
@@ -676,6 +1291,133 @@ static void SV_BuildClientSnapshot( client_t *client ) {
 	for ( i = 0 ; i < entityNumbers.numSnapshotEntities ; i++ )	{
 		frame->ents[ i ] = svs.currFrame->ents[ entityNumbers.snapshotEntities[ i ] ];
 	}
+
+	return entityNumbers.badClientMask ? qfalse : qtrue;
+}
+
+
+/*
+=============
+SV_SnapshotBench_f
+
+Measures time spent on gathering visible entities for all
+connected clients with and without shared visibility sets
+=============
+*/
+void SV_SnapshotBench_f( void ) {
+	static clientSnapshot_t	frame;
+	int64_t		start, elapsed[2];
+	client_t	*list[ MAX_SERVER_CLIENTS ];
+	client_t	*cl;
+	int			iterations;
+	int			count;
+	int			mode, n, i;
+
+	if ( !com_sv_running->integer || sv.state != SS_GAME ) {
+		Com_Printf( "Server is not running.\n" );
+		return;
+	}
+
+	iterations = Cmd_Argc() > 1 ? atoi( Cmd_Argv( 1 ) ) : 100;
+	if ( iterations < 1 ) {
+		iterations = 1;
+	}
+
+	count = 0;
+	for ( i = 0, cl = svs.clients; i < sv.maxclients; i++, cl++ ) {
+		if ( cl->state >= CS_PRIMED && cl->gentity ) {
+			list[ count++ ] = cl;
+		}
+	}
+
+	if ( !count ) {
+		Com_Printf( "No active clients.\n" );
+		return;
+	}
+
+	if ( svs.currFrame == NULL ) {
+		SV_BuildCommonSnapshot();
+	}
+
+	for ( mode = 0; mode < 2; mode++ ) {
+		start = Sys_Microseconds();
+		for ( n = 0; n < iterations; n++ ) {
+			visCacheCount = 0;
+			for ( i = 0; i < count; i++ ) {
+				frame.ps = *SV_GameClientNum( list[ i ] - svs.clients );
+				Com_Memset( frame.areabits, 0, sizeof( frame.areabits ) );
+				frame.areabytes = 0;
+				frame.num_entities = 0;
+				if ( mode ) {
+					SV_CacheVisibleEntities( &frame );
+				}
+				SV_AddClientEntities( &frame );
+			}
+		}
+		elapsed[ mode ] = Sys_Microseconds() - start;
+	}
+
+	Com_Printf( "%i clients, %i entities, %i distinct views, %i iterations:\n",
+		count, svs.currFrame->count, visCacheCount, iterations );
+	Com_Printf( " per-client: %.2fus per client\n", (double)elapsed[0] / ( iterations * count ) );
+	Com_Printf( " shared:     %.2fus per client\n", (double)elapsed[1] / ( iterations * count ) );
+
+	// let next snapshots rebuild the cache
+	visCacheCount = 0;
+}
+
+
+/*
+=============
+SV_AddRelayEntities
+
+Relay proxies check visibility for each of their own clients,
+so they get every entity of the common snapshot
+=============
+*/
+static void SV_AddRelayEntities( clientSnapshot_t *frame ) {
+	int		i, count;
+
+	count = svs.currFrame->count;
+	if ( count > MAX_SNAPSHOT_ENTITIES ) {
+		count = MAX_SNAPSHOT_ENTITIES;
+	}
+
+	for ( i = 0; i < count; i++ ) {
+		frame->ents[ i ] = svs.currFrame->ents[ i ];
+	}
+
+	frame->num_entities = count;
+}
+
+
+/*
+=============
+SV_BuildClientSnapshot
+
+Decides which entities are going to be visible to the client, and
+copies off the playerstate and areabits.
+
+For viewing through other player's eyes, clent can be something other than client->gentity
+=============
+*/
+static void SV_BuildClientSnapshot( client_t *client ) {
+	clientSnapshot_t			*frame;
+
+	if ( !SV_PrepareClientSnapshot( client ) ) {
+		return;
+	}
+
+	frame = &client->frames[ client->netchan.outgoingSequence & PACKET_MASK ];
+
+	if ( client->relay ) {
+		SV_AddRelayEntities( frame );
+		return;
+	}
+
+	if ( !SV_AddClientEntities( frame ) ) {
+		Com_Error( ERR_DROP, "SVF_CLIENTMASK: clientNum >= 32" );
+	}
 }
 
 
@@ -698,6 +1440,96 @@ void SV_SendMessageToClient( msg_t *msg, client_t *client )
 }
 
 
+/*
+=======================
+SV_WriteRelayInfo
+
+Relay proxies rebuild the world from snapshots, so they also need
+entity flags used for visibility checks and states of all players,
+which are delta compressed against the same frame as the snapshot
+=======================
+*/
+static void SV_WriteRelayInfo( const client_t *client, const clientSnapshot_t *frame, int lastframe, msg_t *msg ) {
+	const sharedEntity_t	*ent;
+	const playerState_t		*ps;
+	const relayFrame_t		*oldframe;
+	relayFrame_t			*rf;
+	int						i, num, flags;
+
+	rf = &client->relayFrames[ client->netchan.outgoingSequence & PACKET_MASK ];
+	if ( lastframe ) {
+		oldframe = &client->relayFrames[ ( client->netchan.outgoingSequence - lastframe ) & PACKET_MASK ];
+	} else {
+		oldframe = NULL;
+	}
+
+	MSG_WriteByte( msg, svc_relay );
+
+	// flags of snapshot entities
+	for ( i = 0; i < frame->num_entities; i++ ) {
+		num = frame->ents[ i ]->number;
+		ent = SV_GentityNum( num );
+		flags = ent->r.svFlags & ( SVF_BROADCAST | SVF_PORTAL | SVF_SINGLECLIENT | SVF_NOTSINGLECLIENT | SVF_CLIENTMASK | SVF_SELF_PORTAL2 );
+		if ( !flags ) {
+			continue;
+		}
+		MSG_WriteBits( msg, num, GENTITYNUM_BITS );
+		MSG_WriteLong( msg, flags );
+		if ( flags & ( SVF_SINGLECLIENT | SVF_NOTSINGLECLIENT | SVF_CLIENTMASK ) ) {
+			MSG_WriteLong( msg, ent->r.singleClient );
+		}
+	}
+	MSG_WriteBits( msg, MAX_GENTITIES - 1, GENTITYNUM_BITS );
+
+	// other players
+	Com_Memset( rf->valid, 0, sizeof( rf->valid ) );
+	for ( i = 0; i < svs.numActiveClients; i++ ) {
+		num = svs.activeClients[ i ];
+		if ( &svs.clients[ num ] == client ) {
+			continue;
+		}
+		ps = SV_GameClientNum( num );
+		if ( oldframe && oldframe->valid[ num >> 5 ] & ( 1U << ( num & 31 ) ) ) {
+			MSG_WriteShort( msg, num | RELAY_PLAYER_DELTA );
+			MSG_WriteDeltaPlayerstate( msg, &oldframe->ps[ num ], ps );
+		} else {
+			MSG_WriteShort( msg, num );
+			MSG_WriteDeltaPlayerstate( msg, NULL, ps );
+		}
+		rf->ps[ num ] = *ps;
+		rf->valid[ num >> 5 ] |= 1U << ( num & 31 );
+	}
+	MSG_WriteShort( msg, MAX_SERVER_CLIENTS );
+}
+
+
+/*
+=======================
+SV_WriteClientMessage
+
+Writes snapshot message body, can be called from worker threads
+=======================
+*/
+static void SV_WriteClientMessage( const client_t *client, const clientSnapshot_t *frame, const clientSnapshot_t *oldframe, int lastframe, msg_t *msg ) {
+
+	// NOTE, MRE: all server->client messages now acknowledge
+	// let the client know which reliable clientCommands we have received
+	MSG_WriteLong( msg, client->lastClientCommand );
+
+	// (re)send any reliable server commands
+	SV_UpdateServerCommandsToClient( client, msg );
+
+	// send over all the relevant entityState_t
+	// and the playerState_t
+	SV_WriteSnapshotToClient( client, frame, oldframe, lastframe, msg );
+
+	// relay clients are never handled by worker threads
+	if ( client->relayFrames && client->state == CS_ACTIVE && sv.state == SS_GAME ) {
+		SV_WriteRelayInfo( client, frame, oldframe ? lastframe : 0, msg );
+	}
+}
+
+
 /*
 =======================
 SV_SendClientSnapshot
@@ -709,10 +1541,18 @@ Also called by SV_FinalMessage
 void SV_SendClientSnapshot( client_t *client ) {
 	byte		msg_buf[ MAX_MSGLEN_BUF ];
 	msg_t		msg;
+	clientSnapshot_t *frame;
+	const clientSnapshot_t *oldframe;
+	int			lastframe;
+	int64_t		start;
+
+	start = Com_ProfileStart();
 
 	// build the snapshot
 	SV_BuildClientSnapshot( client );
 
+	start = Com_ProfileCount( "snapshot build", start );
+
 	// bots need to have their snapshots build, but
 	// the query them directly without needing to be sent
 	if ( client->netchan.remoteAddress.type == NA_BOT ) {
@@ -722,16 +1562,17 @@ void SV_SendClientSnapshot( client_t *client ) {
 	MSG_Init( &msg, msg_buf, MAX_MSGLEN );
 	msg.allowoverflow = qtrue;
 
-	// NOTE, MRE: all server->client messages now acknowledge
-	// let the client know which reliable clientCommands we have received
-	MSG_WriteLong( &msg, client->lastClientCommand );
+	oldframe = SV_GetDeltaFrame( client, &lastframe );
 
-	// (re)send any reliable server commands
-	SV_UpdateServerCommandsToClient( client, &msg );
+	frame = &client->frames[ client->netchan.outgoingSequence & PACKET_MASK ];
 
-	// send over all the relevant entityState_t
-	// and the playerState_t
-	SV_WriteSnapshotToClient( client, &msg );
+	// defer less important changes instead of delaying whole snapshot,
+	// relay proxies pass everything to their own clients
+	if ( !client->relay ) {
+		SV_LimitSnapshotEntities( client, frame, oldframe, &msg );
+	}
+
+	SV_WriteClientMessage( client, frame, oldframe, lastframe, &msg );
 
 	// check for overflow
 	if ( msg.overflowed ) {
@@ -739,7 +1580,264 @@ void SV_SendClientSnapshot( client_t *client ) {
 		MSG_Clear( &msg );
 	}
 
+	start = Com_ProfileCount( "snapshot encode", start );
+
 	SV_SendMessageToClient( &msg, client );
+
+	Com_ProfileCount( "snapshot transmit", start );
+}
+
+
+/*
+=============================================================================
+
+Threaded snapshots
+
+Everything that touches shared state or may print or throw errors
+is done on the main thread before and after running the jobs,
+workers only gather visible entities and encode messages into
+per-client buffers. Encoding errors are stored in the message
+and raised after all jobs are finished. Transmission stays serialized in client order.
+
+=============================================================================
+*/
+
+typedef struct {
+	client_t				*client;
+	const clientSnapshot_t	*oldframe;
+	int						lastframe;
+	qboolean				addEntities;
+	qboolean				badClientMask;
+	qboolean				limited;		// some entities were deferred
+	msg_t					msg;
+	int64_t					buildTime;		// for profiler, 0 if disabled
+	int64_t					encodeTime;
+} snapshotJob_t;
+
+static snapshotJob_t	snapshotJobs[ MAX_SERVER_CLIENTS ];
+static byte				*snapshotBuffers;	// snapshotBufferCount * MAX_MSGLEN_BUF
+static int				snapshotBufferCount;
+
+
+/*
+=======================
+SV_SnapshotJob
+=======================
+*/
+static void SV_SnapshotJob( void *arg, int index ) {
+	snapshotJob_t *job = (snapshotJob_t *)arg + index;
+	client_t *client = job->client;
+	clientSnapshot_t *frame;
+
+	int64_t start = 0;
+
+	frame = &client->frames[ client->netchan.outgoingSequence & PACKET_MASK ];
+
+	if ( job->buildTime ) {
+		start = Sys_Microseconds();
+	}
+
+	if ( job->addEntities ) {
+		job->badClientMask = SV_AddClientEntities( frame ) ? qfalse : qtrue;
+	}
+
+	if ( start ) {
+		job->buildTime = Sys_Microseconds();
+		job->encodeTime = job->buildTime;
+		job->buildTime -= start;
+	}
+
+	if ( client->netchan.remoteAddress.type == NA_BOT ) {
+		return;
+	}
+
+	job->limited = SV_LimitSnapshotEntities( client, frame, job->oldframe, &job->msg );
+
+	SV_WriteClientMessage( client, frame, job->oldframe, job->lastframe, &job->msg );
+
+	if ( start ) {
+		job->encodeTime = Sys_Microseconds() - job->encodeTime;
+	}
+}
+
+
+/*
+=======================
+SV_VerifySnapshotJob
+
+Rebuilds and encodes the snapshot again on main thread
+and checks that it matches the threaded result
+=======================
+*/
+static void SV_VerifySnapshotJob( const snapshotJob_t *job ) {
+	static clientSnapshot_t	frame;
+	byte		msg_buf[ MAX_MSGLEN_BUF ];
+	msg_t		msg;
+	const client_t *client = job->client;
+	const clientSnapshot_t *curr;
+
+	curr = &client->frames[ client->netchan.outgoingSequence & PACKET_MASK ];
+	frame = *curr;
+
+	// deferred entities depend on priorities already updated by the job
+	if ( job->addEntities && !job->limited ) {
+		Com_Memset( frame.areabits, 0, sizeof( frame.areabits ) );
+		frame.areabytes = 0;
+		frame.num_entities = 0;
+		SV_AddClientEntities( &frame );
+	}
+
+	MSG_Init( &msg, msg_buf, MAX_MSGLEN );
+	msg.allowoverflow = qtrue;
+
+	// also checks shared entity deltas against direct encoding
+	deltaCacheBypass = qtrue;
+	SV_WriteClientMessage( client, &frame, job->oldframe, job->lastframe, &msg );
+	deltaCacheBypass = qfalse;
+
+	if ( frame.num_entities != curr->num_entities || memcmp( frame.ents, curr->ents, frame.num_entities * sizeof( frame.ents[0] ) ) != 0 ) {
+		Com_Printf( S_COLOR_RED "snapshot verify: entity list mismatch for %s (%i != %i)\n",
+			client->name, curr->num_entities, frame.num_entities );
+	}
+
+	if ( msg.overflowed != job->msg.overflowed || msg.bit != job->msg.bit || msg.cursize != job->msg.cursize
+		|| memcmp( msg.data, job->msg.data, msg.cursize ) != 0 ) {
+		Com_Printf( S_COLOR_RED "snapshot verify: message mismatch for %s (%i != %i bytes)\n",
+			client->name, job->msg.cursize, msg.cursize );
+	}
+}
+
+
+/*
+=======================
+SV_ShutdownSnapshotThreads
+=======================
+*/
+void SV_ShutdownSnapshotThreads( void ) {
+
+	Com_SetJobWorkers( 0 );
+
+	if ( snapshotBuffers ) {
+		Z_Free( snapshotBuffers );
+		snapshotBuffers = NULL;
+		snapshotBufferCount = 0;
+	}
+
+	if ( deltaCacheLock ) {
+		Sys_DestroyMutex( deltaCacheLock );
+		deltaCacheLock = NULL;
+	}
+
+	// restart workers on next use
+	if ( sv_snapshotThreads ) {
+		sv_snapshotThreads->modified = qtrue;
+	}
+}
+
+
+/*
+=======================
+SV_SendClientSnapshots
+
+Same as calling SV_SendClientSnapshot() for each client
+but builds and encodes snapshots in parallel
+=======================
+*/
+static void SV_SendClientSnapshots( client_t **list, int count ) {
+	snapshotJob_t	*job;
+	client_t		*c;
+	int64_t			start;
+	int				i;
+
+	if ( snapshotBufferCount < sv.maxclients ) {
+		if ( snapshotBuffers ) {
+			Z_Free( snapshotBuffers );
+		}
+		snapshotBufferCount = sv.maxclients;
+		snapshotBuffers = Z_Malloc( snapshotBufferCount * MAX_MSGLEN_BUF );
+	}
+
+	if ( !deltaCacheLock ) {
+		deltaCacheLock = Sys_CreateMutex();
+		if ( !deltaCacheLock ) {
+			Com_Error( ERR_FATAL, "%s: failed to create mutex", __func__ );
+		}
+	}
+
+	start = Com_ProfileStart();
+
+	// setup everything that needs main thread
+	for ( i = 0; i < count; i++ ) {
+		c = list[ i ];
+		job = &snapshotJobs[ i ];
+		job->client = c;
+		job->addEntities = SV_PrepareClientSnapshot( c );
+		job->badClientMask = qfalse;
+		job->limited = qfalse;
+		job->buildTime = start;
+		job->encodeTime = 0;
+		if ( c->netchan.remoteAddress.type != NA_BOT ) {
+			job->oldframe = SV_GetDeltaFrame( c, &job->lastframe );
+			MSG_Init( &job->msg, snapshotBuffers + i * MAX_MSGLEN_BUF, MAX_MSGLEN );
+			job->msg.allowoverflow = qtrue;
+			job->msg.deferError = qtrue;
+		} else {
+			job->oldframe = NULL;
+			job->lastframe = 0;
+		}
+	}
+
+	Com_ProfileSpan( "snapshot prepare", start );
+
+	start = Com_ProfileStart();
+
+	Com_RunJobs( SV_SnapshotJob, snapshotJobs, count );
+
+	Com_ProfileSpan( "snapshot jobs", start );
+
+	start = Com_ProfileStart();
+
+	// send messages in the same order as serial code does
+	for ( i = 0; i < count; i++ ) {
+		job = &snapshotJobs[ i ];
+		c = job->client;
+
+		if ( start ) {
+			// cpu time spent by workers
+			Com_ProfileAdd( "snapshot build", job->buildTime );
+			if ( c->netchan.remoteAddress.type != NA_BOT ) {
+				Com_ProfileAdd( "snapshot encode", job->encodeTime );
+			}
+		}
+
+		if ( job->badClientMask ) {
+			Com_Error( ERR_DROP, "SVF_CLIENTMASK: clientNum >= 32" );
+		}
+
+		if ( c->netchan.remoteAddress.type != NA_BOT ) {
+			// raise encoding errors that workers couldn't throw
+			if ( job->msg.error ) {
+				Com_Error( ERR_DROP, job->msg.error, job->msg.errorValue );
+			}
+
+			if ( sv_snapshotVerify->integer ) {
+				SV_VerifySnapshotJob( job );
+			}
+
+			// check for overflow
+			if ( job->msg.overflowed ) {
+				Com_Printf( "WARNING: msg overflowed for %s\n", c->name );
+				MSG_Clear( &job->msg );
+			}
+
+			SV_SendMessageToClient( &job->msg, c );
+		}
+
+		c->lastSnapshotTime = svs.time;
+		c->rateDelayed = qfalse;
+	}
+
+	Com_ProfileSpan( "snapshot send", start );
 }
 
 
@@ -750,15 +1848,32 @@ SV_SendClientMessages
 */
 void SV_SendClientMessages( void )
 {
+	client_t	*list[ MAX_SERVER_CLIENTS ];
+	int		count;
 	int		i;
 	client_t	*c;
 
-	svs.msgTime = Sys_Milliseconds();
+	svs.msgTime = SV_Milliseconds();
+
+	// send last values of configstrings changed during this frame
+	if ( sv.numCsPending ) {
+		SV_FlushConfigstrings();
+	}
+
+	if ( sv_snapshotThreads->modified ) {
+		sv_snapshotThreads->modified = qfalse;
+		Com_SetJobWorkers( sv_snapshotThreads->integer );
+	}
+
+	count = 0;
+
+	// send all snapshots with as few syscalls as possible
+	NET_BeginSendBatch();
 
 	// send a message to each connected client
-	for ( i = 0; i < sv.maxclients; i++ )
+	for ( i = 0; i < svs.numConnectedClients; i++ )
 	{
-		c = &svs.clients[ i ];
+		c = &svs.clients[ svs.connectedClients[ i ] ];
 
 		if ( c->state == CS_FREE )
 			continue;		// not connected
@@ -791,9 +1906,22 @@ void SV_SendClientMessages( void )
 			continue;
 		}
 
+		if ( Com_JobWorkers() > 0 && !c->relay )
+		{
+			// will be sent in parallel later
+			list[ count++ ] = c;
+			continue;
+		}
+
 		// generate and send a new message
 		SV_SendClientSnapshot( c );
 		c->lastSnapshotTime = svs.time;
 		c->rateDelayed = qfalse;
 	}
+
+	if ( count ) {
+		SV_SendClientSnapshots( list, count );
+	}
+
+	NET_FlushSendBatch();
 }
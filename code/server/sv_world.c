@@ -58,6 +58,12 @@ the world is carved up with an evenly spaced, axially aligned bsp tree.  Entitie
 are kept in chains either at the final leafs, or at the first node that splits
 them, which prevents having to deal with multiple fragments of a single entity.
 
+Alternatively (sv_worldIndex 1) entities are kept in a loose octree: each node
+covers a cube of twice the size of its cell so an entity always goes to the
+deepest node whose cell contains its center and whose cell size is not smaller
+than the entity itself.  Nodes are allocated on demand and released as soon
+as they become empty so moving entities do not leave garbage behind.
+
 ===============================================================================
 */
 
@@ -74,6 +80,41 @@ typedef struct worldSector_s {
 static worldSector_t	sv_worldSectors[AREA_NODES];
 static int			sv_numworldSectors;
 
+typedef struct worldOctant_s {
+	vec3_t	center;
+	float	size;		// half-width of the cell, loose bounds are center +/- size*2
+	int		depth;
+	int		index;		// slot in parent's children[]
+	int		numChildren;
+	struct worldOctant_s	*parent;
+	struct worldOctant_s	*children[8];
+	svEntity_t	*entities;
+} worldOctant_t;
+
+#define	OCTREE_DEPTH	8
+#define	OCTREE_NODES	4096
+
+static worldOctant_t	sv_worldOctants[OCTREE_NODES];
+static worldOctant_t	*sv_freeOctants;
+static int			sv_numOctants;		// currently allocated
+
+typedef enum {
+	WORLD_SECTORS,
+	WORLD_OCTREE
+} worldIndex_t;
+
+static worldIndex_t	sv_worldIndexType;
+static vec3_t		sv_worldMins, sv_worldMaxs;
+
+typedef enum {
+	WOP_LINK,
+	WOP_UNLINK,
+	WOP_QUERY
+} worldOpType_t;
+
+static void SV_RecordWorldOp( int op, int num, const vec3_t mins, const vec3_t maxs );
+static void SV_FreeWorldOps( void );
+
 
 /*
 ===============
@@ -82,9 +123,31 @@ SV_SectorList_f
 */
 void SV_SectorList_f( void ) {
 	int				i, c;
+	int				nodes[OCTREE_DEPTH+1], ents[OCTREE_DEPTH+1];
 	worldSector_t	*sec;
+	worldOctant_t	*oct;
 	svEntity_t		*ent;
 
+	if ( sv_worldIndexType == WORLD_OCTREE ) {
+		Com_Memset( nodes, 0, sizeof( nodes ) );
+		Com_Memset( ents, 0, sizeof( ents ) );
+		for ( i = 0 ; i < OCTREE_NODES ; i++ ) {
+			oct = &sv_worldOctants[i];
+			if ( oct->size == 0.0f ) {
+				continue;	// free
+			}
+			nodes[oct->depth]++;
+			for ( ent = oct->entities ; ent ; ent = ent->nextEntityInWorldSector ) {
+				ents[oct->depth]++;
+			}
+		}
+		for ( i = 0 ; i <= OCTREE_DEPTH ; i++ ) {
+			Com_Printf( "depth %i: %i nodes, %i entities\n", i, nodes[i], ents[i] );
+		}
+		Com_Printf( "%i of %i octree nodes in use\n", sv_numOctants, OCTREE_NODES );
+		return;
+	}
+
 	for ( i = 0 ; i < AREA_NODES ; i++ ) {
 		sec = &sv_worldSectors[i];
 
@@ -138,60 +201,289 @@ static worldSector_t *SV_CreateworldSector( int depth, vec3_t mins, vec3_t maxs
 	return anode;
 }
 
+
 /*
 ===============
-SV_ClearWorld
+SV_AllocOctant
 
+Returns NULL if node pool is exhausted, caller should keep
+the entity in parent node then
 ===============
 */
-void SV_ClearWorld( void ) {
-	clipHandle_t	h;
-	vec3_t			mins, maxs;
+static worldOctant_t *SV_AllocOctant( worldOctant_t *parent, int index ) {
+	worldOctant_t	*node;
+	int				i;
+
+	node = sv_freeOctants;
+	if ( !node ) {
+		return NULL;
+	}
+	sv_freeOctants = node->children[0];
+	sv_numOctants++;
+
+	Com_Memset( node, 0, sizeof( *node ) );
+
+	node->size = parent->size * 0.5f;
+	for ( i = 0 ; i < 3 ; i++ ) {
+		if ( index & ( 1 << i ) ) {
+			node->center[i] = parent->center[i] + node->size;
+		} else {
+			node->center[i] = parent->center[i] - node->size;
+		}
+	}
+	node->depth = parent->depth + 1;
+	node->index = index;
+	node->parent = parent;
+
+	parent->children[index] = node;
+	parent->numChildren++;
+
+	return node;
+}
+
+
+/*
+===============
+SV_FreeOctants
+
+Releases empty leaf nodes up to the root
+===============
+*/
+static void SV_FreeOctants( worldOctant_t *node ) {
+	worldOctant_t	*parent;
+
+	while ( node->parent && !node->entities && !node->numChildren ) {
+		parent = node->parent;
+		parent->children[node->index] = NULL;
+		parent->numChildren--;
+
+		node->size = 0.0f;
+		node->children[0] = sv_freeOctants;
+		sv_freeOctants = node;
+		sv_numOctants--;
+
+		node = parent;
+	}
+}
+
+
+/*
+===============
+SV_CreateOctree
+===============
+*/
+static void SV_CreateOctree( const vec3_t mins, const vec3_t maxs ) {
+	worldOctant_t	*root;
+	int				i;
+
+	Com_Memset( sv_worldOctants, 0, sizeof( sv_worldOctants ) );
+
+	// first node is always the root, rest goes to free list
+	sv_freeOctants = NULL;
+	for ( i = OCTREE_NODES - 1 ; i > 0 ; i-- ) {
+		sv_worldOctants[i].children[0] = sv_freeOctants;
+		sv_freeOctants = &sv_worldOctants[i];
+	}
+	sv_numOctants = 1;
+
+	root = &sv_worldOctants[0];
+	root->size = 1.0f;
+	for ( i = 0 ; i < 3 ; i++ ) {
+		root->center[i] = 0.5f * ( mins[i] + maxs[i] );
+		if ( root->size < 0.5f * ( maxs[i] - mins[i] ) ) {
+			root->size = 0.5f * ( maxs[i] - mins[i] );
+		}
+	}
+}
+
+
+/*
+===============
+SV_ResetWorldIndex
+
+Drops all links and rebuilds empty index of specified type
+===============
+*/
+static void SV_ResetWorldIndex( worldIndex_t type ) {
+	svEntity_t	*ent;
+	int			i;
+
+	for ( i = 0, ent = sv.svEntities ; i < MAX_GENTITIES ; i++, ent++ ) {
+		ent->worldSector = NULL;
+		ent->worldOctant = NULL;
+		ent->nextEntityInWorldSector = NULL;
+	}
 
 	Com_Memset( sv_worldSectors, 0, sizeof(sv_worldSectors) );
 	sv_numworldSectors = 0;
 
+	sv_worldIndexType = type;
+
+	if ( type == WORLD_OCTREE ) {
+		SV_CreateOctree( sv_worldMins, sv_worldMaxs );
+	} else {
+		SV_CreateworldSector( 0, sv_worldMins, sv_worldMaxs );
+	}
+}
+
+
+/*
+===============
+SV_ClearWorld
+
+===============
+*/
+void SV_ClearWorld( void ) {
+	clipHandle_t	h;
+
 	// get world map bounds
 	h = CM_InlineModel( 0 );
-	CM_ModelBounds( h, mins, maxs );
-	SV_CreateworldSector( 0, mins, maxs );
+	CM_ModelBounds( h, sv_worldMins, sv_worldMaxs );
+
+	// recorded entity numbers have no meaning on a new map
+	SV_FreeWorldOps();
+
+	if ( sv_worldIndex->integer == 1 ) {
+		SV_ResetWorldIndex( WORLD_OCTREE );
+	} else {
+		SV_ResetWorldIndex( WORLD_SECTORS );
+	}
 }
 
 
 /*
 ===============
-SV_UnlinkEntity
-
+SV_UnlinkFromIndex
 ===============
 */
-void SV_UnlinkEntity( sharedEntity_t *gEnt ) {
-	svEntity_t		*ent;
+static qboolean SV_UnlinkFromIndex( svEntity_t *ent ) {
 	svEntity_t		*scan;
-	worldSector_t	*ws;
-
-	ent = SV_SvEntityForGentity( gEnt );
+	svEntity_t		**head;
+	worldOctant_t	*oct;
+
+	if ( ent->worldOctant ) {
+		oct = ent->worldOctant;
+		head = &oct->entities;
+		ent->worldOctant = NULL;
+	} else if ( ent->worldSector ) {
+		oct = NULL;
+		head = &ent->worldSector->entities;
+		ent->worldSector = NULL;
+	} else {
+		return qfalse;	// not linked in anywhere
+	}
 
-	gEnt->r.linked = qfalse;
+	if ( *head == ent ) {
+		*head = ent->nextEntityInWorldSector;
+	} else {
+		for ( scan = *head ; scan ; scan = scan->nextEntityInWorldSector ) {
+			if ( scan->nextEntityInWorldSector == ent ) {
+				scan->nextEntityInWorldSector = ent->nextEntityInWorldSector;
+				break;
+			}
+		}
+		if ( !scan ) {
+			Com_Printf( "WARNING: SV_UnlinkEntity: not found in worldSector\n" );
+		}
+	}
 
-	ws = ent->worldSector;
-	if ( !ws ) {
-		return;		// not linked in anywhere
+	if ( oct ) {
+		SV_FreeOctants( oct );
 	}
-	ent->worldSector = NULL;
 
-	if ( ws->entities == ent ) {
-		ws->entities = ent->nextEntityInWorldSector;
+	return qtrue;
+}
+
+
+/*
+===============
+SV_LinkToIndex
+
+Places entity with already computed absmin/absmax into the index
+===============
+*/
+static void SV_LinkToIndex( svEntity_t *ent, const sharedEntity_t *gEnt ) {
+	worldSector_t	*node;
+	worldOctant_t	*oct, *child;
+	vec3_t			center;
+	float			radius, r;
+	int				i, index;
+
+	if ( sv_worldIndexType == WORLD_OCTREE ) {
+		oct = &sv_worldOctants[0];
+		radius = 0.0f;
+		for ( i = 0 ; i < 3 ; i++ ) {
+			center[i] = 0.5f * ( gEnt->r.absmin[i] + gEnt->r.absmax[i] );
+			r = 0.5f * ( gEnt->r.absmax[i] - gEnt->r.absmin[i] );
+			if ( radius < r ) {
+				radius = r;
+			}
+			// anything centered outside of the world stays in the root
+			if ( center[i] < oct->center[i] - oct->size || center[i] > oct->center[i] + oct->size ) {
+				radius = oct->size;
+			}
+		}
+
+		while ( oct->depth < OCTREE_DEPTH && radius <= oct->size * 0.5f ) {
+			index = 0;
+			for ( i = 0 ; i < 3 ; i++ ) {
+				if ( center[i] > oct->center[i] ) {
+					index |= 1 << i;
+				}
+			}
+			child = oct->children[index];
+			if ( !child ) {
+				child = SV_AllocOctant( oct, index );
+				if ( !child ) {
+					break;
+				}
+			}
+			oct = child;
+		}
+
+		ent->worldOctant = oct;
+		ent->nextEntityInWorldSector = oct->entities;
+		oct->entities = ent;
 		return;
 	}
 
-	for ( scan = ws->entities ; scan ; scan = scan->nextEntityInWorldSector ) {
-		if ( scan->nextEntityInWorldSector == ent ) {
-			scan->nextEntityInWorldSector = ent->nextEntityInWorldSector;
-			return;
-		}
+	// find the first world sector node that the ent's box crosses
+	node = sv_worldSectors;
+	while (1)
+	{
+		if (node->axis == -1)
+			break;
+		if ( gEnt->r.absmin[node->axis] > node->dist)
+			node = node->children[0];
+		else if ( gEnt->r.absmax[node->axis] < node->dist)
+			node = node->children[1];
+		else
+			break;		// crosses the node
 	}
+	
+	// link it in
+	ent->worldSector = node;
+	ent->nextEntityInWorldSector = node->entities;
+	node->entities = ent;
+}
+
+
+/*
+===============
+SV_UnlinkEntity
 
-	Com_Printf( "WARNING: SV_UnlinkEntity: not found in worldSector\n" );
+===============
+*/
+void SV_UnlinkEntity( sharedEntity_t *gEnt ) {
+	svEntity_t		*ent;
+
+	ent = SV_SvEntityForGentity( gEnt );
+
+	gEnt->r.linked = qfalse;
+
+	if ( SV_UnlinkFromIndex( ent ) ) {
+		SV_RecordWorldOp( WOP_UNLINK, ent - sv.svEntities, NULL, NULL );
+	}
 }
 
 
@@ -203,7 +495,6 @@ SV_LinkEntity
 */
 #define MAX_TOTAL_ENT_LEAFS		128
 void SV_LinkEntity( sharedEntity_t *gEnt ) {
-	worldSector_t	*node;
 	int			leafs[MAX_TOTAL_ENT_LEAFS];
 	int			cluster;
 	int			num_leafs;
@@ -215,7 +506,7 @@ void SV_LinkEntity( sharedEntity_t *gEnt ) {
 
 	ent = SV_SvEntityForGentity( gEnt );
 
-	if ( ent->worldSector ) {
+	if ( ent->worldSector || ent->worldOctant ) {
 		SV_UnlinkEntity( gEnt );	// unlink from old position
 	}
 
@@ -332,24 +623,9 @@ void SV_LinkEntity( sharedEntity_t *gEnt ) {
 
 	gEnt->r.linkcount++;
 
-	// find the first world sector node that the ent's box crosses
-	node = sv_worldSectors;
-	while (1)
-	{
-		if (node->axis == -1)
-			break;
-		if ( gEnt->r.absmin[node->axis] > node->dist)
-			node = node->children[0];
-		else if ( gEnt->r.absmax[node->axis] < node->dist)
-			node = node->children[1];
-		else
-			break;		// crosses the node
-	}
-	
-	// link it in
-	ent->worldSector = node;
-	ent->nextEntityInWorldSector = node->entities;
-	node->entities = ent;
+	SV_LinkToIndex( ent, gEnt );
+
+	SV_RecordWorldOp( WOP_LINK, ent - sv.svEntities, gEnt->r.absmin, gEnt->r.absmax );
 
 	gEnt->r.linked = qtrue;
 }
@@ -374,15 +650,15 @@ typedef struct {
 
 /*
 ====================
-SV_AreaEntities_r
+SV_AreaEntitiesInList
 
 ====================
 */
-static void SV_AreaEntities_r( worldSector_t *node, areaParms_t *ap ) {
+static void SV_AreaEntitiesInList( svEntity_t *list, areaParms_t *ap ) {
 	svEntity_t	*check, *next;
 	sharedEntity_t *gcheck;
 
-	for ( check = node->entities  ; check ; check = next ) {
+	for ( check = list ; check ; check = next ) {
 		next = check->nextEntityInWorldSector;
 
 		gcheck = SV_GEntityForSvEntity( check );
@@ -404,6 +680,18 @@ static void SV_AreaEntities_r( worldSector_t *node, areaParms_t *ap ) {
 		ap->list[ap->count] = check - sv.svEntities;
 		ap->count++;
 	}
+}
+
+
+/*
+====================
+SV_AreaEntities_r
+
+====================
+*/
+static void SV_AreaEntities_r( worldSector_t *node, areaParms_t *ap ) {
+
+	SV_AreaEntitiesInList( node->entities, ap );
 	
 	if (node->axis == -1) {
 		return;		// terminal node
@@ -418,12 +706,47 @@ static void SV_AreaEntities_r( worldSector_t *node, areaParms_t *ap ) {
 	}
 }
 
+
+/*
+====================
+SV_AreaOctants_r
+
+====================
+*/
+static void SV_AreaOctants_r( worldOctant_t *node, areaParms_t *ap ) {
+	float	loose;
+	int		i;
+
+	// root node holds everything that does not fit anywhere else
+	if ( node->parent ) {
+		loose = node->size * 2.0f;
+		for ( i = 0 ; i < 3 ; i++ ) {
+			if ( ap->mins[i] > node->center[i] + loose || ap->maxs[i] < node->center[i] - loose ) {
+				return;
+			}
+		}
+	}
+
+	SV_AreaEntitiesInList( node->entities, ap );
+
+	if ( !node->numChildren ) {
+		return;
+	}
+
+	for ( i = 0 ; i < 8 ; i++ ) {
+		if ( node->children[i] ) {
+			SV_AreaOctants_r( node->children[i], ap );
+		}
+	}
+}
+
+
 /*
 ================
-SV_AreaEntities
+SV_QueryIndex
 ================
 */
-int SV_AreaEntities( const vec3_t mins, const vec3_t maxs, int *entityList, int maxcount ) {
+static int SV_QueryIndex( const vec3_t mins, const vec3_t maxs, int *entityList, int maxcount ) {
 	areaParms_t		ap;
 
 	ap.mins = mins;
@@ -432,12 +755,261 @@ int SV_AreaEntities( const vec3_t mins, const vec3_t maxs, int *entityList, int
 	ap.count = 0;
 	ap.maxcount = maxcount;
 
-	SV_AreaEntities_r( sv_worldSectors, &ap );
+	if ( sv_worldIndexType == WORLD_OCTREE ) {
+		SV_AreaOctants_r( sv_worldOctants, &ap );
+	} else {
+		SV_AreaEntities_r( sv_worldSectors, &ap );
+	}
 
 	return ap.count;
 }
 
 
+/*
+================
+SV_AreaEntities
+================
+*/
+int SV_AreaEntities( const vec3_t mins, const vec3_t maxs, int *entityList, int maxcount ) {
+
+	SV_RecordWorldOp( WOP_QUERY, 0, mins, maxs );
+
+	return SV_QueryIndex( mins, maxs, entityList, maxcount );
+}
+
+
+/*
+============================================================================
+
+INDEX BENCHMARK
+
+Link, unlink and area queries can be captured from a running game and
+replayed later against both index implementations to compare their speed
+and to verify that they return the same entity sets.
+============================================================================
+*/
+
+typedef struct {
+	int		op;
+	int		num;
+	vec3_t	mins, maxs;
+} worldOp_t;
+
+static worldOp_t	*worldOps;
+static int			numWorldOps;
+static int			maxWorldOps;
+static qboolean		worldOpsRecording;
+
+
+/*
+================
+SV_FreeWorldOps
+================
+*/
+static void SV_FreeWorldOps( void ) {
+	if ( worldOps ) {
+		Z_Free( worldOps );
+	}
+	worldOps = NULL;
+	numWorldOps = 0;
+	maxWorldOps = 0;
+	worldOpsRecording = qfalse;
+}
+
+
+/*
+================
+SV_RecordWorldOp
+================
+*/
+static void SV_RecordWorldOp( int op, int num, const vec3_t mins, const vec3_t maxs ) {
+	worldOp_t	*wop;
+
+	if ( !worldOpsRecording ) {
+		return;
+	}
+
+	if ( numWorldOps >= maxWorldOps ) {
+		Com_Printf( "worldbench: recording buffer is full, %i operations captured\n", numWorldOps );
+		worldOpsRecording = qfalse;
+		return;
+	}
+
+	wop = &worldOps[ numWorldOps++ ];
+	wop->op = op;
+	wop->num = num;
+	if ( mins ) {
+		VectorCopy( mins, wop->mins );
+		VectorCopy( maxs, wop->maxs );
+	}
+}
+
+
+/*
+================
+SV_StartWorldOps
+
+Starts new recording with all currently linked entities
+================
+*/
+static void SV_StartWorldOps( int count ) {
+	sharedEntity_t	*gEnt;
+	svEntity_t		*ent;
+	int				i;
+
+	SV_FreeWorldOps();
+
+	worldOps = Z_Malloc( count * sizeof( worldOp_t ) );
+	maxWorldOps = count;
+	worldOpsRecording = qtrue;
+
+	for ( i = 0, ent = sv.svEntities ; i < sv.num_entities ; i++, ent++ ) {
+		if ( ent->worldSector || ent->worldOctant ) {
+			gEnt = SV_GentityNum( i );
+			SV_RecordWorldOp( WOP_LINK, i, gEnt->r.absmin, gEnt->r.absmax );
+		}
+	}
+}
+
+
+/*
+================
+SV_ReplayWorldOps
+
+Returns order-independent hash of all query results
+================
+*/
+static unsigned int SV_ReplayWorldOps( worldIndex_t type, int64_t *elapsed ) {
+	static int		list[ MAX_GENTITIES ];
+	const worldOp_t	*wop;
+	sharedEntity_t	*gEnt;
+	svEntity_t		*ent;
+	int64_t			start;
+	unsigned int	hash;
+	int				i, n, count;
+
+	SV_ResetWorldIndex( type );
+
+	hash = 0;
+	start = Sys_Microseconds();
+
+	for ( i = 0, wop = worldOps ; i < numWorldOps ; i++, wop++ ) {
+		if ( wop->op == WOP_QUERY ) {
+			count = SV_QueryIndex( wop->mins, wop->maxs, list, ARRAY_LEN( list ) );
+			for ( n = 0 ; n < count ; n++ ) {
+				hash += ( (unsigned int)list[n] * 0x9E3779B1U ) ^ i;
+			}
+			continue;
+		}
+		if ( wop->num >= sv.num_entities ) {
+			continue;
+		}
+		ent = &sv.svEntities[ wop->num ];
+		SV_UnlinkFromIndex( ent );
+		if ( wop->op == WOP_LINK ) {
+			gEnt = SV_GentityNum( wop->num );
+			VectorCopy( wop->mins, gEnt->r.absmin );
+			VectorCopy( wop->maxs, gEnt->r.absmax );
+			SV_LinkToIndex( ent, gEnt );
+		}
+	}
+
+	*elapsed = Sys_Microseconds() - start;
+
+	return hash;
+}
+
+
+/*
+================
+SV_WorldBench_f
+================
+*/
+void SV_WorldBench_f( void ) {
+	static const char *names[2] = { "sectors", "octree" };
+	static vec3_t	absmin[ MAX_GENTITIES ], absmax[ MAX_GENTITIES ];
+	static byte		linked[ MAX_GENTITIES ];
+	worldIndex_t	type, saved;
+	sharedEntity_t	*gEnt;
+	svEntity_t		*ent;
+	int64_t			elapsed[2], t;
+	unsigned int	hash[2];
+	int				iterations, i, n;
+	const char		*cmd;
+
+	if ( !com_sv_running->integer || sv.state != SS_GAME ) {
+		Com_Printf( "Server is not running.\n" );
+		return;
+	}
+
+	cmd = Cmd_Argv( 1 );
+
+	if ( !Q_stricmp( cmd, "record" ) ) {
+		n = Cmd_Argc() > 2 ? atoi( Cmd_Argv( 2 ) ) : 131072;
+		if ( n < 1024 ) {
+			n = 1024;
+		}
+		SV_StartWorldOps( n );
+		Com_Printf( "worldbench: recording up to %i operations\n", n );
+		return;
+	}
+
+	if ( !Q_stricmp( cmd, "stop" ) ) {
+		worldOpsRecording = qfalse;
+		Com_Printf( "worldbench: %i operations captured\n", numWorldOps );
+		return;
+	}
+
+	if ( !numWorldOps ) {
+		Com_Printf( "usage: worldbench record [maxops] | stop | [iterations]\n" );
+		return;
+	}
+
+	iterations = *cmd ? atoi( cmd ) : 10;
+	if ( iterations < 1 ) {
+		iterations = 1;
+	}
+
+	worldOpsRecording = qfalse;
+
+	// save current state, replay overwrites entity bounds
+	saved = sv_worldIndexType;
+	for ( i = 0, ent = sv.svEntities ; i < sv.num_entities ; i++, ent++ ) {
+		gEnt = SV_GentityNum( i );
+		VectorCopy( gEnt->r.absmin, absmin[i] );
+		VectorCopy( gEnt->r.absmax, absmax[i] );
+		linked[i] = ( ent->worldSector || ent->worldOctant ) ? 1 : 0;
+	}
+
+	for ( type = WORLD_SECTORS ; type <= WORLD_OCTREE ; type++ ) {
+		elapsed[ type ] = 0;
+		for ( n = 0 ; n < iterations ; n++ ) {
+			hash[ type ] = SV_ReplayWorldOps( type, &t );
+			elapsed[ type ] += t;
+		}
+	}
+
+	// restore original index
+	SV_ResetWorldIndex( saved );
+	for ( i = 0, ent = sv.svEntities ; i < sv.num_entities ; i++, ent++ ) {
+		gEnt = SV_GentityNum( i );
+		VectorCopy( absmin[i], gEnt->r.absmin );
+		VectorCopy( absmax[i], gEnt->r.absmax );
+		if ( linked[i] ) {
+			SV_LinkToIndex( ent, gEnt );
+		}
+	}
+
+	Com_Printf( "%i operations, %i iterations:\n", numWorldOps, iterations );
+	for ( type = WORLD_SECTORS ; type <= WORLD_OCTREE ; type++ ) {
+		Com_Printf( " %-8s %.2fms per replay\n", names[ type ], (double)elapsed[ type ] / ( iterations * 1000 ) );
+	}
+	if ( hash[ WORLD_SECTORS ] != hash[ WORLD_OCTREE ] ) {
+		Com_Printf( S_COLOR_YELLOW "WARNING: query results differ between implementations\n" );
+	}
+}
+
+
 
 //===========================================================================
 
@@ -589,33 +1161,25 @@ static void SV_ClipMoveToEntities( moveclip_t *clip ) {
 
 /*
 ==================
-SV_Trace
+SV_ClipTraceToEntities
 
-Moves the given mins/maxs volume through the world from start to end.
-passEntityNum and entities owned by passEntityNum are explicitly not checked.
+Finishes trace that was already clipped to the world
 ==================
 */
-void SV_Trace( trace_t *results, const vec3_t start, const vec3_t mins, const vec3_t maxs, const vec3_t end, int passEntityNum, int contentmask, qboolean capsule ) {
+static void SV_ClipTraceToEntities( trace_t *results, const trace_t *world, const vec3_t start, const vec3_t mins, const vec3_t maxs, const vec3_t end, int passEntityNum, int contentmask, qboolean capsule ) {
 	moveclip_t	clip;
 	int			i;
 
-	if ( !mins ) {
-		mins = vec3_origin;
-	}
-	if ( !maxs ) {
-		maxs = vec3_origin;
+	if ( world->fraction == 0 ) {
+		if ( results != world ) {
+			*results = *world;
+		}
+		return;		// blocked immediately by the world
 	}
 
 	Com_Memset ( &clip, 0, sizeof ( clip ) );
 
-	// clip to world
-	CM_BoxTrace( &clip.trace, start, end, mins, maxs, 0, contentmask, capsule );
-	clip.trace.entityNum = clip.trace.fraction != 1.0 ? ENTITYNUM_WORLD : ENTITYNUM_NONE;
-	if ( clip.trace.fraction == 0 ) {
-		*results = clip.trace;
-		return;		// blocked immediately by the world
-	}
-
+	clip.trace = *world;
 	clip.contentmask = contentmask;
 	clip.start = start;
 //	VectorCopy( clip.trace.endpos, clip.end );
@@ -646,6 +1210,100 @@ void SV_Trace( trace_t *results, const vec3_t start, const vec3_t mins, const ve
 }
 
 
+/*
+==================
+SV_Trace
+
+Moves the given mins/maxs volume through the world from start to end.
+passEntityNum and entities owned by passEntityNum are explicitly not checked.
+==================
+*/
+void SV_Trace( trace_t *results, const vec3_t start, const vec3_t mins, const vec3_t maxs, const vec3_t end, int passEntityNum, int contentmask, qboolean capsule ) {
+	trace_t		trace;
+
+	if ( !mins ) {
+		mins = vec3_origin;
+	}
+	if ( !maxs ) {
+		maxs = vec3_origin;
+	}
+
+	// clip to world
+	CM_BoxTrace( &trace, start, end, mins, maxs, 0, contentmask, capsule );
+	trace.entityNum = trace.fraction != 1.0 ? ENTITYNUM_WORLD : ENTITYNUM_NONE;
+
+	SV_ClipTraceToEntities( results, &trace, start, mins, maxs, end, passEntityNum, contentmask, capsule );
+}
+
+
+/*
+==================
+SV_TraceWorldJob
+
+Clips a range of batched traces to the world, runs on job workers
+==================
+*/
+#define TRACE_BATCH_CHUNK	16
+
+typedef struct {
+	trace_t					*results;
+	const traceRequest_t	*requests;
+	int						count;
+} traceBatch_t;
+
+static void SV_TraceWorldJob( void *arg, int index ) {
+	const traceBatch_t		*batch = (const traceBatch_t *)arg;
+	const traceRequest_t	*req;
+	trace_t					*tr;
+	int						i, end;
+
+	i = index * TRACE_BATCH_CHUNK;
+	end = i + TRACE_BATCH_CHUNK;
+	if ( end > batch->count ) {
+		end = batch->count;
+	}
+
+	for ( ; i < end; i++ ) {
+		req = &batch->requests[ i ];
+		tr = &batch->results[ i ];
+		CM_BoxTraceConcurrent( tr, req->start, req->end, req->mins, req->maxs, 0, req->contentmask, req->capsule ? qtrue : qfalse );
+		tr->entityNum = tr->fraction != 1.0 ? ENTITYNUM_WORLD : ENTITYNUM_NONE;
+	}
+}
+
+
+/*
+==================
+SV_TraceBatch
+
+Same as calling SV_Trace() for each request. World clipping can be done
+on job worker threads, entity clipping is always done on the caller thread
+==================
+*/
+void SV_TraceBatch( trace_t *results, const traceRequest_t *requests, int count ) {
+	const traceRequest_t	*req;
+	traceBatch_t			batch;
+	int						i;
+
+	batch.results = results;
+	batch.requests = requests;
+	batch.count = count;
+
+	if ( sv_traceBatchJobs->integer && Com_JobWorkers() > 0 && count > TRACE_BATCH_CHUNK ) {
+		Com_RunJobs( SV_TraceWorldJob, &batch, ( count + TRACE_BATCH_CHUNK - 1 ) / TRACE_BATCH_CHUNK );
+		for ( i = 0, req = requests; i < count; i++, req++ ) {
+			SV_ClipTraceToEntities( &results[ i ], &results[ i ], req->start, req->mins, req->maxs, req->end,
+				req->passEntityNum, req->contentmask, req->capsule ? qtrue : qfalse );
+		}
+	} else {
+		for ( i = 0, req = requests; i < count; i++, req++ ) {
+			SV_Trace( &results[ i ], req->start, req->mins, req->maxs, req->end,
+				req->passEntityNum, req->contentmask, req->capsule ? qtrue : qfalse );
+		}
+	}
+}
+
+
 
 /*
 =============
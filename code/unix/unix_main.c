@@ -586,6 +586,22 @@ char *Sys_ConsoleInput( void )
 }
 
 
+/*
+=================
+Sys_ConsoleInputFd
+
+Returns descriptor which can be polled for console input, -1 if there is none
+=================
+*/
+int Sys_ConsoleInputFd( void )
+{
+	if ( stdin_active )
+		return STDIN_FILENO;
+	else
+		return -1;
+}
+
+
 /*
 =================
 Sys_SendKeyEvents
@@ -618,7 +634,11 @@ void Sys_Sleep( int msec ) {
 
 	if ( msec < 0 ) {
 		// special case: wait for console input or network packet
-		if ( stdin_active ) {
+		if ( NET_EpollActive() ) {
+			// console input is polled along with network sockets
+			while ( NET_Sleep( 3000 * 1000 ) )
+				;
+		} else if ( stdin_active ) {
 			msec = 300;
 			do {
 				FD_ZERO( &fdset );
@@ -29,9 +29,11 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 #include <unistd.h>
 #include <sys/mman.h>
 #include <sys/time.h>
+#include <sys/resource.h>
 #include <pwd.h>
 #include <dlfcn.h>
 #include <libgen.h>
+#include <pthread.h>
 
 #include "../qcommon/q_shared.h"
 #include "../qcommon/qcommon.h"
@@ -72,6 +74,25 @@ int Sys_Milliseconds( void )
 }
 
 
+/*
+================
+Sys_ProcessTime
+
+Returns user and system cpu time used by the process, in microseconds
+================
+*/
+int64_t Sys_ProcessTime( void )
+{
+	struct rusage ru;
+
+	if ( getrusage( RUSAGE_SELF, &ru ) != 0 )
+		return 0;
+
+	return (int64_t)( ru.ru_utime.tv_sec + ru.ru_stime.tv_sec ) * 1000000LL
+		+ ru.ru_utime.tv_usec + ru.ru_stime.tv_usec;
+}
+
+
 char *strlwr( char *s ) {
   if ( s==NULL ) { // bk001204 - paranoia
     assert(0);
@@ -350,6 +371,37 @@ qboolean Sys_ResetReadOnlyAttribute( const char *ospath )
 }
 
 
+/*
+=================
+Sys_MapFile
+=================
+*/
+void *Sys_MapFile( FILE *f, size_t length )
+{
+	void *base;
+
+	if ( length == 0 )
+		return NULL;
+
+	base = mmap( NULL, length, PROT_READ, MAP_PRIVATE, fileno( f ), 0 );
+	if ( base == MAP_FAILED )
+		return NULL;
+
+	return base;
+}
+
+
+/*
+=================
+Sys_UnmapFile
+=================
+*/
+void Sys_UnmapFile( void *base, size_t length )
+{
+	munmap( base, length );
+}
+
+
 /*
 =================
 Sys_Pwd
@@ -596,3 +648,144 @@ qboolean Sys_SetAffinityMask( const uint64_t mask )
 	}
 }
 #endif // USE_AFFINITY_MASK
+
+
+/*
+=============================================================================
+
+THREADS
+
+=============================================================================
+*/
+
+struct sysThread_s {
+	pthread_t		thread;
+	sysThreadFunc_t	func;
+	void			*arg;
+};
+
+struct sysMutex_s {
+	pthread_mutex_t	mutex;
+};
+
+struct sysCond_s {
+	pthread_cond_t	cond;
+};
+
+
+static void *Sys_ThreadEntry( void *arg )
+{
+	sysThread_t *thread = (sysThread_t *)arg;
+	thread->func( thread->arg );
+	return NULL;
+}
+
+
+/*
+=================
+Sys_CreateThread
+
+Returns NULL if thread can't be started
+=================
+*/
+sysThread_t *Sys_CreateThread( sysThreadFunc_t func, void *arg )
+{
+	sysThread_t *thread;
+
+	thread = malloc( sizeof( *thread ) );
+	if ( !thread ) {
+		return NULL;
+	}
+
+	thread->func = func;
+	thread->arg = arg;
+
+	if ( pthread_create( &thread->thread, NULL, Sys_ThreadEntry, thread ) != 0 ) {
+		free( thread );
+		return NULL;
+	}
+
+	return thread;
+}
+
+
+/*
+=================
+Sys_JoinThread
+=================
+*/
+void Sys_JoinThread( sysThread_t *thread )
+{
+	pthread_join( thread->thread, NULL );
+	free( thread );
+}
+
+
+sysMutex_t *Sys_CreateMutex( void )
+{
+	sysMutex_t *mutex;
+
+	mutex = malloc( sizeof( *mutex ) );
+	if ( mutex ) {
+		pthread_mutex_init( &mutex->mutex, NULL );
+	}
+
+	return mutex;
+}
+
+
+void Sys_DestroyMutex( sysMutex_t *mutex )
+{
+	pthread_mutex_destroy( &mutex->mutex );
+	free( mutex );
+}
+
+
+void Sys_LockMutex( sysMutex_t *mutex )
+{
+	pthread_mutex_lock( &mutex->mutex );
+}
+
+
+void Sys_UnlockMutex( sysMutex_t *mutex )
+{
+	pthread_mutex_unlock( &mutex->mutex );
+}
+
+
+sysCond_t *Sys_CreateCond( void )
+{
+	sysCond_t *cond;
+
+	cond = malloc( sizeof( *cond ) );
+	if ( cond ) {
+		pthread_cond_init( &cond->cond, NULL );
+	}
+
+	return cond;
+}
+
+
+void Sys_DestroyCond( sysCond_t *cond )
+{
+	pthread_cond_destroy( &cond->cond );
+	free( cond );
+}
+
+
+void Sys_CondWait( sysCond_t *cond, sysMutex_t *mutex )
+{
+	pthread_cond_wait( &cond->cond, &mutex->mutex );
+}
+
+
+void Sys_CondSignal( sysCond_t *cond )
+{
+	pthread_cond_signal( &cond->cond );
+}
+
+
+void Sys_CondBroadcast( sysCond_t *cond )
+{
+	pthread_cond_broadcast( &cond->cond );
+}
@@ -233,6 +233,42 @@ qboolean Sys_ResetReadOnlyAttribute( const char *ospath ) {
 }
 
 
+/*
+==============
+Sys_MapFile
+==============
+*/
+void *Sys_MapFile( FILE *f, size_t length ) {
+	HANDLE hMapping;
+	void *base;
+
+	if ( length == 0 ) {
+		return NULL;
+	}
+
+	hMapping = CreateFileMappingA( (HANDLE)_get_osfhandle( _fileno( f ) ), NULL, PAGE_READONLY, 0, 0, NULL );
+	if ( hMapping == NULL ) {
+		return NULL;
+	}
+
+	// view keeps the mapping object alive
+	base = MapViewOfFile( hMapping, FILE_MAP_READ, 0, 0, length );
+	CloseHandle( hMapping );
+
+	return base;
+}
+
+
+/*
+==============
+Sys_UnmapFile
+==============
+*/
+void Sys_UnmapFile( void *base, size_t length ) {
+	UnmapViewOfFile( base );
+}
+
+
 /*
 ==============
 Sys_Pwd
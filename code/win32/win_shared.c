@@ -53,6 +53,31 @@ int Sys_Milliseconds( void )
 }
 
 
+/*
+================
+Sys_ProcessTime
+
+Returns user and system cpu time used by the process, in microseconds
+================
+*/
+int64_t Sys_ProcessTime( void )
+{
+	FILETIME creation, exit, kernel, user;
+	ULARGE_INTEGER k, u;
+
+	if ( !GetProcessTimes( GetCurrentProcess(), &creation, &exit, &kernel, &user ) )
+		return 0;
+
+	k.LowPart = kernel.dwLowDateTime;
+	k.HighPart = kernel.dwHighDateTime;
+	u.LowPart = user.dwLowDateTime;
+	u.HighPart = user.dwHighDateTime;
+
+	// 100ns units
+	return (int64_t)( ( k.QuadPart + u.QuadPart ) / 10 );
+}
+
+
 /*
 ================
 Sys_RandomBytes
@@ -247,3 +272,145 @@ qboolean Sys_SetAffinityMask( const uint64_t mask )
 	return qfalse;
 }
 #endif // USE_AFFINITY_MASK
+
+
+/*
+=============================================================================
+
+THREADS
+
+=============================================================================
+*/
+
+struct sysThread_s {
+	HANDLE			handle;
+	sysThreadFunc_t	func;
+	void			*arg;
+};
+
+struct sysMutex_s {
+	CRITICAL_SECTION cs;
+};
+
+struct sysCond_s {
+	CONDITION_VARIABLE cv;
+};
+
+
+static DWORD WINAPI Sys_ThreadEntry( LPVOID arg )
+{
+	sysThread_t *thread = (sysThread_t *)arg;
+	thread->func( thread->arg );
+	return 0;
+}
+
+
+/*
+=================
+Sys_CreateThread
+
+Returns NULL if thread can't be started
+=================
+*/
+sysThread_t *Sys_CreateThread( sysThreadFunc_t func, void *arg )
+{
+	sysThread_t *thread;
+
+	thread = malloc( sizeof( *thread ) );
+	if ( !thread ) {
+		return NULL;
+	}
+
+	thread->func = func;
+	thread->arg = arg;
+	thread->handle = CreateThread( NULL, 0, Sys_ThreadEntry, thread, 0, NULL );
+
+	if ( thread->handle == NULL ) {
+		free( thread );
+		return NULL;
+	}
+
+	return thread;
+}
+
+
+/*
+=================
+Sys_JoinThread
+=================
+*/
+void Sys_JoinThread( sysThread_t *thread )
+{
+	WaitForSingleObject( thread->handle, INFINITE );
+	CloseHandle( thread->handle );
+	free( thread );
+}
+
+
+sysMutex_t *Sys_CreateMutex( void )
+{
+	sysMutex_t *mutex;
+
+	mutex = malloc( sizeof( *mutex ) );
+	if ( mutex ) {
+		InitializeCriticalSection( &mutex->cs );
+	}
+
+	return mutex;
+}
+
+
+void Sys_DestroyMutex( sysMutex_t *mutex )
+{
+	DeleteCriticalSection( &mutex->cs );
+	free( mutex );
+}
+
+
+void Sys_LockMutex( sysMutex_t *mutex )
+{
+	EnterCriticalSection( &mutex->cs );
+}
+
+
+void Sys_UnlockMutex( sysMutex_t *mutex )
+{
+	LeaveCriticalSection( &mutex->cs );
+}
+
+
+sysCond_t *Sys_CreateCond( void )
+{
+	sysCond_t *cond;
+
+	cond = malloc( sizeof( *cond ) );
+	if ( cond ) {
+		InitializeConditionVariable( &cond->cv );
+	}
+
+	return cond;
+}
+
+
+void Sys_DestroyCond( sysCond_t *cond )
+{
+	free( cond );
+}
+
+
+void Sys_CondWait( sysCond_t *cond, sysMutex_t *mutex )
+{
+	SleepConditionVariableCS( &cond->cv, &mutex->cs, INFINITE );
+}
+
+
+void Sys_CondSignal( sysCond_t *cond )
+{
+	WakeConditionVariable( &cond->cv );
+}
+
+
+void Sys_CondBroadcast( sysCond_t *cond )
+{
+	WakeAllConditionVariable( &cond->cv );
+}